@@ -0,0 +1,175 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_ARCHIVE_H_
+#define SIMCPP_ARCHIVE_H_
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace simcpp {
+
+class Event;
+
+/**
+ * In-memory archive of the state of objects.
+ *
+ * Values are saved in sequence and loaded back in the same sequence. Plain
+ * values are copied as bytes. Shared pointers are stored as pointers, so the
+ * pointed-to objects are kept alive but not copied.
+ */
+class Archive {
+public:
+  /// Saved shared pointer.
+  class Pointer {
+  public:
+    /// Pointed-to object. Points to the Event subobject if event is true.
+    std::shared_ptr<void> object;
+
+    /// Whether the object is an event.
+    bool event;
+  };
+
+  /**
+   * Save a trivially copyable value.
+   *
+   * @param value Value to save.
+   */
+  template <typename T> void save(const T &value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "only trivially copyable values can be saved as bytes");
+    auto first = reinterpret_cast<const unsigned char *>(&value);
+    bytes.insert(bytes.end(), first, first + sizeof(T));
+  }
+
+  /**
+   * Save a shared pointer. The object is not copied.
+   *
+   * @param pointer Pointer to save.
+   */
+  template <typename T> void save(const std::shared_ptr<T> &pointer) {
+    save_pointer(pointer, std::is_base_of<Event, T>());
+  }
+
+  /**
+   * Save a vector element by element.
+   *
+   * @param values Vector to save.
+   */
+  template <typename T> void save(const std::vector<T> &values) {
+    save(values.size());
+    for (auto &value : values) {
+      save(value);
+    }
+  }
+
+  /**
+   * Load a trivially copyable value.
+   *
+   * @param value Set to the next saved value.
+   */
+  template <typename T> void load(T &value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "only trivially copyable values can be loaded as bytes");
+    std::memcpy(&value, bytes.data() + byte_position, sizeof(T));
+    byte_position += sizeof(T);
+  }
+
+  /**
+   * Load a shared pointer.
+   *
+   * @param pointer Set to the next saved pointer.
+   */
+  template <typename T> void load(std::shared_ptr<T> &pointer) {
+    load_pointer(pointer, std::is_base_of<Event, T>());
+    ++pointer_position;
+  }
+
+  /**
+   * Load a vector element by element.
+   *
+   * @param values Set to the next saved vector.
+   */
+  template <typename T> void load(std::vector<T> &values) {
+    size_t size;
+    load(size);
+    values.resize(size);
+    for (auto &value : values) {
+      load(value);
+    }
+  }
+
+  /**
+   * Save bytes as they are.
+   *
+   * @param data First byte.
+   * @param size Number of bytes.
+   */
+  void save_bytes(const void *data, size_t size) {
+    auto first = static_cast<const unsigned char *>(data);
+    bytes.insert(bytes.end(), first, first + size);
+  }
+
+  /// @return Saved bytes.
+  const std::vector<unsigned char> &get_bytes() const { return bytes; }
+
+  /// @return Saved shared pointers.
+  const std::vector<Pointer> &get_pointers() const { return pointers; }
+
+  /// Load from the beginning again.
+  void rewind() {
+    byte_position = 0;
+    pointer_position = 0;
+  }
+
+  /// Remove all saved values.
+  void clear() {
+    bytes.clear();
+    pointers.clear();
+    rewind();
+  }
+
+  /// @return Whether nothing is saved.
+  bool empty() const { return bytes.empty() && pointers.empty(); }
+
+private:
+  std::vector<unsigned char> bytes = {};
+  std::vector<Pointer> pointers = {};
+  size_t byte_position = 0;
+  size_t pointer_position = 0;
+
+  // Pointers to events are stored as pointers to their Event subobject, so
+  // they can be identified as events and cast back to any subclass.
+
+  template <typename T>
+  void save_pointer(const std::shared_ptr<T> &pointer, std::true_type) {
+    std::shared_ptr<Event> event =
+        std::const_pointer_cast<typename std::remove_const<T>::type>(pointer);
+    pointers.push_back(Pointer{event, true});
+  }
+
+  template <typename T>
+  void save_pointer(const std::shared_ptr<T> &pointer, std::false_type) {
+    pointers.push_back(Pointer{std::const_pointer_cast<void>(
+                                   std::static_pointer_cast<const void>(pointer)),
+                               false});
+  }
+
+  template <typename T>
+  void load_pointer(std::shared_ptr<T> &pointer, std::true_type) {
+    pointer = std::static_pointer_cast<T>(std::static_pointer_cast<Event>(
+        pointers[pointer_position].object));
+  }
+
+  template <typename T>
+  void load_pointer(std::shared_ptr<T> &pointer, std::false_type) {
+    pointer = std::static_pointer_cast<T>(pointers[pointer_position].object);
+  }
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_ARCHIVE_H_
@@ -0,0 +1,1453 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "archive.h"
+#include "pdes.h"
+#include "queue.h"
+#include "realtime.h"
+#include "replication.h"
+#include "resource.h"
+#include "simcpp.h"
+#include "snapshot.h"
+#include "staticsim.h"
+#include "stats.h"
+#include "task.h"
+#include "timewarp.h"
+#include "trace.h"
+
+namespace {
+
+const char *queue_name(simcpp::QueueType type) {
+  switch (type) {
+  case simcpp::QueueType::BinaryHeap:
+    return "binary-heap";
+  case simcpp::QueueType::QuaternaryHeap:
+    return "4-ary-heap";
+  case simcpp::QueueType::Calendar:
+    return "calendar";
+  case simcpp::QueueType::Ladder:
+    return "ladder";
+  case simcpp::QueueType::SplitHeap:
+    return "split-4-ary-heap";
+  }
+  return "";
+}
+
+/// Distribution of the delays between scheduling and processing an event.
+enum class Shape {
+  /// Exponentially distributed delays.
+  Exponential,
+  /// Integer delays, so many events share a timestamp.
+  Bursty,
+  /// Mostly short delays with occasional very long ones.
+  Bimodal
+};
+
+std::vector<double> make_delays(Shape shape) {
+  std::mt19937_64 rng(0);
+  std::exponential_distribution<double> exponential(1.0);
+  std::uniform_int_distribution<int> integer(0, 10);
+  std::bernoulli_distribution far(0.05);
+
+  std::vector<double> delays(1 << 12);
+  for (auto &delay : delays) {
+    switch (shape) {
+    case Shape::Exponential:
+      delay = exponential(rng);
+      break;
+    case Shape::Bursty:
+      delay = integer(rng);
+      break;
+    case Shape::Bimodal:
+      delay = far(rng) ? 1000.0 * exponential(rng) : exponential(rng);
+      break;
+    }
+  }
+  return delays;
+}
+
+/**
+ * Classic hold model: The queue is filled to a fixed size, then each iteration
+ * removes the next entry and inserts a new one after a random delay. The queue
+ * is warmed up by as many hold operations as it has entries before measuring,
+ * so one-time reorganizations do not dominate short runs.
+ */
+template <Shape S> void BM_QueueHold(benchmark::State &state) {
+  auto type = static_cast<simcpp::QueueType>(state.range(0));
+  auto size = static_cast<size_t>(state.range(1));
+  auto delays = make_delays(S);
+  auto queue = simcpp::make_queue(type);
+  size_t next_id = 0;
+  size_t next_delay = 0;
+
+  auto hold = [&]() {
+    auto entry = queue->pop();
+    queue->push(simcpp::QueuedEvent(entry.time + delays[next_delay],
+                                    next_id++, nullptr));
+    next_delay = (next_delay + 1) % delays.size();
+  };
+
+  for (size_t i = 0; i < size; ++i) {
+    queue->push(simcpp::QueuedEvent(delays[next_delay], next_id++, nullptr));
+    next_delay = (next_delay + 1) % delays.size();
+  }
+  for (size_t i = 0; i < size; ++i) {
+    hold();
+  }
+
+  for (auto _ : state) {
+    hold();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(queue_name(type));
+}
+
+const std::vector<int64_t> queue_types = {0, 1, 2, 3, 4};
+const std::vector<int64_t> queue_sizes = {1 << 10, 1 << 16, 1 << 20};
+
+BENCHMARK_TEMPLATE(BM_QueueHold, Shape::Exponential)
+    ->ArgsProduct({queue_types, queue_sizes});
+BENCHMARK_TEMPLATE(BM_QueueHold, Shape::Bursty)
+    ->ArgsProduct({queue_types, queue_sizes});
+BENCHMARK_TEMPLATE(BM_QueueHold, Shape::Bimodal)
+    ->ArgsProduct({queue_types, queue_sizes});
+
+/// Timeouts scheduled and processed through a simulation.
+void BM_SimulationTimeouts(benchmark::State &state) {
+  simcpp::SimulationOptions options;
+  options.queue_type = static_cast<simcpp::QueueType>(state.range(0));
+  auto size = static_cast<size_t>(state.range(1));
+  auto delays = make_delays(Shape::Exponential);
+  auto sim = simcpp::Simulation::create(options);
+  size_t next_delay = 0;
+
+  auto hold = [&]() {
+    sim->step();
+    sim->timeout(delays[next_delay]);
+    next_delay = (next_delay + 1) % delays.size();
+  };
+
+  for (size_t i = 0; i < size; ++i) {
+    sim->timeout(delays[next_delay]);
+    next_delay = (next_delay + 1) % delays.size();
+  }
+  for (size_t i = 0; i < size; ++i) {
+    hold();
+  }
+
+  for (auto _ : state) {
+    hold();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(queue_name(options.queue_type));
+}
+
+BENCHMARK(BM_SimulationTimeouts)->ArgsProduct({queue_types, queue_sizes});
+
+/**
+ * Schedule a number of timeouts, then process all of them. Unlike the hold
+ * model, the queue grows and shrinks.
+ */
+void BM_ScheduleThenStep(benchmark::State &state) {
+  auto size = static_cast<size_t>(state.range(0));
+  auto delays = make_delays(Shape::Exponential);
+
+  for (auto _ : state) {
+    auto sim = simcpp::Simulation::create();
+    for (size_t i = 0; i < size; ++i) {
+      sim->timeout(delays[i % delays.size()]);
+    }
+    while (sim->step()) {
+    }
+  }
+
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+
+BENCHMARK(BM_ScheduleThenStep)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+/**
+ * Timeouts which are aborted before they expire, like watchdog timers which
+ * are restarted. Each iteration aborts the oldest of a number of pending
+ * timeouts, schedules a new one and processes the next entry of the queue.
+ * The second argument enables the timing wheel.
+ */
+void BM_TimeoutChurn(benchmark::State &state) {
+  simcpp::SimulationOptions options;
+  if (state.range(1) != 0) {
+    options.timing_wheel_resolution = 1.0;
+    options.timing_wheel_horizon = 256.0;
+  }
+  auto sim = simcpp::Simulation::create(options);
+  auto delays = make_delays(Shape::Exponential);
+  std::vector<simcpp::EventPtr> timeouts;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    timeouts.push_back(sim->timeout(100.0 + delays[i % delays.size()]));
+  }
+  size_t oldest = 0;
+
+  for (auto _ : state) {
+    timeouts[oldest]->abort();
+    timeouts[oldest] = sim->timeout(100.0 + delays[oldest % delays.size()]);
+    oldest = (oldest + 1) % timeouts.size();
+    sim->step();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(state.range(1) != 0 ? "wheel" : "heap");
+}
+
+BENCHMARK(BM_TimeoutChurn)->ArgsProduct({{1000, 100000}, {0, 1}});
+
+/// Process which works in steps, each guarded by a much longer watchdog timer.
+class Worker : public simcpp::Process {
+public:
+  Worker(simcpp::SimulationPtr sim, bool abort_watchdog)
+      : Process(sim), abort_watchdog(abort_watchdog) {}
+
+  bool Run() override {
+    auto sim = this->sim.lock();
+
+    PT_BEGIN();
+    while (true) {
+      watchdog = sim->timeout(1000.0);
+      PROC_WAIT_FOR(sim->any_of({sim->timeout(1.0), watchdog}));
+      if (abort_watchdog) {
+        watchdog->abort();
+      }
+    }
+    PT_END();
+  }
+
+private:
+  bool abort_watchdog;
+  simcpp::EventPtr watchdog = nullptr;
+};
+
+/**
+ * 1000 workers whose watchdog timers expire long after they are obsolete.
+ * Unless the watchdogs are aborted, the queue fills up with them.
+ */
+void BM_ObsoleteTimeouts(benchmark::State &state) {
+  bool abort_watchdog = state.range(0) != 0;
+  auto sim = simcpp::Simulation::create();
+
+  for (int i = 0; i < 1000; ++i) {
+    sim->start_process<Worker>(abort_watchdog);
+  }
+  // Warm up until the first watchdogs expire.
+  sim->run_until(1000.0);
+
+  // Each iteration simulates one time unit, in which every worker does one
+  // step.
+  for (auto _ : state) {
+    sim->run_until(sim->get_now() + 1.0);
+  }
+
+  state.SetItemsProcessed(state.iterations() * 1000);
+  state.SetLabel(abort_watchdog ? "abort" : "keep");
+}
+
+BENCHMARK(BM_ObsoleteTimeouts)->Arg(0)->Arg(1);
+
+/**
+ * Condition over timeouts, processed until the condition is triggered.
+ *
+ * @tparam All Whether to use all_of instead of any_of.
+ */
+template <bool All> void BM_ConditionFanIn(benchmark::State &state) {
+  auto sim = simcpp::Simulation::create();
+  size_t n = state.range(0);
+  std::vector<simcpp::EventPtr> events(n);
+
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; ++i) {
+      events[i] = sim->timeout(static_cast<double>(i + 1));
+    }
+    auto condition = All ? sim->all_of(events) : sim->any_of(events);
+    sim->advance_to(condition);
+    sim->run();
+  }
+
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n));
+}
+
+BENCHMARK_TEMPLATE(BM_ConditionFanIn, false)
+    ->Arg(2)
+    ->Arg(16)
+    ->Arg(256)
+    ->Arg(100000);
+BENCHMARK_TEMPLATE(BM_ConditionFanIn, true)
+    ->Arg(2)
+    ->Arg(16)
+    ->Arg(256)
+    ->Arg(100000);
+
+/**
+ * "Any of" events which are never triggered and one timeout, so all but one
+ * underlying event lose and are detached.
+ */
+void BM_ConditionLosers(benchmark::State &state) {
+  auto sim = simcpp::Simulation::create();
+  size_t n = state.range(0);
+  std::vector<simcpp::EventPtr> events(n);
+
+  for (auto _ : state) {
+    for (size_t i = 0; i + 1 < n; ++i) {
+      events[i] = sim->event();
+    }
+    events[n - 1] = sim->timeout(1.0);
+    sim->any_of(events);
+    sim->run();
+  }
+
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n));
+}
+
+BENCHMARK(BM_ConditionLosers)->Arg(16)->Arg(100000);
+
+/// Exponentially distributed observations added to a statistics collector.
+template <typename T> void BM_Collector(benchmark::State &state) {
+  std::mt19937_64 rng(42);
+  std::exponential_distribution<double> distribution(1.0);
+  std::vector<double> values(1 << 16);
+  for (auto &value : values) {
+    value = distribution(rng);
+  }
+
+  T collector;
+  size_t i = 0;
+  for (auto _ : state) {
+    collector.add(values[i]);
+    i = (i + 1) & (values.size() - 1);
+  }
+  benchmark::DoNotOptimize(collector);
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_Collector, simcpp::Tally);
+BENCHMARK_TEMPLATE(BM_Collector, simcpp::QuantileSketch);
+BENCHMARK_TEMPLATE(BM_Collector, simcpp::BatchMeans);
+
+/// Exponential variates from the standard library, for comparison.
+void BM_RandomStd(benchmark::State &state) {
+  std::mt19937_64 rng(42);
+  std::exponential_distribution<double> distribution(1.0);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(distribution(rng));
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_RandomStd);
+
+/// Exponential variates drawn one by one.
+void BM_RandomSingle(benchmark::State &state) {
+  simcpp::Random random(42);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(random.exponential(1.0));
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_RandomSingle);
+
+/// Uniform (0) or exponential (1) variates drawn in batches of 256.
+void BM_RandomFill(benchmark::State &state) {
+  simcpp::Random random(42);
+  std::vector<double> values(256);
+  for (auto _ : state) {
+    if (state.range(0) == 0) {
+      random.fill_uniform(values.data(), values.size());
+    } else {
+      random.fill_exponential(values.data(), values.size(), 1.0);
+    }
+    benchmark::DoNotOptimize(values.data());
+  }
+
+  state.SetItemsProcessed(
+      static_cast<int64_t>(state.iterations() * values.size()));
+}
+
+BENCHMARK(BM_RandomFill)->Arg(0)->Arg(1);
+
+/// Uniform variates drawn one by one, for comparison with BM_RandomFill/0.
+void BM_RandomUniform(benchmark::State &state) {
+  simcpp::Random random(42);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(random.uniform());
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_RandomUniform);
+
+/// Process which waits for its event, then triggers the event of the other.
+class Player : public simcpp::Process {
+public:
+  Player(simcpp::SimulationPtr sim, simcpp::EventPtr *own,
+         simcpp::EventPtr *other)
+      : Process(sim), own(own), other(other) {}
+
+  bool Run() override {
+    auto sim = this->sim.lock();
+
+    PT_BEGIN();
+    while (true) {
+      PROC_WAIT_FOR(*own);
+      *own = sim->event();
+      (*other)->trigger();
+    }
+    PT_END();
+  }
+
+private:
+  simcpp::EventPtr *own;
+  simcpp::EventPtr *other;
+};
+
+/// Two processes passing control to each other without simulated delay.
+void BM_ProcessPingPong(benchmark::State &state) {
+  simcpp::SimulationOptions options;
+  options.pooled_allocation = state.range(0) != 0;
+  auto sim = simcpp::Simulation::create(options);
+  auto ping = sim->event();
+  auto pong = sim->event();
+  sim->start_process<Player>(&ping, &pong);
+  sim->start_process<Player>(&pong, &ping);
+  sim->run_batch();
+  ping->trigger();
+
+  for (auto _ : state) {
+    sim->step();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(options.pooled_allocation ? "pooled" : "heap");
+}
+
+BENCHMARK(BM_ProcessPingPong)->Arg(0)->Arg(1);
+
+/**
+ * Hold model of 1024 pending actions, each of which schedules the next one,
+ * with a timeout and a handler (0) or with call_in (1).
+ */
+void BM_CallHold(benchmark::State &state) {
+  simcpp::SimulationOptions options;
+  options.pooled_allocation = true;
+  auto sim = simcpp::Simulation::create(options);
+  auto delays = make_delays(Shape::Exponential);
+  size_t next_delay = 0;
+  uint64_t n_actions = 0;
+  bool calls = state.range(0) != 0;
+
+  std::function<void()> schedule = [&]() {
+    double delay = delays[next_delay];
+    next_delay = (next_delay + 1) % delays.size();
+    if (calls) {
+      sim->call_in(delay, [&]() {
+        ++n_actions;
+        schedule();
+      });
+    } else {
+      sim->timeout(delay)->add_handler([&](simcpp::EventPtr) {
+        ++n_actions;
+        schedule();
+      });
+    }
+  };
+
+  for (int i = 0; i < 1024; ++i) {
+    schedule();
+  }
+  for (auto _ : state) {
+    sim->step();
+  }
+
+  benchmark::DoNotOptimize(n_actions);
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(calls ? "call_in" : "timeout+handler");
+}
+
+BENCHMARK(BM_CallHold)->Arg(0)->Arg(1);
+
+/// A recurring action with a process waiting for timeouts (0) or call_every
+/// (1).
+class CountingTicker : public simcpp::Process {
+public:
+  CountingTicker(simcpp::SimulationPtr sim, uint64_t *n_ticks)
+      : Process(sim), n_ticks(n_ticks) {}
+
+  bool Run() override {
+    auto sim = this->sim.lock();
+
+    PT_BEGIN();
+    while (true) {
+      PROC_WAIT_FOR(sim->timeout(1.0));
+      ++*n_ticks;
+    }
+    PT_END();
+  }
+
+private:
+  uint64_t *n_ticks;
+};
+
+void BM_CallEvery(benchmark::State &state) {
+  simcpp::SimulationOptions options;
+  options.pooled_allocation = true;
+  auto sim = simcpp::Simulation::create(options);
+  uint64_t n_ticks = 0;
+  bool calls = state.range(0) != 0;
+  if (calls) {
+    sim->call_every(1.0, [&n_ticks]() { ++n_ticks; });
+  } else {
+    sim->start_process<CountingTicker>(&n_ticks);
+  }
+
+  for (auto _ : state) {
+    sim->step();
+  }
+
+  benchmark::DoNotOptimize(n_ticks);
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(calls ? "call_every" : "process");
+}
+
+BENCHMARK(BM_CallEvery)->Arg(0)->Arg(1);
+
+/// Process which waits for a reply it holds. If the reply never comes, the
+/// two keep each other alive.
+class Caller : public simcpp::Process {
+public:
+  /// Number of callers which are not destroyed.
+  static int64_t n_live;
+
+  Caller(simcpp::SimulationPtr sim, simcpp::EventPtr reply)
+      : Process(sim), reply(std::move(reply)) {
+    ++n_live;
+  }
+
+  ~Caller() override { --n_live; }
+
+  bool Run() override {
+    PT_BEGIN();
+    PROC_WAIT_FOR(reply);
+    PT_END();
+  }
+
+  void save(simcpp::Archive &archive) const override {
+    Process::save(archive);
+    archive.save(reply);
+  }
+
+private:
+  simcpp::EventPtr reply;
+};
+
+int64_t Caller::n_live = 0;
+
+/// Start callers whose replies never come, without tracking (0), with
+/// tracking (1), and with tracking and collection of 8 slots per step (2).
+/// Reports the callers left alive.
+void BM_LeakedCallers(benchmark::State &state) {
+  simcpp::SimulationOptions options;
+  options.track_events = state.range(0) > 0;
+  options.collection_rate = state.range(0) > 1 ? 8 : 0;
+  auto sim = simcpp::Simulation::create(options);
+  auto n_live = Caller::n_live;
+
+  for (auto _ : state) {
+    sim->start_process<Caller>(sim->event());
+    sim->step();
+  }
+
+  state.counters["live"] = static_cast<double>(Caller::n_live - n_live);
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_LeakedCallers)->Arg(0)->Arg(1)->Arg(2);
+
+/// Static process which waits for its signal, then notifies the other.
+class StaticPlayer : public simcpp::StaticProcess {
+public:
+  StaticPlayer(simcpp::StaticScheduler &sim, simcpp::StaticSignal *own,
+               simcpp::StaticSignal *other)
+      : StaticProcess(sim), own(own), other(other) {}
+
+  bool Run() override {
+    PT_BEGIN();
+    while (true) {
+      STATIC_WAIT_FOR(*own);
+      other->notify();
+    }
+    PT_END();
+  }
+
+private:
+  simcpp::StaticSignal *own;
+  simcpp::StaticSignal *other;
+};
+
+/// The ping-pong of BM_ProcessPingPong with a static model.
+void BM_StaticPingPong(benchmark::State &state) {
+  simcpp::StaticSimulation<StaticPlayer> sim;
+  simcpp::StaticSignal ping(sim);
+  simcpp::StaticSignal pong(sim);
+  sim.start_process<StaticPlayer>(&ping, &pong);
+  sim.start_process<StaticPlayer>(&pong, &ping);
+  ping.notify();
+
+  for (auto _ : state) {
+    sim.step();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_StaticPingPong);
+
+/// Message passed through a store, larger than a pointer.
+struct Message {
+  uint64_t id;
+  double payload[3];
+};
+
+/// Process which puts messages into a store.
+class Producer : public simcpp::Process {
+public:
+  Producer(simcpp::SimulationPtr sim, simcpp::Store<Message> *store)
+      : Process(sim), store(store) {}
+
+  bool Run() override {
+    PT_BEGIN();
+    while (true) {
+      PROC_WAIT_FOR(store->put(Message{id++, {1.0, 2.0, 3.0}}));
+    }
+    PT_END();
+  }
+
+private:
+  simcpp::Store<Message> *store;
+  uint64_t id = 0;
+};
+
+/// Process which takes messages from a store.
+class Consumer : public simcpp::Process {
+public:
+  Consumer(simcpp::SimulationPtr sim, simcpp::Store<Message> *store,
+           uint64_t *sum)
+      : Process(sim), store(store), sum(sum) {}
+
+  bool Run() override {
+    PT_BEGIN();
+    while (true) {
+      get = store->get();
+      PROC_WAIT_FOR(get);
+      *sum += get->get_item().id;
+    }
+    PT_END();
+  }
+
+private:
+  simcpp::Store<Message> *store;
+  uint64_t *sum;
+  simcpp::Store<Message>::GetPtr get = nullptr;
+};
+
+/// Messages passed between two processes through a store with one slot.
+void BM_StoreMessages(benchmark::State &state) {
+  simcpp::SimulationOptions options;
+  options.pooled_allocation = state.range(0) != 0;
+  auto sim = simcpp::Simulation::create(options);
+  simcpp::Store<Message> store(sim, 1);
+  uint64_t sum = 0;
+  sim->start_process<Producer>(&store);
+  sim->start_process<Consumer>(&store, &sum);
+
+  for (auto _ : state) {
+    sim->step();
+  }
+
+  benchmark::DoNotOptimize(sum);
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(options.pooled_allocation ? "pooled" : "heap");
+}
+
+BENCHMARK(BM_StoreMessages)->Arg(0)->Arg(1);
+
+#ifdef SIMCPP_TRACE
+/**
+ * The pooled ping-pong without a trace recorder (0), and recording a packed
+ * (1) or plain (2) trace. Only built by make bench-trace.
+ */
+void BM_Trace(benchmark::State &state) {
+  // Once the program has started a thread, as the recorder does, libstdc++
+  // updates reference counts atomically, so the comparison starts one in all
+  // cases.
+  std::thread([] {}).join();
+
+  const char *path = "bench.trace";
+  std::unique_ptr<simcpp::TraceRecorder> recorder;
+  if (state.range(0) != 0) {
+    simcpp::TraceOptions trace_options;
+    trace_options.compress = state.range(0) == 1;
+    recorder.reset(new simcpp::TraceRecorder(path, trace_options));
+  }
+  simcpp::TraceRecorder::set_active(recorder.get());
+
+  simcpp::SimulationOptions options;
+  options.pooled_allocation = true;
+  auto sim = simcpp::Simulation::create(options);
+  auto ping = sim->event();
+  auto pong = sim->event();
+  sim->start_process<Player>(&ping, &pong);
+  sim->start_process<Player>(&pong, &ping);
+  sim->run_batch();
+  ping->trigger();
+
+  for (auto _ : state) {
+    sim->step();
+  }
+
+  simcpp::TraceRecorder::set_active(nullptr);
+  state.SetItemsProcessed(state.iterations());
+  if (recorder != nullptr) {
+    state.counters["records"] = benchmark::Counter(
+        static_cast<double>(recorder->get_n_records()),
+        benchmark::Counter::kIsRate);
+    recorder.reset();
+    std::remove(path);
+  }
+  const char *labels[] = {"off", "packed", "plain"};
+  state.SetLabel(labels[state.range(0)]);
+}
+
+BENCHMARK(BM_Trace)->Arg(0)->Arg(1)->Arg(2);
+#endif
+
+class Ticker : public simcpp::Process {
+public:
+  explicit Ticker(simcpp::SimulationPtr sim) : Process(sim) {}
+
+  bool Run() override {
+    auto sim = this->sim.lock();
+
+    PT_BEGIN();
+    while (true) {
+      PROC_WAIT_FOR(sim->timeout(1.0));
+    }
+    PT_END();
+  }
+};
+
+class Reneger : public simcpp::Process {
+public:
+  explicit Reneger(simcpp::SimulationPtr sim) : Process(sim) {}
+
+  bool Run() override {
+    auto sim = this->sim.lock();
+
+    PT_BEGIN();
+    while (true) {
+      PROC_WAIT_FOR(sim->any_of({sim->event(), sim->timeout(1.0)}));
+    }
+    PT_END();
+  }
+};
+
+/// Processes waiting for timeouts, with and without pooled allocation.
+template <typename T> void BM_ProcessWakeups(benchmark::State &state) {
+  simcpp::SimulationOptions options;
+  options.pooled_allocation = state.range(0) != 0;
+  auto sim = simcpp::Simulation::create(options);
+
+  for (int i = 0; i < 1000; ++i) {
+    sim->start_process<T>();
+  }
+
+  for (auto _ : state) {
+    sim->step();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(options.pooled_allocation ? "pooled" : "heap");
+}
+
+BENCHMARK_TEMPLATE(BM_ProcessWakeups, Ticker)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(BM_ProcessWakeups, Reneger)->Arg(0)->Arg(1);
+
+/**
+ * Snapshots of 100000 renegers with their conditions, taken (0) or restored
+ * (1).
+ */
+void BM_Snapshot(benchmark::State &state) {
+  int n_processes = 100000;
+  simcpp::SnapshotRegistry registry;
+  registry.add<Reneger>("Reneger");
+  auto sim = simcpp::Simulation::create();
+  for (int i = 0; i < n_processes; ++i) {
+    sim->start_process<Reneger>();
+  }
+  sim->run_until(10.5);
+  auto snapshot = simcpp::Snapshot::take(sim, registry);
+
+  for (auto _ : state) {
+    if (state.range(0) == 0) {
+      benchmark::DoNotOptimize(
+          simcpp::Snapshot::take(sim, registry).get_size());
+    } else {
+      benchmark::DoNotOptimize(snapshot.restore(registry));
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * n_processes);
+  state.SetBytesProcessed(state.iterations() * snapshot.get_size());
+}
+
+BENCHMARK(BM_Snapshot)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+/**
+ * Bursts of 1000 process wakeups at the same time, processed one by one with
+ * step or at once with run_batch.
+ */
+void BM_SameTimeBurst(benchmark::State &state) {
+  bool batched = state.range(0) != 0;
+  auto sim = simcpp::Simulation::create();
+  const size_t n_processes = 1000;
+
+  for (size_t i = 0; i < n_processes; ++i) {
+    sim->start_process<Ticker>();
+  }
+
+  for (auto _ : state) {
+    if (batched) {
+      sim->run_batch();
+    } else {
+      for (size_t i = 0; i < n_processes; ++i) {
+        sim->step();
+      }
+    }
+  }
+
+  state.SetItemsProcessed(
+      static_cast<int64_t>(state.iterations() * n_processes));
+  state.SetLabel(batched ? "run_batch" : "step");
+}
+
+BENCHMARK(BM_SameTimeBurst)->Arg(0)->Arg(1);
+
+/// Ad-hoc counters, which example-resource.cpp used before simcpp::Resource.
+class Counters {
+public:
+  Counters(simcpp::SimulationPtr sim, int capacity)
+      : sim(sim), capacity(capacity) {}
+
+  simcpp::EventPtr request() {
+    auto request = sim.lock()->event();
+    request_queue.push(request);
+    trigger_requests();
+    return request;
+  }
+
+  void release() {
+    ++capacity;
+    trigger_requests();
+  }
+
+private:
+  std::queue<simcpp::EventPtr> request_queue = {};
+  simcpp::SimulationWeakPtr sim;
+  int capacity;
+
+  void trigger_requests() {
+    while (capacity > 0 && request_queue.size() > 0) {
+      auto request = request_queue.front();
+      request_queue.pop();
+
+      if (!request->is_pending()) {
+        continue;
+      }
+
+      --capacity;
+      request->trigger();
+    }
+  }
+};
+
+/// Parameters and state shared by all customers of the bank model.
+class Bank {
+public:
+  Counters counters;
+  simcpp::Random &rng;
+  std::exponential_distribution<double> arrival_interval;
+  std::exponential_distribution<double> time_in_bank;
+  double max_wait_time = 16.0;
+  int n_customers;
+  int n_served = 0;
+
+  Bank(simcpp::SimulationPtr sim, int n_customers)
+      : counters(sim, 2), rng(sim->get_random()), arrival_interval(1 / 10.0),
+        time_in_bank(1 / 12.0), n_customers(n_customers) {}
+};
+
+class Customer : public simcpp::Process {
+public:
+  Customer(simcpp::SimulationPtr sim, Bank *bank) : Process(sim), bank(bank) {}
+
+  bool Run() override {
+    auto sim = this->sim.lock();
+
+    PT_BEGIN();
+
+    request = bank->counters.request();
+    timeout = sim->timeout(bank->max_wait_time);
+    PROC_WAIT_FOR(sim->any_of({request, timeout}));
+
+    if (!request->is_triggered()) {
+      request->abort();
+      PT_EXIT();
+    }
+    timeout->abort();
+
+    PROC_WAIT_FOR(sim->timeout(bank->time_in_bank(bank->rng)));
+    ++bank->n_served;
+    bank->counters.release();
+
+    PT_END();
+  }
+
+private:
+  Bank *bank;
+  simcpp::EventPtr request = nullptr;
+  simcpp::EventPtr timeout = nullptr;
+};
+
+class CustomerSource : public simcpp::Process {
+public:
+  CustomerSource(simcpp::SimulationPtr sim, Bank *bank)
+      : Process(sim), bank(bank) {}
+
+  bool Run() override {
+    auto sim = this->sim.lock();
+
+    PT_BEGIN();
+    while (i < bank->n_customers) {
+      sim->start_process<Customer>(bank);
+      ++i;
+      PROC_WAIT_FOR(sim->timeout(bank->arrival_interval(bank->rng)));
+    }
+    PT_END();
+  }
+
+private:
+  Bank *bank;
+  int i = 0;
+};
+
+simcpp::Task customer(simcpp::Simulation &sim, Bank *bank) {
+  auto request = bank->counters.request();
+  auto timeout = sim.timeout(bank->max_wait_time);
+  auto any_of = sim.any_of({request, timeout});
+  co_await any_of;
+
+  if (!request->is_triggered()) {
+    request->abort();
+    co_return;
+  }
+  timeout->abort();
+
+  co_await sim.timeout(bank->time_in_bank(bank->rng));
+  ++bank->n_served;
+  bank->counters.release();
+}
+
+simcpp::Task customer_source(simcpp::Simulation &sim, Bank *bank) {
+  for (int i = 0; i < bank->n_customers; ++i) {
+    customer(sim, bank);
+    co_await sim.timeout(bank->arrival_interval(bank->rng));
+  }
+}
+
+/// Bank model of example-resource.cpp with protothread processes.
+void BM_BankProcesses(benchmark::State &state) {
+  int n_customers = static_cast<int>(state.range(0));
+
+  for (auto _ : state) {
+    auto sim = simcpp::Simulation::create();
+    Bank bank(sim, n_customers);
+    sim->start_process<CustomerSource>(&bank);
+    sim->run();
+    benchmark::DoNotOptimize(bank.n_served);
+  }
+
+  state.SetItemsProcessed(state.iterations() * n_customers);
+}
+
+/// Bank model of example-resource.cpp with coroutine tasks.
+void BM_BankTasks(benchmark::State &state) {
+  int n_customers = static_cast<int>(state.range(0));
+
+  for (auto _ : state) {
+    auto sim = simcpp::Simulation::create();
+    Bank bank(sim, n_customers);
+    customer_source(*sim, &bank);
+    sim->run();
+    benchmark::DoNotOptimize(bank.n_served);
+  }
+
+  state.SetItemsProcessed(state.iterations() * n_customers);
+}
+
+BENCHMARK(BM_BankProcesses)
+    ->Arg(10000)
+    ->Arg(1000000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BankTasks)
+    ->Arg(10000)
+    ->Arg(1000000)
+    ->Unit(benchmark::kMillisecond);
+
+void release(Counters &counters, const simcpp::EventPtr &) {
+  counters.release();
+}
+
+void release(simcpp::Resource &resource, const simcpp::RequestPtr &request) {
+  resource.release(request);
+}
+
+/// Customer which waits for a slot of a busy resource, or reneges.
+template <typename Resource> class Contender : public simcpp::Process {
+public:
+  Contender(simcpp::SimulationPtr sim, Resource *resource, int *n_served)
+      : Process(sim), resource(resource), n_served(n_served) {}
+
+  bool Run() override {
+    auto sim = this->sim.lock();
+
+    PT_BEGIN();
+
+    request = resource->request();
+    timeout = sim->timeout(16.0);
+    PROC_WAIT_FOR(sim->any_of({request, timeout}));
+
+    if (!request->is_triggered()) {
+      request->abort();
+      PT_EXIT();
+    }
+    timeout->abort();
+
+    PROC_WAIT_FOR(sim->timeout(1.0));
+    ++*n_served;
+    release(*resource, request);
+
+    PT_END();
+  }
+
+  void save(simcpp::Archive &archive) const override {
+    Process::save(archive);
+    archive.save(request);
+    archive.save(timeout);
+  }
+
+  void load(simcpp::Archive &archive) override {
+    Process::load(archive);
+    archive.load(request);
+    archive.load(timeout);
+  }
+
+private:
+  Resource *resource;
+  int *n_served;
+  decltype(std::declval<Resource>().request()) request = nullptr;
+  simcpp::EventPtr timeout = nullptr;
+};
+
+/// Source of contenders with exponential interarrival times.
+template <typename Resource> class Arrivals : public simcpp::Process {
+public:
+  Arrivals(simcpp::SimulationPtr sim, Resource *resource, int n_customers,
+           int *n_served)
+      : Process(sim), resource(resource), n_customers(n_customers),
+        n_served(n_served) {}
+
+  bool Run() override {
+    auto sim = this->sim.lock();
+
+    PT_BEGIN();
+    while (i < n_customers) {
+      sim->template start_process<Contender<Resource>>(resource, n_served);
+      ++i;
+      PROC_WAIT_FOR(sim->timeout(arrival_interval(rng)));
+    }
+    PT_END();
+  }
+
+  void save(simcpp::Archive &archive) const override {
+    Process::save(archive);
+    archive.save(rng);
+    archive.save(arrival_interval);
+    archive.save(i);
+  }
+
+  void load(simcpp::Archive &archive) override {
+    Process::load(archive);
+    archive.load(rng);
+    archive.load(arrival_interval);
+    archive.load(i);
+  }
+
+private:
+  Resource *resource;
+  int n_customers;
+  int *n_served;
+  std::mt19937_64 rng{0};
+  std::exponential_distribution<double> arrival_interval{20.0};
+  int i = 0;
+};
+
+/**
+ * Customers arriving ten times as fast as a resource with two slots serves
+ * them, so most of them renege. Compares the counters of the bank model with
+ * simcpp::Resource, with and without pooled allocation.
+ */
+template <typename Resource>
+void BM_ResourceContention(benchmark::State &state) {
+  int n_customers = 100000;
+  simcpp::SimulationOptions options;
+  options.pooled_allocation = state.range(0) != 0;
+
+  for (auto _ : state) {
+    auto sim = simcpp::Simulation::create(options);
+    Resource resource(sim, 2);
+    int n_served = 0;
+    sim->template start_process<Arrivals<Resource>>(&resource, n_customers,
+                                                    &n_served);
+    sim->run();
+    benchmark::DoNotOptimize(n_served);
+  }
+
+  state.SetItemsProcessed(state.iterations() * n_customers);
+}
+
+BENCHMARK_TEMPLATE(BM_ResourceContention, Counters)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(BM_ResourceContention, simcpp::Resource)->Arg(0)->Arg(1);
+
+/**
+ * A scenario branched from the contention model at half of its 5000 time
+ * units, by simulating the first half again (0) or by forking a simulation
+ * which is already there (1).
+ */
+void BM_Fork(benchmark::State &state) {
+  using Resource = simcpp::Resource;
+  int n_customers = 100000;
+  simcpp::simtime warm_up = 2500.0;
+
+  auto sim = simcpp::Simulation::create();
+  Resource resource(sim, 2);
+  int n_served = 0;
+  sim->start_process<Arrivals<Resource>>(&resource, n_customers, &n_served);
+  sim->run_until(warm_up);
+
+  Resource *branch_resource = nullptr;
+  int branch_served = 0;
+  simcpp::SnapshotRegistry registry;
+  registry.add<Arrivals<Resource>>("Arrivals", [&](simcpp::SimulationPtr sim) {
+    return sim->event<Arrivals<Resource>>(branch_resource, n_customers,
+                                          &branch_served);
+  });
+  registry.add<Contender<Resource>>(
+      "Contender", [&](simcpp::SimulationPtr sim) {
+        return sim->event<Contender<Resource>>(branch_resource, &branch_served);
+      });
+  registry.add<simcpp::Request>("simcpp::Request");
+
+  for (auto _ : state) {
+    auto branch = simcpp::Simulation::create();
+    Resource resource_copy(branch, 2);
+    branch_resource = &resource_copy;
+    branch_served = 0;
+    if (state.range(0) == 0) {
+      branch->start_process<Arrivals<Resource>>(branch_resource, n_customers,
+                                                &branch_served);
+      branch->run_until(warm_up);
+    } else {
+      sim->fork(
+          branch, registry,
+          [&](simcpp::Archive &archive) {
+            archive.save(n_served);
+            resource.save(archive);
+          },
+          [&](simcpp::Archive &archive) {
+            archive.load(branch_served);
+            resource_copy.load(archive);
+          });
+    }
+    benchmark::DoNotOptimize(branch_served);
+  }
+
+  state.SetLabel(state.range(0) == 0 ? "replay" : "fork");
+}
+
+BENCHMARK(BM_Fork)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+/// Replications of the bank model on a number of threads.
+void BM_Replications(benchmark::State &state) {
+  simcpp::ReplicationRunner runner(static_cast<size_t>(state.range(0)));
+  size_t n_replications = 64;
+  auto model = [](simcpp::Replication &replication) {
+    Bank bank(replication.sim, 1000);
+    replication.sim->start_process<CustomerSource>(&bank);
+    replication.sim->run();
+    return static_cast<double>(bank.n_served);
+  };
+
+  for (auto _ : state) {
+    auto results = runner.run(model, n_replications, 0);
+    benchmark::DoNotOptimize(results.summary.get_mean());
+  }
+
+  state.SetItemsProcessed(state.iterations() * n_replications);
+}
+
+BENCHMARK(BM_Replications)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
+
+/// Single server station in a ring of logical processes.
+template <typename LogicalProcess> class Station {
+public:
+  size_t n_departures = 0;
+
+  Station(LogicalProcess &lp, size_t next, simcpp::simtime lookahead)
+      : lp(lp), next(next), lookahead(lookahead), rng(lp.get_id()) {
+    lp.on_message(
+        [this](const simcpp::Message &message) { arrive(message.value); });
+  }
+
+  void save(simcpp::Archive &archive) const {
+    archive.save(std::vector<double>(queue.begin(), queue.end()));
+    archive.save(busy);
+    archive.save(rng);
+    archive.save(n_departures);
+  }
+
+  void load(simcpp::Archive &archive) {
+    std::vector<double> queue;
+    archive.load(queue);
+    this->queue.assign(queue.begin(), queue.end());
+    archive.load(busy);
+    archive.load(rng);
+    archive.load(n_departures);
+  }
+
+  void arrive(double customer) {
+    queue.push_back(customer);
+    if (!busy) {
+      serve();
+    }
+  }
+
+private:
+  LogicalProcess &lp;
+  size_t next;
+  simcpp::simtime lookahead;
+  std::mt19937_64 rng;
+  std::exponential_distribution<double> service{1.0};
+  std::deque<double> queue = {};
+  bool busy = false;
+
+  void serve() {
+    busy = true;
+    double customer = queue.front();
+    queue.pop_front();
+
+    auto sim = lp.get_simulation();
+    sim->timeout(service(rng))->add_handler([this, customer](simcpp::EventPtr) {
+      ++n_departures;
+      lp.send(next, lookahead + service(rng), 0, customer);
+      busy = false;
+      if (!queue.empty()) {
+        serve();
+      }
+    });
+  }
+};
+
+template <typename LogicalProcess>
+size_t count_departures(
+    const std::vector<std::unique_ptr<Station<LogicalProcess>>> &stations) {
+  size_t n_departures = 0;
+  for (auto &station : stations) {
+    n_departures += station->n_departures;
+  }
+  return n_departures;
+}
+
+/**
+ * Ring of single server stations, one per logical process. Each logical
+ * process has the same amount of work, so ideally the time stays constant as
+ * logical processes are added (weak scaling).
+ *
+ * Arguments: number of logical processes, lookahead in thousandths.
+ */
+void BM_ParallelRing(benchmark::State &state) {
+  auto n = static_cast<size_t>(state.range(0));
+  simcpp::simtime lookahead = static_cast<double>(state.range(1)) / 1000;
+  size_t n_departures = 0;
+
+  for (auto _ : state) {
+    simcpp::ParallelSimulation psim(n);
+    std::vector<std::unique_ptr<Station<simcpp::LogicalProcess>>> stations;
+    for (size_t id = 0; id < n; ++id) {
+      psim.connect(id, (id + 1) % n, lookahead);
+      stations.emplace_back(new Station<simcpp::LogicalProcess>(
+          psim.get_process(id), (id + 1) % n, lookahead));
+    }
+    for (size_t id = 0; id < n; ++id) {
+      for (int customer = 0; customer < 100; ++customer) {
+        stations[id]->arrive(customer);
+      }
+    }
+
+    psim.run_until(1000);
+    n_departures += count_departures(stations);
+  }
+
+  state.SetItemsProcessed(static_cast<int64_t>(n_departures));
+}
+
+BENCHMARK(BM_ParallelRing)
+    ->ArgsProduct({{1, 2, 4}, {1000, 10}})
+    ->UseRealTime();
+
+/// Same model as BM_ParallelRing with optimistic synchronization.
+void BM_TimeWarpRing(benchmark::State &state) {
+  auto n = static_cast<size_t>(state.range(0));
+  simcpp::simtime lookahead = static_cast<double>(state.range(1)) / 1000;
+  simcpp::simtime window = static_cast<double>(state.range(2));
+  size_t n_departures = 0;
+  simcpp::TimeWarpStats stats;
+
+  for (auto _ : state) {
+    simcpp::TimeWarpSimulation tsim(n, simcpp::SimulationOptions(), 1024, window);
+    std::vector<std::unique_ptr<Station<simcpp::TimeWarpProcess>>> stations;
+    for (size_t id = 0; id < n; ++id) {
+      auto &lp = tsim.get_process(id);
+      stations.emplace_back(
+          new Station<simcpp::TimeWarpProcess>(lp, (id + 1) % n, lookahead));
+      auto station = stations.back().get();
+      lp.on_checkpoint(
+          [station](simcpp::Archive &archive) { station->save(archive); },
+          [station](simcpp::Archive &archive) { station->load(archive); });
+    }
+    for (size_t id = 0; id < n; ++id) {
+      for (int customer = 0; customer < 100; ++customer) {
+        stations[id]->arrive(customer);
+      }
+    }
+
+    tsim.run_until(1000);
+    n_departures += count_departures(stations);
+    stats = tsim.get_stats();
+  }
+
+  state.SetItemsProcessed(static_cast<int64_t>(n_departures));
+  state.counters["efficiency"] = stats.get_efficiency();
+}
+
+BENCHMARK(BM_TimeWarpRing)
+    ->ArgsProduct({{1, 2, 4}, {1000, 10}, {1, 10}})
+    ->UseRealTime();
+
+/// Handlers posted by a number of producer threads into the inbox.
+void BM_InboxPost(benchmark::State &state) {
+  simcpp::SimulationOptions options;
+  options.inbox_capacity = 1024;
+  auto sim = simcpp::Simulation::create(options);
+  std::atomic<bool> done(false);
+  uint64_t n_received = 0;
+  std::vector<std::thread> producers;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    producers.emplace_back([&]() {
+      while (!done.load(std::memory_order_relaxed)) {
+        sim->try_post(0.0, [&n_received](simcpp::EventPtr) { ++n_received; });
+      }
+    });
+  }
+
+  for (auto _ : state) {
+    if (!sim->step()) {
+      std::this_thread::yield();
+    }
+  }
+  done.store(true);
+  for (auto &producer : producers) {
+    producer.join();
+  }
+
+  state.SetItemsProcessed(static_cast<int64_t>(n_received));
+}
+
+BENCHMARK(BM_InboxPost)->Arg(1)->Arg(4)->UseRealTime();
+
+/**
+ * Timeouts of 100 microseconds in a real-time simulation, reporting how late
+ * they are processed. The argument is 1 if another thread injects a function
+ * during each timeout.
+ */
+void BM_RealtimeJitter(benchmark::State &state) {
+  simcpp::RealtimeOptions realtime_options;
+  realtime_options.factor = 1e-6;
+  simcpp::RealtimeSimulation rt(realtime_options);
+  auto sim = rt.get_simulation();
+  std::atomic<bool> done(false);
+  std::atomic<uint64_t> n_injected(0);
+  std::thread producer;
+  if (state.range(0) != 0) {
+    producer = std::thread([&]() {
+      while (!done.load()) {
+        rt.inject([&n_injected](simcpp::SimulationPtr) { ++n_injected; });
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    });
+  }
+
+  for (auto _ : state) {
+    sim->timeout(100.0);
+    rt.step();
+  }
+  done.store(true);
+  if (producer.joinable()) {
+    producer.join();
+  }
+
+  auto &lateness = rt.get_lateness();
+  state.counters["mean_lateness_us"] = lateness.get_mean() * 1e6;
+  state.counters["max_lateness_us"] = lateness.get_max() * 1e6;
+  state.counters["injected"] = static_cast<double>(n_injected.load());
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_RealtimeJitter)->Arg(0)->Arg(1)->UseRealTime();
+
+} // namespace
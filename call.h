@@ -0,0 +1,160 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_CALL_H_
+#define SIMCPP_CALL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace simcpp {
+
+/**
+ * Function without arguments, like std::function<void()>, which stores small
+ * callables inline.
+ *
+ * Callables of up to buffer_size bytes which can be moved without throwing are
+ * stored in the call itself. Larger ones are allocated on the heap. Calls can
+ * only be moved, so callables need not be copyable.
+ */
+class Call {
+public:
+  /// Size of the inline buffer.
+  static const size_t buffer_size = 48;
+
+  /// Construct an empty call.
+  Call() = default;
+
+  /**
+   * Construct a call.
+   *
+   * @tparam F Type of the callable.
+   * @param function Callable, which is moved into the call.
+   */
+  template <typename F,
+            typename = typename std::enable_if<!std::is_same<
+                typename std::decay<F>::type, Call>::value>::type>
+  Call(F &&function) {
+    using T = typename std::decay<F>::type;
+    construct<T>(std::forward<F>(function),
+                 std::integral_constant<bool, fits_inline<T>()>());
+  }
+
+  Call(Call &&other) noexcept { take(other); }
+
+  Call &operator=(Call &&other) noexcept {
+    if (this != &other) {
+      reset();
+      take(other);
+    }
+    return *this;
+  }
+
+  Call(const Call &) = delete;
+  Call &operator=(const Call &) = delete;
+
+  ~Call() { reset(); }
+
+  /// Call the callable. The call must not be empty.
+  void operator()() { operations->invoke(buffer); }
+
+  /// @return Whether a callable is set.
+  explicit operator bool() const { return operations != nullptr; }
+
+private:
+  /// Operations on the callable in the buffer, one instance per type.
+  class Operations {
+  public:
+    void (*invoke)(void *buffer);
+    void (*move)(void *from, void *to);
+    void (*destroy)(void *buffer);
+  };
+
+  /// Operations of a callable stored in the buffer.
+  template <typename T> class Inline {
+  public:
+    static void invoke(void *buffer) { (*static_cast<T *>(buffer))(); }
+
+    static void move(void *from, void *to) {
+      new (to) T(std::move(*static_cast<T *>(from)));
+      static_cast<T *>(from)->~T();
+    }
+
+    static void destroy(void *buffer) { static_cast<T *>(buffer)->~T(); }
+
+    static const Operations operations;
+  };
+
+  /// Operations of a callable on the heap, whose pointer is in the buffer.
+  template <typename T> class Boxed {
+  public:
+    static void invoke(void *buffer) { (**static_cast<T **>(buffer))(); }
+
+    static void move(void *from, void *to) {
+      *static_cast<T **>(to) = *static_cast<T **>(from);
+    }
+
+    static void destroy(void *buffer) { delete *static_cast<T **>(buffer); }
+
+    static const Operations operations;
+  };
+
+  alignas(std::max_align_t) unsigned char buffer[buffer_size];
+  const Operations *operations = nullptr;
+
+  template <typename T> static constexpr bool fits_inline() {
+    return sizeof(T) <= buffer_size &&
+           alignof(T) <= alignof(std::max_align_t) &&
+           std::is_nothrow_move_constructible<T>::value;
+  }
+
+  template <typename T, typename F>
+  void construct(F &&function, std::true_type) {
+    new (buffer) T(std::forward<F>(function));
+    operations = &Inline<T>::operations;
+  }
+
+  template <typename T, typename F>
+  void construct(F &&function, std::false_type) {
+    *reinterpret_cast<T **>(buffer) = new T(std::forward<F>(function));
+    operations = &Boxed<T>::operations;
+  }
+
+  void take(Call &other) {
+    if (other.operations != nullptr) {
+      other.operations->move(other.buffer, buffer);
+      operations = other.operations;
+      other.operations = nullptr;
+    }
+  }
+
+  void reset() {
+    if (operations != nullptr) {
+      operations->destroy(buffer);
+      operations = nullptr;
+    }
+  }
+};
+
+template <typename T>
+const Call::Operations Call::Inline<T>::operations = {invoke, move, destroy};
+
+template <typename T>
+const Call::Operations Call::Boxed<T>::operations = {invoke, move, destroy};
+
+/// Handle of a call scheduled by Simulation::call_at, call_in or call_every.
+class CallHandle {
+public:
+  /// Slot of the call.
+  uint32_t slot = 0;
+  /// Generation of the slot, which changes whenever the slot is freed, so
+  /// handles of finished calls do not match later calls.
+  uint32_t generation = 0;
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_CALL_H_
@@ -0,0 +1,145 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include <cstdio>
+#include <queue>
+#include <random>
+
+#include "replication.h"
+#include "simcpp.h"
+
+class Resource {
+public:
+  Resource(simcpp::SimulationPtr sim, int capacity)
+      : sim(sim), capacity(capacity) {}
+
+  simcpp::EventPtr request() {
+    auto request = sim.lock()->event();
+    request_queue.push(request);
+
+    trigger_requests();
+
+    return request;
+  }
+
+  void release() {
+    ++capacity;
+
+    trigger_requests();
+  }
+
+private:
+  std::queue<simcpp::EventPtr> request_queue = {};
+  simcpp::SimulationWeakPtr sim;
+  int capacity;
+
+  void trigger_requests() {
+    while (capacity > 0 && request_queue.size() > 0) {
+      auto request = request_queue.front();
+      request_queue.pop();
+
+      if (!request->is_pending()) {
+        continue;
+      }
+
+      --capacity;
+      request->trigger();
+    }
+  }
+};
+
+/// State of one replication of the bank, shared by all its processes.
+class Bank {
+public:
+  Resource counters;
+  simcpp::Random &rng;
+  std::exponential_distribution<double> arrival_interval;
+  std::exponential_distribution<double> time_in_bank;
+  double max_wait_time;
+  int n_customers;
+  int n_served = 0;
+
+  Bank(simcpp::Replication &replication, int n_customers, int n_counters)
+      : counters(replication.sim, n_counters),
+        rng(replication.sim->get_random()), arrival_interval(1 / 10.0),
+        time_in_bank(1 / 12.0), max_wait_time(16.0), n_customers(n_customers) {}
+};
+
+class Customer : public simcpp::Process {
+public:
+  Customer(simcpp::SimulationPtr sim, Bank *bank) : Process(sim), bank(bank) {}
+
+  bool Run() override {
+    auto sim = this->sim.lock();
+
+    PT_BEGIN();
+
+    request = bank->counters.request();
+    timeout = sim->timeout(bank->max_wait_time);
+    PROC_WAIT_FOR(sim->any_of({request, timeout}));
+
+    if (!request->is_triggered()) {
+      request->abort();
+      PT_EXIT();
+    }
+    timeout->abort();
+
+    PROC_WAIT_FOR(sim->timeout(bank->time_in_bank(bank->rng)));
+
+    ++bank->n_served;
+    bank->counters.release();
+
+    PT_END();
+  }
+
+private:
+  Bank *bank;
+  simcpp::EventPtr request = nullptr;
+  simcpp::EventPtr timeout = nullptr;
+};
+
+class CustomerSource : public simcpp::Process {
+public:
+  CustomerSource(simcpp::SimulationPtr sim, Bank *bank)
+      : Process(sim), bank(bank) {}
+
+  bool Run() override {
+    auto sim = this->sim.lock();
+
+    PT_BEGIN();
+    while (i < bank->n_customers) {
+      sim->start_process<Customer>(bank);
+      ++i;
+      PROC_WAIT_FOR(sim->timeout(bank->arrival_interval(bank->rng)));
+    }
+    PT_END();
+  }
+
+private:
+  Bank *bank;
+  int i = 0;
+};
+
+int main() {
+  int n_customers = 100;
+  int n_counters = 1;
+  size_t n_replications = 1000;
+
+  simcpp::ReplicationRunner runner;
+  auto results = runner.run(
+      [&](simcpp::Replication &replication) {
+        Bank bank(replication, n_customers, n_counters);
+        replication.sim->start_process<CustomerSource>(&bank);
+        replication.sim->run();
+        return static_cast<double>(bank.n_served) / n_customers;
+      },
+      n_replications, 0);
+
+  printf("Served customers: %.3f +- %.3f (95%% confidence, %zu replications "
+         "on %zu threads)\n",
+         results.summary.get_mean(),
+         results.summary.get_confidence_half_width(),
+         results.summary.get_count(), runner.get_n_threads());
+
+  return 0;
+}
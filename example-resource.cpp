@@ -1,67 +1,20 @@
 // Copyright © 2021 Felix Schütz
 // Licensed under the MIT license. See the LICENSE file for details.
 
-#include <cmath>
 #include <cstdio>
-#include <queue>
 
+#include "resource.h"
 #include "simcpp.h"
 
-double expovariate(double lambda) {
-  double u = rand() / (RAND_MAX + 1.0);
-  return -log(1 - u) / lambda;
-}
-
-class Resource {
-public:
-  Resource(simcpp::SimulationPtr sim, int capacity)
-      : sim(sim), capacity(capacity) {}
-
-  simcpp::EventPtr request() {
-    auto request = sim.lock()->event();
-    request_queue.push(request);
-
-    trigger_requests();
-
-    return request;
-  }
-
-  void release() {
-    ++capacity;
-
-    trigger_requests();
-  }
-
-  int get_queue_length() { return request_queue.size(); }
-
-private:
-  std::queue<simcpp::EventPtr> request_queue = {};
-  simcpp::SimulationWeakPtr sim;
-  int capacity;
-
-  void trigger_requests() {
-    while (capacity > 0 && request_queue.size() > 0) {
-      auto request = request_queue.front();
-      request_queue.pop();
-
-      if (!request->is_pending()) {
-        continue;
-      }
-
-      --capacity;
-      request->trigger();
-    }
-  }
-};
-
-using ResourcePtr = std::shared_ptr<Resource>;
+using ResourcePtr = std::shared_ptr<simcpp::Resource>;
 
 class Customer : public simcpp::Process {
 public:
   Customer(simcpp::SimulationPtr sim, double mean_time_in_bank,
            double max_wait_time, ResourcePtr counters, int id)
       : Process(sim), mean_time_in_bank(mean_time_in_bank),
-        max_wait_time(max_wait_time), counters(counters), id(id) {}
+        max_wait_time(max_wait_time), counters(counters), id(id),
+        random(sim->get_random().substream(id)) {}
 
   bool Run() override {
     auto sim = this->sim.lock();
@@ -71,7 +24,8 @@ public:
     printf("[%5.2f] Customer %d arrives\n", sim->get_now(), id);
 
     request = counters->request();
-    PROC_WAIT_FOR(sim->any_of({request, sim->timeout(max_wait_time)}));
+    timeout = sim->timeout(max_wait_time);
+    PROC_WAIT_FOR(sim->any_of({request, timeout}));
 
     if (!request->is_triggered()) {
       request->abort();
@@ -79,22 +33,29 @@ public:
       PT_EXIT();
     }
 
+    // Remove the timeout from the queue.
+    timeout->abort();
+
     printf("[%5.2f] Customer %d gets to the counter\n", sim->get_now(), id);
 
-    PROC_WAIT_FOR(sim->timeout(expovariate(1 / mean_time_in_bank)));
+    PROC_WAIT_FOR(sim->timeout(random.exponential(1 / mean_time_in_bank)));
 
     printf("[%5.2f] Customer %d leaves\n", sim->get_now(), id);
-    counters->release();
+    counters->release(request);
 
     PT_END();
   }
 
 private:
-  simcpp::EventPtr request = nullptr;
+  simcpp::RequestPtr request = nullptr;
+  simcpp::EventPtr timeout = nullptr;
   double mean_time_in_bank;
   double max_wait_time;
   ResourcePtr counters;
   int id;
+  /// Substream of the customer, so its time in the bank does not depend on
+  /// the order in which customers arrive.
+  simcpp::Random random;
 };
 
 class CustomerSource : public simcpp::Process {
@@ -115,7 +76,8 @@ public:
       sim->start_process<Customer>(mean_time_in_bank, max_wait_time, counters,
                                    next_id);
       ++next_id;
-      PROC_WAIT_FOR(sim->timeout(expovariate(1 / mean_arrival_interval)));
+      PROC_WAIT_FOR(sim->timeout(
+          sim->get_random().exponential(1 / mean_arrival_interval)));
     }
     PT_END();
   }
@@ -136,10 +98,11 @@ int main() {
   double max_wait_time = 16.0;
   int n_counters = 1;
 
-  srand(0);
+  simcpp::SimulationOptions options;
+  options.seed = 0;
 
-  auto sim = simcpp::Simulation::create();
-  auto counters = std::make_shared<Resource>(sim, n_counters);
+  auto sim = simcpp::Simulation::create(options);
+  auto counters = std::make_shared<simcpp::Resource>(sim, n_counters);
   auto customer_source = sim->start_process<CustomerSource>(
       n_customers, mean_arrival_interval, mean_time_in_bank, max_wait_time,
       counters);
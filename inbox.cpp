@@ -0,0 +1,58 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "inbox.h"
+
+#include <utility>
+
+namespace simcpp {
+
+/* Inbox */
+
+Inbox::Inbox(size_t capacity) : n_reserved(0), tail(0) {
+  size_t n_slots = 1;
+  while (n_slots < capacity) {
+    n_slots *= 2;
+  }
+  slots.reset(new Slot[n_slots]);
+  for (size_t i = 0; i < n_slots; ++i) {
+    slots[i].filled.store(0, std::memory_order_relaxed);
+  }
+  this->capacity = n_slots;
+}
+
+bool Inbox::push(simtime time, Handler &&handler) {
+  if (n_reserved.fetch_add(1, std::memory_order_acquire) >= capacity) {
+    n_reserved.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  // At most capacity tickets are not removed yet, and the consumer removes
+  // them in order, so the previous handler of the slot is removed.
+  size_t ticket = tail.fetch_add(1, std::memory_order_relaxed);
+  auto &slot = slots[ticket & (capacity - 1)];
+  slot.time = time;
+  slot.handler = std::move(handler);
+  slot.filled.store(ticket + 1, std::memory_order_release);
+  return true;
+}
+
+bool Inbox::pop(simtime &time, Handler &handler) {
+  auto &slot = slots[head & (capacity - 1)];
+  if (slot.filled.load(std::memory_order_acquire) != head + 1) {
+    return false;
+  }
+
+  time = slot.time;
+  handler = std::move(slot.handler);
+  slot.handler = nullptr;
+  ++head;
+  n_reserved.fetch_sub(1, std::memory_order_release);
+  return true;
+}
+
+size_t Inbox::get_capacity() const { return capacity; }
+
+bool Inbox::empty() const { return n_reserved.load() == 0; }
+
+} // namespace simcpp
@@ -0,0 +1,88 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_INBOX_H_
+#define SIMCPP_INBOX_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "simcpp.h"
+
+namespace simcpp {
+
+/**
+ * Bounded queue of timestamped handlers with multiple producers and a single
+ * consumer. Used by Simulation::post and RealtimeSimulation::inject.
+ *
+ * A producer reserves space by incrementing a counter, takes a slot by
+ * incrementing a ticket, and marks the slot as filled, so pushing is
+ * wait-free. If the queue is full, it undoes the reservation and fails. The
+ * consumer takes the slots in the order of the tickets.
+ */
+class Inbox {
+public:
+  /**
+   * Construct an inbox.
+   *
+   * @param capacity Number of slots. Rounded up to a power of two.
+   */
+  explicit Inbox(size_t capacity);
+
+  Inbox(const Inbox &) = delete;
+  Inbox &operator=(const Inbox &) = delete;
+
+  /**
+   * Append a handler. Thread-safe.
+   *
+   * @param time Simulation time at which to call the handler.
+   * @param handler Handler to append. Left unchanged if there was no free
+   * slot.
+   * @return Whether there was a free slot.
+   */
+  bool push(simtime time, Handler &&handler);
+
+  /**
+   * Remove the oldest handler. Only called by the consumer.
+   *
+   * @param time Set to the time of the handler.
+   * @param handler Set to the removed handler.
+   * @return Whether there was a handler which is completely appended.
+   */
+  bool pop(simtime &time, Handler &handler);
+
+  /// @return Number of slots.
+  size_t get_capacity() const;
+
+  /// @return Whether no handler is appended or being appended. Thread-safe.
+  bool empty() const;
+
+private:
+  /// Size of a cache line. The counters of the producers and the index of the
+  /// consumer are padded to separate cache lines.
+  static const size_t cache_line_size = 64;
+
+  class Slot {
+  public:
+    /// Ticket of the handler in the slot plus one, once it is filled.
+    std::atomic<size_t> filled;
+    simtime time;
+    Handler handler;
+  };
+
+  std::unique_ptr<Slot[]> slots;
+  size_t capacity;
+  char padding1[cache_line_size];
+  /// Number of handlers appended or being appended and not removed yet.
+  std::atomic<size_t> n_reserved;
+  /// Next ticket. Written by the producers.
+  std::atomic<size_t> tail;
+  char padding2[cache_line_size - 2 * sizeof(std::atomic<size_t>)];
+  /// Next ticket to remove. Written by the consumer.
+  size_t head = 0;
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_INBOX_H_
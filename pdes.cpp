@@ -0,0 +1,316 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "pdes.h"
+
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace simcpp {
+
+namespace {
+
+const simtime infinity = std::numeric_limits<simtime>::infinity();
+
+} // namespace
+
+/* Channel */
+
+Channel::Channel(size_t capacity /* = 1024 */) : head(0), tail(0) {
+  size_t n_slots = 1;
+  while (n_slots < capacity) {
+    n_slots *= 2;
+  }
+  slots.resize(n_slots);
+  mask = n_slots - 1;
+}
+
+bool Channel::push(const Message &message) {
+  size_t tail = this->tail.load(std::memory_order_relaxed);
+  if (tail - head.load(std::memory_order_acquire) == slots.size()) {
+    return false;
+  }
+
+  slots[tail & mask] = message;
+  this->tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+bool Channel::pop(Message &message) {
+  size_t head = this->head.load(std::memory_order_relaxed);
+  if (head == tail.load(std::memory_order_acquire)) {
+    return false;
+  }
+
+  message = std::move(slots[head & mask]);
+  this->head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+/* LogicalProcess */
+
+LogicalProcess::LogicalProcess(size_t id, const SimulationOptions &options)
+    : id(id), sim(Simulation::create(options)) {}
+
+size_t LogicalProcess::get_id() const { return id; }
+
+SimulationPtr LogicalProcess::get_simulation() const { return sim; }
+
+void LogicalProcess::on_message(Receiver receiver) {
+  this->receiver = std::move(receiver);
+}
+
+void LogicalProcess::send(size_t target, simtime delay, int64_t kind /* = 0 */,
+                          double value /* = 0.0 */,
+                          std::shared_ptr<void> data /* = nullptr */) {
+  auto &output = this->output(target);
+  if (delay < output.lookahead) {
+    throw std::invalid_argument("message delay is less than the lookahead");
+  }
+
+  simtime now = sim->get_now();
+  output.promise = std::max(output.promise, now + output.lookahead);
+
+  Message message;
+  message.time = now + delay;
+  message.source = id;
+  message.sequence = next_sequence++;
+  message.kind = kind;
+  message.value = value;
+  message.data = std::move(data);
+  message.promise = output.promise;
+
+  if (!output.outbox.empty() || !output.channel->push(message)) {
+    output.outbox.push_back(std::move(message));
+  }
+}
+
+uint64_t LogicalProcess::get_n_null_messages() const {
+  return n_null_messages;
+}
+
+bool LogicalProcess::Later::operator()(const Message &a,
+                                       const Message &b) const {
+  if (a.time != b.time) {
+    return a.time > b.time;
+  }
+
+  if (a.source != b.source) {
+    return a.source > b.source;
+  }
+
+  return a.sequence > b.sequence;
+}
+
+LogicalProcess::Output &LogicalProcess::output(size_t target) {
+  for (auto &output : outputs) {
+    if (output.target == target) {
+      return output;
+    }
+  }
+
+  throw std::invalid_argument("logical processes are not connected");
+}
+
+bool LogicalProcess::receive() {
+  bool received = false;
+  Message message;
+
+  for (auto &input : inputs) {
+    while (input.channel->pop(message)) {
+      received = true;
+      input.promise = std::max(input.promise, message.promise);
+      if (!message.null) {
+        inbox.push(std::move(message));
+      }
+    }
+  }
+
+  return received;
+}
+
+void LogicalProcess::promise(simtime bound) {
+  for (auto &output : outputs) {
+    if (bound + output.lookahead <= output.promise) {
+      continue;
+    }
+    output.promise = bound + output.lookahead;
+
+    // Only the latest promise matters, so a waiting null message is updated
+    // instead of sending another one.
+    if (!output.outbox.empty() && output.outbox.back().null) {
+      output.outbox.back().promise = output.promise;
+      continue;
+    }
+
+    Message message;
+    message.time = output.promise;
+    message.source = id;
+    message.promise = output.promise;
+    message.null = true;
+    ++n_null_messages;
+
+    if (!output.outbox.empty() || !output.channel->push(message)) {
+      output.outbox.push_back(std::move(message));
+    }
+  }
+}
+
+bool LogicalProcess::flush() {
+  bool flushed = true;
+
+  for (auto &output : outputs) {
+    while (!output.outbox.empty() &&
+           output.channel->push(output.outbox.front())) {
+      output.outbox.pop_front();
+    }
+    flushed = flushed && output.outbox.empty();
+  }
+
+  return flushed;
+}
+
+void LogicalProcess::run_until(simtime end, const std::atomic<bool> &failed,
+                               std::atomic<size_t> &n_running) {
+  while (!failed.load(std::memory_order_relaxed)) {
+    bool progress = receive();
+
+    simtime safe = infinity;
+    for (auto &input : inputs) {
+      safe = std::min(safe, input.promise);
+    }
+    simtime horizon = std::min(safe, end);
+    simtime next_message = inbox.empty() ? infinity : inbox.top().time;
+    simtime next_event = sim->has_next() ? sim->peek_next_time() : infinity;
+
+    if (next_message < horizon && next_message <= next_event) {
+      // Deliver all messages at this time before any local event.
+      sim->run_until(next_message);
+      while (!inbox.empty() && inbox.top().time == next_message) {
+        Message message = inbox.top();
+        inbox.pop();
+        if (receiver) {
+          receiver(message);
+        }
+      }
+      progress = true;
+    } else if (next_event < horizon) {
+      sim->run_until(std::min(next_message, horizon));
+      progress = true;
+    } else if (safe >= end) {
+      // No more events or messages before the end.
+      sim->run_until(end);
+      promise(end);
+      // Senders which are still running may need the channels to be emptied
+      // to flush. Messages received now are delivered by the next call.
+      bool flushed = false;
+      while (n_running.load(std::memory_order_acquire) > 0 &&
+             !failed.load(std::memory_order_relaxed)) {
+        if (!flushed && flush()) {
+          flushed = true;
+          n_running.fetch_sub(1, std::memory_order_acq_rel);
+        }
+        receive();
+        std::this_thread::yield();
+      }
+      return;
+    }
+
+    // Nothing earlier than the next event, message or promise of an input can
+    // happen anymore.
+    simtime bound = std::min(safe, end);
+    if (sim->has_next()) {
+      bound = std::min(bound, sim->peek_next_time());
+    }
+    if (!inbox.empty()) {
+      bound = std::min(bound, inbox.top().time);
+    }
+    promise(bound);
+
+    flush();
+
+    if (!progress) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+/* ParallelSimulation */
+
+ParallelSimulation::ParallelSimulation(
+    size_t n_processes,
+    const SimulationOptions &options /* = SimulationOptions() */) {
+  for (size_t id = 0; id < n_processes; ++id) {
+    processes.emplace_back(new LogicalProcess(id, options));
+  }
+}
+
+LogicalProcess &ParallelSimulation::get_process(size_t index) {
+  return *processes[index];
+}
+
+size_t ParallelSimulation::get_n_processes() const { return processes.size(); }
+
+void ParallelSimulation::connect(size_t source, size_t target,
+                                 simtime lookahead) {
+  if (!(lookahead > 0)) {
+    throw std::invalid_argument("lookahead must be positive");
+  }
+
+  channels.emplace_back(new Channel());
+  auto channel = channels.back().get();
+
+  auto &sender = *processes[source];
+  LogicalProcess::Output output;
+  output.target = target;
+  output.lookahead = lookahead;
+  output.channel = channel;
+  output.promise = sender.sim->get_now() + lookahead;
+  sender.outputs.push_back(std::move(output));
+
+  auto &receiver = *processes[target];
+  LogicalProcess::Input input;
+  input.channel = channel;
+  input.promise = sender.sim->get_now() + lookahead;
+  receiver.inputs.push_back(input);
+}
+
+void ParallelSimulation::run_until(simtime end) {
+  std::atomic<bool> failed(false);
+  std::atomic<size_t> n_running(processes.size());
+  std::exception_ptr error = nullptr;
+  std::mutex error_mutex;
+
+  auto work = [&](size_t index) {
+    try {
+      processes[index]->run_until(end, failed, n_running);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+      failed = true;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t index = 1; index < processes.size(); ++index) {
+    threads.emplace_back(work, index);
+  }
+  if (!processes.empty()) {
+    work(0);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+} // namespace simcpp
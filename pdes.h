@@ -0,0 +1,277 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_PDES_H_
+#define SIMCPP_PDES_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+
+#include "simcpp.h"
+
+namespace simcpp {
+
+/// Timestamped message between logical processes.
+class Message {
+public:
+  /// Time at which the message is delivered.
+  simtime time = 0.0;
+
+  /// Index of the sending logical process.
+  size_t source = 0;
+
+  /// Number of messages the source sent before this one.
+  uint64_t sequence = 0;
+
+  /// Kind of the message, defined by the model.
+  int64_t kind = 0;
+
+  /// Value carried by the message, defined by the model.
+  double value = 0.0;
+
+  /// Data carried by the message, defined by the model.
+  std::shared_ptr<void> data = nullptr;
+
+  /**
+   * Lower bound of the times of all later messages on the same channel. Set
+   * by the sender.
+   */
+  simtime promise = 0.0;
+
+  /// Whether the message only carries the promise (a null message).
+  bool null = false;
+
+  /**
+   * Whether the message cancels an earlier message with the same source and
+   * sequence (an anti-message). Only used by optimistic simulations.
+   */
+  bool anti = false;
+};
+
+/**
+ * Bounded lock-free queue with a single producer and a single consumer.
+ *
+ * Connects two logical processes running on different threads.
+ */
+class Channel {
+public:
+  /**
+   * Construct a channel.
+   *
+   * @param capacity Number of slots. Rounded up to a power of two.
+   */
+  explicit Channel(size_t capacity = 1024);
+
+  Channel(const Channel &) = delete;
+  Channel &operator=(const Channel &) = delete;
+
+  /**
+   * Append a message. Only called by the producer.
+   *
+   * @param message Message to append.
+   * @return Whether there was a free slot.
+   */
+  bool push(const Message &message);
+
+  /**
+   * Remove the oldest message. Only called by the consumer.
+   *
+   * @param message Set to the removed message.
+   * @return Whether there was a message.
+   */
+  bool pop(Message &message);
+
+private:
+  /// Size of a cache line. The indices are padded to separate cache lines,
+  /// so producer and consumer do not invalidate each other's cache.
+  static const size_t cache_line_size = 64;
+
+  std::vector<Message> slots;
+  size_t mask;
+  char padding1[cache_line_size];
+  /// Index of the next slot to read. Written by the consumer.
+  std::atomic<size_t> head;
+  char padding2[cache_line_size - sizeof(std::atomic<size_t>)];
+  /// Index of the next slot to write. Written by the producer.
+  std::atomic<size_t> tail;
+};
+
+/**
+ * Logical process of a parallel simulation.
+ *
+ * Owns a simulation which runs on its own thread and exchanges messages with
+ * other logical processes. Must only be used from its own thread while the
+ * parallel simulation runs.
+ */
+class LogicalProcess {
+public:
+  using Receiver = std::function<void(const Message &)>;
+
+  /**
+   * Construct a logical process. Use ParallelSimulation instead.
+   *
+   * @param id Index of the logical process.
+   * @param options Options of the simulation.
+   */
+  LogicalProcess(size_t id, const SimulationOptions &options);
+
+  /// @return Index of the logical process.
+  size_t get_id() const;
+
+  /// @return Simulation instance of the logical process.
+  SimulationPtr get_simulation() const;
+
+  /**
+   * Set the function which is called when a message is delivered.
+   *
+   * It is called at the time of the message, before any local event scheduled
+   * at the same time.
+   *
+   * @param receiver Function called with each delivered message.
+   */
+  void on_message(Receiver receiver);
+
+  /**
+   * Send a message to another logical process.
+   *
+   * @param target Index of the receiving logical process. Must be connected.
+   * @param delay Delay after which the message is delivered. Must be at least
+   * the lookahead of the connection.
+   * @param kind Kind of the message.
+   * @param value Value carried by the message.
+   * @param data Data carried by the message.
+   */
+  void send(size_t target, simtime delay, int64_t kind = 0, double value = 0.0,
+            std::shared_ptr<void> data = nullptr);
+
+  /// @return Number of null messages sent.
+  uint64_t get_n_null_messages() const;
+
+private:
+  friend class ParallelSimulation;
+
+  class Input {
+  public:
+    Channel *channel;
+    /// Lower bound of the times of messages still to be received.
+    simtime promise;
+  };
+
+  class Output {
+  public:
+    size_t target;
+    simtime lookahead;
+    Channel *channel;
+    /// Messages which did not fit into the channel yet.
+    std::deque<Message> outbox;
+    /// Last promise sent.
+    simtime promise;
+  };
+
+  class Later {
+  public:
+    bool operator()(const Message &a, const Message &b) const;
+  };
+
+  size_t id;
+  SimulationPtr sim;
+  Receiver receiver = nullptr;
+  std::vector<Input> inputs = {};
+  std::vector<Output> outputs = {};
+  /// Received messages which are not delivered yet.
+  std::priority_queue<Message, std::vector<Message>, Later> inbox = {};
+  uint64_t next_sequence = 0;
+  uint64_t n_null_messages = 0;
+
+  Output &output(size_t target);
+  bool receive();
+  void promise(simtime bound);
+  bool flush();
+  /**
+   * Run until a time. Keeps receiving messages until all logical processes
+   * flushed their messages, so no sender waits for a full channel forever.
+   *
+   * @param end Time to run until.
+   * @param failed Set if another logical process failed.
+   * @param n_running Number of logical processes which did not finish and
+   * flush yet. Decremented when this one did.
+   */
+  void run_until(simtime end, const std::atomic<bool> &failed,
+                 std::atomic<size_t> &n_running);
+};
+
+/**
+ * Parallel discrete-event simulation with a conservative protocol.
+ *
+ * The model is partitioned into logical processes, each with its own
+ * simulation running on its own thread. Logical processes exchange messages
+ * through connections with a lookahead, which is the minimum delay of the
+ * messages sent through them.
+ *
+ * Logical processes are synchronized with null messages (Chandy, Misra and
+ * Bryant): Each message carries a promise that no later message on the
+ * connection is earlier than the current time of the sender plus the
+ * lookahead. A logical process only processes events and messages before the
+ * smallest promise of its inputs, so it never receives a message from its
+ * past. Every cycle of connections must have a positive lookahead.
+ *
+ * Messages are delivered before local events at the same time, in the order of
+ * the sending logical process and then the order of sending. Therefore, the
+ * results are deterministic and do not depend on the scheduling of threads.
+ */
+class ParallelSimulation {
+public:
+  /**
+   * Construct a parallel simulation.
+   *
+   * @param n_processes Number of logical processes.
+   * @param options Options of the simulation of each logical process.
+   */
+  explicit ParallelSimulation(
+      size_t n_processes,
+      const SimulationOptions &options = SimulationOptions());
+
+  /**
+   * @param index Index of the logical process.
+   * @return Logical process.
+   */
+  LogicalProcess &get_process(size_t index);
+
+  /// @return Number of logical processes.
+  size_t get_n_processes() const;
+
+  /**
+   * Connect two logical processes, so the source can send messages to the
+   * target.
+   *
+   * @param source Index of the sending logical process.
+   * @param target Index of the receiving logical process.
+   * @param lookahead Minimum delay of messages. Must be positive.
+   */
+  void connect(size_t source, size_t target, simtime lookahead);
+
+  /**
+   * Run all logical processes until a time, each on its own thread. Blocks
+   * until all logical processes reach the time.
+   *
+   * Events and messages at exactly the time are not processed yet, so the
+   * simulation can be continued by calling this method again.
+   *
+   * @param end Time to run until.
+   */
+  void run_until(simtime end);
+
+private:
+  std::vector<std::unique_ptr<LogicalProcess>> processes = {};
+  std::vector<std::unique_ptr<Channel>> channels = {};
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_PDES_H_
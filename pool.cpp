@@ -0,0 +1,76 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "pool.h"
+
+namespace simcpp {
+
+const size_t Pool::granularity;
+const size_t Pool::max_block_size;
+const size_t Pool::slab_size;
+
+Pool::Pool() : free_lists(max_block_size / granularity, nullptr) {}
+
+Pool::~Pool() {
+  for (auto slab : slabs) {
+    ::operator delete(slab);
+  }
+}
+
+void *Pool::allocate(size_t size) {
+  ++n_allocated;
+
+  if (size > max_block_size) {
+    return ::operator new(size);
+  }
+
+  size_t size_class = size == 0 ? 0 : (size - 1) / granularity;
+  auto &free_list = free_lists[size_class];
+  if (free_list != nullptr) {
+    auto block = free_list;
+    free_list = block->next;
+    return block;
+  }
+
+  size_t block_size = (size_class + 1) * granularity;
+  if (slab_remaining < block_size) {
+    // The rest of the current slab is too small and is wasted.
+    slab_cursor = static_cast<char *>(::operator new(slab_size));
+    slab_remaining = slab_size;
+    slabs.push_back(slab_cursor);
+  }
+
+  void *block = slab_cursor;
+  slab_cursor += block_size;
+  slab_remaining -= block_size;
+  return block;
+}
+
+void Pool::deallocate(void *pointer, size_t size) {
+  --n_allocated;
+
+  if (size > max_block_size) {
+    ::operator delete(pointer);
+  } else {
+    size_t size_class = size == 0 ? 0 : (size - 1) / granularity;
+    auto block = static_cast<FreeBlock *>(pointer);
+    block->next = free_lists[size_class];
+    free_lists[size_class] = block;
+  }
+
+  if (released && n_allocated == 0) {
+    delete this;
+  }
+}
+
+size_t Pool::get_n_allocated() { return n_allocated; }
+
+void Pool::release() {
+  released = true;
+
+  if (n_allocated == 0) {
+    delete this;
+  }
+}
+
+} // namespace simcpp
@@ -0,0 +1,158 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_POOL_H_
+#define SIMCPP_POOL_H_
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace simcpp {
+
+/**
+ * Memory pool for small objects.
+ *
+ * Blocks are carved from large slabs and recycled through one free list per
+ * size class, so allocating and freeing a block is a few pointer operations.
+ * Memory is only returned to the system when the pool is destroyed. Requests
+ * larger than the largest size class are forwarded to operator new.
+ *
+ * A pool is not thread-safe.
+ *
+ * A pool created with new can be released instead of deleted. It then deletes
+ * itself once the last block is freed, so objects may outlive the owner of
+ * the pool.
+ */
+class Pool {
+public:
+  /// Size classes are multiples of this size. Also the alignment of blocks.
+  static const size_t granularity = 16;
+
+  /// Largest size class.
+  static const size_t max_block_size = 512;
+
+  /// Size of a slab.
+  static const size_t slab_size = 64 * 1024;
+
+  Pool();
+
+  Pool(const Pool &) = delete;
+  Pool &operator=(const Pool &) = delete;
+
+  ~Pool();
+
+  /**
+   * Allocate a block.
+   *
+   * @param size Size of the block in bytes.
+   * @return Pointer to the block.
+   */
+  void *allocate(size_t size);
+
+  /**
+   * Free a block.
+   *
+   * @param pointer Pointer to the block.
+   * @param size Size of the block in bytes, as passed to allocate.
+   */
+  void deallocate(void *pointer, size_t size);
+
+  /// @return Number of blocks which are currently allocated.
+  size_t get_n_allocated();
+
+  /**
+   * Delete the pool once no blocks are allocated anymore. The pool must have
+   * been created with new.
+   */
+  void release();
+
+private:
+  class FreeBlock {
+  public:
+    FreeBlock *next;
+  };
+
+  std::vector<FreeBlock *> free_lists;
+  std::vector<char *> slabs = {};
+  char *slab_cursor = nullptr;
+  size_t slab_remaining = 0;
+  size_t n_allocated = 0;
+  bool released = false;
+};
+
+/**
+ * Standard allocator which allocates from a pool.
+ *
+ * The allocator does not own the pool. A released pool stays alive as long as
+ * blocks are allocated from it, which includes the control blocks of objects
+ * created with std::allocate_shared.
+ *
+ * @tparam T Type of the allocated objects.
+ */
+template <typename T> class PoolAllocator {
+public:
+  using value_type = T;
+
+  template <typename U> struct rebind { using other = PoolAllocator<U>; };
+
+  /**
+   * Construct an allocator.
+   *
+   * @param pool Pool to allocate from.
+   */
+  explicit PoolAllocator(Pool *pool) : pool(pool) {}
+
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U> &other) : pool(other.pool) {}
+
+  /// Types aligned more strictly than the blocks of the pool are allocated
+  /// with operator new instead, aligned to their alignment since C++17.
+  T *allocate(size_t n) {
+    if (alignof(T) > Pool::granularity) {
+#ifdef __cpp_aligned_new
+      return static_cast<T *>(
+          ::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+#else
+      return static_cast<T *>(::operator new(n * sizeof(T)));
+#endif
+    }
+    return static_cast<T *>(pool->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T *pointer, size_t n) {
+    if (alignof(T) > Pool::granularity) {
+#ifdef __cpp_aligned_new
+      ::operator delete(pointer, std::align_val_t(alignof(T)));
+#else
+      ::operator delete(pointer);
+#endif
+      return;
+    }
+    pool->deallocate(pointer, n * sizeof(T));
+  }
+
+  template <typename U> bool operator==(const PoolAllocator<U> &other) const {
+    return pool == other.pool;
+  }
+
+  template <typename U> bool operator!=(const PoolAllocator<U> &other) const {
+    return pool != other.pool;
+  }
+
+private:
+  template <typename U> friend class PoolAllocator;
+
+#ifndef __cpp_aligned_new
+  // Before C++17, operator new only aligns to std::max_align_t.
+  static_assert(alignof(T) <= alignof(std::max_align_t),
+                "over-aligned types need C++17");
+#endif
+
+  Pool *pool;
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_POOL_H_
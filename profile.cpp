@@ -0,0 +1,208 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "profile.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+namespace simcpp {
+
+namespace {
+
+thread_local Profiler *active_profiler = nullptr;
+
+/**
+ * @param type Type.
+ * @return Readable name of the type.
+ */
+std::string type_name(const std::type_info &type) {
+#if defined(__GNUG__)
+  int status = 0;
+  char *name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+  if (status == 0 && name != nullptr) {
+    std::string result(name);
+    std::free(name);
+    return result;
+  }
+#endif
+  return type.name();
+}
+
+/// Write a string as a JSON string literal.
+void write_string(std::ostream &stream, const std::string &string) {
+  stream << '"';
+  for (char c : string) {
+    if (c == '"' || c == '\\') {
+      stream << '\\';
+    }
+    stream << c;
+  }
+  stream << '"';
+}
+
+} // namespace
+
+/* Profiler */
+
+Profiler::Profiler(const ProfilerOptions &options /* = ProfilerOptions() */)
+    : options(options), origin(Clock::now()) {}
+
+Profiler *Profiler::get_active() { return active_profiler; }
+
+void Profiler::set_active(Profiler *profiler) { active_profiler = profiler; }
+
+void Profiler::on_allocate(const std::type_info &type) {
+  ++stats(type).n_allocated;
+}
+
+void Profiler::on_schedule(size_t queue_size) {
+  ++n_scheduled;
+  max_queue_size = std::max(max_queue_size, queue_size);
+}
+
+void Profiler::on_step(double time, size_t queue_size) {
+  now = time;
+  if (n_steps % options.queue_sample_interval == 0) {
+    QueueSample sample;
+    sample.time = time;
+    sample.size = queue_size;
+    queue_samples.push_back(sample);
+  }
+  ++n_steps;
+}
+
+void Profiler::on_process(const std::type_info &type, size_t n_handlers) {
+  ++n_processed;
+  ++stats(type).n_processed;
+  if (handler_counts.size() <= n_handlers) {
+    handler_counts.resize(n_handlers + 1, 0);
+  }
+  ++handler_counts[n_handlers];
+}
+
+void Profiler::on_abort(const std::type_info &type) {
+  ++n_aborted;
+  ++stats(type).n_aborted;
+}
+
+void Profiler::on_resume(const std::type_info &type, Clock::time_point start) {
+  auto end = Clock::now();
+  auto &stats = this->stats(type);
+  ++stats.n_resumes;
+  stats.resume_seconds += std::chrono::duration<double>(end - start).count();
+
+  if (options.trace && trace.size() < options.max_trace_events) {
+    TraceEvent event;
+    event.type = &type;
+    event.start =
+        std::chrono::duration<double, std::micro>(start - origin).count();
+    event.duration =
+        std::chrono::duration<double, std::micro>(end - start).count();
+    event.time = now;
+    trace.push_back(event);
+  }
+}
+
+uint64_t Profiler::get_n_scheduled() const { return n_scheduled; }
+
+uint64_t Profiler::get_n_processed() const { return n_processed; }
+
+uint64_t Profiler::get_n_aborted() const { return n_aborted; }
+
+size_t Profiler::get_max_queue_size() const { return max_queue_size; }
+
+const std::vector<Profiler::QueueSample> &
+Profiler::get_queue_samples() const {
+  return queue_samples;
+}
+
+const std::vector<uint64_t> &Profiler::get_handler_counts() const {
+  return handler_counts;
+}
+
+Profiler::TypeStats Profiler::get_type_stats(const std::type_info &type) const {
+  auto it = types.find(std::type_index(type));
+  if (it == types.end()) {
+    TypeStats stats;
+    stats.name = type_name(type);
+    return stats;
+  }
+
+  return it->second;
+}
+
+void Profiler::write_summary(std::ostream &stream) const {
+  stream << "{\"events\":{\"scheduled\":" << n_scheduled
+         << ",\"processed\":" << n_processed << ",\"aborted\":" << n_aborted
+         << "},\"queue\":{\"max_size\":" << max_queue_size
+         << ",\"samples\":[";
+  for (size_t i = 0; i < queue_samples.size(); ++i) {
+    stream << (i == 0 ? "" : ",") << "[" << queue_samples[i].time << ","
+           << queue_samples[i].size << "]";
+  }
+  stream << "]},\"handlers\":[";
+  for (size_t i = 0; i < handler_counts.size(); ++i) {
+    stream << (i == 0 ? "" : ",") << handler_counts[i];
+  }
+  stream << "],\"types\":{";
+
+  // Sorted by name, so the output is stable.
+  std::map<std::string, const TypeStats *> sorted;
+  for (auto &entry : types) {
+    sorted[entry.second.name] = &entry.second;
+  }
+  bool first = true;
+  for (auto &entry : sorted) {
+    auto &stats = *entry.second;
+    stream << (first ? "" : ",");
+    write_string(stream, stats.name);
+    stream << ":{\"allocated\":" << stats.n_allocated
+           << ",\"processed\":" << stats.n_processed
+           << ",\"aborted\":" << stats.n_aborted
+           << ",\"resumes\":" << stats.n_resumes
+           << ",\"resume_seconds\":" << stats.resume_seconds << "}";
+    first = false;
+  }
+  stream << "}}\n";
+}
+
+void Profiler::write_trace(std::ostream &stream) const {
+  // Resumptions are placed on the wall time axis, the size of the queue on the
+  // simulation time axis, one time unit per second.
+  stream << "{\"traceEvents\":[{\"name\":\"process_name\",\"ph\":\"M\","
+            "\"pid\":0,\"args\":{\"name\":\"wall time\"}},\n"
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"args\":{\"name\":\"simulation time\"}}";
+  for (auto &event : trace) {
+    stream << ",\n{\"name\":";
+    write_string(stream, types.at(std::type_index(*event.type)).name);
+    stream << ",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":" << event.start
+           << ",\"dur\":" << event.duration
+           << ",\"args\":{\"time\":" << event.time << "}}";
+  }
+  for (auto &sample : queue_samples) {
+    stream << ",\n{\"name\":\"queue\",\"ph\":\"C\",\"pid\":1,\"ts\":"
+           << sample.time * 1e6 << ",\"args\":{\"size\":" << sample.size
+           << "}}";
+  }
+  stream << "]}\n";
+}
+
+Profiler::TypeStats &Profiler::stats(const std::type_info &type) {
+  auto it = types.find(std::type_index(type));
+  if (it == types.end()) {
+    TypeStats stats;
+    stats.name = type_name(type);
+    it = types.emplace(std::type_index(type), std::move(stats)).first;
+  }
+
+  return it->second;
+}
+
+} // namespace simcpp
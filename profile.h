@@ -0,0 +1,240 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_PROFILE_H_
+#define SIMCPP_PROFILE_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Call a hook of the active profiler, if any.
+ *
+ * Expands to nothing unless SIMCPP_PROFILE is defined. SIMCPP_PROFILE must be
+ * defined for the whole program, as it changes inline code in the headers.
+ *
+ * @param hook Call of a method of Profiler.
+ */
+#ifdef SIMCPP_PROFILE
+#define SIMCPP_PROFILE_HOOK(hook)                                              \
+  do {                                                                         \
+    if (::simcpp::Profiler *active_profiler =                                  \
+            ::simcpp::Profiler::get_active()) {                                \
+      active_profiler->hook;                                                   \
+    }                                                                          \
+  } while (0)
+#else
+#define SIMCPP_PROFILE_HOOK(hook)                                              \
+  do {                                                                         \
+  } while (0)
+#endif
+
+namespace simcpp {
+
+/// Options of a profiler.
+struct ProfilerOptions {
+  /// Whether to record a timeline of process resumptions for write_trace.
+  bool trace = false;
+
+  /// Number of processed events between two samples of the queue size.
+  size_t queue_sample_interval = 1024;
+
+  /// Maximum number of timeline entries. Later entries are dropped.
+  size_t max_trace_events = 1000000;
+};
+
+/**
+ * Instrumentation of the event loop.
+ *
+ * Counts scheduled, processed and aborted events, samples the size of the
+ * event queue, counts the handlers of processed events and measures the wall
+ * time spent in each Process subclass. Events and processes are counted per
+ * dynamic type.
+ *
+ * The hooks are only compiled in if SIMCPP_PROFILE is defined. Then, the
+ * simulations used on a thread report to the profiler active on that thread:
+ *
+ * ```
+ * simcpp::Profiler profiler;
+ * simcpp::Profiler::set_active(&profiler);
+ * sim->run();
+ * simcpp::Profiler::set_active(nullptr);
+ * profiler.write_summary(std::cout);
+ * ```
+ */
+class Profiler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// Statistics of one type of events or processes.
+  class TypeStats {
+  public:
+    /// Readable name of the type.
+    std::string name = {};
+
+    /// Number of constructed instances.
+    uint64_t n_allocated = 0;
+
+    /// Number of processed instances.
+    uint64_t n_processed = 0;
+
+    /// Number of aborted instances.
+    uint64_t n_aborted = 0;
+
+    /// Number of resumptions of processes.
+    uint64_t n_resumes = 0;
+
+    /// Wall time spent resuming processes in seconds.
+    double resume_seconds = 0.0;
+  };
+
+  /// Sample of the size of the event queue.
+  class QueueSample {
+  public:
+    /// Simulation time of the sample.
+    double time;
+
+    /// Number of scheduled events.
+    size_t size;
+  };
+
+  /**
+   * Construct a profiler.
+   *
+   * @param options Options of the profiler.
+   */
+  explicit Profiler(const ProfilerOptions &options = ProfilerOptions());
+
+  /// @return Profiler which is active on this thread, or nullptr.
+  static Profiler *get_active();
+
+  /**
+   * Make a profiler active on this thread.
+   *
+   * @param profiler Profiler to activate, or nullptr to deactivate.
+   */
+  static void set_active(Profiler *profiler);
+
+  /**
+   * Called when an event or process is constructed by a simulation.
+   *
+   * @param type Type of the event.
+   */
+  void on_allocate(const std::type_info &type);
+
+  /**
+   * Called after an event was scheduled.
+   *
+   * @param queue_size Number of scheduled events.
+   */
+  void on_schedule(size_t queue_size);
+
+  /**
+   * Called before a scheduled event is processed.
+   *
+   * @param time Simulation time of the event.
+   * @param queue_size Number of events left in the queue.
+   */
+  void on_step(double time, size_t queue_size);
+
+  /**
+   * Called when an event is processed.
+   *
+   * @param type Type of the event.
+   * @param n_handlers Number of handlers called.
+   */
+  void on_process(const std::type_info &type, size_t n_handlers);
+
+  /**
+   * Called when an event is aborted.
+   *
+   * @param type Type of the event.
+   */
+  void on_abort(const std::type_info &type);
+
+  /**
+   * Called after a process was resumed.
+   *
+   * @param type Type of the process.
+   * @param start Time at which the process was resumed.
+   */
+  void on_resume(const std::type_info &type, Clock::time_point start);
+
+  /// @return Number of scheduled events.
+  uint64_t get_n_scheduled() const;
+
+  /// @return Number of processed events.
+  uint64_t get_n_processed() const;
+
+  /// @return Number of aborted events.
+  uint64_t get_n_aborted() const;
+
+  /// @return Largest number of scheduled events at once.
+  size_t get_max_queue_size() const;
+
+  /// @return Samples of the size of the event queue.
+  const std::vector<QueueSample> &get_queue_samples() const;
+
+  /// @return Number of processed events by their number of handlers.
+  const std::vector<uint64_t> &get_handler_counts() const;
+
+  /**
+   * @param type Type of events or processes.
+   * @return Statistics of the type.
+   */
+  TypeStats get_type_stats(const std::type_info &type) const;
+
+  /**
+   * Write all statistics as a JSON object.
+   *
+   * @param stream Stream to write to.
+   */
+  void write_summary(std::ostream &stream) const;
+
+  /**
+   * Write the recorded timeline in the Chrome trace event format, which can
+   * be opened with chrome://tracing or Perfetto. Process resumptions are
+   * slices named by type, the size of the event queue is a counter.
+   *
+   * @param stream Stream to write to.
+   */
+  void write_trace(std::ostream &stream) const;
+
+private:
+  class TraceEvent {
+  public:
+    const std::type_info *type;
+    /// Wall time since the construction of the profiler in microseconds.
+    double start;
+    double duration;
+    /// Simulation time.
+    double time;
+  };
+
+  ProfilerOptions options;
+  Clock::time_point origin;
+  double now = 0.0;
+  uint64_t n_scheduled = 0;
+  uint64_t n_processed = 0;
+  uint64_t n_aborted = 0;
+  uint64_t n_steps = 0;
+  size_t max_queue_size = 0;
+  std::vector<QueueSample> queue_samples = {};
+  std::vector<uint64_t> handler_counts = {};
+  std::unordered_map<std::type_index, TypeStats> types = {};
+  std::vector<TraceEvent> trace = {};
+
+  TypeStats &stats(const std::type_info &type);
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_PROFILE_H_
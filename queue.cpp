@@ -0,0 +1,886 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "queue.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+namespace simcpp {
+
+namespace {
+
+/// Buckets of a ladder queue with more entries are spread over a new rung.
+const size_t ladder_threshold = 50;
+const size_t ladder_max_rungs = 8;
+const size_t ladder_max_buckets = 1 << 16;
+
+/// @return Index of the highest set bit. At least one bit must be set.
+unsigned highest_bit(uint64_t bits) {
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll(bits);
+#else
+  unsigned index = 0;
+  while (bits >>= 1) {
+    ++index;
+  }
+  return index;
+#endif
+}
+
+/// @return Index of the lowest set bit. At least one bit must be set.
+unsigned lowest_bit(uint64_t bits) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(bits);
+#else
+  unsigned index = 0;
+  while ((bits & 1) == 0) {
+    bits >>= 1;
+    ++index;
+  }
+  return index;
+#endif
+}
+
+} // namespace
+
+/* QueuedEvent */
+
+QueuedEvent::QueuedEvent(simtime time, size_t id, EventPtr event)
+    : time(time), id(id), event(event) {}
+
+bool QueuedEvent::operator<(const QueuedEvent &other) const {
+  if (time != other.time) {
+    return time > other.time;
+  }
+
+  return id > other.id;
+}
+
+/* EventQueue */
+
+EventQueue::~EventQueue() {}
+
+void EventQueue::remove_if(
+    const std::function<bool(const QueuedEvent &)> &predicate) {
+  std::vector<QueuedEvent> entries;
+  entries.reserve(size());
+  while (!empty()) {
+    auto entry = pop();
+    if (!predicate(entry)) {
+      entries.push_back(std::move(entry));
+    }
+  }
+
+  for (auto &entry : entries) {
+    push(std::move(entry));
+  }
+}
+
+EventQueuePtr make_queue(QueueType type) {
+  switch (type) {
+  case QueueType::QuaternaryHeap:
+    return EventQueuePtr(new DaryHeapQueue<4>());
+  case QueueType::Calendar:
+    return EventQueuePtr(new CalendarQueue());
+  case QueueType::Ladder:
+    return EventQueuePtr(new LadderQueue());
+  case QueueType::SplitHeap:
+    return EventQueuePtr(new SplitHeapQueue());
+  case QueueType::BinaryHeap:
+  default:
+    return EventQueuePtr(new BinaryHeapQueue());
+  }
+}
+
+/* BinaryHeapQueue */
+
+void BinaryHeapQueue::push(QueuedEvent entry) {
+  heap.push_back(std::move(entry));
+  std::push_heap(heap.begin(), heap.end());
+}
+
+const QueuedEvent &BinaryHeapQueue::top() { return heap.front(); }
+
+QueuedEvent BinaryHeapQueue::pop() {
+  std::pop_heap(heap.begin(), heap.end());
+  QueuedEvent entry = std::move(heap.back());
+  heap.pop_back();
+  return entry;
+}
+
+bool BinaryHeapQueue::empty() const { return heap.empty(); }
+
+size_t BinaryHeapQueue::size() const { return heap.size(); }
+
+void BinaryHeapQueue::remove_if(
+    const std::function<bool(const QueuedEvent &)> &predicate) {
+  heap.erase(std::remove_if(heap.begin(), heap.end(), predicate), heap.end());
+  std::make_heap(heap.begin(), heap.end());
+}
+
+/* SplitHeapQueue */
+
+void SplitHeapQueue::push(QueuedEvent entry) {
+  if (!has_root) {
+    root = std::move(entry);
+    has_root = true;
+    return;
+  }
+
+  if (simcpp::before(entry, root)) {
+    std::swap(entry, root);
+  }
+  if (n_nodes == capacity) {
+    grow();
+  }
+  if (entry.id > UINT32_MAX && !wide_ids) {
+    // All ids so far fit in 32 bits, so their high bits are zero.
+    wide_ids = true;
+    high_ids.assign(slots.size(), 0);
+  }
+  Node node = {entry.time, 0, static_cast<uint32_t>(entry.id)};
+  node.handle = store(std::move(entry));
+  ++n_nodes;
+  sift_up(n_nodes - 1, node);
+}
+
+const QueuedEvent &SplitHeapQueue::top() { return root; }
+
+QueuedEvent SplitHeapQueue::pop() {
+  QueuedEvent entry = std::move(root);
+  take_root();
+  return entry;
+}
+
+bool SplitHeapQueue::empty() const { return !has_root; }
+
+size_t SplitHeapQueue::size() const { return has_root ? n_nodes + 1 : 0; }
+
+void SplitHeapQueue::remove_if(
+    const std::function<bool(const QueuedEvent &)> &predicate) {
+  size_t n = 0;
+  for (size_t index = 0; index < n_nodes; ++index) {
+    // The event is moved into a whole entry for the predicate and back.
+    Node node = nodes[index];
+    auto &slot = slots[node.handle];
+    QueuedEvent entry(node.time, get_id(node), std::move(slot));
+    if (predicate(entry)) {
+      free_slots.push_back(node.handle);
+    } else {
+      slot = std::move(entry.event);
+      nodes[n] = node;
+      ++n;
+    }
+  }
+  n_nodes = n;
+
+  if (n > 1) {
+    // Sift down all inner nodes, starting with the parent of the last node.
+    for (size_t index = (n - 2) / arity + 1; index > 0; --index) {
+      sift_down(index - 1, nodes[index - 1]);
+    }
+  }
+
+  if (has_root && predicate(root)) {
+    take_root();
+  }
+}
+
+void SplitHeapQueue::grow() {
+  size_t capacity = this->capacity > 0 ? 2 * this->capacity : 64;
+  std::unique_ptr<char[]> buffer(
+      new char[capacity * sizeof(Node) + cache_line_size]);
+
+  // Align the second node, the first child of the first node, to a cache
+  // line.
+  auto first_child = reinterpret_cast<uintptr_t>(buffer.get()) + sizeof(Node);
+  first_child = (first_child + cache_line_size - 1) & ~(cache_line_size - 1);
+  auto nodes = reinterpret_cast<Node *>(first_child - sizeof(Node));
+
+  if (n_nodes > 0) {
+    std::copy(this->nodes, this->nodes + n_nodes, nodes);
+  }
+  this->buffer = std::move(buffer);
+  this->nodes = nodes;
+  this->capacity = capacity;
+}
+
+uint32_t SplitHeapQueue::store(QueuedEvent entry) {
+  uint32_t handle;
+  if (!free_slots.empty()) {
+    handle = free_slots.back();
+    free_slots.pop_back();
+  } else {
+    handle = static_cast<uint32_t>(slots.size());
+    slots.emplace_back();
+  }
+
+  slots[handle] = std::move(entry.event);
+  if (wide_ids) {
+    if (high_ids.size() < slots.size()) {
+      high_ids.resize(slots.size());
+    }
+    high_ids[handle] = static_cast<uint32_t>(
+        static_cast<uint64_t>(entry.id) >> 32);
+  }
+  return handle;
+}
+
+void SplitHeapQueue::take_root() {
+  if (n_nodes == 0) {
+    root.event = nullptr;
+    has_root = false;
+    return;
+  }
+
+  root.time = nodes[0].time;
+  root.id = get_id(nodes[0]);
+  root.event = std::move(slots[nodes[0].handle]);
+  free_slots.push_back(nodes[0].handle);
+
+  --n_nodes;
+  if (n_nodes > 0) {
+    sift_down(0, nodes[n_nodes]);
+  } else {
+    wide_ids = false;
+    high_ids.clear();
+  }
+}
+
+void SplitHeapQueue::sift_up(size_t index, Node node) {
+  while (index > 0) {
+    size_t parent = (index - 1) / arity;
+    if (!before(node, nodes[parent])) {
+      break;
+    }
+    nodes[index] = nodes[parent];
+    index = parent;
+  }
+  nodes[index] = node;
+}
+
+void SplitHeapQueue::sift_down(size_t index, Node node) {
+  while (true) {
+    size_t first = index * arity + 1;
+    if (first >= n_nodes) {
+      break;
+    }
+
+    size_t last = first + arity < n_nodes ? first + arity : n_nodes;
+    size_t best = first;
+    for (size_t child = first + 1; child < last; ++child) {
+      if (before(nodes[child], nodes[best])) {
+        best = child;
+      }
+    }
+
+    if (!before(nodes[best], node)) {
+      break;
+    }
+    nodes[index] = nodes[best];
+    index = best;
+  }
+  nodes[index] = node;
+}
+
+/* SortedEntries */
+
+bool SortedEntries::empty() const { return head == entries.size(); }
+
+size_t SortedEntries::size() const { return entries.size() - head; }
+
+const QueuedEvent &SortedEntries::front() const { return entries[head]; }
+
+const QueuedEvent &SortedEntries::back() const { return entries.back(); }
+
+QueuedEvent SortedEntries::pop_front() {
+  QueuedEvent entry = std::move(entries[head]);
+  ++head;
+
+  if (head == entries.size()) {
+    entries.clear();
+    head = 0;
+  } else if (head >= 64 && 2 * head >= entries.size()) {
+    entries.erase(entries.begin(), entries.begin() + head);
+    head = 0;
+  }
+
+  return entry;
+}
+
+void SortedEntries::insert(QueuedEvent entry) {
+  auto position = entries.end();
+  auto first = entries.begin() + head;
+  while (position != first && before(entry, *(position - 1))) {
+    --position;
+  }
+
+  if (position == first && head > 0) {
+    --head;
+    entries[head] = std::move(entry);
+  } else {
+    entries.insert(position, std::move(entry));
+  }
+}
+
+void SortedEntries::assign(std::vector<QueuedEvent> entries) {
+  std::sort(entries.begin(), entries.end(), before);
+  this->entries.swap(entries);
+  head = 0;
+}
+
+std::vector<QueuedEvent> SortedEntries::take() {
+  std::vector<QueuedEvent> result;
+  if (head == 0) {
+    result.swap(entries);
+  } else {
+    result.assign(std::make_move_iterator(entries.begin() + head),
+                  std::make_move_iterator(entries.end()));
+    entries.clear();
+  }
+  head = 0;
+  return result;
+}
+
+/* CalendarQueue */
+
+CalendarQueue::CalendarQueue() : buckets(2) {}
+
+void CalendarQueue::push(QueuedEvent entry) {
+  double virtual_bucket = this->virtual_bucket(entry.time);
+  if (virtual_bucket < current) {
+    current = virtual_bucket;
+  }
+
+  if (found && before(entry, buckets[next].front())) {
+    found = false;
+  }
+
+  insert(std::move(entry));
+  ++n_entries;
+
+  if (n_entries > 2 * buckets.size()) {
+    resize(2 * buckets.size());
+  }
+}
+
+const QueuedEvent &CalendarQueue::top() {
+  if (!found) {
+    find_next();
+  }
+
+  return buckets[next].front();
+}
+
+QueuedEvent CalendarQueue::pop() {
+  if (!found) {
+    find_next();
+  }
+
+  QueuedEvent entry = buckets[next].pop_front();
+  --n_entries;
+  found = false;
+
+  if (buckets.size() > 2 && n_entries < buckets.size() / 2) {
+    resize(buckets.size() / 2);
+  }
+
+  return entry;
+}
+
+bool CalendarQueue::empty() const { return n_entries == 0; }
+
+size_t CalendarQueue::size() const { return n_entries; }
+
+double CalendarQueue::virtual_bucket(simtime time) const {
+  return std::floor(time / width);
+}
+
+size_t CalendarQueue::bucket_index(double virtual_bucket) const {
+  double n_buckets = static_cast<double>(buckets.size());
+  double index = std::fmod(virtual_bucket, n_buckets);
+  if (index < 0) {
+    index += n_buckets;
+  }
+  return static_cast<size_t>(index);
+}
+
+void CalendarQueue::insert(QueuedEvent entry) {
+  buckets[bucket_index(virtual_bucket(entry.time))].insert(std::move(entry));
+}
+
+void CalendarQueue::find_next() {
+  // Virtual buckets are monotonic in time, so the first bucket (in calendar
+  // order) whose earliest entry belongs to the current year holds the next
+  // entry.
+  double virtual_bucket = current;
+  for (size_t i = 0; i < buckets.size(); ++i, virtual_bucket += 1.0) {
+    size_t index = bucket_index(virtual_bucket);
+    auto &bucket = buckets[index];
+    if (!bucket.empty() &&
+        this->virtual_bucket(bucket.front().time) == virtual_bucket) {
+      current = virtual_bucket;
+      next = index;
+      found = true;
+      return;
+    }
+  }
+
+  // All entries are at least a year away, so search directly.
+  const QueuedEvent *best = nullptr;
+  for (size_t index = 0; index < buckets.size(); ++index) {
+    auto &bucket = buckets[index];
+    if (!bucket.empty() &&
+        (best == nullptr || before(bucket.front(), *best))) {
+      best = &bucket.front();
+      next = index;
+    }
+  }
+
+  current = this->virtual_bucket(best->time);
+  found = true;
+}
+
+void CalendarQueue::resize(size_t n_buckets) {
+  std::vector<QueuedEvent> entries;
+  entries.reserve(n_entries);
+  for (auto &bucket : buckets) {
+    for (auto &entry : bucket.take()) {
+      entries.push_back(std::move(entry));
+    }
+  }
+
+  // Estimate the bucket width from the average separation of the earliest
+  // entries, as proposed by Brown.
+  size_t n_sample = std::min<size_t>(entries.size(), 25);
+  if (n_sample > 0) {
+    std::partial_sort(entries.begin(), entries.begin() + n_sample,
+                      entries.end(), before);
+  }
+  if (n_sample > 1) {
+    simtime separation = (entries[n_sample - 1].time - entries[0].time) /
+                         static_cast<double>(n_sample - 1);
+    if (separation > 0) {
+      width = 3.0 * separation;
+    }
+  }
+
+  buckets.clear();
+  buckets.resize(n_buckets);
+  found = false;
+  if (n_sample > 0) {
+    current = virtual_bucket(entries[0].time);
+  }
+
+  for (auto &entry : entries) {
+    insert(std::move(entry));
+  }
+}
+
+/* LadderQueue */
+
+LadderQueue::Rung::Rung(simtime start, simtime width, size_t n_buckets)
+    : start(start), width(width), buckets(n_buckets) {}
+
+double LadderQueue::Rung::bucket(simtime time) const {
+  double index = std::floor((time - start) / width);
+  if (index < 0) {
+    return -1;
+  }
+
+  double last = static_cast<double>(buckets.size() - 1);
+  return index < last ? index : last;
+}
+
+LadderQueue::LadderQueue()
+    : top_start(-std::numeric_limits<simtime>::infinity()) {}
+
+void LadderQueue::push(QueuedEvent entry) {
+  ++n_entries;
+
+  // Entries at the start of the top may already be in the rungs or the
+  // bottom, so later entries at that time are sorted among them.
+  if (entry.time > top_start) {
+    if (top_list.empty()) {
+      top_min = top_max = entry.time;
+    } else {
+      top_min = std::min(top_min, entry.time);
+      top_max = std::max(top_max, entry.time);
+    }
+    top_list.push_back(std::move(entry));
+    return;
+  }
+
+  // Rungs are ordered from coarse to fine. Buckets before the current bucket
+  // of a rung were already moved to a finer rung or the bottom.
+  for (auto &rung : rungs) {
+    double index = rung.bucket(entry.time);
+    if (index >= static_cast<double>(rung.current)) {
+      rung.buckets[static_cast<size_t>(index)].push_back(std::move(entry));
+      return;
+    }
+  }
+
+  insert_bottom(std::move(entry));
+}
+
+const QueuedEvent &LadderQueue::top() {
+  fill_bottom();
+  return bottom.front();
+}
+
+QueuedEvent LadderQueue::pop() {
+  fill_bottom();
+  QueuedEvent entry = bottom.pop_front();
+  --n_entries;
+
+  if (n_entries == 0) {
+    top_start = -std::numeric_limits<simtime>::infinity();
+    rungs.clear();
+  }
+
+  return entry;
+}
+
+bool LadderQueue::empty() const { return n_entries == 0; }
+
+size_t LadderQueue::size() const { return n_entries; }
+
+void LadderQueue::insert_bottom(QueuedEvent entry) {
+  bottom.insert(std::move(entry));
+
+  if (bottom.size() > ladder_threshold && rungs.size() < ladder_max_rungs &&
+      bottom.front().time != bottom.back().time) {
+    simtime min = bottom.front().time;
+    simtime max = bottom.back().time;
+    auto entries = bottom.take();
+    spread(entries, min, max);
+  }
+}
+
+void LadderQueue::fill_bottom() {
+  while (bottom.empty()) {
+    std::vector<QueuedEvent> entries;
+    simtime min;
+    simtime max;
+
+    if (rungs.empty()) {
+      if (top_list.empty()) {
+        return;
+      }
+
+      entries.swap(top_list);
+      min = top_min;
+      max = top_max;
+      top_start = top_max;
+    } else {
+      auto &rung = rungs.back();
+      while (rung.current < rung.buckets.size() &&
+             rung.buckets[rung.current].empty()) {
+        ++rung.current;
+      }
+
+      if (rung.current == rung.buckets.size()) {
+        rungs.pop_back();
+        continue;
+      }
+
+      entries.swap(rung.buckets[rung.current]);
+      ++rung.current;
+      min = max = entries.front().time;
+      for (auto &entry : entries) {
+        min = std::min(min, entry.time);
+        max = std::max(max, entry.time);
+      }
+    }
+
+    if (entries.size() <= ladder_threshold || min == max ||
+        rungs.size() >= ladder_max_rungs) {
+      bottom.assign(std::move(entries));
+    } else {
+      spread(entries, min, max);
+    }
+  }
+}
+
+void LadderQueue::spread(std::vector<QueuedEvent> &entries, simtime min,
+                         simtime max) {
+  size_t n_buckets = std::min(entries.size(), ladder_max_buckets);
+  simtime width = (max - min) / static_cast<double>(n_buckets);
+  if (!(width > 0)) {
+    bottom.assign(std::move(entries));
+    return;
+  }
+
+  Rung rung(min, width, n_buckets);
+  for (auto &entry : entries) {
+    auto index = static_cast<size_t>(rung.bucket(entry.time));
+    rung.buckets[index].push_back(std::move(entry));
+  }
+  rungs.push_back(std::move(rung));
+}
+
+/* TimingWheelQueue */
+
+TimingWheelQueue::TimingWheelQueue(EventQueuePtr queue, simtime resolution,
+                                   simtime horizon,
+                                   Discard discard /* = nullptr */)
+    : queue(std::move(queue)), per_tick(1.0 / resolution), n_levels(1),
+      discard(std::move(discard)) {
+  double span = static_cast<double>(n_slots) * resolution;
+  while (span < horizon && n_levels < max_levels) {
+    span *= n_slots;
+    ++n_levels;
+  }
+  slots.resize(n_levels * n_slots);
+}
+
+void TimingWheelQueue::push(QueuedEvent entry) {
+  if (!insert(entry)) {
+    queue->push(std::move(entry));
+  }
+}
+
+const QueuedEvent &TimingWheelQueue::top() {
+  // Entries of earlier slots than the wheel are processed before all entries
+  // in the wheel.
+  while (n_entries > 0 &&
+         (queue->empty() || queue->top().time * per_tick >= now_tick)) {
+    advance();
+  }
+
+  return queue->top();
+}
+
+QueuedEvent TimingWheelQueue::pop() {
+  top();
+  return queue->pop();
+}
+
+bool TimingWheelQueue::empty() const {
+  return n_entries == 0 && queue->empty();
+}
+
+size_t TimingWheelQueue::size() const { return n_entries + queue->size(); }
+
+void TimingWheelQueue::remove_if(
+    const std::function<bool(const QueuedEvent &)> &predicate) {
+  for (size_t level = 0; level < n_levels; ++level) {
+    for (size_t i = 0; i < n_slots; ++i) {
+      auto &slot = slots[level * n_slots + i];
+      auto end = std::remove_if(slot.begin(), slot.end(), predicate);
+      n_entries -= std::distance(end, slot.end());
+      slot.erase(end, slot.end());
+      if (slot.empty()) {
+        occupied[level] &= ~(uint64_t(1) << i);
+      }
+    }
+  }
+
+  queue->remove_if(predicate);
+}
+
+bool TimingWheelQueue::insert(QueuedEvent &entry) {
+  double ticks = entry.time * per_tick;
+  if (!(ticks >= now_tick) ||
+      ticks >= static_cast<double>(std::numeric_limits<uint64_t>::max())) {
+    return false;
+  }
+
+  // The level is given by the highest bit in which the slot of the entry
+  // differs from the current slot.
+  auto tick = static_cast<uint64_t>(ticks);
+  uint64_t differing = tick ^ now_tick;
+  size_t level = differing == 0 ? 0 : highest_bit(differing) / slot_bits;
+  if (level >= n_levels) {
+    return false;
+  }
+
+  size_t index = (tick >> (level * slot_bits)) & (n_slots - 1);
+  slots[level * n_slots + index].push_back(std::move(entry));
+  occupied[level] |= uint64_t(1) << index;
+  ++n_entries;
+  return true;
+}
+
+void TimingWheelQueue::advance() {
+  for (size_t level = 0; level < n_levels; ++level) {
+    unsigned shift = level * slot_bits;
+    size_t current = (now_tick >> shift) & (n_slots - 1);
+    uint64_t later = occupied[level] & (~uint64_t(0) << current);
+    if (later == 0) {
+      continue;
+    }
+
+    size_t index = lowest_bit(later);
+    occupied[level] &= ~(uint64_t(1) << index);
+    reached.swap(slots[level * n_slots + index]);
+    n_entries -= reached.size();
+
+    // Move to the start of the slot. Its entries then lie in the first level
+    // or in the current slots of the levels below, and all earlier slots are
+    // empty.
+    uint64_t block = (uint64_t(1) << (shift + slot_bits)) - 1;
+    now_tick = (now_tick & ~block) | (uint64_t(index) << shift);
+    if (level == 0) {
+      ++now_tick;
+    }
+
+    for (auto &entry : reached) {
+      if (discard && discard(entry)) {
+        continue;
+      }
+      if (level == 0 || !insert(entry)) {
+        queue->push(std::move(entry));
+      }
+    }
+    reached.clear();
+    return;
+  }
+
+  // Callers loop until the wheel is empty, so they would never return.
+  throw std::logic_error(
+      "entries of the timing wheel lie before its current slot");
+}
+
+/* CallQueue */
+
+CallHandle CallQueue::push(simtime time, size_t id, simtime period,
+                           Call call) {
+  uint32_t slot;
+  if (!free_slots.empty()) {
+    slot = free_slots.back();
+    free_slots.pop_back();
+  } else {
+    slot = static_cast<uint32_t>(slots.size());
+    slots.emplace_back();
+  }
+
+  auto &data = slots[slot];
+  data.call = std::move(call);
+  data.period = period;
+  data.used = true;
+  data.cancelled = false;
+  insert(Entry{time, id, slot});
+
+  CallHandle handle;
+  handle.slot = slot;
+  handle.generation = data.generation;
+  return handle;
+}
+
+bool CallQueue::empty() const { return heap.empty(); }
+
+size_t CallQueue::size() const { return heap.size(); }
+
+const CallQueue::Entry &CallQueue::top() const { return heap.front(); }
+
+CallQueue::Entry CallQueue::pop() {
+  Entry entry = heap.front();
+  erase(0);
+  return entry;
+}
+
+void CallQueue::call(uint32_t slot) { slots[slot].call(); }
+
+bool CallQueue::finish(const Entry &entry, size_t id) {
+  auto &data = slots[entry.slot];
+  if (data.period <= 0.0 || data.cancelled) {
+    release(entry.slot);
+    return false;
+  }
+
+  insert(Entry{entry.time + data.period, id, entry.slot});
+  return true;
+}
+
+void CallQueue::release(uint32_t slot) {
+  auto &data = slots[slot];
+  data.call = Call();
+  data.used = false;
+  ++data.generation;
+  free_slots.push_back(slot);
+}
+
+bool CallQueue::cancel(CallHandle handle) {
+  if (handle.slot >= slots.size()) {
+    return false;
+  }
+
+  auto &data = slots[handle.slot];
+  if (!data.used || data.generation != handle.generation ||
+      data.cancelled) {
+    return false;
+  }
+
+  if (data.position == not_queued) {
+    // The call is being made, so it is freed once it returns.
+    data.cancelled = true;
+  } else {
+    erase(data.position);
+    release(handle.slot);
+  }
+  return true;
+}
+
+void CallQueue::insert(Entry entry) {
+  heap.emplace_back();
+  sift_up(heap.size() - 1, entry);
+}
+
+void CallQueue::erase(size_t position) {
+  slots[heap[position].slot].position = not_queued;
+  Entry last = heap.back();
+  heap.pop_back();
+  if (position == heap.size()) {
+    return;
+  }
+
+  if (position > 0 && before(last, heap[(position - 1) / 2])) {
+    sift_up(position, last);
+  } else {
+    sift_down(position, last);
+  }
+}
+
+void CallQueue::place(size_t position, const Entry &entry) {
+  heap[position] = entry;
+  slots[entry.slot].position = position;
+}
+
+void CallQueue::sift_up(size_t position, Entry entry) {
+  while (position > 0) {
+    size_t parent = (position - 1) / 2;
+    if (!before(entry, heap[parent])) {
+      break;
+    }
+    place(position, heap[parent]);
+    position = parent;
+  }
+  place(position, entry);
+}
+
+void CallQueue::sift_down(size_t position, Entry entry) {
+  size_t n = heap.size();
+  while (true) {
+    size_t child = 2 * position + 1;
+    if (child >= n) {
+      break;
+    }
+    if (child + 1 < n && before(heap[child + 1], heap[child])) {
+      ++child;
+    }
+    if (!before(heap[child], entry)) {
+      break;
+    }
+    place(position, heap[child]);
+    position = child;
+  }
+  place(position, entry);
+}
+
+} // namespace simcpp
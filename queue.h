@@ -0,0 +1,667 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_QUEUE_H_
+#define SIMCPP_QUEUE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "call.h"
+#include "simcpp.h"
+
+namespace simcpp {
+
+/// Entry of an event queue.
+class QueuedEvent {
+public:
+  simtime time;
+  size_t id;
+  EventPtr event;
+
+  QueuedEvent(simtime time, size_t id, EventPtr event);
+
+  /**
+   * Compare the priority of two entries.
+   *
+   * The order is inverted, as expected by std::priority_queue: An entry is
+   * "less" than another entry if it is processed after it.
+   *
+   * @param other Other entry.
+   * @return Whether this entry is processed after the other entry.
+   */
+  bool operator<(const QueuedEvent &other) const;
+};
+
+/**
+ * @param a First entry.
+ * @param b Second entry.
+ * @return Whether the first entry is processed before the second entry.
+ */
+inline bool before(const QueuedEvent &a, const QueuedEvent &b) {
+  if (a.time != b.time) {
+    return a.time < b.time;
+  }
+
+  return a.id < b.id;
+}
+
+/**
+ * Priority queue of scheduled events.
+ *
+ * Entries are ordered by time and then by id. All implementations produce the
+ * same order, so the choice of implementation only affects performance.
+ */
+class EventQueue {
+public:
+  virtual ~EventQueue();
+
+  /**
+   * Insert an entry.
+   *
+   * @param entry Entry to insert.
+   */
+  virtual void push(QueuedEvent entry) = 0;
+
+  /**
+   * The queue must not be empty.
+   *
+   * @return Entry which is processed next.
+   */
+  virtual const QueuedEvent &top() = 0;
+
+  /**
+   * Remove the entry which is processed next. The queue must not be empty.
+   *
+   * @return Removed entry.
+   */
+  virtual QueuedEvent pop() = 0;
+
+  /// @return Whether the queue is empty.
+  virtual bool empty() const = 0;
+
+  /// @return Number of entries in the queue.
+  virtual size_t size() const = 0;
+
+  /**
+   * Remove all entries matching a predicate.
+   *
+   * The default implementation removes all entries and inserts the remaining
+   * ones again, which takes O(n log n) time.
+   *
+   * @param predicate Predicate which returns true for entries to remove.
+   */
+  virtual void
+  remove_if(const std::function<bool(const QueuedEvent &)> &predicate);
+};
+
+using EventQueuePtr = std::unique_ptr<EventQueue>;
+
+/**
+ * Create an event queue.
+ *
+ * @param type Implementation of the queue.
+ * @return Queue instance.
+ */
+EventQueuePtr make_queue(QueueType type);
+
+/// Binary heap. This is the behavior of std::priority_queue.
+class BinaryHeapQueue : public EventQueue {
+public:
+  void push(QueuedEvent entry) override;
+  const QueuedEvent &top() override;
+  QueuedEvent pop() override;
+  bool empty() const override;
+  size_t size() const override;
+  void remove_if(
+      const std::function<bool(const QueuedEvent &)> &predicate) override;
+
+private:
+  std::vector<QueuedEvent> heap = {};
+};
+
+/**
+ * Implicit d-ary heap.
+ *
+ * Compared to a binary heap, the tree is flatter and the children of a node
+ * are adjacent in memory, which reduces cache misses when sifting down.
+ *
+ * @tparam D Number of children per node.
+ */
+template <size_t D> class DaryHeapQueue : public EventQueue {
+  static_assert(D >= 2, "a d-ary heap needs at least two children per node");
+
+public:
+  void push(QueuedEvent entry) override {
+    heap.push_back(std::move(entry));
+    sift_up(heap.size() - 1);
+  }
+
+  const QueuedEvent &top() override { return heap.front(); }
+
+  QueuedEvent pop() override {
+    QueuedEvent entry = std::move(heap.front());
+    if (heap.size() > 1) {
+      heap.front() = std::move(heap.back());
+      heap.pop_back();
+      sift_down(0);
+    } else {
+      heap.pop_back();
+    }
+    return entry;
+  }
+
+  bool empty() const override { return heap.empty(); }
+
+  size_t size() const override { return heap.size(); }
+
+  /// Removes the entries and restores the heap property in O(n) time.
+  void remove_if(
+      const std::function<bool(const QueuedEvent &)> &predicate) override {
+    heap.erase(std::remove_if(heap.begin(), heap.end(), predicate),
+               heap.end());
+    if (heap.size() > 1) {
+      // Sift down all inner nodes, starting with the parent of the last entry.
+      for (size_t index = (heap.size() - 2) / D + 1; index > 0; --index) {
+        sift_down(index - 1);
+      }
+    }
+  }
+
+private:
+  std::vector<QueuedEvent> heap = {};
+
+  void sift_up(size_t index) {
+    QueuedEvent entry = std::move(heap[index]);
+    while (index > 0) {
+      size_t parent = (index - 1) / D;
+      if (!before(entry, heap[parent])) {
+        break;
+      }
+      heap[index] = std::move(heap[parent]);
+      index = parent;
+    }
+    heap[index] = std::move(entry);
+  }
+
+  void sift_down(size_t index) {
+    size_t n = heap.size();
+    QueuedEvent entry = std::move(heap[index]);
+    while (true) {
+      size_t first = index * D + 1;
+      if (first >= n) {
+        break;
+      }
+
+      size_t last = first + D < n ? first + D : n;
+      size_t best = first;
+      for (size_t child = first + 1; child < last; ++child) {
+        if (before(heap[child], heap[best])) {
+          best = child;
+        }
+      }
+
+      if (!before(heap[best], entry)) {
+        break;
+      }
+      heap[index] = std::move(heap[best]);
+      index = best;
+    }
+    heap[index] = std::move(entry);
+  }
+};
+
+/**
+ * 4-ary heap of small nodes which refer to the events through handles.
+ *
+ * A node holds the time of an entry, the low 32 bits of its id and a 32-bit
+ * handle of a slot in a table of events. Nodes take 16 bytes, half of a whole
+ * entry, and groups of four children are aligned to cache lines, so finding
+ * the earliest child reads exactly one cache line. Sifting moves only nodes,
+ * and the table is only read when an entry leaves the heap. Slots are reused
+ * through a free list. The entry processed next is kept whole outside of the
+ * heap, so top returns it without copying.
+ *
+ * Including the table, an entry takes 32 bytes like in the other heaps, as
+ * the event pointer alone takes 16. Only the part read while sifting is
+ * halved. Once an id no longer fits in 32 bits, a third array holds the high
+ * bits of the ids, and ties are broken with it until the queue is empty.
+ */
+class SplitHeapQueue : public EventQueue {
+public:
+  void push(QueuedEvent entry) override;
+  const QueuedEvent &top() override;
+  QueuedEvent pop() override;
+  bool empty() const override;
+  size_t size() const override;
+  void remove_if(
+      const std::function<bool(const QueuedEvent &)> &predicate) override;
+
+private:
+  /// Node of the heap.
+  class Node {
+  public:
+    simtime time;
+    /// Slot of the entry in the table.
+    uint32_t handle;
+    /// Low 32 bits of the id.
+    uint32_t id;
+  };
+
+  static const size_t arity = 4;
+  static const size_t cache_line_size = 64;
+
+  /// Entry processed next. Valid if has_root is true.
+  QueuedEvent root = QueuedEvent(0.0, 0, nullptr);
+  bool has_root = false;
+  /// Memory of the nodes, with room to align them.
+  std::unique_ptr<char[]> buffer = nullptr;
+  /// Nodes of the heap. The children of a node start at a cache line.
+  Node *nodes = nullptr;
+  size_t n_nodes = 0;
+  size_t capacity = 0;
+  /// Events of the entries in the heap, by handle.
+  std::vector<EventPtr> slots = {};
+  /// Free slots, at most as many as the entries which have left the heap.
+  std::vector<uint32_t> free_slots = {};
+  /// Whether an id in the heap may not fit in 32 bits.
+  bool wide_ids = false;
+  /// High 32 bits of the ids, by handle. Only used if wide_ids is true.
+  std::vector<uint32_t> high_ids = {};
+
+  /// @return Whole id of the entry of a node.
+  size_t get_id(const Node &node) const {
+    if (!wide_ids) {
+      return node.id;
+    }
+    return static_cast<size_t>(static_cast<uint64_t>(high_ids[node.handle])
+                                   << 32 |
+                               node.id);
+  }
+
+  bool before(const Node &a, const Node &b) const {
+    if (a.time != b.time) {
+      return a.time < b.time;
+    }
+
+    if (!wide_ids) {
+      return a.id < b.id;
+    }
+    return get_id(a) < get_id(b);
+  }
+
+  /// Make room for one more node.
+  void grow();
+
+  /**
+   * Store the event of an entry, and the high bits of its id if needed, in a
+   * free slot.
+   *
+   * @param entry Entry.
+   * @return Handle of the slot.
+   */
+  uint32_t store(QueuedEvent entry);
+
+  /// Replace the root by the earliest entry of the heap, if any.
+  void take_root();
+
+  /**
+   * Place a node at or above a free position.
+   *
+   * @param index Free position.
+   * @param node Node to place.
+   */
+  void sift_up(size_t index, Node node);
+
+  /**
+   * Place a node at or below a free position.
+   *
+   * @param index Free position.
+   * @param node Node to place.
+   */
+  void sift_down(size_t index, Node node);
+};
+
+/**
+ * Entries sorted by priority, which are removed from the front.
+ *
+ * Used for the buckets of the calendar queue and ladder queue. New entries are
+ * usually later than all existing entries, so inserting searches from the back.
+ */
+class SortedEntries {
+public:
+  /// @return Whether there are no entries.
+  bool empty() const;
+
+  /// @return Number of entries.
+  size_t size() const;
+
+  /// @return Earliest entry. There must be at least one entry.
+  const QueuedEvent &front() const;
+
+  /// @return Latest entry. There must be at least one entry.
+  const QueuedEvent &back() const;
+
+  /**
+   * Remove the earliest entry. There must be at least one entry.
+   *
+   * @return Removed entry.
+   */
+  QueuedEvent pop_front();
+
+  /**
+   * Insert an entry at its sorted position.
+   *
+   * @param entry Entry to insert.
+   */
+  void insert(QueuedEvent entry);
+
+  /**
+   * Replace all entries.
+   *
+   * @param entries New entries in any order.
+   */
+  void assign(std::vector<QueuedEvent> entries);
+
+  /**
+   * Remove all entries.
+   *
+   * @return Removed entries in sorted order.
+   */
+  std::vector<QueuedEvent> take();
+
+private:
+  std::vector<QueuedEvent> entries = {};
+  /// Number of entries at the front which were already removed.
+  size_t head = 0;
+};
+
+/**
+ * Calendar queue (R. Brown, 1988).
+ *
+ * Entries are hashed by time into buckets of a fixed width, like days of a
+ * year in a calendar. Each bucket is kept sorted. Enqueue and dequeue take
+ * O(1) amortized time if the bucket width matches the distribution of event
+ * times. The number of buckets and their width are adapted when the size of
+ * the queue changes.
+ */
+class CalendarQueue : public EventQueue {
+public:
+  CalendarQueue();
+
+  void push(QueuedEvent entry) override;
+  const QueuedEvent &top() override;
+  QueuedEvent pop() override;
+  bool empty() const override;
+  size_t size() const override;
+
+private:
+  std::vector<SortedEntries> buckets;
+  simtime width = 1.0;
+  size_t n_entries = 0;
+  /// Virtual bucket (time divided by width) of the last dequeued entry.
+  double current = 0.0;
+  /// Index of the bucket holding the next entry. Valid if found is true.
+  size_t next = 0;
+  bool found = false;
+
+  double virtual_bucket(simtime time) const;
+  size_t bucket_index(double virtual_bucket) const;
+  void insert(QueuedEvent entry);
+  void find_next();
+  void resize(size_t n_buckets);
+};
+
+/**
+ * Ladder queue (W. T. Tang, R. S. M. Goh, I. L.-J. Thng, 2005).
+ *
+ * Entries far in the future are collected in an unsorted top list. When they
+ * are needed, they are spread over a ladder of increasingly fine bucket rungs.
+ * Only a small bottom list of the earliest entries is ever sorted. Enqueue and
+ * dequeue take O(1) amortized time regardless of the distribution of event
+ * times.
+ */
+class LadderQueue : public EventQueue {
+public:
+  LadderQueue();
+
+  void push(QueuedEvent entry) override;
+  const QueuedEvent &top() override;
+  QueuedEvent pop() override;
+  bool empty() const override;
+  size_t size() const override;
+
+private:
+  class Rung {
+  public:
+    simtime start;
+    simtime width;
+    /// Index of the first bucket which was not moved to a lower rung yet.
+    size_t current = 0;
+    std::vector<std::vector<QueuedEvent>> buckets;
+
+    Rung(simtime start, simtime width, size_t n_buckets);
+
+    /// @return Bucket index of the time, or -1 if it lies before the rung.
+    double bucket(simtime time) const;
+  };
+
+  std::vector<QueuedEvent> top_list = {};
+  simtime top_start;
+  simtime top_min = 0.0;
+  simtime top_max = 0.0;
+  std::vector<Rung> rungs = {};
+  /// Sorted list of the earliest entries.
+  SortedEntries bottom = {};
+  size_t n_entries = 0;
+
+  void insert_bottom(QueuedEvent entry);
+  void fill_bottom();
+  void spread(std::vector<QueuedEvent> &entries, simtime min, simtime max);
+};
+
+/**
+ * Hierarchical timing wheel in front of another event queue.
+ *
+ * Entries up to a horizon ahead are hashed by time into levels of 64 slots.
+ * The slots of the first level are as wide as the resolution, and those of
+ * each further level are 64 times as wide as those of the level below.
+ * Inserting such an entry takes O(1) time, and entries of aborted events are
+ * dropped when their slot is reached, so they never enter the other queue.
+ * When the wheel reaches a slot, its entries are moved into the other queue,
+ * from the first level, or spread over the lower levels. The other queue
+ * orders them exactly, and it holds all entries beyond the horizon or before
+ * the current slot.
+ */
+class TimingWheelQueue : public EventQueue {
+public:
+  /// Function which returns whether an entry can be dropped, and does the
+  /// bookkeeping of its removal.
+  using Discard = std::function<bool(const QueuedEvent &)>;
+
+  /**
+   * Construct a timing wheel.
+   *
+   * @param queue Queue of the entries outside of the wheel.
+   * @param resolution Width of the slots of the first level. Must be
+   * positive.
+   * @param horizon Distance in time up to which entries are inserted into the
+   * wheel. Determines the number of levels, at most 10.
+   * @param discard Function which returns whether an entry is dropped when
+   * its slot is reached, or nullptr to keep all entries.
+   */
+  TimingWheelQueue(EventQueuePtr queue, simtime resolution, simtime horizon,
+                   Discard discard = nullptr);
+
+  void push(QueuedEvent entry) override;
+  const QueuedEvent &top() override;
+  QueuedEvent pop() override;
+  bool empty() const override;
+  size_t size() const override;
+  void remove_if(
+      const std::function<bool(const QueuedEvent &)> &predicate) override;
+
+private:
+  static const unsigned slot_bits = 6;
+  static const size_t n_slots = size_t(1) << slot_bits;
+  static const size_t max_levels = 10;
+
+  EventQueuePtr queue;
+  /// Inverse of the resolution.
+  double per_tick;
+  size_t n_levels;
+  Discard discard;
+  /// Index of the first slot of the first level which was not reached yet.
+  /// All entries in the wheel are in this or later slots.
+  uint64_t now_tick = 0;
+  size_t n_entries = 0;
+  /// Slots of all levels, level by level.
+  std::vector<std::vector<QueuedEvent>> slots;
+  /// Bit mask of the non-empty slots of each level.
+  uint64_t occupied[max_levels] = {};
+  std::vector<QueuedEvent> reached = {};
+
+  /**
+   * Insert an entry into the wheel if it lies within the horizon.
+   *
+   * @param entry Entry to insert. Not moved from if it is not inserted.
+   * @return Whether the entry was inserted.
+   */
+  bool insert(QueuedEvent &entry);
+
+  /// Move the entries of the next non-empty slot out of the wheel or to
+  /// lower levels. There must be at least one entry.
+  void advance();
+};
+
+/**
+ * Queue of the calls scheduled by Simulation::call_at, call_in and
+ * call_every.
+ *
+ * Calls are kept in slots, which are reused, so scheduling a call does not
+ * allocate once the queue is warm, and a recurring call keeps its slot. The
+ * slots are ordered by a binary heap of small entries, and each slot knows its
+ * position in the heap, so a call can be cancelled in O(log n) time.
+ */
+class CallQueue {
+public:
+  /// Entry of the heap.
+  class Entry {
+  public:
+    simtime time;
+    size_t id;
+    uint32_t slot;
+  };
+
+  /**
+   * Schedule a call.
+   *
+   * @param time Time of the call.
+   * @param id Id of the call, ordering it among calls and events at the same
+   * time.
+   * @param period Period after which the call recurs, or 0 for a single call.
+   * @param call Function to call.
+   * @return Handle of the call.
+   */
+  CallHandle push(simtime time, size_t id, simtime period, Call call);
+
+  /// @return Whether no calls are scheduled.
+  bool empty() const;
+
+  /// @return Number of scheduled calls.
+  size_t size() const;
+
+  /// @return Entry of the next call. The queue must not be empty.
+  const Entry &top() const;
+
+  /**
+   * Remove the next call. Its slot stays reserved until finish or release is
+   * called, so the call can be made and cancel itself.
+   *
+   * @return Entry of the call.
+   */
+  Entry pop();
+
+  /**
+   * Make a removed call.
+   *
+   * @param slot Slot of the call.
+   */
+  void call(uint32_t slot);
+
+  /**
+   * Schedule a removed recurring call again, or free its slot.
+   *
+   * @param entry Entry of the call.
+   * @param id Id of the next occurrence.
+   * @return Whether the call was scheduled again, using the id.
+   */
+  bool finish(const Entry &entry, size_t id);
+
+  /**
+   * Free the slot of a removed call.
+   *
+   * @param slot Slot of the call.
+   */
+  void release(uint32_t slot);
+
+  /**
+   * Cancel a call. A recurring call which is being made does not recur.
+   *
+   * @param handle Handle of the call.
+   * @return Whether the call was scheduled or being made.
+   */
+  bool cancel(CallHandle handle);
+
+private:
+  /// Position of slots which are not in the heap.
+  static const size_t not_queued = static_cast<size_t>(-1);
+
+  class Slot {
+  public:
+    Call call = {};
+    simtime period = 0.0;
+    /// Starts at one, so default handles never match.
+    uint32_t generation = 1;
+    bool used = false;
+    /// Whether the call was cancelled while being made.
+    bool cancelled = false;
+    size_t position = not_queued;
+  };
+
+  /// Slots of the calls. A deque keeps calls in place while they are made
+  /// and schedule further calls.
+  std::deque<Slot> slots = {};
+  std::vector<uint32_t> free_slots = {};
+  std::vector<Entry> heap = {};
+
+  static bool before(const Entry &a, const Entry &b) {
+    if (a.time != b.time) {
+      return a.time < b.time;
+    }
+
+    return a.id < b.id;
+  }
+
+  /// Insert an entry into the heap.
+  void insert(Entry entry);
+
+  /// Remove the entry at a position from the heap.
+  void erase(size_t position);
+
+  /// Store an entry at a position and update the position of its slot.
+  void place(size_t position, const Entry &entry);
+
+  void sift_up(size_t position, Entry entry);
+  void sift_down(size_t position, Entry entry);
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_QUEUE_H_
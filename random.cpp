@@ -0,0 +1,251 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "random.h"
+
+#include <cmath>
+
+namespace simcpp {
+
+namespace {
+
+const double pi = 3.14159265358979323846;
+
+const uint32_t philox_m0 = 0xd2511f53;
+const uint32_t philox_m1 = 0xcd9e8d57;
+const uint32_t philox_w0 = 0x9e3779b9;
+const uint32_t philox_w1 = 0xbb67ae85;
+const int philox_rounds = 10;
+
+/// Number of blocks computed side by side by fill_bits.
+const size_t lanes = 8;
+
+/// Number of values drawn at once by fill_uniform and fill_erlang.
+const size_t scratch_size = 256;
+
+/// Finalizer of SplitMix64, a bijective mix of 64 bits.
+uint64_t mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+/// Transform pairs of uniform values into pairs of normal values in place.
+void box_muller(double *values, size_t n) {
+  for (size_t i = 0; i + 1 < n; i += 2) {
+    double radius = std::sqrt(-2.0 * std::log(1.0 - values[i]));
+    double angle = 2.0 * pi * values[i + 1];
+    values[i] = radius * std::cos(angle);
+    values[i + 1] = radius * std::sin(angle);
+  }
+}
+
+} // namespace
+
+/* Random */
+
+Random::Random(uint64_t seed, uint64_t stream) : seed(seed), stream(stream) {}
+
+Random Random::substream(uint64_t id) const {
+  return Random(seed, mix(mix(stream) + id + 1));
+}
+
+uint64_t Random::get_seed() const { return seed; }
+
+uint64_t Random::get_stream() const { return stream; }
+
+double Random::uniform(double a, double b) { return a + (b - a) * uniform(); }
+
+double Random::exponential(double rate) {
+  return -std::log(1.0 - uniform()) / rate;
+}
+
+double Random::normal(double mean, double stddev) {
+  if (has_spare) {
+    has_spare = false;
+    return mean + stddev * spare;
+  }
+
+  double pair[2] = {uniform(), uniform()};
+  box_muller(pair, 2);
+  has_spare = true;
+  spare = pair[1];
+  return mean + stddev * pair[0];
+}
+
+double Random::lognormal(double mu, double sigma) {
+  return std::exp(normal(mu, sigma));
+}
+
+double Random::erlang(unsigned k, double rate) {
+  double sum = 0.0;
+  for (unsigned i = 0; i < k; ++i) {
+    sum += std::log(1.0 - uniform());
+  }
+  return -sum / rate;
+}
+
+void Random::fill_uniform(double *values, size_t n) {
+  size_t i = 0;
+  for (; i < n && position < block_size; ++i) {
+    values[i] = uniform();
+  }
+
+  // Whole blocks are drawn in chunks, which gives the same values as drawing
+  // them one by one.
+  uint64_t bits[scratch_size];
+  while (n - i >= block_size) {
+    size_t n_blocks = (n - i) / block_size;
+    if (n_blocks > scratch_size / block_size) {
+      n_blocks = scratch_size / block_size;
+    }
+    fill_bits(bits, n_blocks);
+    for (size_t j = 0; j < n_blocks * block_size; ++j) {
+      values[i + j] = to_unit(bits[j]);
+    }
+    i += n_blocks * block_size;
+  }
+
+  for (; i < n; ++i) {
+    values[i] = uniform();
+  }
+}
+
+void Random::fill_exponential(double *values, size_t n, double rate) {
+  fill_uniform(values, n);
+  for (size_t i = 0; i < n; ++i) {
+    values[i] = -std::log(1.0 - values[i]) / rate;
+  }
+}
+
+void Random::fill_normal(double *values, size_t n, double mean,
+                         double stddev) {
+  size_t i = 0;
+  if (n > 0 && has_spare) {
+    values[i++] = normal();
+  }
+
+  size_t n_pairs = (n - i) / 2;
+  fill_uniform(values + i, 2 * n_pairs);
+  box_muller(values + i, 2 * n_pairs);
+  i += 2 * n_pairs;
+
+  if (i < n) {
+    values[i] = normal();
+  }
+
+  for (i = 0; i < n; ++i) {
+    values[i] = mean + stddev * values[i];
+  }
+}
+
+void Random::fill_lognormal(double *values, size_t n, double mu,
+                            double sigma) {
+  fill_normal(values, n, mu, sigma);
+  for (size_t i = 0; i < n; ++i) {
+    values[i] = std::exp(values[i]);
+  }
+}
+
+void Random::fill_erlang(double *values, size_t n, unsigned k, double rate) {
+  if (k == 0 || k > scratch_size) {
+    for (size_t i = 0; i < n; ++i) {
+      values[i] = erlang(k, rate);
+    }
+    return;
+  }
+
+  double scratch[scratch_size];
+  size_t per_chunk = scratch_size / k;
+  for (size_t i = 0; i < n; i += per_chunk) {
+    size_t m = per_chunk < n - i ? per_chunk : n - i;
+    fill_uniform(scratch, m * k);
+    for (size_t j = 0; j < m; ++j) {
+      double sum = 0.0;
+      for (unsigned phase = 0; phase < k; ++phase) {
+        sum += std::log(1.0 - scratch[j * k + phase]);
+      }
+      values[i + j] = -sum / rate;
+    }
+  }
+}
+
+void Random::philox(const uint32_t counter[4], const uint32_t key[2],
+                    uint32_t block[4]) {
+  uint32_t x0 = counter[0], x1 = counter[1], x2 = counter[2],
+           x3 = counter[3];
+  uint32_t k0 = key[0], k1 = key[1];
+  for (int round = 0; round < philox_rounds; ++round) {
+    uint64_t p0 = static_cast<uint64_t>(philox_m0) * x0;
+    uint64_t p1 = static_cast<uint64_t>(philox_m1) * x2;
+    x0 = static_cast<uint32_t>(p1 >> 32) ^ x1 ^ k0;
+    x1 = static_cast<uint32_t>(p1);
+    x2 = static_cast<uint32_t>(p0 >> 32) ^ x3 ^ k1;
+    x3 = static_cast<uint32_t>(p0);
+    k0 += philox_w0;
+    k1 += philox_w1;
+  }
+  block[0] = x0;
+  block[1] = x1;
+  block[2] = x2;
+  block[3] = x3;
+}
+
+void Random::refill() {
+  fill_bits(buffer, 1);
+  position = 0;
+}
+
+void Random::fill_bits(uint64_t *bits, size_t n_blocks) {
+  uint32_t key[2] = {static_cast<uint32_t>(seed),
+                     static_cast<uint32_t>(seed >> 32)};
+  uint32_t s0 = static_cast<uint32_t>(stream);
+  uint32_t s1 = static_cast<uint32_t>(stream >> 32);
+
+  // Rounds of several blocks are interleaved in fixed-size loops without
+  // dependencies between iterations, which the compiler vectorizes.
+  size_t i = 0;
+  for (; i + lanes <= n_blocks; i += lanes) {
+    uint32_t x0[lanes], x1[lanes], x2[lanes], x3[lanes];
+    for (size_t lane = 0; lane < lanes; ++lane) {
+      uint64_t block = counter + lane;
+      x0[lane] = static_cast<uint32_t>(block);
+      x1[lane] = static_cast<uint32_t>(block >> 32);
+      x2[lane] = s0;
+      x3[lane] = s1;
+    }
+
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int round = 0; round < philox_rounds; ++round) {
+      for (size_t lane = 0; lane < lanes; ++lane) {
+        uint64_t p0 = static_cast<uint64_t>(philox_m0) * x0[lane];
+        uint64_t p1 = static_cast<uint64_t>(philox_m1) * x2[lane];
+        x0[lane] = static_cast<uint32_t>(p1 >> 32) ^ x1[lane] ^ k0;
+        x1[lane] = static_cast<uint32_t>(p1);
+        x2[lane] = static_cast<uint32_t>(p0 >> 32) ^ x3[lane] ^ k1;
+        x3[lane] = static_cast<uint32_t>(p0);
+      }
+      k0 += philox_w0;
+      k1 += philox_w1;
+    }
+
+    for (size_t lane = 0; lane < lanes; ++lane) {
+      bits[2 * (i + lane)] = x0[lane] | static_cast<uint64_t>(x1[lane]) << 32;
+      bits[2 * (i + lane) + 1] =
+          x2[lane] | static_cast<uint64_t>(x3[lane]) << 32;
+    }
+    counter += lanes;
+  }
+
+  for (; i < n_blocks; ++i) {
+    uint32_t block_counter[4] = {static_cast<uint32_t>(counter),
+                                 static_cast<uint32_t>(counter >> 32), s0, s1};
+    uint32_t block[4];
+    philox(block_counter, key, block);
+    bits[2 * i] = block[0] | static_cast<uint64_t>(block[1]) << 32;
+    bits[2 * i + 1] = block[2] | static_cast<uint64_t>(block[3]) << 32;
+    ++counter;
+  }
+}
+
+} // namespace simcpp
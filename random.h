@@ -0,0 +1,202 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_RANDOM_H_
+#define SIMCPP_RANDOM_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace simcpp {
+
+/**
+ * Deterministic random number generator with independent substreams.
+ *
+ * Based on the counter-based generator Philox4x32-10: the numbers of a stream
+ * are a keyed hash of their position, with the seed as the key and the stream
+ * number as part of the counter. Creating a substream is therefore free, and
+ * the numbers of a substream depend only on the seed and its number, not on
+ * how many numbers other streams drew before. Giving each process a substream
+ * numbered by a stable identifier, for example the number of a customer,
+ * makes the results independent of the order of creation and of threads.
+ *
+ * Each simulation owns a generator seeded by SimulationOptions::seed. The
+ * generator is trivially copyable, so it can be saved to an Archive as a
+ * value, for example by Event::save or a checkpoint of a logical process.
+ *
+ * The fill methods draw many variates into a buffer at once, with the same
+ * results as the same number of single draws. They generate the random bits
+ * of several blocks side by side, which the compiler can vectorize, so
+ * high-rate sources should draw their variates in batches.
+ *
+ * ```
+ * auto &random = sim->get_random();
+ * double interval = random.exponential(1 / mean_interval);
+ * simcpp::Random customer_random = random.substream(customer_id);
+ * ```
+ *
+ * It also models the UniformRandomBitGenerator of the standard library, so it
+ * can be used with the distributions of `<random>`.
+ */
+class Random {
+public:
+  using result_type = uint64_t;
+
+  /**
+   * Construct a generator.
+   *
+   * @param seed Seed of the generator.
+   * @param stream Number of the stream.
+   */
+  explicit Random(uint64_t seed = 0, uint64_t stream = 0);
+
+  /**
+   * Create an independent substream. Its stream number is a hash of the
+   * number of this stream and its own, so substreams, and substreams of
+   * substreams, practically never share numbers.
+   *
+   * @param id Number of the substream.
+   * @return Generator of the substream, at its beginning.
+   */
+  Random substream(uint64_t id) const;
+
+  /// @return Seed of the generator.
+  uint64_t get_seed() const;
+
+  /// @return Number of the stream.
+  uint64_t get_stream() const;
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT64_MAX; }
+
+  /// @return Next 64 random bits.
+  result_type operator()() {
+    if (position == block_size) {
+      refill();
+    }
+    return buffer[position++];
+  }
+
+  /// @return Uniformly distributed value in [0, 1).
+  double uniform() { return to_unit((*this)()); }
+
+  /**
+   * @param a Lower bound.
+   * @param b Upper bound.
+   * @return Uniformly distributed value in [a, b).
+   */
+  double uniform(double a, double b);
+
+  /**
+   * @param rate Rate of the distribution, the inverse of its mean.
+   * @return Exponentially distributed value.
+   */
+  double exponential(double rate);
+
+  /**
+   * @param mean Mean of the distribution.
+   * @param stddev Standard deviation of the distribution.
+   * @return Normally distributed value.
+   */
+  double normal(double mean = 0.0, double stddev = 1.0);
+
+  /**
+   * @param mu Mean of the logarithm of the value.
+   * @param sigma Standard deviation of the logarithm of the value.
+   * @return Lognormally distributed value.
+   */
+  double lognormal(double mu, double sigma);
+
+  /**
+   * @param k Shape of the distribution, the number of exponential phases.
+   * @param rate Rate of each phase.
+   * @return Erlang distributed value.
+   */
+  double erlang(unsigned k, double rate);
+
+  /**
+   * Draw uniformly distributed values in [0, 1).
+   *
+   * @param values Buffer of the values.
+   * @param n Number of values.
+   */
+  void fill_uniform(double *values, size_t n);
+
+  /**
+   * Draw exponentially distributed values.
+   *
+   * @param values Buffer of the values.
+   * @param n Number of values.
+   * @param rate Rate of the distribution.
+   */
+  void fill_exponential(double *values, size_t n, double rate);
+
+  /**
+   * Draw normally distributed values.
+   *
+   * @param values Buffer of the values.
+   * @param n Number of values.
+   * @param mean Mean of the distribution.
+   * @param stddev Standard deviation of the distribution.
+   */
+  void fill_normal(double *values, size_t n, double mean = 0.0,
+                   double stddev = 1.0);
+
+  /**
+   * Draw lognormally distributed values.
+   *
+   * @param values Buffer of the values.
+   * @param n Number of values.
+   * @param mu Mean of the logarithm of the values.
+   * @param sigma Standard deviation of the logarithm of the values.
+   */
+  void fill_lognormal(double *values, size_t n, double mu, double sigma);
+
+  /**
+   * Draw Erlang distributed values.
+   *
+   * @param values Buffer of the values.
+   * @param n Number of values.
+   * @param k Shape of the distribution.
+   * @param rate Rate of each phase.
+   */
+  void fill_erlang(double *values, size_t n, unsigned k, double rate);
+
+  /**
+   * Compute a block of Philox4x32-10.
+   *
+   * @param counter Counter of the block.
+   * @param key Key of the block.
+   * @param block Set to the four random words of the block.
+   */
+  static void philox(const uint32_t counter[4], const uint32_t key[2],
+                     uint32_t block[4]);
+
+private:
+  /// Number of 64-bit values per block of Philox4x32.
+  static const unsigned block_size = 2;
+
+  uint64_t seed;
+  uint64_t stream;
+  /// Number of the next block of the stream.
+  uint64_t counter = 0;
+  uint64_t buffer[block_size] = {};
+  unsigned position = block_size;
+  /// Second value of the last pair of normal variates, if not drawn yet.
+  bool has_spare = false;
+  double spare = 0.0;
+
+  static double to_unit(uint64_t bits) {
+    return static_cast<double>(bits >> 11) / 9007199254740992.0;
+  }
+
+  /// Compute the next block into the buffer.
+  void refill();
+
+  /// Draw the random bits of whole blocks directly into a buffer.
+  void fill_bits(uint64_t *bits, size_t n_blocks);
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_RANDOM_H_
@@ -0,0 +1,201 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "realtime.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace simcpp {
+
+namespace {
+
+const simtime infinity = std::numeric_limits<simtime>::infinity();
+
+} // namespace
+
+/* RealtimeSimulation */
+
+RealtimeSimulation::RealtimeSimulation(
+    const RealtimeOptions &realtime_options /* = RealtimeOptions() */,
+    const SimulationOptions &options /* = SimulationOptions() */)
+    : realtime_options(realtime_options), sim(Simulation::create(options)),
+      injections(realtime_options.inbox_capacity), stopping(false),
+      sleeping(false) {
+  sync();
+}
+
+SimulationPtr RealtimeSimulation::get_simulation() const { return sim; }
+
+void RealtimeSimulation::sync() {
+  start_wall = Clock::now();
+  start_sim = sim->get_now();
+}
+
+void RealtimeSimulation::inject(Injection injection) {
+  Handler handler = [this, injection](EventPtr) { injection(sim); };
+  while (!injections.push(0.0, std::move(handler))) {
+    std::this_thread::yield();
+  }
+
+  // Orders the push before checking whether the simulation thread sleeps.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping.load()) {
+    std::lock_guard<std::mutex> lock(mutex);
+    wakeup.notify_one();
+  }
+}
+
+bool RealtimeSimulation::step() {
+  while (true) {
+    call_injections();
+    if (!sim->has_next()) {
+      return false;
+    }
+    if (!wait_until(sim->peek_next_time())) {
+      process_next();
+      return true;
+    }
+    if (stopping.exchange(false)) {
+      return false;
+    }
+  }
+}
+
+void RealtimeSimulation::run() {
+  while (true) {
+    call_injections();
+    if (!sim->has_next()) {
+      break;
+    }
+    if (!wait_until(sim->peek_next_time())) {
+      process_next();
+    } else if (stopping.load()) {
+      break;
+    }
+  }
+  stopping.store(false);
+}
+
+void RealtimeSimulation::run_until(simtime time) {
+  while (true) {
+    call_injections();
+    bool has_event = sim->has_next() && sim->peek_next_time() < time;
+    if (!wait_until(has_event ? sim->peek_next_time() : time)) {
+      if (!has_event) {
+        sim->run_until(time);
+        break;
+      }
+      process_next();
+    } else if (stopping.load()) {
+      break;
+    }
+  }
+  stopping.store(false);
+}
+
+void RealtimeSimulation::stop() {
+  stopping.store(true);
+  std::lock_guard<std::mutex> lock(mutex);
+  wakeup.notify_one();
+}
+
+const Tally &RealtimeSimulation::get_lateness() const { return lateness; }
+
+uint64_t RealtimeSimulation::get_n_late() const { return n_late; }
+
+RealtimeSimulation::Clock::time_point
+RealtimeSimulation::to_wall(simtime time) const {
+  std::chrono::duration<double> offset((time - start_sim) *
+                                       realtime_options.factor);
+  return start_wall + std::chrono::duration_cast<Clock::duration>(offset);
+}
+
+simtime RealtimeSimulation::to_sim(Clock::time_point wall) const {
+  std::chrono::duration<double> offset = wall - start_wall;
+  return start_sim + offset.count() / realtime_options.factor;
+}
+
+bool RealtimeSimulation::interrupted() const {
+  // The inbox is not empty as soon as a producer reserved a slot, even if it
+  // did not fill it yet.
+  return !injections.empty() || stopping.load();
+}
+
+void RealtimeSimulation::call_injections() {
+  simtime ignored;
+  Handler handler;
+  while (!injections.empty()) {
+    if (!injections.pop(ignored, handler)) {
+      // A producer is between reserving and filling its slot.
+      std::this_thread::yield();
+      continue;
+    }
+
+    // Injections happen at the current wall-clock time, but never before
+    // the current simulation time or after the next event.
+    simtime time = std::max(to_sim(Clock::now()), sim->get_now());
+    if (sim->has_next()) {
+      time = std::min(time, sim->peek_next_time());
+    }
+    sim->run_until(time);
+    handler(nullptr);
+  }
+}
+
+bool RealtimeSimulation::wait_until(simtime time) {
+  bool forever = time == infinity;
+  auto deadline = forever ? Clock::time_point::max() : to_wall(time);
+  auto spin = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(realtime_options.spin));
+
+  while (true) {
+    if (interrupted()) {
+      return true;
+    }
+
+    auto now = Clock::now();
+    if (now >= deadline) {
+      return false;
+    }
+
+    if (forever || deadline - now > spin) {
+      // Producers check whether the simulation sleeps after pushing, and it
+      // checks for pushes after declaring that it sleeps, so no wakeup is
+      // lost.
+      std::unique_lock<std::mutex> lock(mutex);
+      sleeping.store(true);
+      if (!interrupted()) {
+        if (forever) {
+          wakeup.wait(lock);
+        } else {
+          wakeup.wait_until(lock, deadline - spin);
+        }
+      }
+      sleeping.store(false);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void RealtimeSimulation::process_next() {
+  std::chrono::duration<double> late =
+      Clock::now() - to_wall(sim->peek_next_time());
+  double seconds = late.count() > 0.0 ? late.count() : 0.0;
+  lateness.add(seconds);
+  if (seconds > realtime_options.tolerance) {
+    ++n_late;
+    if (realtime_options.strict) {
+      throw std::runtime_error("simulation is late by " +
+                               std::to_string(seconds) + " s");
+    }
+  }
+  sim->step();
+}
+
+} // namespace simcpp
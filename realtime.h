@@ -0,0 +1,171 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_REALTIME_H_
+#define SIMCPP_REALTIME_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#include "inbox.h"
+#include "simcpp.h"
+#include "stats.h"
+
+namespace simcpp {
+
+/// Options of a real-time simulation.
+struct RealtimeOptions {
+  /// Wall-clock seconds per unit of simulation time.
+  double factor = 1.0;
+
+  /**
+   * Whether processing an event later than the tolerance after its
+   * wall-clock time throws std::runtime_error. Otherwise, it is only counted.
+   */
+  bool strict = false;
+
+  /// Wall-clock seconds an event may be processed late without counting as
+  /// late.
+  double tolerance = 0.001;
+
+  /**
+   * Wall-clock seconds before the time of an event at which the simulation
+   * stops sleeping and spins instead, as the operating system wakes sleeping
+   * threads too late by up to this much.
+   */
+  double spin = 0.0002;
+
+  /// Number of injected functions which can wait to be called. Injecting
+  /// waits while this many are waiting.
+  size_t inbox_capacity = 1024;
+};
+
+/**
+ * Simulation which runs in sync with the wall clock, for example to drive or
+ * be driven by external systems.
+ *
+ * Each event is processed when the wall clock reaches its simulation time,
+ * scaled by RealtimeOptions::factor. The wall-clock time of an event is
+ * computed from a fixed reference point, set by sync, so events processed
+ * late do not delay later events. How late events are processed is recorded.
+ *
+ * Other threads inject functions into the simulation through an Inbox. They
+ * are called on the thread running the
+ * simulation, at the simulation time of the wall clock when they arrive:
+ *
+ * ```
+ * simcpp::RealtimeSimulation rt(options);
+ * // on another thread
+ * rt.inject([](simcpp::SimulationPtr sim) { sim->start_process<Request>(); });
+ * ```
+ */
+class RealtimeSimulation {
+public:
+  using Injection = std::function<void(SimulationPtr)>;
+
+  /**
+   * Construct a real-time simulation and sync it to the wall clock.
+   *
+   * @param realtime_options Options of the real-time execution.
+   * @param options Options of the simulation.
+   */
+  explicit RealtimeSimulation(
+      const RealtimeOptions &realtime_options = RealtimeOptions(),
+      const SimulationOptions &options = SimulationOptions());
+
+  RealtimeSimulation(const RealtimeSimulation &) = delete;
+  RealtimeSimulation &operator=(const RealtimeSimulation &) = delete;
+
+  /// @return Simulation instance.
+  SimulationPtr get_simulation() const;
+
+  /// Set the reference point, so the current simulation time corresponds to
+  /// the current wall-clock time.
+  void sync();
+
+  /**
+   * Call a function in the simulation. Thread-safe. Waits while the inbox is
+   * full, see RealtimeOptions::inbox_capacity.
+   *
+   * @param injection Function called on the thread running the simulation.
+   */
+  void inject(Injection injection);
+
+  /**
+   * Wait for the wall-clock time of the next event and process it, calling
+   * injected functions while waiting.
+   *
+   * @return Whether there was an event to process.
+   */
+  bool step();
+
+  /// Run the simulation until no scheduled events are left or stop is called.
+  void run();
+
+  /**
+   * Run the simulation until the wall-clock time of a simulation time or
+   * until stop is called. Events at exactly that time are not processed yet.
+   * Injected functions are called even if no events are scheduled.
+   *
+   * @param time Time to run until.
+   */
+  void run_until(simtime time);
+
+  /// Make the running run or run_until return. Thread-safe.
+  void stop();
+
+  /// @return Lateness in wall-clock seconds of each processed event, zero if
+  /// it was on time.
+  const Tally &get_lateness() const;
+
+  /// @return Number of events processed later than the tolerance.
+  uint64_t get_n_late() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  RealtimeOptions realtime_options;
+  SimulationPtr sim;
+  Clock::time_point start_wall;
+  simtime start_sim = 0.0;
+  Tally lateness = {};
+  uint64_t n_late = 0;
+
+  /// Injected functions, as handlers called with nullptr. Their times are
+  /// not used, as they are called at the time at which they are taken.
+  Inbox injections;
+  std::atomic<bool> stopping;
+  /// Whether the simulation thread sleeps and must be notified.
+  std::atomic<bool> sleeping;
+  std::mutex mutex = {};
+  std::condition_variable wakeup = {};
+
+  Clock::time_point to_wall(simtime time) const;
+  simtime to_sim(Clock::time_point wall) const;
+
+  /// @return Whether injected functions or a stop are pending.
+  bool interrupted() const;
+
+  /// Call all injected functions which arrived so far.
+  void call_injections();
+
+  /**
+   * Wait until the wall-clock time of a simulation time.
+   *
+   * @param time Simulation time, or infinity to wait for an interruption.
+   * @return Whether the wait was interrupted before.
+   */
+  bool wait_until(simtime time);
+
+  /// Process the next event, which is due, and record its lateness.
+  void process_next();
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_REALTIME_H_
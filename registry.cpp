@@ -0,0 +1,117 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "registry.h"
+
+#include <cstdlib>
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+namespace simcpp {
+
+namespace {
+
+/**
+ * @param type Type.
+ * @return Readable name of the type.
+ */
+std::string type_name(const std::type_info &type) {
+#if defined(__GNUG__)
+  int status = 0;
+  char *name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+  if (status == 0 && name != nullptr) {
+    std::string result(name);
+    std::free(name);
+    return result;
+  }
+#endif
+  return type.name();
+}
+
+} // namespace
+
+/* Registry */
+
+uint32_t Registry::add(const EventPtr &event, const std::type_info &type,
+                       bool process) {
+  uint32_t slot;
+  if (!free_slots.empty()) {
+    slot = free_slots.back();
+    free_slots.pop_back();
+  } else {
+    slot = static_cast<uint32_t>(slots.size());
+    slots.push_back(Slot{EventWeakPtr(), nullptr, 1, false});
+  }
+
+  slots[slot].event = event;
+  slots[slot].type = &type;
+  slots[slot].process = process;
+  return slot;
+}
+
+void Registry::remove(uint32_t slot) {
+  slots[slot].event.reset();
+  slots[slot].type = nullptr;
+  slots[slot].process = false;
+  ++slots[slot].generation;
+  free_slots.push_back(slot);
+}
+
+EventHandle Registry::get_handle(uint32_t slot) const {
+  EventHandle handle;
+  handle.slot = slot;
+  handle.generation = slots[slot].generation;
+  return handle;
+}
+
+EventPtr Registry::get(EventHandle handle) const {
+  if (handle.slot >= slots.size() ||
+      slots[handle.slot].generation != handle.generation) {
+    return nullptr;
+  }
+  return slots[handle.slot].event.lock();
+}
+
+EventPtr Registry::get(uint32_t slot) const {
+  return slots[slot].event.lock();
+}
+
+bool Registry::is_process(uint32_t slot) const { return slots[slot].process; }
+
+uint32_t Registry::get_n_slots() const {
+  return static_cast<uint32_t>(slots.size());
+}
+
+size_t Registry::size() const { return slots.size() - free_slots.size(); }
+
+std::map<std::string, size_t> Registry::count_by_type() const {
+  std::map<const std::type_info *, size_t> counts;
+  for (auto &slot : slots) {
+    if (slot.type != nullptr) {
+      ++counts[slot.type];
+    }
+  }
+
+  std::map<std::string, size_t> result;
+  for (auto &count : counts) {
+    result[type_name(*count.first)] += count.second;
+  }
+  return result;
+}
+
+/* Registry::Group */
+
+void Registry::Group::clear() {
+  events.clear();
+  first_reference.clear();
+  targets.clear();
+  n_referenced.clear();
+  alive.clear();
+  reached.clear();
+  referenced.clear();
+  archive.clear();
+}
+
+} // namespace simcpp
@@ -0,0 +1,130 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_REGISTRY_H_
+#define SIMCPP_REGISTRY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include "archive.h"
+#include "simcpp.h"
+
+namespace simcpp {
+
+/**
+ * Registry of the events and processes of a simulation. Used by
+ * SimulationOptions::track_events.
+ *
+ * Each live event occupies a slot, which holds a weak pointer to it, so the
+ * registry does not keep events alive. Events free their slot when they are
+ * destroyed, and freed slots are reused. The generation of a slot changes
+ * whenever it is freed, so handles of destroyed events do not match later
+ * events.
+ */
+class Registry {
+public:
+  Registry() = default;
+
+  Registry(const Registry &) = delete;
+  Registry &operator=(const Registry &) = delete;
+
+  /**
+   * Add an event.
+   *
+   * @param event Event to add.
+   * @param type Type of the event.
+   * @param process Whether the event is a process.
+   * @return Slot of the event.
+   */
+  uint32_t add(const EventPtr &event, const std::type_info &type,
+               bool process);
+
+  /**
+   * Free the slot of a destroyed event.
+   *
+   * @param slot Slot of the event.
+   */
+  void remove(uint32_t slot);
+
+  /**
+   * @param slot Slot of an event.
+   * @return Handle of the event.
+   */
+  EventHandle get_handle(uint32_t slot) const;
+
+  /**
+   * @param handle Handle of an event.
+   * @return Event, or nullptr if it was destroyed.
+   */
+  EventPtr get(EventHandle handle) const;
+
+  /**
+   * @param slot Slot, which may be free.
+   * @return Event in the slot, or nullptr if the slot is free.
+   */
+  EventPtr get(uint32_t slot) const;
+
+  /**
+   * @param slot Slot, which may be free.
+   * @return Whether the slot holds a process.
+   */
+  bool is_process(uint32_t slot) const;
+
+  /// @return Number of slots, including free ones.
+  uint32_t get_n_slots() const;
+
+  /// @return Number of live events.
+  size_t size() const;
+
+  /// @return Number of live events by the readable name of their type.
+  std::map<std::string, size_t> count_by_type() const;
+
+  /// Group of events examined by Simulation::collect. Kept between calls, so
+  /// collecting allocates nothing once the buffers have grown.
+  class Group {
+  public:
+    /// Events of the group, each held once.
+    std::vector<EventPtr> events = {};
+    /// Index of the first reference of each event in targets, and the
+    /// number of references at the end.
+    std::vector<size_t> first_reference = {};
+    /// Indices of the events referred to, ordered by the referring event.
+    std::vector<size_t> targets = {};
+    /// Number of references to each event from the group.
+    std::vector<size_t> n_referenced = {};
+    std::vector<bool> alive = {};
+    std::vector<size_t> reached = {};
+    /// Events referred to by the event being examined.
+    std::vector<EventPtr> referenced = {};
+    /// Archive used to find the events saved by the event being examined.
+    Archive archive = {};
+
+    /// Release the events and empty the buffers.
+    void clear();
+  };
+
+  /// Buffers of Simulation::collect.
+  Group group = {};
+
+private:
+  class Slot {
+  public:
+    EventWeakPtr event;
+    /// Type of the event, or nullptr if the slot is free.
+    const std::type_info *type;
+    uint32_t generation;
+    bool process;
+  };
+
+  std::vector<Slot> slots = {};
+  std::vector<uint32_t> free_slots = {};
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_REGISTRY_H_
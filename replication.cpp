@@ -0,0 +1,163 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "replication.h"
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace simcpp {
+
+namespace {
+
+/// Indices of replications assigned to a worker.
+class WorkQueue {
+public:
+  void push_back(size_t index) { indices.push_back(index); }
+
+  /// Take the next replication of the owning worker.
+  bool pop_front(size_t &index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (indices.empty()) {
+      return false;
+    }
+    index = indices.front();
+    indices.pop_front();
+    return true;
+  }
+
+  /// Steal the last replication for another worker.
+  bool pop_back(size_t &index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (indices.empty()) {
+      return false;
+    }
+    index = indices.back();
+    indices.pop_back();
+    return true;
+  }
+
+private:
+  std::mutex mutex = {};
+  std::deque<size_t> indices = {};
+};
+
+} // namespace
+
+/* Replication */
+
+Replication::Replication(size_t index, uint64_t seed, SimulationPtr sim)
+    : index(index), seed(seed), sim(sim) {}
+
+/* ReplicationRunner */
+
+ReplicationRunner::ReplicationRunner(
+    size_t n_threads /* = 0 */,
+    const SimulationOptions &options /* = SimulationOptions() */)
+    : n_threads(n_threads), options(options) {
+  if (this->n_threads == 0) {
+    this->n_threads = std::thread::hardware_concurrency();
+  }
+  if (this->n_threads == 0) {
+    this->n_threads = 1;
+  }
+}
+
+ReplicationResults ReplicationRunner::run(const Model &model,
+                                          const std::vector<uint64_t> &seeds) {
+  size_t n = seeds.size();
+  size_t n_workers = n_threads < n ? n_threads : n;
+
+  ReplicationResults results;
+  results.values.resize(n);
+  if (n == 0) {
+    return results;
+  }
+
+  // Contiguous blocks, so neighboring replications run on the same worker
+  // unless they are stolen.
+  std::vector<WorkQueue> queues(n_workers);
+  for (size_t worker = 0; worker < n_workers; ++worker) {
+    for (size_t i = worker * n / n_workers; i < (worker + 1) * n / n_workers;
+         ++i) {
+      queues[worker].push_back(i);
+    }
+  }
+
+  std::atomic<bool> failed(false);
+  std::exception_ptr error = nullptr;
+  std::mutex error_mutex;
+
+  auto work = [&](size_t worker) {
+    while (!failed.load(std::memory_order_relaxed)) {
+      size_t index;
+      bool found = queues[worker].pop_front(index);
+      for (size_t k = 1; !found && k < n_workers; ++k) {
+        found = queues[(worker + k) % n_workers].pop_back(index);
+      }
+      if (!found) {
+        return;
+      }
+
+      try {
+        SimulationOptions replication_options = options;
+        replication_options.seed = seeds[index];
+        Replication replication(index, seeds[index],
+                                Simulation::create(replication_options));
+        results.values[index] = model(replication);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        failed = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t worker = 1; worker < n_workers; ++worker) {
+    threads.emplace_back(work, worker);
+  }
+  work(0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  // Summarize in the order of the seeds, so the statistics do not depend on
+  // the schedule of the workers.
+  for (auto value : results.values) {
+    results.summary.add(value);
+  }
+
+  return results;
+}
+
+ReplicationResults ReplicationRunner::run(const Model &model,
+                                          size_t n_replications,
+                                          uint64_t seed) {
+  return run(model, make_seeds(n_replications, seed));
+}
+
+size_t ReplicationRunner::get_n_threads() const { return n_threads; }
+
+std::vector<uint64_t> ReplicationRunner::make_seeds(size_t n, uint64_t seed) {
+  std::vector<uint64_t> seeds(n);
+  for (auto &result : seeds) {
+    seed += 0x9e3779b97f4a7c15;
+    uint64_t z = seed;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    result = z ^ (z >> 31);
+  }
+  return seeds;
+}
+
+} // namespace simcpp
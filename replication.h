@@ -0,0 +1,126 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_REPLICATION_H_
+#define SIMCPP_REPLICATION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "simcpp.h"
+#include "stats.h"
+
+namespace simcpp {
+
+/// Context of a single replication of a model.
+class Replication {
+public:
+  /// Index of the replication, in the order of the seeds.
+  size_t index;
+
+  /// Seed of the replication.
+  uint64_t seed;
+
+  /// Simulation instance of the replication. Its random number generator is
+  /// seeded with the seed.
+  SimulationPtr sim;
+
+  /**
+   * Construct a replication.
+   *
+   * @param index Index of the replication.
+   * @param seed Seed of the replication.
+   * @param sim Simulation instance of the replication.
+   */
+  Replication(size_t index, uint64_t seed, SimulationPtr sim);
+};
+
+/**
+ * Model run by a replication runner.
+ *
+ * Builds the model in the simulation of the replication, runs it and returns
+ * the observed response. It is called concurrently from multiple threads, so
+ * it must only use the simulation and random number generator of the
+ * replication and no other mutable shared state.
+ */
+using Model = std::function<double(Replication &)>;
+
+/// Results of a set of replications.
+class ReplicationResults {
+public:
+  /// Response of each replication, in the order of the seeds.
+  std::vector<double> values = {};
+
+  /// Summary statistics of the responses.
+  Tally summary = {};
+};
+
+/**
+ * Runs independent replications of a model in parallel.
+ *
+ * Replications are distributed over a pool of worker threads. Each worker
+ * takes replications from the front of its own queue and steals from the back
+ * of the queues of other workers when its own queue is empty, so the load is
+ * balanced even if the run times of replications vary. Each replication gets
+ * its own simulation and random number generator, so the results do not
+ * depend on the number of threads.
+ */
+class ReplicationRunner {
+public:
+  /**
+   * Construct a replication runner.
+   *
+   * @param n_threads Number of worker threads, including the calling thread. If
+   * 0, one thread per hardware thread is used.
+   * @param options Options of the simulation of each replication.
+   */
+  explicit ReplicationRunner(
+      size_t n_threads = 0,
+      const SimulationOptions &options = SimulationOptions());
+
+  /**
+   * Run one replication per seed. Blocks until all replications are finished.
+   *
+   * If a replication throws an exception, no further replications are started
+   * and the exception is rethrown.
+   *
+   * @param model Model to run.
+   * @param seeds Seed of each replication.
+   * @return Results of the replications.
+   */
+  ReplicationResults run(const Model &model,
+                         const std::vector<uint64_t> &seeds);
+
+  /**
+   * Run replications with seeds derived from a single seed.
+   *
+   * @param model Model to run.
+   * @param n_replications Number of replications.
+   * @param seed Seed from which the seeds of the replications are derived.
+   * @return Results of the replications.
+   */
+  ReplicationResults run(const Model &model, size_t n_replications,
+                         uint64_t seed);
+
+  /// @return Number of worker threads.
+  size_t get_n_threads() const;
+
+  /**
+   * Derive well-separated seeds from a single seed with SplitMix64.
+   *
+   * @param n Number of seeds.
+   * @param seed Seed from which the seeds are derived.
+   * @return Derived seeds.
+   */
+  static std::vector<uint64_t> make_seeds(size_t n, uint64_t seed);
+
+private:
+  size_t n_threads;
+  SimulationOptions options;
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_REPLICATION_H_
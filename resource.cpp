@@ -0,0 +1,376 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "resource.h"
+
+#include <cassert>
+#include <iterator>
+
+namespace simcpp {
+
+/* Request */
+
+Request::Request(SimulationPtr sim, Resource *resource /* = nullptr */,
+                 int priority /* = 0 */, bool preempt /* = false */)
+    : Event(sim), resource(resource), priority(priority), preempt(preempt) {}
+
+int Request::get_priority() const { return priority; }
+
+bool Request::is_granted() const { return granted; }
+
+bool Request::is_preempted() const { return was_preempted; }
+
+EventPtr Request::preempted() {
+  if (preemption == nullptr) {
+    preemption = sim.lock()->event();
+    if (was_preempted) {
+      preemption->trigger();
+    }
+  }
+
+  return preemption;
+}
+
+void Request::Aborted() {
+  if (waiting && resource != nullptr) {
+    waiting = false;
+    resource->dequeue(*this);
+  }
+  Event::Aborted();
+}
+
+void Request::save(Archive &archive) const {
+  Event::save(archive);
+  archive.save(priority);
+  archive.save(preempt);
+  archive.save(order);
+  archive.save(waiting);
+  archive.save(granted);
+  archive.save(was_preempted);
+  archive.save(preemption);
+}
+
+void Request::load(Archive &archive) {
+  Event::load(archive);
+  archive.load(priority);
+  archive.load(preempt);
+  archive.load(order);
+  archive.load(waiting);
+  archive.load(granted);
+  archive.load(was_preempted);
+  archive.load(preemption);
+}
+
+/* Resource */
+
+Resource::Resource(SimulationPtr sim, size_t capacity)
+    : sim(sim), capacity(capacity),
+      queue(PoolAllocator<RequestPtr>(sim->get_pool())) {}
+
+Resource::~Resource() {
+  for (auto &request : queue) {
+    request->resource = nullptr;
+  }
+}
+
+RequestPtr Resource::request() { return add_request(0, false); }
+
+void Resource::release(const RequestPtr &request) {
+  // Granted requests loaded from a snapshot have no resource.
+  assert(request->resource == this || request->resource == nullptr);
+
+  if (request->waiting) {
+    request->abort();
+    return;
+  }
+  if (!request->granted) {
+    return;
+  }
+
+  request->granted = false;
+  --n_users;
+  released(*request);
+  grant();
+}
+
+size_t Resource::get_capacity() const { return capacity; }
+
+void Resource::set_capacity(size_t capacity) {
+  this->capacity = capacity;
+  grant();
+}
+
+size_t Resource::get_n_users() const { return n_users; }
+
+size_t Resource::get_n_queued() const { return queue.size(); }
+
+void Resource::save(Archive &archive) const {
+  archive.save(capacity);
+  archive.save(n_users);
+  archive.save(next_order);
+  archive.save(queue.size());
+  for (auto &request : queue) {
+    archive.save(request);
+  }
+}
+
+void Resource::load(Archive &archive) {
+  archive.load(capacity);
+  archive.load(n_users);
+  archive.load(next_order);
+  queue.clear();
+  size_t size;
+  archive.load(size);
+  for (size_t i = 0; i < size; ++i) {
+    RequestPtr request;
+    archive.load(request);
+    request->resource = this;
+    request->position = queue.insert(queue.end(), request);
+  }
+}
+
+RequestPtr Resource::add_request(int priority, bool preempt) {
+  auto request = sim.lock()->event<Request>(this, priority, preempt);
+  request->order = next_order++;
+  request->waiting = true;
+  enqueue(request);
+  grant();
+  return request;
+}
+
+void Resource::enqueue(const RequestPtr &request) {
+  request->position = queue.insert(queue.end(), request);
+}
+
+void Resource::dequeue(Request &request) { queue.erase(request.position); }
+
+RequestPtr Resource::front() const {
+  return queue.empty() ? nullptr : queue.front();
+}
+
+void Resource::acquired(const RequestPtr &) {}
+
+void Resource::released(Request &) {}
+
+void Resource::grant() {
+  while (n_users < capacity) {
+    auto request = front();
+    if (request == nullptr) {
+      break;
+    }
+
+    request->waiting = false;
+    dequeue(*request);
+    request->granted = true;
+    ++n_users;
+    acquired(request);
+    request->trigger();
+  }
+}
+
+/* PriorityResource */
+
+bool PriorityResource::Before::operator()(const RequestPtr &a,
+                                          const RequestPtr &b) const {
+  if (a->priority != b->priority) {
+    return a->priority < b->priority;
+  }
+  return a->order < b->order;
+}
+
+PriorityResource::PriorityResource(SimulationPtr sim, size_t capacity)
+    : Resource(sim, capacity),
+      queue(Before(), PoolAllocator<RequestPtr>(sim->get_pool())) {}
+
+PriorityResource::~PriorityResource() {
+  for (auto &request : queue) {
+    request->resource = nullptr;
+  }
+}
+
+RequestPtr PriorityResource::request(int priority) {
+  return add_request(priority, false);
+}
+
+size_t PriorityResource::get_n_queued() const { return queue.size(); }
+
+void PriorityResource::save(Archive &archive) const {
+  Resource::save(archive);
+  archive.save(queue.size());
+  for (auto &request : queue) {
+    archive.save(request);
+  }
+}
+
+void PriorityResource::load(Archive &archive) {
+  Resource::load(archive);
+  queue.clear();
+  size_t size;
+  archive.load(size);
+  for (size_t i = 0; i < size; ++i) {
+    RequestPtr request;
+    archive.load(request);
+    request->resource = this;
+    queue.insert(request);
+  }
+}
+
+void PriorityResource::enqueue(const RequestPtr &request) {
+  queue.insert(request);
+}
+
+void PriorityResource::dequeue(Request &request) {
+  queue.erase(find(queue, request));
+}
+
+RequestPtr PriorityResource::front() const {
+  return queue.empty() ? nullptr : *queue.begin();
+}
+
+PriorityResource::Set::iterator PriorityResource::find(Set &set,
+                                                       Request &request) {
+  // The set does not own the request, so the shared pointer must not delete
+  // it.
+  RequestPtr key(RequestPtr(), &request);
+  return set.find(key);
+}
+
+/* PreemptiveResource */
+
+PreemptiveResource::PreemptiveResource(SimulationPtr sim, size_t capacity)
+    : PriorityResource(sim, capacity),
+      users(Before(), PoolAllocator<RequestPtr>(sim->get_pool())) {}
+
+RequestPtr PreemptiveResource::request(int priority, bool preempt) {
+  return add_request(priority, preempt);
+}
+
+void PreemptiveResource::save(Archive &archive) const {
+  PriorityResource::save(archive);
+  archive.save(users.size());
+  for (auto &request : users) {
+    archive.save(request);
+  }
+}
+
+void PreemptiveResource::load(Archive &archive) {
+  PriorityResource::load(archive);
+  users.clear();
+  size_t size;
+  archive.load(size);
+  for (size_t i = 0; i < size; ++i) {
+    RequestPtr request;
+    archive.load(request);
+    request->resource = this;
+    users.insert(request);
+  }
+}
+
+void PreemptiveResource::enqueue(const RequestPtr &request) {
+  PriorityResource::enqueue(request);
+
+  if (!request->preempt || n_users < capacity || users.empty()) {
+    return;
+  }
+
+  auto last = std::prev(users.end());
+  auto user = *last;
+  if (user->priority <= request->priority) {
+    return;
+  }
+
+  users.erase(last);
+  user->granted = false;
+  user->was_preempted = true;
+  --n_users;
+  if (user->preemption != nullptr) {
+    user->preemption->trigger();
+  }
+}
+
+void PreemptiveResource::acquired(const RequestPtr &request) {
+  users.insert(request);
+}
+
+void PreemptiveResource::released(Request &request) {
+  users.erase(find(users, request));
+}
+
+/* Container */
+
+Container::Transfer::Transfer(SimulationPtr sim, Container *container,
+                              double amount, bool put)
+    : Event(sim), container(container), amount(amount), put(put) {}
+
+void Container::Transfer::Aborted() {
+  if (container != nullptr) {
+    (put ? container->puts : container->gets).erase(position);
+    container = nullptr;
+  }
+  Event::Aborted();
+}
+
+Container::Container(SimulationPtr sim,
+                     double capacity /* = infinity */,
+                     double level /* = 0.0 */)
+    : sim(sim), capacity(capacity), level(level),
+      puts(PoolAllocator<TransferPtr>(sim->get_pool())),
+      gets(PoolAllocator<TransferPtr>(sim->get_pool())) {}
+
+Container::~Container() {
+  for (auto &put : puts) {
+    put->container = nullptr;
+  }
+  for (auto &get : gets) {
+    get->container = nullptr;
+  }
+}
+
+EventPtr Container::put(double amount) { return transfer(amount, true); }
+
+EventPtr Container::get(double amount) { return transfer(amount, false); }
+
+double Container::get_capacity() const { return capacity; }
+
+double Container::get_level() const { return level; }
+
+size_t Container::get_n_puts() const { return puts.size(); }
+
+size_t Container::get_n_gets() const { return gets.size(); }
+
+EventPtr Container::transfer(double amount, bool put) {
+  assert(amount >= 0.0 && amount <= capacity);
+
+  auto transfer = sim.lock()->event<Transfer>(this, amount, put);
+  auto &list = put ? puts : gets;
+  transfer->position = list.insert(list.end(), transfer);
+  trigger_transfers();
+  return transfer;
+}
+
+void Container::trigger_transfers() {
+  bool progress = true;
+  while (progress) {
+    progress = false;
+
+    while (!puts.empty() && level + puts.front()->amount <= capacity) {
+      auto put = puts.front();
+      puts.pop_front();
+      put->container = nullptr;
+      level += put->amount;
+      put->trigger();
+      progress = true;
+    }
+
+    while (!gets.empty() && gets.front()->amount <= level) {
+      auto get = gets.front();
+      gets.pop_front();
+      get->container = nullptr;
+      level -= get->amount;
+      get->trigger();
+      progress = true;
+    }
+  }
+}
+
+} // namespace simcpp
@@ -0,0 +1,620 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_RESOURCE_H_
+#define SIMCPP_RESOURCE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <list>
+#include <memory>
+#include <set>
+#include <utility>
+
+#include "archive.h"
+#include "pool.h"
+#include "simcpp.h"
+
+namespace simcpp {
+
+class Request;
+class Resource;
+
+using RequestPtr = std::shared_ptr<Request>;
+
+/**
+ * Request for a slot of a resource.
+ *
+ * The request is triggered when the slot is granted. A request which is still
+ * waiting can be withdrawn by aborting it (reneging). It is then removed from
+ * the queue of the resource immediately.
+ */
+class Request : public Event {
+public:
+  /**
+   * Construct a request. Use the request method of a resource instead.
+   *
+   * @param sim Simulation instance.
+   * @param resource Resource the request belongs to. Waiting requests are
+   * assigned to a resource when it is loaded.
+   * @param priority Priority of the request. Lower values are served first.
+   * @param preempt Whether the request may preempt users with a lower
+   * priority.
+   */
+  explicit Request(SimulationPtr sim, Resource *resource = nullptr,
+                   int priority = 0, bool preempt = false);
+
+  /// @return Priority of the request.
+  int get_priority() const;
+
+  /// @return Whether the request holds a slot of the resource.
+  bool is_granted() const;
+
+  /// @return Whether the slot of the request was taken by another request.
+  bool is_preempted() const;
+
+  /**
+   * @return Event which is triggered when the slot of the request is taken by
+   * another request of a PreemptiveResource. Constructed on the first call.
+   */
+  EventPtr preempted();
+
+  void Aborted() override;
+
+  void save(Archive &archive) const override;
+  void load(Archive &archive) override;
+
+private:
+  friend class Resource;
+  friend class PriorityResource;
+  friend class PreemptiveResource;
+
+  using List = std::list<RequestPtr, PoolAllocator<RequestPtr>>;
+
+  Resource *resource;
+  int priority;
+  bool preempt;
+  /// Order of the request at its resource, to serve equal priorities FIFO.
+  uint64_t order = 0;
+  bool waiting = false;
+  bool granted = false;
+  bool was_preempted = false;
+  /// Position in the queue of a Resource, which has no priorities.
+  List::iterator position = {};
+  EventPtr preemption = nullptr;
+};
+
+/**
+ * Resource with a number of slots, which are granted to requests in FIFO
+ * order.
+ *
+ * Requests and releases take constant time. The nodes of the queue are
+ * allocated from the pool of the simulation, and so are the requests if its
+ * allocation is pooled.
+ *
+ * ```
+ * auto request = resource->request();
+ * PT_WAIT(request);
+ * PT_WAIT(sim->timeout(service_time));
+ * resource->release(request);
+ * ```
+ */
+class Resource {
+public:
+  /**
+   * Construct a resource.
+   *
+   * @param sim Simulation instance.
+   * @param capacity Number of slots.
+   */
+  Resource(SimulationPtr sim, size_t capacity);
+
+  Resource(const Resource &) = delete;
+  Resource &operator=(const Resource &) = delete;
+
+  /// Withdraws all waiting requests from the resource without aborting them.
+  virtual ~Resource();
+
+  /**
+   * Request a slot.
+   *
+   * @return Request, which is triggered when the slot is granted.
+   */
+  RequestPtr request();
+
+  /**
+   * Release the slot of a request. A request which is still waiting is
+   * aborted instead. Nothing is done for preempted requests.
+   *
+   * @param request Request of this resource.
+   */
+  void release(const RequestPtr &request);
+
+  /// @return Number of slots.
+  size_t get_capacity() const;
+
+  /**
+   * Change the number of slots. Free slots are granted to waiting requests.
+   * Users keep their slots if the capacity is reduced below their number.
+   *
+   * @param capacity Number of slots.
+   */
+  void set_capacity(size_t capacity);
+
+  /// @return Number of granted slots.
+  size_t get_n_users() const;
+
+  /// @return Number of waiting requests.
+  virtual size_t get_n_queued() const;
+
+  /**
+   * Save the state of the resource, including its waiting requests. Used for
+   * checkpoints and snapshots of the model.
+   *
+   * @param archive Archive to save to.
+   */
+  virtual void save(Archive &archive) const;
+
+  /**
+   * Restore the state saved with save.
+   *
+   * @param archive Archive to load from.
+   */
+  virtual void load(Archive &archive);
+
+protected:
+  SimulationWeakPtr sim;
+  size_t capacity;
+  size_t n_users = 0;
+  uint64_t next_order = 0;
+
+  /**
+   * Construct a request, queue it and grant free slots.
+   *
+   * @param priority Priority of the request.
+   * @param preempt Whether the request may preempt users.
+   * @return Request.
+   */
+  RequestPtr add_request(int priority, bool preempt);
+
+  /// Add a waiting request to the queue.
+  virtual void enqueue(const RequestPtr &request);
+
+  /// Remove a waiting request from the queue.
+  virtual void dequeue(Request &request);
+
+  /// @return Next waiting request, or nullptr.
+  virtual RequestPtr front() const;
+
+  /// Called after a request was granted a slot.
+  virtual void acquired(const RequestPtr &request);
+
+  /// Called after a granted request gave up its slot.
+  virtual void released(Request &request);
+
+  /// Grant free slots to waiting requests.
+  void grant();
+
+private:
+  friend class Request;
+
+  Request::List queue;
+};
+
+/**
+ * Resource which grants slots to requests in the order of their priority, and
+ * in FIFO order for equal priorities.
+ *
+ * Requests and releases take logarithmic time.
+ */
+class PriorityResource : public Resource {
+public:
+  /**
+   * Construct a resource.
+   *
+   * @param sim Simulation instance.
+   * @param capacity Number of slots.
+   */
+  PriorityResource(SimulationPtr sim, size_t capacity);
+
+  ~PriorityResource() override;
+
+  using Resource::request;
+
+  /**
+   * Request a slot.
+   *
+   * @param priority Priority of the request. Lower values are served first.
+   * @return Request, which is triggered when the slot is granted.
+   */
+  RequestPtr request(int priority);
+
+  size_t get_n_queued() const override;
+
+  void save(Archive &archive) const override;
+  void load(Archive &archive) override;
+
+protected:
+  class Before {
+  public:
+    bool operator()(const RequestPtr &a, const RequestPtr &b) const;
+  };
+
+  using Set = std::set<RequestPtr, Before, PoolAllocator<RequestPtr>>;
+
+  void enqueue(const RequestPtr &request) override;
+  void dequeue(Request &request) override;
+  RequestPtr front() const override;
+
+  /**
+   * Find a request in a set by its priority and order.
+   *
+   * @param set Set of requests.
+   * @param request Request to find.
+   * @return Position of the request, or the end of the set.
+   */
+  static Set::iterator find(Set &set, Request &request);
+
+private:
+  Set queue;
+};
+
+/**
+ * Priority resource whose requests can take the slot of a user with a lower
+ * priority.
+ *
+ * A request which preempts is granted a slot when it is full and the user with
+ * the lowest priority, and the latest among equals, has a strictly lower
+ * priority than the request. That user loses its slot: Its preempted event is
+ * triggered, and releasing it does nothing.
+ */
+class PreemptiveResource : public PriorityResource {
+public:
+  /**
+   * Construct a resource.
+   *
+   * @param sim Simulation instance.
+   * @param capacity Number of slots.
+   */
+  PreemptiveResource(SimulationPtr sim, size_t capacity);
+
+  using PriorityResource::request;
+
+  /**
+   * Request a slot.
+   *
+   * @param priority Priority of the request. Lower values are served first.
+   * @param preempt Whether the request may preempt users with a lower
+   * priority.
+   * @return Request, which is triggered when the slot is granted.
+   */
+  RequestPtr request(int priority, bool preempt);
+
+  void save(Archive &archive) const override;
+  void load(Archive &archive) override;
+
+protected:
+  void enqueue(const RequestPtr &request) override;
+  void acquired(const RequestPtr &request) override;
+  void released(Request &request) override;
+
+private:
+  Set users;
+};
+
+/**
+ * Container of a continuous amount, for example of fuel.
+ *
+ * Puts wait until there is space, gets until there is enough of the amount,
+ * each in FIFO order. Waiting puts and gets can be aborted, which removes them
+ * immediately.
+ */
+class Container {
+public:
+  /**
+   * Construct a container.
+   *
+   * @param sim Simulation instance.
+   * @param capacity Largest amount the container holds.
+   * @param level Initial amount.
+   */
+  explicit Container(
+      SimulationPtr sim,
+      double capacity = std::numeric_limits<double>::infinity(),
+      double level = 0.0);
+
+  Container(const Container &) = delete;
+  Container &operator=(const Container &) = delete;
+
+  ~Container();
+
+  /**
+   * Put an amount into the container.
+   *
+   * @param amount Amount to put. Must not be larger than the capacity.
+   * @return Event, which is triggered when the amount was put.
+   */
+  EventPtr put(double amount);
+
+  /**
+   * Get an amount from the container.
+   *
+   * @param amount Amount to get. Must not be larger than the capacity.
+   * @return Event, which is triggered when the amount was taken.
+   */
+  EventPtr get(double amount);
+
+  /// @return Largest amount the container holds.
+  double get_capacity() const;
+
+  /// @return Current amount.
+  double get_level() const;
+
+  /// @return Number of waiting puts.
+  size_t get_n_puts() const;
+
+  /// @return Number of waiting gets.
+  size_t get_n_gets() const;
+
+private:
+  class Transfer;
+  using TransferPtr = std::shared_ptr<Transfer>;
+  using List = std::list<TransferPtr, PoolAllocator<TransferPtr>>;
+
+  class Transfer : public Event {
+  public:
+    Transfer(SimulationPtr sim, Container *container, double amount, bool put);
+
+    void Aborted() override;
+
+  private:
+    friend class Container;
+
+    Container *container;
+    double amount;
+    bool put;
+    List::iterator position = {};
+  };
+
+  SimulationWeakPtr sim;
+  double capacity;
+  double level;
+  List puts;
+  List gets;
+
+  EventPtr transfer(double amount, bool put);
+  void trigger_transfers();
+};
+
+/**
+ * Store of discrete items, which are taken in FIFO order.
+ *
+ * Puts wait until there is space, gets until there is an item. Waiting puts
+ * and gets can be aborted, which removes them immediately.
+ *
+ * @tparam T Type of the items. Must be movable.
+ */
+template <typename T> class Store {
+public:
+  using Filter = std::function<bool(const T &)>;
+
+  /// Event of a get, which holds the item as its value once it is triggered.
+  class Get : public ValueEvent<T> {
+  public:
+    /**
+     * Construct a get. Use the get method of a store instead.
+     *
+     * @param sim Simulation instance.
+     * @param store Store the get belongs to.
+     * @param filter Function which accepts items, or nullptr for any item.
+     */
+    Get(SimulationPtr sim, Store *store, Filter filter)
+        : ValueEvent<T>(sim), store(store), filter(std::move(filter)) {}
+
+    /// @return Item taken from the store, once the get is triggered.
+    T &get_item() { return this->get_value(); }
+
+    void Aborted() override {
+      if (store != nullptr) {
+        store->gets.erase(position);
+        store = nullptr;
+      }
+      ValueEvent<T>::Aborted();
+    }
+
+  private:
+    friend class Store;
+
+    Store *store;
+    Filter filter;
+    typename std::list<std::shared_ptr<Get>,
+                       PoolAllocator<std::shared_ptr<Get>>>::iterator position =
+        {};
+  };
+
+  using GetPtr = std::shared_ptr<Get>;
+
+  /**
+   * Construct a store.
+   *
+   * @param sim Simulation instance.
+   * @param capacity Largest number of items the store holds.
+   */
+  explicit Store(SimulationPtr sim,
+                 size_t capacity = std::numeric_limits<size_t>::max())
+      : sim(sim), capacity(capacity), puts(PoolAllocator<PutPtr>(sim->get_pool())),
+        gets(PoolAllocator<GetPtr>(sim->get_pool())) {}
+
+  Store(const Store &) = delete;
+  Store &operator=(const Store &) = delete;
+
+  /// Withdraws all waiting puts and gets from the store without aborting them.
+  virtual ~Store() {
+    for (auto &put : puts) {
+      put->store = nullptr;
+    }
+    for (auto &get : gets) {
+      get->store = nullptr;
+    }
+  }
+
+  /**
+   * Put an item into the store.
+   *
+   * @param item Item to put.
+   * @return Event, which is triggered when the item was put.
+   */
+  EventPtr put(T item) {
+    auto put = sim.lock()->template event<Put>(this, std::move(item));
+    put->position = puts.insert(puts.end(), put);
+    trigger_transfers();
+    return put;
+  }
+
+  /**
+   * Get the oldest item from the store.
+   *
+   * @return Get, which is triggered when an item was taken.
+   */
+  GetPtr get() { return get(nullptr); }
+
+  /// @return Number of items.
+  size_t size() const { return items.size(); }
+
+  /// @return Largest number of items the store holds.
+  size_t get_capacity() const { return capacity; }
+
+  /// @return Items in the order in which they were put.
+  const std::deque<T> &get_items() const { return items; }
+
+  /// @return Number of waiting puts.
+  size_t get_n_puts() const { return puts.size(); }
+
+  /// @return Number of waiting gets.
+  size_t get_n_gets() const { return gets.size(); }
+
+protected:
+  /**
+   * Get the oldest item accepted by a filter from the store.
+   *
+   * @param filter Function which accepts items, or nullptr for any item.
+   * @return Get, which is triggered when an item was taken.
+   */
+  GetPtr get(Filter filter) {
+    auto get = sim.lock()->template event<Get>(this, std::move(filter));
+    get->position = gets.insert(gets.end(), get);
+    trigger_transfers();
+    return get;
+  }
+
+private:
+  class Put;
+  using PutPtr = std::shared_ptr<Put>;
+
+  class Put : public Event {
+  public:
+    Put(SimulationPtr sim, Store *store, T item)
+        : Event(sim), store(store), item(std::move(item)) {}
+
+    void Aborted() override {
+      if (store != nullptr) {
+        store->puts.erase(position);
+        store = nullptr;
+      }
+      Event::Aborted();
+    }
+
+  private:
+    friend class Store;
+
+    Store *store;
+    T item;
+    typename std::list<PutPtr, PoolAllocator<PutPtr>>::iterator position = {};
+  };
+
+  SimulationWeakPtr sim;
+  size_t capacity;
+  std::deque<T> items = {};
+  std::list<PutPtr, PoolAllocator<PutPtr>> puts;
+  std::list<GetPtr, PoolAllocator<GetPtr>> gets;
+
+  void trigger_transfers() {
+    bool progress = true;
+    while (progress) {
+      progress = false;
+
+      while (!puts.empty() && items.size() < capacity) {
+        auto put = puts.front();
+        puts.pop_front();
+        put->store = nullptr;
+        items.push_back(std::move(put->item));
+        put->trigger();
+        progress = true;
+      }
+
+      // Gets without a filter take the oldest item, so they only wait while
+      // the store is empty. Gets with a filter may be passed by later gets.
+      for (auto it = gets.begin(); it != gets.end() && !items.empty();) {
+        auto &get = *it;
+        auto item = items.begin();
+        if (get->filter) {
+          while (item != items.end() && !get->filter(*item)) {
+            ++item;
+          }
+          if (item == items.end()) {
+            ++it;
+            continue;
+          }
+        }
+
+        get->store = nullptr;
+        get->trigger(std::move(*item));
+        items.erase(item);
+        it = gets.erase(it);
+        progress = true;
+      }
+    }
+  }
+};
+
+/**
+ * Store whose gets can select items with a filter.
+ *
+ * A get takes the oldest item accepted by its filter. Waiting gets are served
+ * in FIFO order, but a get for which no item is accepted does not block later
+ * gets.
+ *
+ * @tparam T Type of the items. Must be movable.
+ */
+template <typename T> class FilterStore : public Store<T> {
+public:
+  using typename Store<T>::Filter;
+  using typename Store<T>::GetPtr;
+
+  /**
+   * Construct a store.
+   *
+   * @param sim Simulation instance.
+   * @param capacity Largest number of items the store holds.
+   */
+  explicit FilterStore(SimulationPtr sim,
+                       size_t capacity = std::numeric_limits<size_t>::max())
+      : Store<T>(sim, capacity) {}
+
+  using Store<T>::get;
+
+  /**
+   * Get the oldest item accepted by a filter from the store.
+   *
+   * @param filter Function which accepts items.
+   * @return Get, which is triggered when an item was taken.
+   */
+  GetPtr get(Filter filter) { return Store<T>::get(std::move(filter)); }
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_RESOURCE_H_
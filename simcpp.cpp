@@ -3,12 +3,86 @@
 
 #include "simcpp.h"
 
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include "archive.h"
+#include "inbox.h"
+#include "queue.h"
+#include "registry.h"
+
 namespace simcpp {
 
+namespace {
+
+void call_handler(void *context, Event &event) {
+  (*static_cast<Handler *>(context))(event.shared_from_this());
+}
+
+void resume_process(void *context, Event &) {
+  static_cast<Process *>(context)->resume();
+}
+
+thread_local Journal *active_journal = nullptr;
+
+/// Minimum number of aborted events in the queue before it is compacted.
+const size_t min_compaction_size = 64;
+
+/// Hint the processor to load an address into the cache.
+inline void prefetch(const void *address) {
+#if defined(__GNUC__)
+  __builtin_prefetch(address);
+#else
+  (void)address;
+#endif
+}
+
+} // namespace
+
+/* Journal */
+
+Journal::~Journal() {}
+
+Journal *Journal::get_active() { return active_journal; }
+
+void Journal::set_active(Journal *journal) { active_journal = journal; }
+
 /* Simulation */
 
 SimulationPtr Simulation::create() { return std::make_shared<Simulation>(); }
 
+SimulationPtr Simulation::create(const SimulationOptions &options) {
+  return std::make_shared<Simulation>(options);
+}
+
+Simulation::Simulation(const SimulationOptions &options /* = ... */)
+    : options(options), queued_events(make_queue(options.queue_type)),
+      pool(new Pool()),
+      pooled(options.pooled_allocation),
+      compaction_ratio(options.compaction_ratio), random(options.seed),
+      inbox(options.inbox_capacity > 0 ? new Inbox(options.inbox_capacity)
+                                       : nullptr),
+      calls(new CallQueue()),
+      registry(options.track_events ? new Registry() : nullptr) {
+  if (options.timing_wheel_resolution > 0.0) {
+    // Aborted events are dropped like by compact, unless a journal needs to
+    // restore them.
+    queued_events.reset(new TimingWheelQueue(
+        std::move(queued_events), options.timing_wheel_resolution,
+        options.timing_wheel_horizon, [this](const QueuedEvent &entry) {
+          if (!entry.event->is_aborted() || active_journal != nullptr) {
+            return false;
+          }
+          dequeued(*entry.event);
+          return true;
+        }));
+  }
+}
+
+Simulation::~Simulation() { pool->release(); }
+
 void Simulation::run_process(ProcessPtr process, simtime delay /* = 0.0 */) {
   auto event = this->event();
   event->add_handler(process);
@@ -21,78 +95,269 @@ EventPtr Simulation::timeout(simtime delay) {
   return event;
 }
 
-EventPtr Simulation::any_of(std::initializer_list<EventPtr> events) {
-  auto any_of_event = event();
+ConditionPtr Simulation::any_of(std::initializer_list<EventPtr> events) {
+  return n_of(1, events.begin(), events.end());
+}
+
+ConditionPtr Simulation::any_of(const std::vector<EventPtr> &events) {
+  return n_of(1, events.begin(), events.end());
+}
+
+ConditionPtr Simulation::all_of(std::initializer_list<EventPtr> events) {
+  return n_of(events.size(), events.begin(), events.end());
+}
+
+ConditionPtr Simulation::all_of(const std::vector<EventPtr> &events) {
+  return n_of(events.size(), events.begin(), events.end());
+}
+
+ConditionPtr Simulation::n_of(size_t n,
+                              std::initializer_list<EventPtr> events) {
+  return n_of(n, events.begin(), events.end());
+}
 
-  for (auto &event : events) {
-    if (event->is_triggered()) {
-      any_of_event->trigger();
-      return any_of_event;
+ConditionPtr Simulation::n_of(size_t n, const std::vector<EventPtr> &events) {
+  return n_of(n, events.begin(), events.end());
+}
+
+void Simulation::schedule(EventPtr event, simtime delay /* = 0.0 */) {
+  // All events at the current time are in the batch, so an event scheduled
+  // at that time is processed after them, as its id is larger.
+  if (batching && now + delay == now) {
+    batch.push_back(std::move(event));
+    ++next_id;
+    SIMCPP_PROFILE_HOOK(
+        on_schedule(queued_events->size() + batch.size() - batch_position));
+    return;
+  }
+
+  event->queued = true;
+  queued_events->push(QueuedEvent(now + delay, next_id, event));
+  if (active_journal != nullptr) {
+    active_journal->record_push(now + delay, next_id);
+  }
+  ++next_id;
+  SIMCPP_PROFILE_HOOK(
+      on_schedule(queued_events->size() + batch.size() - batch_position));
+}
+
+bool Simulation::cancel(EventPtr event) {
+  if (!event->abort()) {
+    return false;
+  }
+
+  // Without a journal, the queue cannot be restored.
+  if (event->queued && active_journal == nullptr) {
+    queued_events->remove_if(
+        [&event](const QueuedEvent &entry) { return entry.event == event; });
+    event->queued = false;
+    if (n_aborted_queued > 0) {
+      --n_aborted_queued;
     }
   }
 
-  auto handler = [any_of_event](simcpp::EventPtr) { any_of_event->trigger(); };
+  return true;
+}
+
+CallHandle Simulation::call_at(simtime time, Call call) {
+  return schedule_call(time, 0.0, std::move(call));
+}
+
+CallHandle Simulation::call_in(simtime delay, Call call) {
+  return schedule_call(now + delay, 0.0, std::move(call));
+}
 
-  for (auto &event : events) {
-    event->add_handler(handler);
+CallHandle Simulation::call_every(simtime period, Call call) {
+  if (!(period > 0.0)) {
+    throw std::invalid_argument("period must be positive");
   }
 
-  return any_of_event;
+  return schedule_call(now + period, period, std::move(call));
 }
 
-EventPtr Simulation::all_of(std::initializer_list<EventPtr> events) {
-  int n = events.size();
+bool Simulation::cancel(CallHandle handle) { return calls->cancel(handle); }
 
-  for (auto &event : events) {
-    if (event->is_triggered()) {
-      --n;
-    }
+bool Simulation::step() {
+  receive_posted();
+  collect_incrementally();
+  if (batch_position < batch.size()) {
+    auto event = std::move(batch[batch_position]);
+    ++batch_position;
+    SIMCPP_PROFILE_HOOK(
+        on_step(now, queued_events->size() + batch.size() - batch_position));
+    SIMCPP_TRACE_HOOK(set_time(now));
+    event->process();
+    return true;
   }
 
-  auto all_of_event = event();
+  if (call_is_next()) {
+    make_call();
+    return true;
+  }
 
-  if (n == 0) {
-    all_of_event->trigger();
-    return all_of_event;
+  if (queued_events->empty()) {
+    return false;
   }
-  
-  auto n_ptr = std::make_shared<int>(n);
-  auto handler = [all_of_event, n_ptr](simcpp::EventPtr) {
-    --*n_ptr;
-    if (*n_ptr == 0) {
-      all_of_event->trigger();
-    }
-  };
 
-  for (auto &event : events) {
-    event->add_handler(handler);
+  auto queued_event = queued_events->pop();
+  dequeued(*queued_event.event);
+  if (active_journal != nullptr) {
+    active_journal->record_pop(queued_event.time, queued_event.id,
+                               queued_event.event);
+  }
+  now = queued_event.time;
+  SIMCPP_PROFILE_HOOK(on_step(now, queued_events->size()));
+  SIMCPP_TRACE_HOOK(set_time(now));
+  queued_event.event->process();
+  return true;
+}
+
+size_t Simulation::run_batch() {
+  if (batching || active_journal != nullptr) {
+    return step() ? 1 : 0;
   }
 
-  return all_of_event;
+  receive_posted();
+  // Calls are not batched, so events at the time of a call are processed
+  // one by one in their order with it.
+  if (!calls->empty() && (queued_events->empty() ||
+                          calls->top().time <= queued_events->top().time)) {
+    return step() ? 1 : 0;
+  }
+  if (queued_events->empty()) {
+    return 0;
+  }
+
+  collect_incrementally();
+  now = queued_events->top().time;
+  do {
+    auto event = std::move(queued_events->pop().event);
+    dequeued(*event);
+    if (!event->is_aborted()) {
+      batch.push_back(std::move(event));
+    }
+  } while (!queued_events->empty() && queued_events->top().time == now);
+  batching = true;
+
+  size_t n_processed = 0;
+  try {
+    while (batch_position < batch.size()) {
+      auto event = std::move(batch[batch_position]);
+      ++batch_position;
+      if (batch_position < batch.size()) {
+        prefetch(batch[batch_position].get());
+      }
+      SIMCPP_PROFILE_HOOK(
+          on_step(now, queued_events->size() + batch.size() - batch_position));
+      SIMCPP_TRACE_HOOK(set_time(now));
+      event->process();
+      ++n_processed;
+    }
+  } catch (...) {
+    end_batch();
+    throw;
+  }
+
+  end_batch();
+  return n_processed;
 }
 
-void Simulation::schedule(EventPtr event, simtime delay /* = 0.0 */) {
-  queued_events.emplace(now + delay, next_id, event);
+CallHandle Simulation::schedule_call(simtime time, simtime period,
+                                     Call call) {
+  if (time < now) {
+    throw std::invalid_argument("call time is before the current time");
+  }
+  if (active_journal != nullptr) {
+    throw std::logic_error("calls cannot be scheduled with a journal");
+  }
+
+  if (batching && time == now) {
+    // The events left in the batch were scheduled before the call, so they
+    // get smaller ids when they are pushed back to the queue.
+    end_batch();
+  }
+
+  auto handle = calls->push(time, next_id, period, std::move(call));
   ++next_id;
+  return handle;
 }
 
-bool Simulation::step() {
-  if (queued_events.empty()) {
+bool Simulation::call_is_next() {
+  if (calls->empty()) {
     return false;
   }
+  if (queued_events->empty()) {
+    return true;
+  }
 
-  auto queued_event = queued_events.top();
-  queued_events.pop();
-  now = queued_event.time;
-  auto event = queued_event.event;
-  event->process();
-  return true;
+  auto &call = calls->top();
+  auto &entry = queued_events->top();
+  return call.time != entry.time ? call.time < entry.time
+                                 : call.id < entry.id;
+}
+
+void Simulation::make_call() {
+  if (active_journal != nullptr) {
+    throw std::logic_error("calls cannot be made with a journal");
+  }
+
+  auto entry = calls->pop();
+  now = entry.time;
+  SIMCPP_PROFILE_HOOK(on_step(now, queued_events->size()));
+  SIMCPP_TRACE_HOOK(set_time(now));
+  try {
+    calls->call(entry.slot);
+  } catch (...) {
+    calls->release(entry.slot);
+    throw;
+  }
+  if (calls->finish(entry, next_id)) {
+    ++next_id;
+  }
+}
+
+void Simulation::end_batch() {
+  for (; batch_position < batch.size(); ++batch_position) {
+    batch[batch_position]->queued = true;
+    queued_events->push(QueuedEvent(now, next_id, batch[batch_position]));
+    ++next_id;
+  }
+  batch.clear();
+  batch_position = 0;
+  batching = false;
+}
+
+void Simulation::dequeued(Event &event) {
+  event.queued = false;
+  if (event.is_aborted() && n_aborted_queued > 0) {
+    --n_aborted_queued;
+  }
+}
+
+void Simulation::aborted_queued() {
+  ++n_aborted_queued;
+  if (n_aborted_queued >= min_compaction_size &&
+      n_aborted_queued >= compaction_ratio * queued_events->size() &&
+      active_journal == nullptr) {
+    compact();
+  }
+}
+
+void Simulation::compact() {
+  queued_events->remove_if([](const QueuedEvent &entry) {
+    if (!entry.event->is_aborted()) {
+      return false;
+    }
+    entry.event->queued = false;
+    return true;
+  });
+  n_aborted_queued = 0;
 }
 
 void Simulation::advance_by(simtime duration) {
   simtime target = now + duration;
   while (has_next() && peek_next_time() <= target) {
-    step();
+    run_batch();
   }
   now = target;
 }
@@ -106,46 +371,294 @@ bool Simulation::advance_to(EventPtr event) {
 }
 
 void Simulation::run() {
-  while (step()) {
+  while (has_next()) {
+    run_batch();
   }
 }
 
+void Simulation::run_until(simtime time) {
+  while (has_next() && peek_next_time() < time) {
+    run_batch();
+  }
+  now = time;
+}
+
 simtime Simulation::get_now() { return now; }
 
-bool Simulation::has_next() { return !queued_events.empty(); }
+bool Simulation::has_next() {
+  receive_posted();
+  return batch_position < batch.size() || !queued_events->empty() ||
+         !calls->empty();
+}
+
+simtime Simulation::peek_next_time() {
+  if (batch_position < batch.size()) {
+    return now;
+  }
+
+  if (call_is_next()) {
+    return calls->top().time;
+  }
+  return queued_events->top().time;
+}
+
+Pool *Simulation::get_pool() { return pool; }
 
-simtime Simulation::peek_next_time() { return queued_events.top().time; }
+Callback::Function Simulation::get_resume_process() { return resume_process; }
 
-/* Simulation::QueuedEvent */
+Random &Simulation::get_random() { return random; }
 
-Simulation::QueuedEvent::QueuedEvent(simtime time, size_t id, EventPtr event)
-    : time(time), id(id), event(event) {}
+bool Simulation::try_post(simtime time, Handler handler) {
+  if (inbox == nullptr) {
+    throw std::logic_error("simulation has no inbox");
+  }
+  return inbox->push(time, std::move(handler));
+}
 
-bool Simulation::QueuedEvent::operator<(const QueuedEvent &other) const {
-  if (time != other.time) {
-    return time > other.time;
+void Simulation::post(simtime time, Handler handler) {
+  if (inbox == nullptr) {
+    throw std::logic_error("simulation has no inbox");
+  }
+  // A failed push leaves the handler in place, so it is not copied.
+  while (!inbox->push(time, std::move(handler))) {
+    std::this_thread::yield();
   }
+}
 
-  return id > other.id;
+void Simulation::schedule_posted() {
+  // At most one inbox full at a time, so producers which keep posting do not
+  // stall the simulation.
+  simtime time;
+  Handler handler;
+  for (size_t i = 0; i < inbox->get_capacity() && inbox->pop(time, handler);
+       ++i) {
+    auto event = this->event();
+    event->add_handler(std::move(handler));
+    schedule(event, time > now ? time - now : 0.0);
+  }
 }
 
+EventHandle Simulation::get_handle(const Event &event) const {
+  if (registry == nullptr) {
+    throw std::logic_error("events are not tracked");
+  }
+  if (event.slot == Event::untracked) {
+    throw std::invalid_argument("event is not tracked");
+  }
+  return registry->get_handle(event.slot);
+}
+
+std::map<std::string, size_t> Simulation::get_live_counts() const {
+  if (registry == nullptr) {
+    throw std::logic_error("events are not tracked");
+  }
+  return registry->count_by_type();
+}
+
+size_t Simulation::collect(size_t n_slots) {
+  if (registry == nullptr) {
+    throw std::logic_error("events are not tracked");
+  }
+  // Aborting the events of a group cannot be rolled back. Events aborted by
+  // collect may call it again from Aborted while its group is in use.
+  if (active_journal != nullptr || !registry->group.events.empty()) {
+    return 0;
+  }
+
+  size_t n_collected = 0;
+  n_slots = std::min<size_t>(n_slots, registry->get_n_slots());
+  for (size_t i = 0; i < n_slots; ++i) {
+    if (collect_position >= registry->get_n_slots()) {
+      collect_position = 0;
+    }
+    auto slot = collect_position;
+    ++collect_position;
+    if (!registry->is_process(slot)) {
+      continue;
+    }
+    auto process = registry->get(slot);
+    if (process != nullptr && process->is_pending() && !process->queued) {
+      n_collected += collect_group(std::move(process));
+    }
+  }
+  return n_collected;
+}
+
+void Simulation::track(const EventPtr &event, const std::type_info &type,
+                       bool process) {
+  event->slot = registry->add(event, type, process);
+}
+
+void Simulation::untrack(Event &event) {
+  registry->remove(event.slot);
+  event.slot = Event::untracked;
+}
+
+EventPtr Simulation::lookup_event(EventHandle handle) const {
+  if (registry == nullptr) {
+    throw std::logic_error("events are not tracked");
+  }
+  return registry->get(handle);
+}
+
+size_t Simulation::collect_group(EventPtr process) {
+  // Groups are small, so events are found in the group by a linear search,
+  // bounded by max_collected_group.
+  auto &group = registry->group;
+  group.events.push_back(std::move(process));
+  for (size_t i = 0; i < group.events.size(); ++i) {
+    group.first_reference.push_back(group.targets.size());
+    referenced(*group.events[i], group.archive, group.referenced);
+    for (auto &target : group.referenced) {
+      size_t j = 0;
+      while (j < group.events.size() && group.events[j] != target) {
+        ++j;
+      }
+      if (j == group.events.size()) {
+        if (j == max_collected_group) {
+          group.clear();
+          return 0;
+        }
+        group.events.push_back(std::move(target));
+      }
+      group.targets.push_back(j);
+    }
+    group.referenced.clear();
+  }
+  group.first_reference.push_back(group.targets.size());
+
+  // Events with more references than the group holds are referred to from
+  // outside. They and the events they reach stay alive.
+  auto n = group.events.size();
+  group.n_referenced.assign(n, 0);
+  for (auto target : group.targets) {
+    ++group.n_referenced[target];
+  }
+  group.alive.assign(n, false);
+  for (size_t i = 0; i < n; ++i) {
+    // One reference is held by the group itself.
+    if (static_cast<size_t>(group.events[i].use_count()) >
+        group.n_referenced[i] + 1) {
+      group.alive[i] = true;
+      group.reached.push_back(i);
+    }
+  }
+  while (!group.reached.empty()) {
+    auto i = group.reached.back();
+    group.reached.pop_back();
+    for (size_t j = group.first_reference[i];
+         j < group.first_reference[i + 1]; ++j) {
+      auto target = group.targets[j];
+      if (!group.alive[target]) {
+        group.alive[target] = true;
+        group.reached.push_back(target);
+      }
+    }
+  }
+
+  size_t n_collected = 0;
+  if (!group.alive[0]) {
+    for (size_t i = 0; i < n; ++i) {
+      if (!group.alive[i] && group.events[i]->abort() &&
+          dynamic_cast<Process *>(group.events[i].get()) != nullptr) {
+        ++n_collected;
+      }
+    }
+  }
+  group.clear();
+  return n_collected;
+}
+
+void Simulation::referenced(Event &event, Archive &archive,
+                            std::vector<EventPtr> &targets) {
+  // Handlers which resume processes or fire conditions are owned by the
+  // process or the link of the condition. Other handlers are opaque.
+  auto add_owner = [&targets](const Callback &handler) {
+    if (handler.function == resume_process) {
+      targets.push_back(
+          static_cast<Process *>(handler.context)->shared_from_this());
+    } else if (handler.function == Condition::fire) {
+      targets.push_back(
+          static_cast<Condition::Link *>(handler.context)->shared_from_this());
+    }
+  };
+  if (event.first_handler) {
+    add_owner(event.first_handler);
+  }
+  for (auto &handler : event.handlers) {
+    add_owner(handler);
+  }
+
+  // Pointers to handler owners are saved as plain pointers, so only the
+  // events held by subclasses are saved as events.
+  event.save(archive);
+  const Event *link = nullptr;
+  bool link_checked = false;
+  for (auto &pointer : archive.get_pointers()) {
+    if (!pointer.event || pointer.object == nullptr) {
+      continue;
+    }
+    // A condition saves its link, although it only refers to it weakly.
+    if (!link_checked) {
+      auto condition = dynamic_cast<Condition *>(&event);
+      if (condition != nullptr) {
+        link = condition->link.lock().get();
+      }
+      link_checked = true;
+    }
+    if (static_cast<const Event *>(pointer.object.get()) != link) {
+      targets.push_back(std::static_pointer_cast<Event>(pointer.object));
+    }
+  }
+  archive.clear();
+}
+
+/* Callback */
+
+Callback::Callback(Function function, void *context,
+                   std::shared_ptr<void> owner)
+    : function(function), context(context), owner(owner) {}
+
+Callback::operator bool() const { return function != nullptr; }
+
 /* Event */
 
 Event::Event(SimulationPtr sim) : sim(sim) {}
 
+Event::~Event() {
+  if (slot != untracked) {
+    auto sim = this->sim.lock();
+    if (sim) {
+      sim->untrack(*this);
+    }
+  }
+}
+
 bool Event::add_handler(ProcessPtr process) {
-  // Handler takes an additional EventPtr arg, but this is ignored by the
-  // bound function.
-  return add_handler(std::bind(&Process::resume, process));
+  return add_callback(Callback(resume_process, process.get(), process));
 }
 
 bool Event::add_handler(Handler handler) {
+  if (!is_pending()) {
+    return !is_triggered();
+  }
+
+  auto owner = std::make_shared<Handler>(std::move(handler));
+  return add_callback(Callback(call_handler, owner.get(), owner));
+}
+
+bool Event::add_callback(Callback callback) {
   if (is_triggered()) {
     return false;
   }
 
   if (is_pending()) {
-    handlers.push_back(handler);
+    record();
+    if (!first_handler) {
+      first_handler = std::move(callback);
+    } else {
+      handlers.push_back(std::move(callback));
+    }
   }
 
   return true;
@@ -156,10 +669,12 @@ bool Event::trigger(simtime delay /* = 0.0 */) {
     return false;
   }
 
+  SIMCPP_TRACE_HOOK(record(TraceRecorder::Kind::Trigger, typeid(*this), this));
   auto sim = this->sim.lock();
   sim->schedule(shared_from_this(), delay);
 
   if (delay == 0.0) {
+    record();
     state = State::Triggered;
   }
 
@@ -171,8 +686,18 @@ bool Event::abort() {
     return false;
   }
 
+  record();
   state = State::Aborted;
-  handlers.clear();
+  clear_handlers();
+  SIMCPP_PROFILE_HOOK(on_abort(typeid(*this)));
+  SIMCPP_TRACE_HOOK(record(TraceRecorder::Kind::Abort, typeid(*this), this));
+
+  if (queued) {
+    auto sim = this->sim.lock();
+    if (sim) {
+      sim->aborted_queued();
+    }
+  }
 
   Aborted();
 
@@ -184,13 +709,21 @@ void Event::process() {
     return;
   }
 
+  record();
   state = State::Processed;
+  SIMCPP_PROFILE_HOOK(on_process(
+      typeid(*this), first_handler ? handlers.size() + 1 : handlers.size()));
+  SIMCPP_TRACE_HOOK(record(TraceRecorder::Kind::Process, typeid(*this), this));
 
-  for (auto &handler : handlers) {
-    handler(shared_from_this());
+  if (first_handler) {
+    first_handler.function(first_handler.context, *this);
+
+    for (auto &handler : handlers) {
+      handler.function(handler.context, *this);
+    }
   }
 
-  handlers.clear();
+  clear_handlers();
 }
 
 bool Event::is_pending() { return state == State::Pending; }
@@ -207,6 +740,167 @@ Event::State Event::get_state() { return state; }
 
 void Event::Aborted() {}
 
+void Event::save(Archive &archive) const {
+  archive.save(state);
+  archive.save(handlers.size() + (first_handler ? 1 : 0));
+  if (first_handler) {
+    archive.save(first_handler.function);
+    archive.save(first_handler.context);
+    archive.save(first_handler.owner);
+  }
+  for (auto &handler : handlers) {
+    archive.save(handler.function);
+    archive.save(handler.context);
+    archive.save(handler.owner);
+  }
+}
+
+void Event::load(Archive &archive) {
+  archive.load(state);
+  clear_handlers();
+  size_t n_handlers;
+  archive.load(n_handlers);
+  for (size_t i = 0; i < n_handlers; ++i) {
+    Callback handler;
+    archive.load(handler.function);
+    archive.load(handler.context);
+    archive.load(handler.owner);
+    if (i == 0) {
+      first_handler = std::move(handler);
+    } else {
+      handlers.push_back(std::move(handler));
+    }
+  }
+}
+
+void Event::record() {
+  if (active_journal != nullptr) {
+    active_journal->record_event(*this);
+  }
+}
+
+void Event::clear_handlers() {
+  first_handler = Callback();
+  handlers.clear();
+}
+
+/* Condition */
+
+Condition::Condition(SimulationPtr sim, size_t n) : Event(sim), n(n) {}
+
+std::vector<EventPtr> Condition::get_fired() const {
+  std::vector<EventPtr> result;
+  if (first_fired != nullptr) {
+    result.reserve(n_fired);
+    result.push_back(first_fired);
+    result.insert(result.end(), fired.begin(), fired.end());
+  }
+  return result;
+}
+
+void Condition::Aborted() {
+  release();
+  Event::Aborted();
+}
+
+void Condition::save(Archive &archive) const {
+  Event::save(archive);
+  archive.save(n);
+  archive.save(n_fired);
+  archive.save(first_fired);
+  for (auto &event : fired) {
+    archive.save(event);
+  }
+  archive.save(link.lock());
+}
+
+void Condition::load(Archive &archive) {
+  Event::load(archive);
+  archive.load(n);
+  archive.load(n_fired);
+  archive.load(first_fired);
+  fired.resize(n_fired > 1 ? n_fired - 1 : 0);
+  for (auto &event : fired) {
+    archive.load(event);
+  }
+  std::shared_ptr<Link> link;
+  archive.load(link);
+  this->link = link;
+}
+
+Callback Condition::watch() {
+  auto link = sim.lock()->event<Link>();
+  link->condition = std::static_pointer_cast<Condition>(shared_from_this());
+  this->link = link;
+  return Callback(fire, link.get(), link);
+}
+
+void Condition::add(const EventPtr &event, const Callback &callback) {
+  if (event->is_triggered()) {
+    if (n_fired < n) {
+      count(event);
+    }
+  } else if (callback) {
+    event->add_callback(callback);
+  }
+}
+
+void Condition::start() {
+  if (n_fired >= n) {
+    trigger();
+  }
+}
+
+void Condition::count(EventPtr event) {
+  if (n_fired == 0) {
+    first_fired = std::move(event);
+  } else {
+    fired.push_back(std::move(event));
+  }
+  ++n_fired;
+}
+
+void Condition::fire(void *context, Event &event) {
+  // Keeps the condition alive while the link releases it.
+  auto condition = static_cast<Link *>(context)->condition;
+  if (condition == nullptr) {
+    return;
+  }
+
+  condition->record();
+  condition->count(event.shared_from_this());
+  if (condition->n_fired == condition->n) {
+    condition->release();
+    condition->trigger();
+  }
+}
+
+void Condition::release() {
+  auto link = this->link.lock();
+  if (link != nullptr) {
+    link->reset();
+  }
+}
+
+/* Condition::Link */
+
+Condition::Link::Link(SimulationPtr sim) : Event(sim) {}
+
+void Condition::Link::save(Archive &archive) const {
+  Event::save(archive);
+  archive.save(condition);
+}
+
+void Condition::Link::load(Archive &archive) {
+  Event::load(archive);
+  archive.load(condition);
+}
+
+void Condition::Link::reset() {
+  record();
+  condition = nullptr;
+}
+
 /* Process */
 
 Process::Process(SimulationPtr sim) : Event(sim), Protothread() {}
@@ -217,7 +911,19 @@ void Process::resume() {
     return;
   }
 
+  record();
+  SIMCPP_TRACE_HOOK(record(TraceRecorder::Kind::Resume, typeid(*this), this));
+#ifdef SIMCPP_PROFILE
+  auto profiler = Profiler::get_active();
+  auto start = profiler != nullptr ? Profiler::Clock::now()
+                                   : Profiler::Clock::time_point();
+#endif
   bool still_running = Run();
+#ifdef SIMCPP_PROFILE
+  if (profiler != nullptr) {
+    profiler->on_resume(typeid(*this), start);
+  }
+#endif
 
   // Did the process finish now?
   if (!still_running) {
@@ -230,4 +936,14 @@ ProcessPtr Process::shared_from_this() {
   return std::static_pointer_cast<Process>(Event::shared_from_this());
 }
 
+void Process::save(Archive &archive) const {
+  Event::save(archive);
+  archive.save(_ptLine);
+}
+
+void Process::load(Archive &archive) {
+  Event::load(archive);
+  archive.load(_ptLine);
+}
+
 } // namespace simcpp
@@ -4,19 +4,34 @@
 #ifndef SIMCPP_H_
 #define SIMCPP_H_
 
+#include <cstdint>
 #include <functional>
+#include <iterator>
+#include <map>
 #include <memory>
-#include <queue>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
 #include <vector>
 
+#include "archive.h"
+#include "call.h"
+#include "pool.h"
+#include "profile.h"
 #include "protothread.h"
+#include "random.h"
+#include "trace.h"
 
 /**
  * Wait for an event inside the Run method of a process.
  *
  * If the event is pending, the process is paused until it is processed. If the
  * event is already triggered or processed, the process is not paused. If the
- * event is already aborted, the process is paused indefinitely.
+ * event is already aborted, the process is paused indefinitely. Processes
+ * which can never be resumed can be found with Simulation::collect.
  *
  * @param event Event to wait for.
  */
@@ -39,12 +54,197 @@ class Process;
 using ProcessPtr = std::shared_ptr<Process>;
 using ProcessWeakPtr = std::weak_ptr<Process>;
 
+class Condition;
+using ConditionPtr = std::shared_ptr<Condition>;
+
+template <typename T> class ValueEvent;
+template <typename T> using ValueEventPtr = std::shared_ptr<ValueEvent<T>>;
+
 class Simulation;
 using SimulationPtr = std::shared_ptr<Simulation>;
 using SimulationWeakPtr = std::weak_ptr<Simulation>;
 
 using Handler = std::function<void(EventPtr)>;
 
+class EventQueue;
+class CallQueue;
+class Inbox;
+class Registry;
+class Archive;
+class SnapshotRegistry;
+class TimeWarpProcess;
+
+/// Implementation of the event queue of a simulation.
+enum class QueueType {
+  /// Binary heap. Good default for small and medium queues.
+  BinaryHeap,
+  /// 4-ary heap. Flatter than a binary heap, fewer sift steps per event.
+  QuaternaryHeap,
+  /// Calendar queue. O(1) amortized if event times are evenly spread.
+  Calendar,
+  /// Ladder queue. O(1) amortized for skewed distributions of event times.
+  Ladder,
+  /// 4-ary heap of 16-byte keys with handles into a table of the events.
+  /// Only faster than QuaternaryHeap for around a million queued events
+  /// with few equal times.
+  SplitHeap
+};
+
+/// Options for the construction of a simulation environment.
+struct SimulationOptions {
+  /// Implementation of the event queue.
+  QueueType queue_type = QueueType::BinaryHeap;
+
+  /**
+   * Whether events and processes are allocated from a pool owned by the
+   * simulation instead of the global heap.
+   *
+   * The pool is not thread-safe, so events and processes of a pooled
+   * simulation must only be created and destroyed on one thread at a time.
+   */
+  bool pooled_allocation = false;
+
+  /**
+   * Fraction of entries of the event queue which belong to aborted events, at
+   * which they are removed from the queue. Until then, aborted events stay in
+   * the queue and are skipped when they are due. Values above 1 disable the
+   * removal.
+   */
+  double compaction_ratio = 0.5;
+
+  /**
+   * Width of the slots of a hierarchical timing wheel in front of the event
+   * queue, or 0 for no timing wheel.
+   *
+   * Events scheduled up to timing_wheel_horizon ahead are inserted into the
+   * wheel in O(1) time and moved to the event queue when their slot is
+   * reached. Aborted events are dropped from the wheel without entering the
+   * queue, which suits many short, often aborted timeouts. The order of
+   * events does not change.
+   */
+  simtime timing_wheel_resolution = 0.0;
+
+  /// Distance in time up to which events are scheduled in the timing wheel.
+  simtime timing_wheel_horizon = 0.0;
+
+  /// Seed of the random number generator of the simulation.
+  uint64_t seed = 0;
+
+  /**
+   * Capacity of the inbox through which other threads post handlers with
+   * Simulation::post, or 0 for no inbox. Without an inbox, the simulation
+   * does not check for posted handlers.
+   */
+  size_t inbox_capacity = 0;
+
+  /**
+   * Whether the simulation keeps a registry of the events and processes it
+   * constructs. The registry hands out handles which refer to events without
+   * keeping them alive, counts live events by type, and lets the simulation
+   * collect waiting processes which can never be resumed. See
+   * Simulation::get_handle, get_live_counts and collect.
+   */
+  bool track_events = false;
+
+  /**
+   * Number of slots of the registry which Simulation::collect examines before
+   * each step, or 0 to only collect when collect is called. Only used if
+   * events are tracked. Examining a waiting process costs a fraction of a
+   * step, so a rate a few times the rate at which processes leak suffices.
+   */
+  size_t collection_rate = 0;
+};
+
+/**
+ * Callback of an event.
+ *
+ * A plain function pointer with a context pointer. Unlike a Handler, storing
+ * it never allocates. The owner keeps the context alive while the callback is
+ * registered.
+ */
+class Callback {
+public:
+  using Function = void (*)(void *context, Event &event);
+
+  Function function = nullptr;
+  void *context = nullptr;
+  std::shared_ptr<void> owner = nullptr;
+
+  Callback() = default;
+
+  /**
+   * Construct a callback.
+   *
+   * @param function Function to call with the context and the event.
+   * @param context Context passed to the function.
+   * @param owner Owner of the context.
+   */
+  Callback(Function function, void *context, std::shared_ptr<void> owner);
+
+  /// @return Whether a function is set.
+  explicit operator bool() const;
+};
+
+/**
+ * Handle of a tracked event, see Simulation::get_handle.
+ *
+ * Unlike an EventPtr, a handle does not keep the event alive, so processes
+ * which refer to each other by handles form no cycles of shared pointers.
+ */
+class EventHandle {
+public:
+  /// Slot of the event in the registry of the simulation.
+  uint32_t slot = 0;
+  /// Generation of the slot, which changes whenever the slot is freed, so
+  /// handles of destroyed events do not match later events.
+  uint32_t generation = 0;
+};
+
+/**
+ * Journal of changes to simulations, used to roll them back.
+ *
+ * While a journal is active on a thread, simulations and events used on that
+ * thread report changes of their state to it before they happen.
+ */
+class Journal {
+public:
+  virtual ~Journal();
+
+  /**
+   * Called before the state of an event changes.
+   *
+   * @param event Event which is about to change.
+   */
+  virtual void record_event(Event &event) = 0;
+
+  /**
+   * Called after an event was scheduled.
+   *
+   * @param time Time at which the event is processed.
+   * @param id Id of the queue entry.
+   */
+  virtual void record_push(simtime time, size_t id) = 0;
+
+  /**
+   * Called after the next scheduled event was removed from the queue.
+   *
+   * @param time Time at which the event is processed.
+   * @param id Id of the queue entry.
+   * @param event Removed event.
+   */
+  virtual void record_pop(simtime time, size_t id, EventPtr event) = 0;
+
+  /// @return Journal which is active on this thread, or nullptr.
+  static Journal *get_active();
+
+  /**
+   * Make a journal active on this thread.
+   *
+   * @param journal Journal to activate, or nullptr to deactivate.
+   */
+  static void set_active(Journal *journal);
+};
+
 /// Simulation environment.
 class Simulation : public std::enable_shared_from_this<Simulation> {
 public:
@@ -55,6 +255,23 @@ public:
    */
   static SimulationPtr create();
 
+  /**
+   * Create a simulation environment.
+   *
+   * @param options Options of the simulation.
+   * @return Simulation instance.
+   */
+  static SimulationPtr create(const SimulationOptions &options);
+
+  /**
+   * Construct a simulation environment. Use create instead.
+   *
+   * @param options Options of the simulation.
+   */
+  explicit Simulation(const SimulationOptions &options = SimulationOptions());
+
+  ~Simulation();
+
   /**
    * Construct a process and run it immediately.
    *
@@ -65,7 +282,7 @@ public:
    */
   template <typename T, typename... Args>
   std::shared_ptr<T> start_process(Args &&...args) {
-    auto process = std::make_shared<T>(shared_from_this(), args...);
+    auto process = construct<T>(std::forward<Args>(args)...);
     run_process(process);
     return process;
   }
@@ -81,7 +298,7 @@ public:
    */
   template <typename T, typename... Args>
   std::shared_ptr<T> start_process_delayed(simtime delay, Args &&...args) {
-    auto process = std::make_shared<T>(shared_from_this(), args...);
+    auto process = construct<T>(std::forward<Args>(args)...);
     run_process(process, delay);
     return process;
   }
@@ -104,7 +321,7 @@ public:
    */
   template <typename T = Event, typename... Args>
   std::shared_ptr<T> event(Args &&...args) {
-    return std::make_shared<T>(shared_from_this(), args...);
+    return construct<T>(std::forward<Args>(args)...);
   }
 
   /**
@@ -124,7 +341,26 @@ public:
    * @param events Underlying events.
    * @return Event instance.
    */
-  EventPtr any_of(std::initializer_list<EventPtr> events);
+  ConditionPtr any_of(std::initializer_list<EventPtr> events);
+
+  /**
+   * Create an "any of" event of a runtime-sized sequence of events.
+   *
+   * @param events Underlying events.
+   * @return Event instance.
+   */
+  ConditionPtr any_of(const std::vector<EventPtr> &events);
+
+  /**
+   * Create an "any of" event of a range of events.
+   *
+   * @tparam Iterator Forward iterator with EventPtr values.
+   * @param first Iterator to the first underlying event.
+   * @param last Iterator past the last underlying event.
+   * @return Event instance.
+   */
+  template <typename Iterator>
+  ConditionPtr any_of(Iterator first, Iterator last);
 
   /**
    * Create an "all of" event.
@@ -134,7 +370,60 @@ public:
    *
    * @return Event instance.
    */
-  EventPtr all_of(std::initializer_list<EventPtr> events);
+  ConditionPtr all_of(std::initializer_list<EventPtr> events);
+
+  /**
+   * Create an "all of" event of a runtime-sized sequence of events.
+   *
+   * @param events Underlying events.
+   * @return Event instance.
+   */
+  ConditionPtr all_of(const std::vector<EventPtr> &events);
+
+  /**
+   * Create an "all of" event of a range of events.
+   *
+   * @tparam Iterator Forward iterator with EventPtr values.
+   * @param first Iterator to the first underlying event.
+   * @param last Iterator past the last underlying event.
+   * @return Event instance.
+   */
+  template <typename Iterator>
+  ConditionPtr all_of(Iterator first, Iterator last);
+
+  /**
+   * Create an "n of" event.
+   *
+   * An "n of" event is triggered when n of the underlying events are
+   * processed. any_of and all_of are "n of" events with n = 1 and n equal to
+   * the number of underlying events.
+   *
+   * @param n Number of underlying events to wait for.
+   * @param events Underlying events.
+   * @return Event instance.
+   */
+  ConditionPtr n_of(size_t n, std::initializer_list<EventPtr> events);
+
+  /**
+   * Create an "n of" event of a runtime-sized sequence of events.
+   *
+   * @param n Number of underlying events to wait for.
+   * @param events Underlying events.
+   * @return Event instance.
+   */
+  ConditionPtr n_of(size_t n, const std::vector<EventPtr> &events);
+
+  /**
+   * Create an "n of" event of a range of events.
+   *
+   * @tparam Iterator Forward iterator with EventPtr values.
+   * @param n Number of underlying events to wait for.
+   * @param first Iterator to the first underlying event.
+   * @param last Iterator past the last underlying event.
+   * @return Event instance.
+   */
+  template <typename Iterator>
+  ConditionPtr n_of(size_t n, Iterator first, Iterator last);
 
   /**
    * Schedule an event to be processed after a delay.
@@ -144,6 +433,61 @@ public:
    */
   void schedule(EventPtr event, simtime delay = 0.0);
 
+  /**
+   * Abort an event and remove it from the event queue right away, so it is
+   * freed as soon as it is not referenced anymore. Takes O(n) time in the
+   * size of the queue. To abort many events, abort is cheaper, as aborted
+   * events are removed from the queue in bulk.
+   *
+   * @param event Event to cancel.
+   * @return Whether the event was pending.
+   */
+  bool cancel(EventPtr event);
+
+  /**
+   * Call a function at a time, without creating an event.
+   *
+   * The function is ordered with events and other calls at the same time by
+   * the order in which they were scheduled. Small functions are stored inline,
+   * so scheduling a call does not allocate once the simulation is warm. Calls
+   * are not saved in snapshots and must not be scheduled while a journal is
+   * active.
+   *
+   * @param time Time of the call. Must not lie before the current time.
+   * @param call Function to call.
+   * @return Handle to cancel the call.
+   */
+  CallHandle call_at(simtime time, Call call);
+
+  /**
+   * Call a function after a delay, without creating an event. See call_at.
+   *
+   * @param delay Delay after which the function is called.
+   * @param call Function to call.
+   * @return Handle to cancel the call.
+   */
+  CallHandle call_in(simtime delay, Call call);
+
+  /**
+   * Call a function periodically, without creating events. See call_at. The
+   * call keeps its slot between occurrences, and recurs until it is
+   * cancelled, or until it throws an exception.
+   *
+   * @param period Time between the calls, and until the first call. Must be
+   * positive.
+   * @param call Function to call.
+   * @return Handle to cancel the call.
+   */
+  CallHandle call_every(simtime period, Call call);
+
+  /**
+   * Cancel a call. A recurring call can cancel itself while it is made.
+   *
+   * @param handle Handle of the call.
+   * @return Whether the call was still scheduled.
+   */
+  bool cancel(CallHandle handle);
+
   /**
    * Process the next scheduled event.
    *
@@ -151,6 +495,19 @@ public:
    */
   bool step();
 
+  /**
+   * Process all events scheduled at the time of the next scheduled event,
+   * including events scheduled at that time while doing so.
+   *
+   * The events are removed from the event queue in one pass and processed in
+   * the same order as by step. Events scheduled without delay during the
+   * batch are appended to it instead of being pushed to the event queue.
+   * While a journal is active, only one event is processed.
+   *
+   * @return Number of processed events.
+   */
+  size_t run_batch();
+
   /**
    * Advance the simulation by a duration.
    *
@@ -170,6 +527,16 @@ public:
   /// Run the simulation until no scheduled events are left.
   void run();
 
+  /**
+   * Process all events scheduled before a time and advance the simulation to
+   * it. Unlike with advance_by, events scheduled at exactly that time are not
+   * processed yet.
+   *
+   * @param time Time to advance the simulation to. Must not be before the
+   * current simulation time.
+   */
+  void run_until(simtime time);
+
   /// @return Current simulation time.
   simtime get_now();
 
@@ -179,21 +546,288 @@ public:
   /// @return Time at which the next event is scheduled.
   simtime peek_next_time();
 
-private:
-  class QueuedEvent {
-  public:
-    simtime time;
-    size_t id;
-    EventPtr event;
+  /**
+   * Create an independent copy of the simulation with the same options, for
+   * example to branch scenarios from a warmed-up state without simulating it
+   * again. Must be called between steps.
+   *
+   * The copy is made through an in-memory Snapshot, see there for what is
+   * copied. The copy shares no state with the original, so both can run on
+   * different threads. To create many copies, take one snapshot and restore
+   * it once per copy instead, which can be done concurrently. Defined in
+   * snapshot.cpp.
+   *
+   * @param registry Types of the events. Its factories construct the events
+   * of the copy.
+   * @param save_state Function which saves the state of the model outside of
+   * events, or nullptr.
+   * @param load_state Function which loads the saved state into the model of
+   * the copy, or nullptr.
+   * @return Simulation instance.
+   */
+  SimulationPtr fork(const SnapshotRegistry &registry,
+                     std::function<void(Archive &)> save_state = nullptr,
+                     std::function<void(Archive &)> load_state = nullptr);
+
+  /**
+   * Copy the simulation into a new simulation, so the model of the copy, for
+   * example its resources, can be constructed before the events which refer
+   * to it. See the other overload.
+   *
+   * @param copy Simulation instance without scheduled events.
+   * @param registry Types of the events. Its factories construct the events
+   * of the copy.
+   * @param save_state Function which saves the state of the model outside of
+   * events, or nullptr.
+   * @param load_state Function which loads the saved state into the model of
+   * the copy, or nullptr.
+   */
+  void fork(SimulationPtr copy, const SnapshotRegistry &registry,
+            std::function<void(Archive &)> save_state = nullptr,
+            std::function<void(Archive &)> load_state = nullptr);
 
-    QueuedEvent(simtime time, size_t id, EventPtr event);
+  /**
+   * Pool owned by the simulation. Events and processes are only allocated from
+   * it if allocation is pooled. Coroutine frames of tasks always are.
+   *
+   * @return Pool of the simulation.
+   */
+  Pool *get_pool();
 
-    bool operator<(const QueuedEvent &other) const;
-  };
+  /**
+   * Random number generator owned by the simulation, seeded with
+   * SimulationOptions::seed. Draw substreams from it for processes which need
+   * results independent of the order in which they run.
+   *
+   * @return Random number generator of the simulation.
+   */
+  Random &get_random();
+
+  /**
+   * Post a handler from another thread, which is called by an event
+   * scheduled at a time. Thread-safe and wait-free; the other methods of the
+   * simulation must only be called from the thread running it.
+   *
+   * Posted handlers are taken from the inbox in the order in which they were
+   * posted whenever the simulation checks for the next event, and scheduled
+   * at their time, or at the current time if it already passed. The
+   * simulation must have an inbox, see SimulationOptions::inbox_capacity.
+   *
+   * @param time Simulation time at which to call the handler.
+   * @param handler Handler of the event.
+   * @return Whether the handler was posted. If the inbox is full, it is not.
+   */
+  bool try_post(simtime time, Handler handler);
+
+  /**
+   * Post a handler from another thread and wait while the inbox is full. See
+   * try_post.
+   *
+   * @param time Simulation time at which to call the handler.
+   * @param handler Handler of the event.
+   */
+  void post(simtime time, Handler handler);
+
+  /**
+   * Get the handle of a tracked event. Events are tracked if
+   * SimulationOptions::track_events is set.
+   *
+   * @param event Event constructed by the simulation.
+   * @return Handle of the event.
+   */
+  EventHandle get_handle(const Event &event) const;
+
+  /**
+   * Look up a tracked event by its handle.
+   *
+   * @tparam T Event class. Must be the class of the event or a base class.
+   * @param handle Handle of the event.
+   * @return Event instance, or nullptr if the event was destroyed.
+   */
+  template <typename T = Event>
+  std::shared_ptr<T> lookup(EventHandle handle) const {
+    return std::static_pointer_cast<T>(lookup_event(handle));
+  }
+
+  /**
+   * Count the live tracked events and processes by type, so leaks can be
+   * found by comparing the counts over time.
+   *
+   * @return Number of live events by the readable name of their class.
+   */
+  std::map<std::string, size_t> get_live_counts() const;
 
+  /**
+   * Collect waiting processes which can never be resumed, examining a number
+   * of slots of the registry from where the last call stopped.
+   *
+   * A pending process which is not scheduled is collected if it and the
+   * events it reaches are only referred to by each other. They are found by
+   * comparing the reference counts of the events with the references among
+   * them: the handlers of the events, and the pointers to events which their
+   * save methods save, which must be held as shared pointers. Events held by
+   * a process which does not save them count as referred to from outside, so
+   * the process is kept. The pending events of the group, including the
+   * process, are aborted, which breaks the cycles, so the group is destroyed.
+   * Groups of more than max_collected_group events are not examined. While a
+   * journal is active, nothing is collected.
+   *
+   * @param n_slots Number of slots to examine.
+   * @return Number of collected processes.
+   */
+  size_t collect(size_t n_slots);
+
+  /// Maximum number of events in a group examined by collect.
+  static const size_t max_collected_group = 1024;
+
+private:
+  friend class Event;
+  friend class Snapshot;
+  friend class SnapshotRegistry;
+  friend class TimeWarpProcess;
+
+  SimulationOptions options;
   simtime now = 0.0;
   size_t next_id = 0;
-  std::priority_queue<QueuedEvent> queued_events;
+  std::unique_ptr<EventQueue> queued_events;
+  Pool *pool;
+  bool pooled;
+  double compaction_ratio;
+  Random random;
+  /// Inbox of posted handlers, or nullptr.
+  std::unique_ptr<Inbox> inbox;
+  /// Calls scheduled by call_at, call_in and call_every.
+  std::unique_ptr<CallQueue> calls;
+  /// Registry of the constructed events, or nullptr if they are not tracked.
+  std::unique_ptr<Registry> registry;
+  /// Slot of the registry at which collect continues.
+  uint32_t collect_position = 0;
+  /// Number of entries of the queue which belong to aborted events. Exact
+  /// unless an event is scheduled more than once or rolled back.
+  size_t n_aborted_queued = 0;
+
+  /// Events at the current time removed from the queue by run_batch.
+  std::vector<EventPtr> batch = {};
+  size_t batch_position = 0;
+  bool batching = false;
+
+  /// Push events left in the batch back to the queue and end the batch.
+  void end_batch();
+
+  /**
+   * Schedule a call. See call_at.
+   *
+   * @param time Time of the call.
+   * @param period Period of the call, or 0 for a single call.
+   * @param call Function to call.
+   * @return Handle of the call.
+   */
+  CallHandle schedule_call(simtime time, simtime period, Call call);
+
+  /// @return Whether a call comes before the next event in the queue.
+  bool call_is_next();
+
+  /// Make the next call.
+  void make_call();
+
+  /// Schedule the handlers posted to the inbox, if any.
+  void receive_posted() {
+    if (inbox != nullptr) {
+      schedule_posted();
+    }
+  }
+
+  void schedule_posted();
+
+  /// Collect processes before a step, if the collection rate is set.
+  void collect_incrementally() {
+    if (registry != nullptr && options.collection_rate > 0) {
+      collect(options.collection_rate);
+    }
+  }
+
+  /**
+   * Add a constructed event to the registry.
+   *
+   * @param event Constructed event.
+   * @param type Class of the event.
+   * @param process Whether the event is a process.
+   */
+  void track(const EventPtr &event, const std::type_info &type,
+             bool process);
+
+  /**
+   * Remove a destroyed event from the registry.
+   *
+   * @param event Destroyed event.
+   */
+  void untrack(Event &event);
+
+  /**
+   * @param handle Handle of an event.
+   * @return Tracked event, or nullptr if it was destroyed.
+   */
+  EventPtr lookup_event(EventHandle handle) const;
+
+  /**
+   * Collect the group of a waiting process. See collect.
+   *
+   * @param process Waiting process.
+   * @return Number of collected processes.
+   */
+  size_t collect_group(EventPtr process);
+
+  /**
+   * Find the events an event holds by shared pointers, as far as known.
+   *
+   * @param event Event.
+   * @param archive Archive used to find the pointers saved by the event.
+   * @param targets Appended the held events, once per pointer.
+   */
+  void referenced(Event &event, Archive &archive,
+                  std::vector<EventPtr> &targets);
+
+  /**
+   * Called when an event was removed from the queue.
+   *
+   * @param event Removed event.
+   */
+  void dequeued(Event &event);
+
+  /// Called when a queued event was aborted. Compacts the queue if needed.
+  void aborted_queued();
+
+  /// Remove all aborted events from the queue.
+  void compact();
+
+  /// @return Callback function with which processes wait for events.
+  static Callback::Function get_resume_process();
+
+  /**
+   * Construct an event or process, from the pool if allocation is pooled.
+   *
+   * @tparam T Event class. Must be Event or a subclass thereof.
+   * @tparam Args Additional argument types of the constructor.
+   * @param args Additional arguments for the construction of T.
+   * @return Event instance.
+   */
+  template <typename T, typename... Args>
+  std::shared_ptr<T> construct(Args &&...args) {
+    SIMCPP_PROFILE_HOOK(on_allocate(typeid(T)));
+    std::shared_ptr<T> event;
+    if (pooled) {
+      event = std::allocate_shared<T>(PoolAllocator<T>(pool),
+                                      shared_from_this(),
+                                      std::forward<Args>(args)...);
+    } else {
+      event =
+          std::make_shared<T>(shared_from_this(), std::forward<Args>(args)...);
+    }
+    if (registry != nullptr) {
+      track(event, typeid(T), std::is_base_of<Process, T>::value);
+    }
+    return event;
+  }
 };
 
 /**
@@ -204,8 +838,9 @@ private:
  */
 class Event : public std::enable_shared_from_this<Event> {
 public:
-  /// State of an event.
-  enum class State {
+  /// State of an event. Fits in a byte, so the slot of the event in the
+  /// registry fits in the padding after it.
+  enum class State : uint8_t {
     /// Event has not been triggered or aborted.
     Pending,
     /// Event has been triggered.
@@ -223,6 +858,9 @@ public:
    */
   explicit Event(SimulationPtr sim);
 
+  /// Removes the event from the registry of the simulation, if it is tracked.
+  virtual ~Event();
+
   /**
    * Add the resume method of a process as an handler of the event.
    *
@@ -246,6 +884,16 @@ public:
    */
   bool add_handler(Handler handler);
 
+  /**
+   * Add a callback as an handler of the event.
+   *
+   * If the event is already triggered or aborted, nothing is done.
+   *
+   * @param callback Callback to call when the event is processed.
+   * @return Whether the event was not already triggered.
+   */
+  bool add_callback(Callback callback);
+
   /**
    * Trigger the event with a delay.
    *
@@ -294,6 +942,24 @@ public:
   /// Called when the event is aborted.
   virtual void Aborted();
 
+  /**
+   * Save the state of the event, so it can be restored with load.
+   *
+   * Used to roll back optimistic parallel simulations. Subclasses with state
+   * which changes while the event is pending must override this method and
+   * load, and call the method of their base class first.
+   *
+   * @param archive Archive to save to.
+   */
+  virtual void save(Archive &archive) const;
+
+  /**
+   * Restore the state of the event saved with save.
+   *
+   * @param archive Archive to load from.
+   */
+  virtual void load(Archive &archive);
+
 protected:
   /**
    * Weak pointer to the simulation instance.
@@ -303,9 +969,125 @@ protected:
    */
   SimulationWeakPtr sim;
 
+  /**
+   * Report an upcoming change of the state to the active journal, if any.
+   * Subclasses which override save must call this before changing their
+   * state.
+   */
+  void record();
+
 private:
+  friend class Simulation;
+  friend class Snapshot;
+  friend class SnapshotRegistry;
+  friend class TimeWarpProcess;
+
+  /// Slot of events which are not tracked.
+  static const uint32_t untracked = UINT32_MAX;
+
   State state = State::Pending;
-  std::vector<Handler> handlers = {};
+  /// Whether the event is in the event queue.
+  bool queued = false;
+  /// Slot of the event in the registry of the simulation.
+  uint32_t slot = untracked;
+  /// First handler, stored inline since most events have exactly one.
+  Callback first_handler = {};
+  std::vector<Callback> handlers = {};
+
+  void clear_handlers();
+};
+
+/**
+ * Event which is triggered when a number of underlying events are processed.
+ *
+ * Created by Simulation::any_of, all_of and n_of. Underlying events which are
+ * already triggered count at once. All underlying events share one callback,
+ * whose owner is a small link to the condition, so memory and time are linear
+ * in their number. Once the condition is triggered or aborted, the link
+ * releases it, so the underlying events which lost no longer keep the
+ * condition and its handlers alive.
+ */
+class Condition : public Event {
+public:
+  /**
+   * Construct a condition. Use Simulation::n_of instead.
+   *
+   * @param sim Simulation instance.
+   * @param n Number of underlying events to wait for.
+   */
+  Condition(SimulationPtr sim, size_t n);
+
+  /**
+   * @return Underlying events which were processed, or already triggered when
+   * the condition was created, in this order, up to the number waited for.
+   */
+  std::vector<EventPtr> get_fired() const;
+
+  /// Releases the condition from the underlying events.
+  void Aborted() override;
+
+  void save(Archive &archive) const override;
+
+  void load(Archive &archive) override;
+
+private:
+  friend class Simulation;
+  friend class SnapshotRegistry;
+
+  /// Owner of the callback of the underlying events.
+  class Link : public Event {
+  public:
+    explicit Link(SimulationPtr sim);
+
+    void save(Archive &archive) const override;
+
+    void load(Archive &archive) override;
+
+    /// Release the condition.
+    void reset();
+
+    /// Condition, until it is triggered or aborted.
+    ConditionPtr condition = nullptr;
+  };
+
+  size_t n;
+  size_t n_fired = 0;
+  /// First fired event, stored inline since any_of has exactly one.
+  EventPtr first_fired = nullptr;
+  std::vector<EventPtr> fired = {};
+  std::weak_ptr<Link> link = {};
+
+  /**
+   * Create the link to the condition.
+   *
+   * @return Callback to add to the pending underlying events.
+   */
+  Callback watch();
+
+  /**
+   * Add an underlying event while the condition is created.
+   *
+   * @param event Underlying event.
+   * @param callback Callback to add if the event is pending, or an empty
+   * callback if the condition is decided already.
+   */
+  void add(const EventPtr &event, const Callback &callback);
+
+  /// Trigger the condition if enough underlying events are triggered.
+  void start();
+
+  /**
+   * Count an underlying event which was processed or triggered.
+   *
+   * @param event Underlying event.
+   */
+  void count(EventPtr event);
+
+  /// Called when an underlying event is processed.
+  static void fire(void *context, Event &event);
+
+  /// Release the condition from the link.
+  void release();
 };
 
 /// Process in a simulation.
@@ -328,8 +1110,189 @@ public:
 
   /// @return Shared pointer to the process instance.
   ProcessPtr shared_from_this();
+
+  /// Saves the position of the protothread in addition to the event state.
+  void save(Archive &archive) const override;
+
+  void load(Archive &archive) override;
 };
 
+/**
+ * Event which carries a value, for example a message.
+ *
+ * The value is stored inline in the event and constructed when the event is
+ * triggered, so it needs no allocation of its own, and T need not be
+ * default-constructible or copyable. Waiting processes and handlers access it
+ * by reference with get_value, without copying it or casting the event. A
+ * coroutine which awaits the event receives the reference directly.
+ *
+ * The value is set once and not copied into the saved state. Only whether
+ * the event has a value is saved, so rolling the event back to before it was
+ * triggered destroys the value, and the event can be triggered again.
+ *
+ * @tparam T Type of the value. Must be movable.
+ */
+template <typename T> class ValueEvent : public Event {
+public:
+  using value_type = T;
+  using ValueHandler = std::function<void(T &)>;
+
+  /**
+   * Construct a valued event.
+   *
+   * @param sim Simulation instance.
+   */
+  explicit ValueEvent(SimulationPtr sim) : Event(sim) {}
+
+  ValueEvent(const ValueEvent &) = delete;
+  ValueEvent &operator=(const ValueEvent &) = delete;
+
+  ~ValueEvent() {
+    if (constructed) {
+      value()->~T();
+    }
+  }
+
+  using Event::add_handler;
+
+  /**
+   * Add a callback which receives the value as an handler of the event.
+   *
+   * If the event is already triggered or aborted, nothing is done.
+   *
+   * @param handler Callback to call with the value when the event is
+   * processed.
+   * @return Whether the event was not already triggered.
+   */
+  bool add_handler(ValueHandler handler) {
+    if (!is_pending()) {
+      return !is_triggered();
+    }
+
+    auto owner = std::make_shared<ValueHandler>(std::move(handler));
+    return add_callback(Callback(call_handler, owner.get(), owner));
+  }
+
+  /**
+   * Trigger the event with a value and a delay.
+   *
+   * @param value Value, which is moved into the event.
+   * @param delay Delay after with the event is processed.
+   * @return Whether the event was not already triggered or aborted. If it
+   * was, the value is discarded.
+   */
+  bool trigger(T &&value, simtime delay = 0.0) {
+    return emplace(delay, std::move(value));
+  }
+
+  /**
+   * Trigger the event with a copy of a value and a delay.
+   *
+   * @param value Value, which is copied into the event.
+   * @param delay Delay after with the event is processed.
+   * @return Whether the event was not already triggered or aborted.
+   */
+  bool trigger(const T &value, simtime delay = 0.0) {
+    return emplace(delay, value);
+  }
+
+  /**
+   * Trigger the event with a value constructed in place.
+   *
+   * @tparam Args Argument types of the constructor of T.
+   * @param delay Delay after with the event is processed.
+   * @param args Arguments for the construction of the value.
+   * @return Whether the event was not already triggered or aborted. If it
+   * was, no value is constructed.
+   */
+  template <typename... Args> bool emplace(simtime delay, Args &&...args) {
+    // An event triggered with a delay stays pending until it is processed.
+    if (!is_pending() || constructed) {
+      return false;
+    }
+
+    record();
+    new (storage) T(std::forward<Args>(args)...);
+    constructed = true;
+    return Event::trigger(delay);
+  }
+
+  /// @return Whether the event was triggered with a value.
+  bool has_value() const { return constructed; }
+
+  /**
+   * @return Value of the event. Throws std::logic_error if the event was not
+   * triggered with a value.
+   */
+  T &get_value() {
+    if (!constructed) {
+      throw std::logic_error("value event is not triggered");
+    }
+    return *value();
+  }
+
+  /// Saves whether the event has a value in addition to the event state.
+  void save(Archive &archive) const override {
+    Event::save(archive);
+    archive.save(constructed);
+  }
+
+  /// Destroys a value which was set after the state was saved.
+  void load(Archive &archive) override {
+    Event::load(archive);
+    bool had_value;
+    archive.load(had_value);
+    if (constructed && !had_value) {
+      value()->~T();
+      constructed = false;
+    }
+  }
+
+private:
+  alignas(T) unsigned char storage[sizeof(T)];
+  bool constructed = false;
+
+  T *value() { return reinterpret_cast<T *>(storage); }
+
+  static void call_handler(void *context, Event &event) {
+    (*static_cast<ValueHandler *>(context))(
+        static_cast<ValueEvent &>(event).get_value());
+  }
+};
+
+template <typename Iterator>
+ConditionPtr Simulation::any_of(Iterator first, Iterator last) {
+  return n_of(1, first, last);
+}
+
+template <typename Iterator>
+ConditionPtr Simulation::all_of(Iterator first, Iterator last) {
+  return n_of(std::distance(first, last), first, last);
+}
+
+template <typename Iterator>
+ConditionPtr Simulation::n_of(size_t n, Iterator first, Iterator last) {
+  size_t size = 0;
+  size_t n_triggered = 0;
+  for (auto it = first; it != last; ++it) {
+    ++size;
+    if ((*it)->is_triggered()) {
+      ++n_triggered;
+    }
+  }
+
+  auto condition = event<Condition>(n);
+  if (n > 1 && size > 1) {
+    condition->fired.reserve((n < size ? n : size) - 1);
+  }
+  Callback callback = n_triggered < n ? condition->watch() : Callback();
+  for (; first != last; ++first) {
+    condition->add(*first, callback);
+  }
+  condition->start();
+  return condition;
+}
+
 } // namespace simcpp
 
 #endif // SIMCPP_H_
@@ -0,0 +1,585 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SIMCPP_MMAP
+#endif
+
+#include "queue.h"
+
+namespace simcpp {
+
+namespace {
+
+const char magic[8] = {'S', 'I', 'M', 'C', 'P', 'P', 'S', 'N'};
+const uint32_t version = 2;
+const uint32_t byte_order = 0x01020304;
+const uint32_t null_index = 0xffffffff;
+
+/// Range of an array of a snapshot.
+class Range {
+public:
+  uint64_t first;
+  uint64_t size;
+};
+
+/// Bytes and pointers saved to an archive.
+class Blob {
+public:
+  Range bytes;
+  Range pointers;
+};
+
+class Header {
+public:
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  double now;
+  uint64_t next_id;
+  Random random;
+  /// Offsets of the sections.
+  uint64_t types;
+  uint64_t callbacks;
+  uint64_t objects;
+  uint64_t entries;
+  uint64_t handlers;
+  uint64_t pointers;
+  uint64_t bytes;
+  /// Numbers of records of the sections.
+  uint64_t n_types;
+  uint64_t n_callbacks;
+  uint64_t n_objects;
+  uint64_t n_entries;
+  uint64_t n_handlers;
+  uint64_t n_pointers;
+  uint64_t n_bytes;
+  Blob state;
+};
+
+class ObjectRecord {
+public:
+  uint32_t type;
+  uint32_t state;
+  Range handlers;
+  Blob blob;
+};
+
+class HandlerRecord {
+public:
+  uint32_t callback;
+  uint32_t owner;
+};
+
+class EntryRecord {
+public:
+  simtime time;
+  uint64_t id;
+  uint64_t object;
+};
+
+/// Appends a section of records and returns its offset.
+template <typename T>
+uint64_t append(std::vector<unsigned char> &data, const std::vector<T> &records) {
+  // Sections are aligned, so records can be read in place.
+  data.resize((data.size() + 7) / 8 * 8);
+  uint64_t offset = data.size();
+  auto first = reinterpret_cast<const unsigned char *>(records.data());
+  data.insert(data.end(), first, first + records.size() * sizeof(T));
+  return offset;
+}
+
+/// Reads records of a snapshot with bounds checks.
+class Reader {
+public:
+  Reader(const unsigned char *data, size_t size) : data(data), size(size) {}
+
+  template <typename T> T read(uint64_t offset, uint64_t index = 0) const {
+    check(offset, index + 1, sizeof(T));
+    T record;
+    std::memcpy(&record, data + offset + index * sizeof(T), sizeof(T));
+    return record;
+  }
+
+  void check(uint64_t offset, uint64_t n, uint64_t record_size) const {
+    if (offset > size || n > (size - offset) / record_size) {
+      throw std::runtime_error("snapshot is truncated or corrupt");
+    }
+  }
+
+  const unsigned char *data;
+  size_t size;
+};
+
+} // namespace
+
+/* Simulation */
+
+SimulationPtr Simulation::fork(
+    const SnapshotRegistry &registry,
+    std::function<void(Archive &)> save_state /* = nullptr */,
+    std::function<void(Archive &)> load_state /* = nullptr */) {
+  auto copy = Simulation::create(options);
+  fork(copy, registry, std::move(save_state), std::move(load_state));
+  return copy;
+}
+
+void Simulation::fork(SimulationPtr copy, const SnapshotRegistry &registry,
+                      std::function<void(Archive &)> save_state /* = nullptr */,
+                      std::function<void(Archive &)> load_state
+                      /* = nullptr */) {
+  Snapshot::take(shared_from_this(), registry, std::move(save_state))
+      .restore(copy, registry, std::move(load_state));
+}
+
+/* SnapshotRegistry */
+
+SnapshotRegistry::SnapshotRegistry() {
+  add<Event>("simcpp::Event");
+
+  add<Condition>("simcpp::Condition", [](SimulationPtr sim) -> EventPtr {
+    return sim->event<Condition>(0);
+  });
+  add<Condition::Link>("simcpp::ConditionLink");
+  add_callback<Condition::Link>("simcpp::condition", Condition::fire);
+  add_callback<Process>("simcpp::resume", Simulation::get_resume_process());
+}
+
+void SnapshotRegistry::add(const std::type_info &type, const std::string &name,
+                           Factory factory) {
+  if (type_names.count(name) != 0) {
+    throw std::invalid_argument("type name already registered: " + name);
+  }
+
+  Type entry{name, std::type_index(type), std::move(factory)};
+  type_indices[std::type_index(type)] = types.size();
+  type_names[name] = types.size();
+  types.push_back(std::move(entry));
+}
+
+void SnapshotRegistry::add_callback(const std::string &name,
+                                    Callback::Function function,
+                                    ContextToEvent context_to_event,
+                                    EventToContext event_to_context) {
+  if (callback_names.count(name) != 0) {
+    throw std::invalid_argument("callback name already registered: " + name);
+  }
+
+  CallbackType entry{name, function, context_to_event, event_to_context};
+  callback_indices[function] = callbacks.size();
+  callback_names[name] = callbacks.size();
+  callbacks.push_back(std::move(entry));
+}
+
+/* Snapshot */
+
+Snapshot Snapshot::take(SimulationPtr sim, const SnapshotRegistry &registry,
+                        StateHandler save_state /* = nullptr */) {
+  if (sim->batching || Journal::get_active() != nullptr) {
+    throw std::logic_error(
+        "snapshots cannot be taken during a batch or with a journal");
+  }
+  if (!sim->calls->empty()) {
+    throw std::logic_error("snapshots cannot be taken with scheduled calls");
+  }
+
+  std::vector<EventPtr> objects;
+  std::unordered_map<const Event *, uint32_t> object_indices;
+  object_indices.reserve(2 * sim->queued_events->size());
+  auto index = [&](const EventPtr &event) -> uint32_t {
+    if (event == nullptr) {
+      return null_index;
+    }
+    auto it = object_indices.find(event.get());
+    if (it != object_indices.end()) {
+      return it->second;
+    }
+    auto i = static_cast<uint32_t>(objects.size());
+    object_indices[event.get()] = i;
+    objects.push_back(event);
+    return i;
+  };
+
+  // Types and callbacks are stored by name, as indices into these tables.
+  std::vector<size_t> types;
+  std::unordered_map<size_t, uint32_t> type_indices;
+  std::vector<size_t> callbacks;
+  std::unordered_map<size_t, uint32_t> callback_indices;
+  auto local = [](std::vector<size_t> &table,
+                  std::unordered_map<size_t, uint32_t> &indices, size_t i) {
+    auto it = indices.find(i);
+    if (it != indices.end()) {
+      return it->second;
+    }
+    auto local = static_cast<uint32_t>(table.size());
+    indices[i] = local;
+    table.push_back(i);
+    return local;
+  };
+
+  std::vector<unsigned char> bytes;
+  std::vector<uint32_t> pointers;
+  auto blob = [&](const Archive &archive, size_t first_byte,
+                  size_t first_pointer) {
+    Blob blob;
+    auto &archive_bytes = archive.get_bytes();
+    blob.bytes.first = bytes.size();
+    blob.bytes.size = archive_bytes.size() - first_byte;
+    bytes.insert(bytes.end(), archive_bytes.begin() + first_byte,
+                 archive_bytes.end());
+
+    auto &archive_pointers = archive.get_pointers();
+    blob.pointers.first = pointers.size();
+    blob.pointers.size = archive_pointers.size() - first_pointer;
+    for (size_t i = first_pointer; i < archive_pointers.size(); ++i) {
+      auto &pointer = archive_pointers[i];
+      if (pointer.object != nullptr && !pointer.event) {
+        throw std::invalid_argument(
+            "only pointers to events can be stored in a snapshot");
+      }
+      pointers.push_back(
+          index(std::static_pointer_cast<Event>(pointer.object)));
+    }
+    return blob;
+  };
+
+  std::vector<EntryRecord> entries;
+  sim->queued_events->remove_if([&](const QueuedEvent &entry) {
+    if (!entry.event->is_aborted()) {
+      EntryRecord record;
+      record.time = entry.time;
+      record.id = entry.id;
+      record.object = index(entry.event);
+      entries.push_back(record);
+    }
+    return false;
+  });
+  std::sort(entries.begin(), entries.end(),
+            [](const EntryRecord &a, const EntryRecord &b) {
+              return a.time != b.time ? a.time < b.time : a.id < b.id;
+            });
+
+  Header header;
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.byte_order = byte_order;
+  header.now = sim->now;
+  header.next_id = sim->next_id;
+  header.random = sim->random;
+
+  Archive state;
+  if (save_state) {
+    save_state(state);
+  }
+  header.state = blob(state, 0, 0);
+
+  // Events reachable through handlers and pointers are added to the table
+  // while it is traversed.
+  std::vector<ObjectRecord> records;
+  std::vector<HandlerRecord> handlers;
+  Archive base;
+  Archive archive;
+  const std::type_info *last_type = nullptr;
+  uint32_t last_type_index = 0;
+  for (size_t i = 0; i < objects.size(); ++i) {
+    auto object = objects[i];
+    // Hashing a type is slow, and most events have the type of the last one.
+    auto &type = typeid(*object);
+    if (&type != last_type) {
+      auto it = registry.type_indices.find(std::type_index(type));
+      if (it == registry.type_indices.end()) {
+        throw std::invalid_argument(std::string("type not registered: ") +
+                                    type.name());
+      }
+      last_type = &type;
+      last_type_index = local(types, type_indices, it->second);
+    }
+
+    ObjectRecord record;
+    record.type = last_type_index;
+    record.state = static_cast<uint32_t>(object->state);
+
+    record.handlers.first = handlers.size();
+    auto add_handler = [&](const Callback &callback) {
+      auto it = registry.callback_indices.find(callback.function);
+      if (it == registry.callback_indices.end()) {
+        throw std::invalid_argument(
+            "handler not registered, std::function handlers cannot be stored");
+      }
+      auto &callback_type = registry.callbacks[it->second];
+      if (callback.context != callback.owner.get()) {
+        throw std::invalid_argument("callback context is not its owner");
+      }
+
+      HandlerRecord handler;
+      handler.callback = local(callbacks, callback_indices, it->second);
+      handler.owner = index(
+          callback_type.context_to_event(callback.context)->shared_from_this());
+      handlers.push_back(handler);
+    };
+    if (object->first_handler) {
+      add_handler(object->first_handler);
+    }
+    for (auto &handler : object->handlers) {
+      add_handler(handler);
+    }
+    record.handlers.size = handlers.size() - record.handlers.first;
+
+    // Only the part saved by subclasses is stored. The state and handlers of
+    // the event are stored above.
+    base.clear();
+    object->Event::save(base);
+    archive.clear();
+    object->save(archive);
+    record.blob =
+        blob(archive, base.get_bytes().size(), base.get_pointers().size());
+    records.push_back(record);
+  }
+
+  std::vector<Range> type_names;
+  for (auto i : types) {
+    auto &name = registry.types[i].name;
+    type_names.push_back(Range{bytes.size(), name.size()});
+    bytes.insert(bytes.end(), name.begin(), name.end());
+  }
+  std::vector<Range> callback_names;
+  for (auto i : callbacks) {
+    auto &name = registry.callbacks[i].name;
+    callback_names.push_back(Range{bytes.size(), name.size()});
+    bytes.insert(bytes.end(), name.begin(), name.end());
+  }
+
+  header.n_types = type_names.size();
+  header.n_callbacks = callback_names.size();
+  header.n_objects = records.size();
+  header.n_entries = entries.size();
+  header.n_handlers = handlers.size();
+  header.n_pointers = pointers.size();
+  header.n_bytes = bytes.size();
+
+  auto data = std::make_shared<std::vector<unsigned char>>(sizeof(Header));
+  header.types = append(*data, type_names);
+  header.callbacks = append(*data, callback_names);
+  header.objects = append(*data, records);
+  header.entries = append(*data, entries);
+  header.handlers = append(*data, handlers);
+  header.pointers = append(*data, pointers);
+  header.bytes = append(*data, bytes);
+  std::memcpy(data->data(), &header, sizeof(Header));
+
+  return Snapshot(std::shared_ptr<const unsigned char>(data, data->data()),
+                  data->size());
+}
+
+Snapshot Snapshot::read(const std::string &path) {
+#ifdef SIMCPP_MMAP
+  int file = open(path.c_str(), O_RDONLY);
+  if (file < 0) {
+    throw std::runtime_error("cannot open snapshot " + path);
+  }
+  struct stat status;
+  if (fstat(file, &status) != 0 || status.st_size == 0) {
+    close(file);
+    throw std::runtime_error("cannot read snapshot " + path);
+  }
+  auto size = static_cast<size_t>(status.st_size);
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (mapping == MAP_FAILED) {
+    throw std::runtime_error("cannot map snapshot " + path);
+  }
+
+  std::shared_ptr<const unsigned char> data(
+      static_cast<const unsigned char *>(mapping),
+      [size](const unsigned char *mapping) {
+        munmap(const_cast<unsigned char *>(mapping), size);
+      });
+  return Snapshot(data, size);
+#else
+  std::ifstream stream(path, std::ios::binary);
+  if (!stream) {
+    throw std::runtime_error("cannot open snapshot " + path);
+  }
+  auto data = std::make_shared<std::vector<unsigned char>>(
+      std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+  return Snapshot(std::shared_ptr<const unsigned char>(data, data->data()),
+                  data->size());
+#endif
+}
+
+void Snapshot::write(const std::string &path) const {
+  std::ofstream stream(path, std::ios::binary);
+  stream.write(reinterpret_cast<const char *>(data.get()),
+               static_cast<std::streamsize>(size));
+  if (!stream) {
+    throw std::runtime_error("cannot write snapshot " + path);
+  }
+}
+
+SimulationPtr Snapshot::restore(const SnapshotRegistry &registry,
+                                StateHandler load_state /* = nullptr */,
+                                const SimulationOptions &options
+                                /* = SimulationOptions() */) const {
+  auto sim = Simulation::create(options);
+  restore(sim, registry, std::move(load_state));
+  return sim;
+}
+
+void Snapshot::restore(SimulationPtr sim, const SnapshotRegistry &registry,
+                       StateHandler load_state /* = nullptr */) const {
+  if (sim->has_next()) {
+    throw std::invalid_argument("snapshots must be restored into a new "
+                                "simulation");
+  }
+
+  Reader reader(data.get(), size);
+  auto header = reader.read<Header>(0);
+  if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+      header.version != version || header.byte_order != byte_order) {
+    throw std::runtime_error("not a snapshot of this version and platform");
+  }
+  reader.check(header.bytes, header.n_bytes, 1);
+  reader.check(header.pointers, header.n_pointers, sizeof(uint32_t));
+  reader.check(header.handlers, header.n_handlers, sizeof(HandlerRecord));
+
+  auto name = [&](uint64_t section, uint64_t i) {
+    auto range = reader.read<Range>(section, i);
+    reader.check(range.first, range.size, 1);
+    if (range.first + range.size > header.n_bytes) {
+      throw std::runtime_error("snapshot is truncated or corrupt");
+    }
+    return std::string(
+        reinterpret_cast<const char *>(data.get() + header.bytes + range.first),
+        range.size);
+  };
+
+  std::vector<const SnapshotRegistry::Type *> types;
+  for (uint64_t i = 0; i < header.n_types; ++i) {
+    auto type_name = name(header.types, i);
+    auto it = registry.type_names.find(type_name);
+    if (it == registry.type_names.end()) {
+      throw std::invalid_argument("type not registered: " + type_name);
+    }
+    types.push_back(&registry.types[it->second]);
+  }
+  std::vector<const SnapshotRegistry::CallbackType *> callbacks;
+  for (uint64_t i = 0; i < header.n_callbacks; ++i) {
+    auto callback_name = name(header.callbacks, i);
+    auto it = registry.callback_names.find(callback_name);
+    if (it == registry.callback_names.end()) {
+      throw std::invalid_argument("callback not registered: " + callback_name);
+    }
+    callbacks.push_back(&registry.callbacks[it->second]);
+  }
+
+  sim->now = header.now;
+  sim->next_id = header.next_id;
+  sim->random = header.random;
+
+  std::vector<EventPtr> objects;
+  for (uint64_t i = 0; i < header.n_objects; ++i) {
+    auto record = reader.read<ObjectRecord>(header.objects, i);
+    if (record.type >= types.size()) {
+      throw std::runtime_error("snapshot is truncated or corrupt");
+    }
+    auto object = types[record.type]->factory(sim);
+    if (object == nullptr ||
+        std::type_index(typeid(*object)) != types[record.type]->type) {
+      throw std::logic_error("factory of " + types[record.type]->name +
+                             " constructed another type");
+    }
+    objects.push_back(object);
+  }
+
+  auto object = [&](uint32_t i) -> EventPtr {
+    if (i == null_index) {
+      return nullptr;
+    }
+    if (i >= objects.size()) {
+      throw std::runtime_error("snapshot is truncated or corrupt");
+    }
+    return objects[i];
+  };
+  auto load = [&](const Blob &blob, Archive &archive) {
+    if (blob.bytes.first > header.n_bytes ||
+        blob.bytes.size > header.n_bytes - blob.bytes.first ||
+        blob.pointers.first > header.n_pointers ||
+        blob.pointers.size > header.n_pointers - blob.pointers.first) {
+      throw std::runtime_error("snapshot is truncated or corrupt");
+    }
+    archive.save_bytes(data.get() + header.bytes + blob.bytes.first,
+                       blob.bytes.size);
+    for (uint64_t i = 0; i < blob.pointers.size; ++i) {
+      archive.save(object(reader.read<uint32_t>(
+          header.pointers, blob.pointers.first + i)));
+    }
+  };
+
+  for (uint64_t i = 0; i < header.n_objects; ++i) {
+    auto record = reader.read<ObjectRecord>(header.objects, i);
+    auto &event = *objects[i];
+
+    // The saved part of subclasses follows the state of a new event.
+    Archive archive;
+    event.Event::save(archive);
+    load(record.blob, archive);
+    event.load(archive);
+
+    event.state = static_cast<Event::State>(record.state);
+    for (uint64_t j = 0; j < record.handlers.size; ++j) {
+      auto handler = reader.read<HandlerRecord>(header.handlers,
+                                                record.handlers.first + j);
+      auto owner = object(handler.owner);
+      if (handler.callback >= callbacks.size() || owner == nullptr) {
+        throw std::runtime_error("snapshot is truncated or corrupt");
+      }
+      auto &callback = *callbacks[handler.callback];
+      auto context = callback.event_to_context(owner.get());
+      Callback entry(callback.function, context,
+                     std::shared_ptr<void>(owner, context));
+      if (!event.first_handler) {
+        event.first_handler = std::move(entry);
+      } else {
+        event.handlers.push_back(std::move(entry));
+      }
+    }
+  }
+
+  for (uint64_t i = 0; i < header.n_entries; ++i) {
+    auto entry = reader.read<EntryRecord>(header.entries, i);
+    auto event = object(static_cast<uint32_t>(entry.object));
+    if (event == nullptr) {
+      throw std::runtime_error("snapshot is truncated or corrupt");
+    }
+    event->queued = true;
+    sim->queued_events->push(QueuedEvent(entry.time, entry.id, event));
+  }
+
+  if (load_state) {
+    Archive state;
+    load(header.state, state);
+    load_state(state);
+  }
+}
+
+const unsigned char *Snapshot::get_data() const { return data.get(); }
+
+size_t Snapshot::get_size() const { return size; }
+
+Snapshot::Snapshot(std::shared_ptr<const unsigned char> data, size_t size)
+    : data(std::move(data)), size(size) {}
+
+} // namespace simcpp
@@ -0,0 +1,218 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_SNAPSHOT_H_
+#define SIMCPP_SNAPSHOT_H_
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "archive.h"
+#include "simcpp.h"
+
+namespace simcpp {
+
+/**
+ * Types of events and callbacks which can be stored in snapshots.
+ *
+ * Every event in a snapshot must have a registered type, and every handler a
+ * registered callback. Events, the events of any_of and all_of, and the
+ * handlers added for processes, any_of and all_of are registered by default.
+ * Handlers added as std::function cannot be stored.
+ */
+class SnapshotRegistry {
+public:
+  using Factory = std::function<EventPtr(SimulationPtr)>;
+
+  /// Construct a registry of the built-in types and callbacks.
+  SnapshotRegistry();
+
+  /**
+   * Register an event or process class which is constructible from the
+   * simulation instance alone.
+   *
+   * @tparam T Event class.
+   * @param name Name of the class in snapshots. Must be unique.
+   */
+  template <typename T> void add(const std::string &name) {
+    add(typeid(T), name,
+        [](SimulationPtr sim) -> EventPtr { return sim->event<T>(); });
+  }
+
+  /**
+   * Register an event or process class.
+   *
+   * The factory constructs an instance with the members which are not saved,
+   * for example pointers to the model. The saved members are loaded after.
+   *
+   * @tparam T Event class.
+   * @param name Name of the class in snapshots. Must be unique.
+   * @param factory Function constructing an instance of T in a simulation.
+   */
+  template <typename T> void add(const std::string &name, Factory factory) {
+    add(typeid(T), name, std::move(factory));
+  }
+
+  /**
+   * Register a callback function of handlers added with Event::add_callback.
+   *
+   * @tparam T Event class of the context of the callback, which must be the
+   * owner of the callback.
+   * @param name Name of the callback in snapshots. Must be unique.
+   * @param function Callback function.
+   */
+  template <typename T>
+  void add_callback(const std::string &name, Callback::Function function) {
+    add_callback(
+        name, function,
+        [](void *context) -> Event * { return static_cast<T *>(context); },
+        [](Event *event) -> void * { return static_cast<T *>(event); });
+  }
+
+private:
+  friend class Snapshot;
+
+  using ContextToEvent = Event *(*)(void *context);
+  using EventToContext = void *(*)(Event *event);
+
+  class Type {
+  public:
+    std::string name;
+    std::type_index type;
+    Factory factory;
+  };
+
+  class CallbackType {
+  public:
+    std::string name;
+    Callback::Function function;
+    ContextToEvent context_to_event;
+    EventToContext event_to_context;
+  };
+
+  std::vector<Type> types = {};
+  std::unordered_map<std::type_index, size_t> type_indices = {};
+  std::unordered_map<std::string, size_t> type_names = {};
+  std::vector<CallbackType> callbacks = {};
+  std::map<Callback::Function, size_t> callback_indices = {};
+  std::unordered_map<std::string, size_t> callback_names = {};
+
+  void add(const std::type_info &type, const std::string &name,
+           Factory factory);
+  void add_callback(const std::string &name, Callback::Function function,
+                    ContextToEvent context_to_event,
+                    EventToContext event_to_context);
+};
+
+/**
+ * Snapshot of a simulation in a compact binary format.
+ *
+ * Holds the current time, the random number generator of the simulation, the
+ * scheduled events with their order, and all events reachable from them
+ * through handlers and saved shared pointers, with their state, handlers and
+ * the members saved by Event::save. For processes, this includes the position
+ * of the protothread. Restoring a snapshot creates a new simulation, which
+ * continues exactly like the original one.
+ *
+ * The format consists of sections of fixed-size records, which are read
+ * directly from the bytes of the snapshot, so a snapshot file is
+ * memory-mapped rather than parsed when it is read. It is only portable
+ * between machines with the same byte order and type sizes.
+ *
+ * Saved shared pointers must point to events. State of the model outside of
+ * events, for example counters and random number generators, is saved and
+ * loaded by a state handler, which can also save pointers to events.
+ * Coroutine tasks cannot be stored.
+ *
+ * ```
+ * simcpp::SnapshotRegistry registry;
+ * registry.add<Car>("Car");
+ * auto snapshot = simcpp::Snapshot::take(sim, registry);
+ * snapshot.write("warm.snapshot");
+ * // later, possibly in another run of the program
+ * auto sim = simcpp::Snapshot::read("warm.snapshot").restore(registry);
+ * ```
+ */
+class Snapshot {
+public:
+  using StateHandler = std::function<void(Archive &)>;
+
+  /**
+   * Take a snapshot of a simulation. Must be called between steps, for
+   * example after run_until, and not while a journal is active.
+   *
+   * @param sim Simulation instance.
+   * @param registry Types of the events of the simulation.
+   * @param save_state Function which saves the state of the model, or
+   * nullptr.
+   * @return Snapshot.
+   */
+  static Snapshot take(SimulationPtr sim, const SnapshotRegistry &registry,
+                       StateHandler save_state = nullptr);
+
+  /**
+   * Read a snapshot from a file, which is memory-mapped where supported.
+   *
+   * @param path Path of the file.
+   * @return Snapshot.
+   */
+  static Snapshot read(const std::string &path);
+
+  /**
+   * Write the snapshot to a file.
+   *
+   * @param path Path of the file.
+   */
+  void write(const std::string &path) const;
+
+  /**
+   * Create a simulation from the snapshot.
+   *
+   * @param registry Types of the events of the snapshot.
+   * @param load_state Function which loads the state of the model saved by
+   * the save_state function of take, or nullptr.
+   * @param options Options of the new simulation.
+   * @return Simulation instance.
+   */
+  SimulationPtr restore(const SnapshotRegistry &registry,
+                        StateHandler load_state = nullptr,
+                        const SimulationOptions &options =
+                            SimulationOptions()) const;
+
+  /**
+   * Restore the snapshot into a new simulation, so the model of the
+   * simulation, for example its resources, can be constructed before the
+   * events which refer to it.
+   *
+   * @param sim Simulation instance without scheduled events.
+   * @param registry Types of the events of the snapshot.
+   * @param load_state Function which loads the state of the model saved by
+   * the save_state function of take, or nullptr.
+   */
+  void restore(SimulationPtr sim, const SnapshotRegistry &registry,
+               StateHandler load_state = nullptr) const;
+
+  /// @return First byte of the snapshot.
+  const unsigned char *get_data() const;
+
+  /// @return Size of the snapshot in bytes.
+  size_t get_size() const;
+
+private:
+  /// Bytes of the snapshot, owned by a vector or a memory mapping.
+  std::shared_ptr<const unsigned char> data;
+  size_t size;
+
+  Snapshot(std::shared_ptr<const unsigned char> data, size_t size);
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_SNAPSHOT_H_
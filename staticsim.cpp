@@ -0,0 +1,57 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "staticsim.h"
+
+namespace simcpp {
+
+/* StaticEntry */
+
+bool StaticEntry::operator<(const StaticEntry &other) const {
+  if (time != other.time) {
+    return time > other.time;
+  }
+
+  return id > other.id;
+}
+
+/* StaticScheduler */
+
+void StaticScheduler::schedule(StaticHandle process,
+                               simtime delay /* = 0.0 */) {
+  queue.push(StaticEntry{now + delay, next_id, process});
+  ++next_id;
+}
+
+simtime StaticScheduler::get_now() const { return now; }
+
+bool StaticScheduler::has_next() const { return !queue.empty(); }
+
+simtime StaticScheduler::peek_next_time() const { return queue.top().time; }
+
+StaticHandle StaticScheduler::pop() {
+  auto entry = queue.top();
+  queue.pop();
+  now = entry.time;
+  return entry.process;
+}
+
+/* StaticSignal */
+
+void StaticSignal::wait(const StaticProcess &process) {
+  waiting.push_back(process.get_handle());
+}
+
+size_t StaticSignal::notify(simtime delay /* = 0.0 */) {
+  size_t n_waiting = waiting.size();
+  for (auto process : waiting) {
+    sim->schedule(process, delay);
+  }
+  // Clearing keeps the capacity, so waiting does not allocate once warm.
+  waiting.clear();
+  return n_waiting;
+}
+
+size_t StaticSignal::get_n_waiting() const { return waiting.size(); }
+
+} // namespace simcpp
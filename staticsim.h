@@ -0,0 +1,326 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_STATICSIM_H_
+#define SIMCPP_STATICSIM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <queue>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "protothread.h"
+#include "simcpp.h"
+
+/**
+ * Wait for a delay inside the Run method of a static process.
+ *
+ * The yield is in a branch, like in PROC_WAIT_FOR, so compilers do not warn
+ * that the statement before falls through to its case label.
+ *
+ * @param delay Delay after which the process is resumed.
+ */
+#define STATIC_WAIT(delay)                                                     \
+  do {                                                                         \
+    resume_in(delay);                                                          \
+    if (true) {                                                                \
+      PT_YIELD();                                                              \
+    }                                                                          \
+  } while (0)
+
+/**
+ * Wait for a signal inside the Run method of a static process.
+ *
+ * The process is resumed when the signal is notified the next time.
+ *
+ * @param signal Signal to wait for.
+ */
+#define STATIC_WAIT_FOR(signal)                                                \
+  do {                                                                         \
+    (signal).wait(*this);                                                      \
+    if (true) {                                                                \
+      PT_YIELD();                                                              \
+    }                                                                          \
+  } while (0)
+
+namespace simcpp {
+
+/// Process in a static model: tag of its type and index among its type.
+class StaticHandle {
+public:
+  uint32_t index;
+  uint16_t type;
+};
+
+/// Entry of the event queue of a static model.
+class StaticEntry {
+public:
+  simtime time;
+  uint64_t id;
+  StaticHandle process;
+
+  /**
+   * Compare the priority of two entries. Inverted like
+   * QueuedEvent::operator<.
+   *
+   * @param other Other entry.
+   * @return Whether this entry is processed after the other entry.
+   */
+  bool operator<(const StaticEntry &other) const;
+};
+
+static_assert(sizeof(StaticEntry) <= 24, "static entries must stay compact");
+
+/**
+ * Scheduler of a static model, independent of its process types.
+ *
+ * Use StaticSimulation, which derives from it.
+ */
+class StaticScheduler {
+public:
+  StaticScheduler(const StaticScheduler &) = delete;
+  StaticScheduler &operator=(const StaticScheduler &) = delete;
+
+  /**
+   * Schedule a process to be resumed after a delay.
+   *
+   * @param process Process to resume.
+   * @param delay Delay after which the process is resumed.
+   */
+  void schedule(StaticHandle process, simtime delay = 0.0);
+
+  /// @return Current simulation time.
+  simtime get_now() const;
+
+  /// @return Whether a process is scheduled.
+  bool has_next() const;
+
+  /// @return Time at which the next process is resumed. Must be scheduled.
+  simtime peek_next_time() const;
+
+protected:
+  simtime now = 0.0;
+
+  StaticScheduler() = default;
+
+  /**
+   * Remove the next entry and advance the time to it. Must be scheduled.
+   *
+   * @return Process to resume.
+   */
+  StaticHandle pop();
+
+private:
+  std::priority_queue<StaticEntry> queue = {};
+  uint64_t next_id = 0;
+};
+
+/**
+ * Process in a static model.
+ *
+ * Subclasses implement Run like processes with the protothread macros, but
+ * wait with STATIC_WAIT and STATIC_WAIT_FOR. A process must not wait for more
+ * than one thing at a time.
+ */
+class StaticProcess : public Protothread {
+public:
+  /**
+   * Construct a static process. Use StaticSimulation::start_process instead.
+   *
+   * @param sim Scheduler of the model.
+   */
+  explicit StaticProcess(StaticScheduler &sim) : sim(&sim) {}
+
+  /// @return Handle of the process.
+  StaticHandle get_handle() const { return handle; }
+
+protected:
+  /// Scheduler of the model.
+  StaticScheduler *sim;
+
+  /**
+   * Resume the process after a delay. Used by STATIC_WAIT.
+   *
+   * @param delay Delay after which the process is resumed.
+   */
+  void resume_in(simtime delay) { sim->schedule(handle, delay); }
+
+private:
+  template <typename...> friend class StaticSimulation;
+
+  StaticHandle handle = {};
+};
+
+/**
+ * Signal which static processes wait for, the counterpart of an event.
+ *
+ * Unlike an event, a signal is not consumed: Notifying it resumes the
+ * processes waiting at that moment, and later waits wait for the next
+ * notification.
+ */
+class StaticSignal {
+public:
+  /**
+   * Construct a signal.
+   *
+   * @param sim Scheduler of the model.
+   */
+  explicit StaticSignal(StaticScheduler &sim) : sim(&sim) {}
+
+  /**
+   * Add a waiting process. Used by STATIC_WAIT_FOR.
+   *
+   * @param process Process to resume on the next notification.
+   */
+  void wait(const StaticProcess &process);
+
+  /**
+   * Resume the waiting processes after a delay.
+   *
+   * @param delay Delay after which the processes are resumed.
+   * @return Number of processes which were waiting.
+   */
+  size_t notify(simtime delay = 0.0);
+
+  /// @return Number of waiting processes.
+  size_t get_n_waiting() const;
+
+private:
+  StaticScheduler *sim;
+  std::vector<StaticHandle> waiting = {};
+};
+
+/**
+ * Simulation of a model whose process types are known at compile time.
+ *
+ * Processes are stored by type and referred to by a type tag and an index, so
+ * the event queue holds small entries instead of shared pointers, and
+ * resuming a process dispatches on the tag to a non-virtual call of its Run
+ * method. Events, handlers, profiling and tracing are not available, and
+ * processes live as long as the simulation.
+ *
+ * ```
+ * simcpp::StaticSimulation<Ping, Pong> sim;
+ * sim.start_process<Ping>(&signal);
+ * sim.run();
+ * ```
+ *
+ * @tparam Processes Process classes. Must be subclasses of StaticProcess
+ * whose constructors take the scheduler first.
+ */
+template <typename... Processes>
+class StaticSimulation : public StaticScheduler {
+  static_assert(sizeof...(Processes) <= UINT16_MAX, "too many process types");
+
+public:
+  StaticSimulation() = default;
+
+  /**
+   * Construct a process and run it immediately.
+   *
+   * @tparam P Process class. Must be one of the process classes.
+   * @tparam Args Additional argument types of the constructor of P.
+   * @param args Additional arguments for the construction of P.
+   * @return Process, which lives as long as the simulation.
+   */
+  template <typename P, typename... Args> P &start_process(Args &&...args) {
+    auto &of_type = get_processes<P>();
+    of_type.emplace_back(*this, std::forward<Args>(args)...);
+    P &process = of_type.back();
+    process.handle.index = static_cast<uint32_t>(of_type.size() - 1);
+    process.handle.type = TypeIndex<P, Processes...>::value;
+    process.P::Run();
+    return process;
+  }
+
+  /**
+   * Resume the next process.
+   *
+   * @return Whether a process was scheduled.
+   */
+  bool step() {
+    if (!has_next()) {
+      return false;
+    }
+
+    resume(pop());
+    return true;
+  }
+
+  /// Run the simulation until no processes are scheduled.
+  void run() {
+    while (step()) {
+    }
+  }
+
+  /**
+   * Run the simulation until a time. Processes scheduled at exactly that time
+   * are not resumed yet.
+   *
+   * @param time Time to run until.
+   */
+  void run_until(simtime time) {
+    while (has_next() && peek_next_time() < time) {
+      step();
+    }
+    now = time;
+  }
+
+  /// @return Processes of a type in the order in which they were started.
+  template <typename P> std::deque<P> &get_processes() {
+    return std::get<TypeIndex<P, Processes...>::value>(processes);
+  }
+
+private:
+  using Storage = std::tuple<std::deque<Processes>...>;
+
+  /// Index of a type in a list of types.
+  template <typename P, typename... Ps> class TypeIndex;
+
+  template <typename P, typename... Ps> class TypeIndex<P, P, Ps...> {
+  public:
+    static const uint16_t value = 0;
+  };
+
+  template <typename P, typename Q, typename... Ps>
+  class TypeIndex<P, Q, Ps...> {
+  public:
+    static const uint16_t value = 1 + TypeIndex<P, Ps...>::value;
+  };
+
+  /// Resumes a process whose type is at index I or later. Inlined into a
+  /// chain of comparisons of the type tag, which compilers turn into a
+  /// switch.
+  template <size_t I, typename... Ps> class Dispatch {
+  public:
+    static void resume(Storage &, StaticHandle) {}
+  };
+
+  template <size_t I, typename P, typename... Ps>
+  class Dispatch<I, P, Ps...> {
+  public:
+    static void resume(Storage &storage, StaticHandle handle) {
+      if (handle.type == I) {
+        P &process = std::get<I>(storage)[handle.index];
+        if (process.IsRunning()) {
+          process.P::Run();
+        }
+      } else {
+        Dispatch<I + 1, Ps...>::resume(storage, handle);
+      }
+    }
+  };
+
+  Storage processes = {};
+
+  void resume(StaticHandle process) {
+    Dispatch<0, Processes...>::resume(processes, process);
+  }
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_STATICSIM_H_
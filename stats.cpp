@@ -0,0 +1,422 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace simcpp {
+
+namespace {
+
+const double pi = 3.14159265358979323846;
+
+} // namespace
+
+/* Tally */
+
+void Tally::add(double value) {
+  ++count;
+
+  if (count == 1) {
+    min = max = value;
+  } else {
+    min = value < min ? value : min;
+    max = value > max ? value : max;
+  }
+
+  double delta = value - mean;
+  mean += delta / static_cast<double>(count);
+  m2 += delta * (value - mean);
+}
+
+void Tally::merge(const Tally &other) {
+  if (other.count == 0) {
+    return;
+  }
+
+  if (count == 0) {
+    *this = other;
+    return;
+  }
+
+  // Parallel variant of Welford's algorithm (Chan et al., 1979).
+  double n_a = static_cast<double>(count);
+  double n_b = static_cast<double>(other.count);
+  double n = n_a + n_b;
+  double delta = other.mean - mean;
+
+  mean += delta * n_b / n;
+  m2 += other.m2 + delta * delta * n_a * n_b / n;
+  count += other.count;
+  min = other.min < min ? other.min : min;
+  max = other.max > max ? other.max : max;
+}
+
+size_t Tally::get_count() const { return count; }
+
+double Tally::get_mean() const { return mean; }
+
+double Tally::get_variance() const {
+  if (count < 2) {
+    return 0.0;
+  }
+
+  return m2 / static_cast<double>(count - 1);
+}
+
+double Tally::get_stddev() const { return std::sqrt(get_variance()); }
+
+double Tally::get_min() const { return min; }
+
+double Tally::get_max() const { return max; }
+
+double Tally::get_confidence_half_width(double level /* = 0.95 */) const {
+  if (count < 2) {
+    return 0.0;
+  }
+
+  double t = student_t_quantile(0.5 + level / 2.0, count - 1);
+  return t * get_stddev() / std::sqrt(static_cast<double>(count));
+}
+
+/* TimeWeightedStat */
+
+TimeWeightedStat::TimeWeightedStat() {}
+
+TimeWeightedStat::TimeWeightedStat(SimulationPtr sim, double value /* = 0.0 */)
+    : sim(sim), value(value), changed(sim->get_now()), min(value), max(value),
+      empty(false) {}
+
+void TimeWeightedStat::set(double value) {
+  auto sim = this->sim.lock();
+  if (sim == nullptr) {
+    throw std::logic_error("statistic has no simulation");
+  }
+  close(sim->get_now());
+  this->value = value;
+  min = value < min ? value : min;
+  max = value > max ? value : max;
+}
+
+void TimeWeightedStat::add(double delta) { set(value + delta); }
+
+void TimeWeightedStat::merge(const TimeWeightedStat &other) {
+  auto closed = other.closed();
+  if (closed.empty) {
+    return;
+  }
+
+  if (empty) {
+    duration = closed.duration;
+    mean = closed.mean;
+    m2 = closed.m2;
+    min = closed.min;
+    max = closed.max;
+    empty = false;
+    return;
+  }
+
+  min = closed.min < min ? closed.min : min;
+  max = closed.max > max ? closed.max : max;
+  if (closed.duration == 0.0) {
+    return;
+  }
+
+  // Weighted variant of the parallel algorithm of Chan et al. (1979).
+  double total = duration + closed.duration;
+  double delta = closed.mean - mean;
+  mean += delta * closed.duration / total;
+  m2 += closed.m2 + delta * delta * duration * closed.duration / total;
+  duration = total;
+}
+
+double TimeWeightedStat::get_value() const { return value; }
+
+double TimeWeightedStat::get_duration() const { return closed().duration; }
+
+double TimeWeightedStat::get_mean() const {
+  auto closed = this->closed();
+  return closed.duration > 0.0 ? closed.mean : value;
+}
+
+double TimeWeightedStat::get_variance() const {
+  auto closed = this->closed();
+  return closed.duration > 0.0 ? closed.m2 / closed.duration : 0.0;
+}
+
+double TimeWeightedStat::get_stddev() const {
+  return std::sqrt(get_variance());
+}
+
+double TimeWeightedStat::get_min() const { return min; }
+
+double TimeWeightedStat::get_max() const { return max; }
+
+void TimeWeightedStat::close(double now) {
+  double weight = now - changed;
+  changed = now;
+  if (weight <= 0.0) {
+    return;
+  }
+
+  duration += weight;
+  double delta = value - mean;
+  mean += delta * weight / duration;
+  m2 += weight * delta * (value - mean);
+}
+
+TimeWeightedStat TimeWeightedStat::closed() const {
+  TimeWeightedStat copy = *this;
+  auto sim = this->sim.lock();
+  if (sim != nullptr) {
+    copy.close(sim->get_now());
+  }
+  return copy;
+}
+
+/* QuantileSketch */
+
+QuantileSketch::QuantileSketch(double relative_accuracy /* = 0.01 */)
+    : relative_accuracy(relative_accuracy),
+      gamma((1 + relative_accuracy) / (1 - relative_accuracy)),
+      inverse_log_gamma(1 / std::log(gamma)) {
+  if (!(relative_accuracy > 0.0 && relative_accuracy < 1.0)) {
+    throw std::invalid_argument("relative accuracy must be in (0, 1)");
+  }
+}
+
+void QuantileSketch::add(double value) {
+  if (!(value >= 0.0)) {
+    throw std::invalid_argument("value must not be negative");
+  }
+
+  if (count == 0) {
+    min = max = value;
+  } else {
+    min = value < min ? value : min;
+    max = value > max ? value : max;
+  }
+  ++count;
+
+  if (value <= 0.0) {
+    ++n_zeros;
+    return;
+  }
+
+  int index = bucket(value);
+  if (buckets.empty()) {
+    offset = index;
+    buckets.push_back(0);
+  } else if (index < offset) {
+    buckets.insert(buckets.begin(), offset - index, 0);
+    offset = index;
+  } else if (index - offset >= static_cast<int>(buckets.size())) {
+    buckets.resize(index - offset + 1, 0);
+  }
+  ++buckets[index - offset];
+}
+
+void QuantileSketch::merge(const QuantileSketch &other) {
+  if (other.relative_accuracy != relative_accuracy) {
+    throw std::invalid_argument("sketches have different accuracies");
+  }
+
+  if (other.count == 0) {
+    return;
+  }
+
+  if (count == 0) {
+    *this = other;
+    return;
+  }
+
+  min = other.min < min ? other.min : min;
+  max = other.max > max ? other.max : max;
+  count += other.count;
+  n_zeros += other.n_zeros;
+  if (other.buckets.empty()) {
+    return;
+  }
+  if (buckets.empty()) {
+    buckets = other.buckets;
+    offset = other.offset;
+    return;
+  }
+
+  int begin = std::min(offset, other.offset);
+  int end = std::max(offset + static_cast<int>(buckets.size()),
+                     other.offset + static_cast<int>(other.buckets.size()));
+  if (begin < offset) {
+    buckets.insert(buckets.begin(), offset - begin, 0);
+    offset = begin;
+  }
+  buckets.resize(end - offset, 0);
+  for (size_t i = 0; i < other.buckets.size(); ++i) {
+    buckets[other.offset - offset + i] += other.buckets[i];
+  }
+}
+
+uint64_t QuantileSketch::get_count() const { return count; }
+
+double QuantileSketch::get_quantile(double p) const {
+  if (count == 0) {
+    return 0.0;
+  }
+
+  // Rank of the quantile among the observations, counted from 0.
+  auto rank = static_cast<uint64_t>(p * static_cast<double>(count - 1));
+  if (rank == 0) {
+    return min;
+  }
+  if (rank == count - 1) {
+    return max;
+  }
+  if (rank < n_zeros) {
+    return 0.0;
+  }
+
+  uint64_t n = n_zeros;
+  size_t i = 0;
+  for (; i + 1 < buckets.size(); ++i) {
+    n += buckets[i];
+    if (n > rank) {
+      break;
+    }
+  }
+
+  // The value in the bucket with the least relative error to its bounds.
+  double estimate =
+      2 * std::pow(gamma, offset + static_cast<int>(i)) / (gamma + 1);
+  return estimate < min ? min : (estimate > max ? max : estimate);
+}
+
+double QuantileSketch::get_relative_accuracy() const {
+  return relative_accuracy;
+}
+
+int QuantileSketch::bucket(double value) const {
+  return static_cast<int>(std::ceil(std::log(value) * inverse_log_gamma));
+}
+
+/* BatchMeans */
+
+BatchMeans::BatchMeans(size_t max_batches /* = 64 */)
+    : max_batches(max_batches) {
+  if (max_batches < 2 || max_batches % 2 != 0) {
+    throw std::invalid_argument("maximum number of batches must be even and "
+                                "at least 2");
+  }
+  batch_means.reserve(max_batches);
+}
+
+void BatchMeans::add(double value) {
+  ++count;
+  sum += value;
+  batch_sum += value;
+  ++batch_count;
+  if (batch_count < batch_size) {
+    return;
+  }
+
+  batch_means.push_back(batch_sum / static_cast<double>(batch_size));
+  batch_sum = 0.0;
+  batch_count = 0;
+  if (batch_means.size() < max_batches) {
+    return;
+  }
+
+  for (size_t i = 0; i < max_batches / 2; ++i) {
+    batch_means[i] = (batch_means[2 * i] + batch_means[2 * i + 1]) / 2;
+  }
+  batch_means.resize(max_batches / 2);
+  batch_size *= 2;
+}
+
+size_t BatchMeans::get_count() const { return count; }
+
+double BatchMeans::get_mean() const {
+  return count == 0 ? 0.0 : sum / static_cast<double>(count);
+}
+
+size_t BatchMeans::get_n_batches() const { return batch_means.size(); }
+
+size_t BatchMeans::get_batch_size() const { return batch_size; }
+
+const std::vector<double> &BatchMeans::get_batch_means() const {
+  return batch_means;
+}
+
+double BatchMeans::get_confidence_half_width(double level /* = 0.95 */) const {
+  Tally tally;
+  for (double mean : batch_means) {
+    tally.add(mean);
+  }
+  return tally.get_confidence_half_width(level);
+}
+
+/* Quantile functions */
+
+double normal_quantile(double p) {
+  // Rational approximation by P. J. Acklam, refined by one step of Halley's
+  // method to full double precision.
+  static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02,
+                             -2.759285104469687e+02, 1.383577518672690e+02,
+                             -3.066479806614716e+01, 2.506628277459239e+00};
+  static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02,
+                             -1.556989798598866e+02, 6.680131188771972e+01,
+                             -1.328068155288572e+01};
+  static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01,
+                             -2.400758277161838e+00, -2.549732539343734e+00,
+                             4.374664141464968e+00,  2.938163982698783e+00};
+  static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01,
+                             2.445134137142996e+00, 3.754408661907416e+00};
+  const double p_low = 0.02425;
+
+  double x;
+  if (p < p_low) {
+    double q = std::sqrt(-2 * std::log(p));
+    x = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+        ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+  } else if (p <= 1 - p_low) {
+    double q = p - 0.5;
+    double r = q * q;
+    x = (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) *
+        q /
+        (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+  } else {
+    double q = std::sqrt(-2 * std::log(1 - p));
+    x = -(((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+        ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+  }
+
+  double e = 0.5 * std::erfc(-x / std::sqrt(2.0)) - p;
+  double u = e * std::sqrt(2 * pi) * std::exp(x * x / 2);
+  return x - u / (1 + x * u / 2);
+}
+
+double student_t_quantile(double p, size_t df) {
+  if (df == 1) {
+    return std::tan(pi * (p - 0.5));
+  }
+
+  if (df == 2) {
+    return (2 * p - 1) / std::sqrt(2 * p * (1 - p));
+  }
+
+  // Cornish-Fisher expansion (Abramowitz and Stegun, 26.7.5). Accurate to
+  // about three digits for three degrees of freedom and better for more.
+  double z = normal_quantile(p);
+  double z2 = z * z;
+  double v = static_cast<double>(df);
+  double g1 = (z2 + 1) * z / 4;
+  double g2 = ((5 * z2 + 16) * z2 + 3) * z / 96;
+  double g3 = (((3 * z2 + 19) * z2 + 17) * z2 - 15) * z / 384;
+  double g4 =
+      ((((79 * z2 + 776) * z2 + 1482) * z2 - 1920) * z2 - 945) * z / 92160;
+  return z + (g1 + (g2 + (g3 + g4 / v) / v) / v) / v;
+}
+
+} // namespace simcpp
@@ -0,0 +1,312 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_STATS_H_
+#define SIMCPP_STATS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "simcpp.h"
+
+namespace simcpp {
+
+/**
+ * Summary statistics of a sequence of observations.
+ *
+ * Mean and variance are updated with Welford's algorithm, which is numerically
+ * stable. Tallies of disjoint sequences can be merged, for example the results
+ * of replications run on different threads.
+ */
+class Tally {
+public:
+  /**
+   * Add an observation.
+   *
+   * @param value Observed value.
+   */
+  void add(double value);
+
+  /**
+   * Add all observations of another tally.
+   *
+   * @param other Other tally.
+   */
+  void merge(const Tally &other);
+
+  /// @return Number of observations.
+  size_t get_count() const;
+
+  /// @return Mean of the observations, or 0 if there are none.
+  double get_mean() const;
+
+  /// @return Sample variance of the observations, or 0 if there are fewer
+  /// than two.
+  double get_variance() const;
+
+  /// @return Sample standard deviation of the observations.
+  double get_stddev() const;
+
+  /// @return Smallest observation, or 0 if there are none.
+  double get_min() const;
+
+  /// @return Largest observation, or 0 if there are none.
+  double get_max() const;
+
+  /**
+   * Half-width of the confidence interval of the mean, based on the Student t
+   * distribution. The observations are assumed to be independent, for example
+   * the results of independent replications.
+   *
+   * @param level Confidence level, between 0 and 1.
+   * @return Half-width of the interval, or 0 if there are fewer than two
+   * observations.
+   */
+  double get_confidence_half_width(double level = 0.95) const;
+
+private:
+  size_t count = 0;
+  double mean = 0.0;
+  /// Sum of squared deviations from the mean.
+  double m2 = 0.0;
+  double min = 0.0;
+  double max = 0.0;
+};
+
+/**
+ * Time-weighted statistics of a piecewise constant value, for example the
+ * length of a queue or the number of busy servers.
+ *
+ * Each change is accounted in constant time, weighting the previous value by
+ * the simulation time it was held, with the weighted variant of Welford's
+ * algorithm (West, 1979). The statistics include the time up to the current
+ * time of the simulation, so they must be read or merged before the
+ * simulation is destroyed.
+ *
+ * Statistics of disjoint periods can be merged, for example of replications,
+ * into a statistic constructed without a simulation.
+ */
+class TimeWeightedStat {
+public:
+  /// Construct a statistic which only collects merged statistics.
+  TimeWeightedStat();
+
+  /**
+   * Construct a statistic of a value, starting at the current time.
+   *
+   * @param sim Simulation instance.
+   * @param value Initial value.
+   */
+  explicit TimeWeightedStat(SimulationPtr sim, double value = 0.0);
+
+  /**
+   * Change the value at the current time. Throws std::logic_error if the
+   * statistic only collects merged statistics or the simulation is gone.
+   *
+   * @param value New value.
+   */
+  void set(double value);
+
+  /**
+   * Change the value at the current time by a difference. See set.
+   *
+   * @param delta Difference to the current value.
+   */
+  void add(double delta);
+
+  /**
+   * Add the statistics of another period up to its current time.
+   *
+   * @param other Other statistic.
+   */
+  void merge(const TimeWeightedStat &other);
+
+  /// @return Current value.
+  double get_value() const;
+
+  /// @return Simulation time covered by the statistic.
+  double get_duration() const;
+
+  /// @return Time-weighted mean, or the current value if no time has passed.
+  double get_mean() const;
+
+  /// @return Time-weighted variance of the value.
+  double get_variance() const;
+
+  /// @return Time-weighted standard deviation of the value.
+  double get_stddev() const;
+
+  /// @return Smallest value.
+  double get_min() const;
+
+  /// @return Largest value.
+  double get_max() const;
+
+private:
+  SimulationWeakPtr sim;
+  double value = 0.0;
+  /// Time of the last change.
+  double changed = 0.0;
+  double duration = 0.0;
+  double mean = 0.0;
+  /// Weighted sum of squared deviations from the mean.
+  double m2 = 0.0;
+  double min = 0.0;
+  double max = 0.0;
+  bool empty = true;
+
+  /// Account the time since the last change.
+  void close(double now);
+
+  /// @return Copy with the time since the last change accounted.
+  TimeWeightedStat closed() const;
+};
+
+/**
+ * Streaming estimate of the quantiles of non-negative observations.
+ *
+ * Observations are counted in buckets whose bounds grow geometrically, so
+ * every estimate is within a relative error of the accuracy of the true
+ * quantile (DDSketch, Masson et al., 2019). Adding is constant time, and the
+ * memory grows with the logarithm of the ratio of the largest to the smallest
+ * positive observation, not with their number. Sketches of the same accuracy
+ * can be merged.
+ */
+class QuantileSketch {
+public:
+  /**
+   * Construct an empty sketch.
+   *
+   * @param relative_accuracy Relative error of the estimates, between 0 and
+   * 1 (exclusive). Otherwise, std::invalid_argument is thrown.
+   */
+  explicit QuantileSketch(double relative_accuracy = 0.01);
+
+  /**
+   * Add an observation.
+   *
+   * @param value Observed value, at least 0. Otherwise,
+   * std::invalid_argument is thrown.
+   */
+  void add(double value);
+
+  /**
+   * Add all observations of another sketch with the same accuracy. Throws
+   * std::invalid_argument if the accuracies differ.
+   *
+   * @param other Other sketch.
+   */
+  void merge(const QuantileSketch &other);
+
+  /// @return Number of observations.
+  uint64_t get_count() const;
+
+  /**
+   * @param p Probability, between 0 and 1.
+   * @return Estimate of the p-quantile, or 0 if there are no observations.
+   */
+  double get_quantile(double p) const;
+
+  /// @return Relative error of the estimates.
+  double get_relative_accuracy() const;
+
+private:
+  double relative_accuracy;
+  double gamma;
+  /// Reciprocal of the logarithm of gamma.
+  double inverse_log_gamma;
+  /// Counts of the buckets from index offset on. Bucket i holds the values
+  /// in (gamma^(i - 1), gamma^i].
+  std::vector<uint64_t> buckets = {};
+  int offset = 0;
+  uint64_t n_zeros = 0;
+  uint64_t count = 0;
+  double min = 0.0;
+  double max = 0.0;
+
+  int bucket(double value) const;
+};
+
+/**
+ * Confidence interval of the steady-state mean of a single long run by the
+ * method of batch means.
+ *
+ * Consecutive observations are grouped into batches, whose means are nearly
+ * independent if the batches are long enough. The number of batches is
+ * bounded: when it reaches the maximum, adjacent batches are combined and the
+ * batch size doubles, so the memory is constant and the batches grow with the
+ * run. Observations of the warm-up period should not be added.
+ */
+class BatchMeans {
+public:
+  /**
+   * Construct an empty collector.
+   *
+   * @param max_batches Maximum number of batches, even and at least 2.
+   * Otherwise, std::invalid_argument is thrown.
+   */
+  explicit BatchMeans(size_t max_batches = 64);
+
+  /**
+   * Add an observation.
+   *
+   * @param value Observed value.
+   */
+  void add(double value);
+
+  /// @return Number of observations.
+  size_t get_count() const;
+
+  /// @return Mean of all observations, or 0 if there are none.
+  double get_mean() const;
+
+  /// @return Number of complete batches.
+  size_t get_n_batches() const;
+
+  /// @return Number of observations per batch.
+  size_t get_batch_size() const;
+
+  /// @return Means of the complete batches.
+  const std::vector<double> &get_batch_means() const;
+
+  /**
+   * Half-width of the confidence interval of the steady-state mean, based on
+   * the Student t distribution of the batch means.
+   *
+   * @param level Confidence level, between 0 and 1.
+   * @return Half-width of the interval, or 0 if there are fewer than two
+   * batches.
+   */
+  double get_confidence_half_width(double level = 0.95) const;
+
+private:
+  size_t max_batches;
+  size_t batch_size = 1;
+  std::vector<double> batch_means = {};
+  double batch_sum = 0.0;
+  size_t batch_count = 0;
+  size_t count = 0;
+  double sum = 0.0;
+};
+
+/**
+ * Quantile function of the standard normal distribution.
+ *
+ * @param p Probability, between 0 and 1 (exclusive).
+ * @return Value below which the probability is p.
+ */
+double normal_quantile(double p);
+
+/**
+ * Quantile function of the Student t distribution.
+ *
+ * @param p Probability, between 0 and 1 (exclusive).
+ * @param df Degrees of freedom, at least 1.
+ * @return Value below which the probability is p.
+ */
+double student_t_quantile(double p, size_t df);
+
+} // namespace simcpp
+
+#endif // SIMCPP_STATS_H_
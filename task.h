@@ -0,0 +1,276 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_TASK_H_
+#define SIMCPP_TASK_H_
+
+#if __cplusplus < 202002L
+#error "task.h requires C++20"
+#endif
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "simcpp.h"
+
+// GCC before version 14 wrongly warns that the frames of coroutines with a
+// templated operator new in their promise are freed with a mismatched
+// operator delete (GCC bug 109224). The warning is emitted where a coroutine is
+// defined, so it cannot be suppressed here; compile files defining tasks with
+// -Wno-mismatched-new-delete instead.
+
+namespace simcpp {
+
+/**
+ * Event of a coroutine process.
+ *
+ * The event is triggered when the coroutine finishes, so other processes can
+ * wait for it. It owns the coroutine frame, which is destroyed as soon as the
+ * coroutine finishes or the event is destroyed. While the coroutine waits for
+ * an event, the event keeps it alive.
+ */
+class TaskEvent : public Event {
+public:
+  /**
+   * Construct a task event. Created by calling a coroutine returning Task.
+   *
+   * @param sim Simulation instance.
+   */
+  explicit TaskEvent(SimulationPtr sim) : Event(sim) {}
+
+  TaskEvent(const TaskEvent &) = delete;
+  TaskEvent &operator=(const TaskEvent &) = delete;
+
+  ~TaskEvent() {
+    if (handle) {
+      auto handle = this->handle;
+      this->handle = nullptr;
+      handle.destroy();
+    }
+  }
+
+  /**
+   * Resume the coroutine.
+   *
+   * If the event is triggered or aborted, nothing is done.
+   */
+  void resume() {
+    if (!is_pending() || !handle || handle.done()) {
+      return;
+    }
+
+    handle.resume();
+  }
+
+  /// @return Callback which resumes the coroutine.
+  Callback resume_callback() {
+    return Callback(call_resume, this, Event::shared_from_this());
+  }
+
+private:
+  template <typename> friend class TaskPromise;
+
+  std::coroutine_handle<> handle = nullptr;
+
+  static void call_resume(void *context, Event &) {
+    static_cast<TaskEvent *>(context)->resume();
+  }
+};
+
+using TaskEventPtr = std::shared_ptr<TaskEvent>;
+
+/**
+ * Awaiter of an event inside a coroutine process.
+ *
+ * Behaves like PROC_WAIT_FOR: If the event is pending, the coroutine is
+ * suspended until it is processed. If the event is already triggered or
+ * processed, the coroutine is not suspended. If the event is already aborted,
+ * the coroutine is suspended indefinitely.
+ */
+class EventAwaiter {
+public:
+  /**
+   * Construct an awaiter.
+   *
+   * @param event Event to wait for.
+   * @param task Task waiting for the event.
+   */
+  EventAwaiter(EventPtr event, TaskEvent *task)
+      : event(std::move(event)), task(task) {}
+
+  bool await_ready() { return event->is_triggered(); }
+
+  bool await_suspend(std::coroutine_handle<>) {
+    return event->add_callback(task->resume_callback());
+  }
+
+  void await_resume() {}
+
+private:
+  EventPtr event;
+  TaskEvent *task;
+};
+
+/**
+ * Awaiter of a valued event inside a coroutine process. Like EventAwaiter, but
+ * co_await returns a reference to the value.
+ *
+ * @tparam V Type of the value.
+ */
+template <typename V> class ValueAwaiter : public EventAwaiter {
+public:
+  /**
+   * Construct an awaiter.
+   *
+   * @param value_event Event to wait for.
+   * @param event Owner of the event.
+   * @param task Task waiting for the event.
+   */
+  ValueAwaiter(ValueEvent<V> *value_event, EventPtr event, TaskEvent *task)
+      : EventAwaiter(std::move(event), task), value_event(value_event) {}
+
+  V &await_resume() { return value_event->get_value(); }
+
+private:
+  ValueEvent<V> *value_event;
+};
+
+/// @return Awaiter of an event without a value.
+inline EventAwaiter make_awaiter(Event *, EventPtr event, TaskEvent *task) {
+  return EventAwaiter(std::move(event), task);
+}
+
+/// @return Awaiter of a valued event, including subclasses like Store::Get.
+template <typename V>
+ValueAwaiter<V> make_awaiter(ValueEvent<V> *value_event, EventPtr event,
+                             TaskEvent *task) {
+  return ValueAwaiter<V>(value_event, std::move(event), task);
+}
+
+/**
+ * Promise type of Task coroutines.
+ *
+ * @tparam T Task class.
+ */
+template <typename T> class TaskPromise {
+public:
+  /**
+   * Construct the promise. The first parameter of a Task coroutine must be a
+   * reference to the simulation instance. Parameters are copied into the
+   * coroutine frame, so a shared pointer would let the frame own the
+   * simulation, which owns the events keeping the frame alive.
+   *
+   * @param sim Simulation instance.
+   */
+  template <typename... Args>
+  TaskPromise(Simulation &sim, const Args &...) : sim(&sim) {}
+
+  TaskPromise() = delete;
+
+  /**
+   * Allocate the coroutine frame from the pool of the simulation. The pool is
+   * stored in front of the frame, so it can be freed without the simulation.
+   */
+  template <typename... Args>
+  static void *operator new(size_t size, Simulation &sim, const Args &...) {
+    auto pool = sim.get_pool();
+    auto block = static_cast<char *>(pool->allocate(size + header_size));
+    *reinterpret_cast<Pool **>(block) = pool;
+    return block + header_size;
+  }
+
+  static void operator delete(void *frame, size_t size) {
+    auto block = static_cast<char *>(frame) - header_size;
+    auto pool = *reinterpret_cast<Pool **>(block);
+    pool->deallocate(block, size + header_size);
+  }
+
+  ~TaskPromise() {
+    if (task != nullptr) {
+      task->handle = nullptr;
+    }
+  }
+
+  /// Create the task event and schedule the first run of the coroutine.
+  T get_return_object() {
+    auto task = sim->event<TaskEvent>();
+    task->handle = std::coroutine_handle<TaskPromise>::from_promise(*this);
+    this->task = task.get();
+
+    auto start = sim->event();
+    start->add_callback(task->resume_callback());
+    start->trigger();
+
+    return T(task);
+  }
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  /// The frame is destroyed as soon as the coroutine finishes.
+  std::suspend_never final_suspend() noexcept { return {}; }
+
+  void return_void() { task->trigger(); }
+
+  /// Exceptions propagate out of Simulation::step, like those of processes.
+  void unhandled_exception() { throw; }
+
+  template <typename E>
+  auto await_transform(std::shared_ptr<E> event)
+      -> decltype(make_awaiter(event.get(), event, nullptr)) {
+    static_assert(std::is_base_of<Event, E>::value,
+                  "only events can be awaited");
+    E *pointer = event.get();
+    return make_awaiter(pointer, std::move(event), task);
+  }
+
+  EventAwaiter await_transform(const T &other) {
+    return EventAwaiter(other.get_event(), task);
+  }
+
+private:
+  /// Size of the header in front of the frame. Keeps the frame aligned.
+  static const size_t header_size = Pool::granularity;
+
+  Simulation *sim;
+  TaskEvent *task = nullptr;
+};
+
+/**
+ * Coroutine process in a simulation.
+ *
+ * A function returning Task is a coroutine process. Its first parameter must be
+ * a reference to the simulation instance, so the coroutine does not keep the
+ * simulation alive. Unlike in the Run method of a process, local variables
+ * survive waiting. Inside the coroutine, co_await an event, for example
+ * sim.timeout(delay), sim.any_of(...) or another task, to wait for it.
+ *
+ * Calling the coroutine runs it immediately, like Simulation::start_process.
+ */
+class Task {
+public:
+  using promise_type = TaskPromise<Task>;
+
+  /**
+   * Construct a task. Created by calling a coroutine returning Task.
+   *
+   * @param event Event of the task.
+   */
+  explicit Task(TaskEventPtr event) : event(std::move(event)) {}
+
+  /// @return Event which is triggered when the coroutine finishes.
+  TaskEventPtr get_event() const { return event; }
+
+  /// @return Event of the task, so the task can be used like a process.
+  TaskEvent *operator->() const { return event.get(); }
+
+private:
+  TaskEventPtr event;
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_TASK_H_
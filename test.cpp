@@ -1,6 +1,36 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "archive.h"
+#include "pdes.h"
+#include "queue.h"
+#include "realtime.h"
+#include "replication.h"
+#include "resource.h"
 #include "simcpp.h"
+#include "snapshot.h"
+#include "staticsim.h"
+#include "stats.h"
+#include "task.h"
+#include "timewarp.h"
+#include "trace.h"
 
 class Awaiter : public simcpp::Process {
 public:
@@ -93,3 +123,2030 @@ TEST(SimulationTest, AllOfPending) {
   sim->advance_to(awaiter);
   ASSERT_EQ(sim->get_now(), 10);
 }
+
+TEST(SimulationTest, NOfVector) {
+  auto sim = simcpp::Simulation::create();
+
+  std::vector<simcpp::EventPtr> events;
+  for (double delay : {3.0, 1.0, 2.0, 4.0}) {
+    events.push_back(sim->timeout(delay));
+  }
+  auto n_of = sim->n_of(2, events);
+  auto awaiter = sim->start_process<Awaiter>(n_of);
+
+  sim->advance_to(awaiter);
+  ASSERT_EQ(sim->get_now(), 2);
+  sim->run();
+  // Events processed after the condition was triggered are not included.
+  ASSERT_EQ(n_of->get_fired(),
+            (std::vector<simcpp::EventPtr>{events[1], events[2]}));
+}
+
+TEST(SimulationTest, ConditionRange) {
+  auto sim = simcpp::Simulation::create();
+
+  std::list<simcpp::EventPtr> events = {sim->timeout(2), sim->timeout(1)};
+  auto any_of = sim->any_of(events.begin(), events.end());
+  auto all_of = sim->all_of(events.begin(), events.end());
+  sim->run();
+
+  ASSERT_EQ(any_of->get_fired(),
+            (std::vector<simcpp::EventPtr>{events.back()}));
+  ASSERT_EQ(all_of->get_fired().size(), 2);
+}
+
+TEST(SimulationTest, ConditionDetachesLosers) {
+  auto sim = simcpp::Simulation::create();
+
+  // The losing event is never triggered, but must not keep the condition
+  // alive.
+  auto loser = sim->event();
+  std::weak_ptr<simcpp::Condition> any_of =
+      sim->any_of({loser, sim->timeout(1)});
+  sim->run();
+  ASSERT_TRUE(any_of.expired());
+
+  std::weak_ptr<simcpp::Condition> aborted = sim->all_of({loser});
+  aborted.lock()->abort();
+  ASSERT_TRUE(aborted.expired());
+
+  // Other handlers are kept.
+  auto all_of = sim->all_of({loser, sim->event()});
+  bool called = false;
+  loser->add_handler([&called](simcpp::EventPtr) { called = true; });
+  all_of->abort();
+  loser->trigger();
+  sim->run();
+  ASSERT_TRUE(called);
+}
+
+TEST(CallTest, OrderWithEvents) {
+  auto sim = simcpp::Simulation::create();
+  std::vector<int> order;
+  auto log = [&order](int i) {
+    return [&order, i](simcpp::EventPtr) { order.push_back(i); };
+  };
+  auto now = [&sim](simcpp::Handler handler) {
+    auto event = sim->event();
+    event->add_handler(std::move(handler));
+    event->trigger();
+  };
+
+  sim->timeout(1.0)->add_handler(log(0));
+  sim->call_at(1.0, [&order]() { order.push_back(1); });
+  sim->timeout(1.0)->add_handler([&](simcpp::EventPtr) {
+    order.push_back(2);
+    // Scheduled during a batch at the current time.
+    sim->call_in(0.0, [&order]() { order.push_back(4); });
+    now(log(5));
+  });
+  sim->timeout(1.0)->add_handler(log(3));
+  sim->call_in(0.5, [&]() {
+    order.push_back(-1);
+    ASSERT_EQ(sim->get_now(), 0.5);
+  });
+
+  sim->run();
+  ASSERT_EQ(order, std::vector<int>({-1, 0, 1, 2, 3, 4, 5}));
+
+  // Without calls at the same time, events are batched as before.
+  order.clear();
+  sim->timeout(1.0)->add_handler([&](simcpp::EventPtr) {
+    order.push_back(0);
+    sim->call_in(0.0, [&order]() { order.push_back(2); });
+    now(log(3));
+  });
+  sim->timeout(1.0)->add_handler(log(1));
+  sim->run();
+  ASSERT_EQ(order, std::vector<int>({0, 1, 2, 3}));
+}
+
+TEST(CallTest, Every) {
+  auto sim = simcpp::Simulation::create();
+  std::vector<double> times;
+  simcpp::CallHandle handle;
+  handle = sim->call_every(2.0, [&]() {
+    times.push_back(sim->get_now());
+    if (times.size() == 3) {
+      ASSERT_TRUE(sim->cancel(handle));
+    }
+  });
+  auto once = sim->call_in(1.0, []() {});
+
+  sim->run();
+  ASSERT_EQ(times, std::vector<double>({2, 4, 6}));
+  ASSERT_FALSE(sim->cancel(handle));
+  ASSERT_FALSE(sim->cancel(once));
+
+  // The freed slot is reused with a new generation.
+  auto reused = sim->call_in(1.0, []() {});
+  ASSERT_TRUE(reused.slot == handle.slot || reused.slot == once.slot);
+  ASSERT_FALSE(sim->cancel(handle));
+  ASSERT_TRUE(sim->cancel(reused));
+  ASSERT_FALSE(sim->has_next());
+  ASSERT_THROW(sim->call_every(0.0, []() {}), std::invalid_argument);
+  ASSERT_THROW(sim->call_at(1.0, []() {}), std::invalid_argument);
+}
+
+TEST(CallTest, StoresCallables) {
+  auto sim = simcpp::Simulation::create();
+  auto value = std::make_unique<int>(1);
+  int sum = 0;
+  sim->call_in(1.0, [value = std::move(value), &sum]() { sum += *value; });
+  std::array<int, 64> large = {};
+  large[63] = 2;
+  sim->call_in(2.0, [large, &sum]() { sum += large[63]; });
+
+  simcpp::Call empty;
+  ASSERT_FALSE(empty);
+  sim->run();
+  ASSERT_EQ(sum, 3);
+}
+
+/// Waits for an event which it holds, so they can refer to each other.
+class Sleeper : public simcpp::Process {
+public:
+  simcpp::EventPtr wakeup;
+
+  Sleeper(simcpp::SimulationPtr sim, simcpp::EventPtr wakeup)
+      : Process(sim), wakeup(std::move(wakeup)) {}
+
+  bool Run() override {
+    PT_BEGIN();
+    PROC_WAIT_FOR(wakeup);
+    PT_END();
+  }
+
+  void save(simcpp::Archive &archive) const override {
+    Process::save(archive);
+    archive.save(wakeup);
+  }
+
+  void load(simcpp::Archive &archive) override {
+    Process::load(archive);
+    archive.load(wakeup);
+  }
+};
+
+simcpp::SimulationOptions tracking_options() {
+  simcpp::SimulationOptions options;
+  options.track_events = true;
+  return options;
+}
+
+TEST(RegistryTest, Handles) {
+  auto sim = simcpp::Simulation::create(tracking_options());
+  auto event = sim->event();
+  auto handle = sim->get_handle(*event);
+  ASSERT_EQ(sim->lookup(handle), event);
+
+  event = nullptr;
+  ASSERT_EQ(sim->lookup(handle), nullptr);
+  auto other = sim->event();
+  ASSERT_EQ(sim->get_handle(*other).slot, handle.slot);
+  ASSERT_EQ(sim->lookup(handle), nullptr);
+
+  auto untracked = simcpp::Simulation::create();
+  ASSERT_THROW(untracked->get_handle(*untracked->event()), std::logic_error);
+}
+
+TEST(RegistryTest, CollectsCycle) {
+  auto sim = simcpp::Simulation::create(tracking_options());
+  auto sleeper = sim->start_process<Sleeper>(sim->event());
+  std::weak_ptr<Sleeper> weak = sleeper;
+  sim->run();
+  ASSERT_EQ(sim->collect(16), 0u);
+  ASSERT_EQ(sim->get_live_counts(),
+            (std::map<std::string, size_t>{{"Sleeper", 1},
+                                           {"simcpp::Event", 1}}));
+
+  sleeper = nullptr;
+  ASSERT_FALSE(weak.expired());
+  ASSERT_EQ(sim->collect(16), 1u);
+  ASSERT_TRUE(weak.expired());
+  ASSERT_TRUE(sim->get_live_counts().empty());
+}
+
+TEST(RegistryTest, KeepsReachable) {
+  auto sim = simcpp::Simulation::create(tracking_options());
+  auto wakeup = sim->event();
+  std::weak_ptr<Sleeper> held = sim->start_process<Sleeper>(wakeup);
+  std::weak_ptr<Sleeper> condition = sim->start_process<Sleeper>(
+      sim->any_of({sim->timeout(5.0), sim->event()}));
+  sim->step();
+  sim->step();
+
+  ASSERT_EQ(sim->collect(16), 0u);
+  wakeup->trigger();
+  sim->run();
+  ASSERT_TRUE(held.expired());
+  ASSERT_TRUE(condition.expired());
+}
+
+TEST(RegistryTest, CollectsIncrementally) {
+  auto options = tracking_options();
+  options.collection_rate = 4;
+  auto sim = simcpp::Simulation::create(options);
+  std::vector<std::weak_ptr<Sleeper>> sleepers;
+  for (int i = 0; i < 10; ++i) {
+    sleepers.push_back(sim->start_process<Sleeper>(sim->event()));
+  }
+  for (int i = 0; i < 20; ++i) {
+    sim->timeout(i);
+  }
+  sim->run();
+
+  for (auto &sleeper : sleepers) {
+    ASSERT_TRUE(sleeper.expired());
+  }
+  ASSERT_TRUE(sim->get_live_counts().empty());
+}
+
+class QueueTest : public ::testing::TestWithParam<simcpp::QueueType> {};
+
+/// Check that a queue pops entries in the same order as std::priority_queue.
+void check_priority_queue_order(simcpp::EventQueue *queue) {
+  std::priority_queue<simcpp::QueuedEvent> reference;
+  std::mt19937 rng(42);
+  std::exponential_distribution<double> exponential(1.0);
+  std::uniform_int_distribution<int> integer(0, 3);
+  size_t next_id = 0;
+  double now = 0.0;
+
+  auto push = [&](double time) {
+    queue->push(simcpp::QueuedEvent(time, next_id, nullptr));
+    reference.emplace(time, next_id, nullptr);
+    ++next_id;
+  };
+
+  for (int i = 0; i < 1000; ++i) {
+    push(integer(rng));
+  }
+
+  for (int i = 0; i < 20000; ++i) {
+    ASSERT_EQ(queue->size(), reference.size());
+    ASSERT_EQ(queue->top().id, reference.top().id);
+    auto entry = queue->pop();
+    ASSERT_EQ(entry.id, reference.top().id);
+    ASSERT_EQ(entry.time, reference.top().time);
+    reference.pop();
+    now = entry.time;
+
+    switch (i % 4) {
+    case 0:
+      push(now);
+      break;
+    case 1:
+      push(now + integer(rng));
+      push(now + 1000 * exponential(rng));
+      break;
+    case 2:
+      push(now + exponential(rng));
+      break;
+    case 3:
+      // Push the entry again with its old id, like a rollback does.
+      queue->push(entry);
+      reference.push(entry);
+      break;
+    }
+  }
+
+  while (!reference.empty()) {
+    ASSERT_EQ(queue->pop().id, reference.top().id);
+    reference.pop();
+  }
+  ASSERT_TRUE(queue->empty());
+}
+
+TEST_P(QueueTest, MatchesPriorityQueueOrder) {
+  auto queue = simcpp::make_queue(GetParam());
+  check_priority_queue_order(queue.get());
+}
+
+TEST_P(QueueTest, WideIds) {
+  if (sizeof(size_t) < 8) {
+    GTEST_SKIP();
+  }
+  auto queue = simcpp::make_queue(GetParam());
+  size_t wide = size_t(1) << 32;
+
+  // Ties between ids below and above 2^32, with equal low 32 bits.
+  std::vector<size_t> ids = {wide + 5, 7, wide - 1, 5, wide + 7, wide, 0};
+  for (size_t id : ids) {
+    queue->push(simcpp::QueuedEvent(1.0, id, nullptr));
+  }
+  std::sort(ids.begin(), ids.end());
+  for (size_t id : ids) {
+    ASSERT_EQ(queue->pop().id, id);
+  }
+  ASSERT_TRUE(queue->empty());
+}
+
+TEST_P(QueueTest, RemoveIf) {
+  auto queue = simcpp::make_queue(GetParam());
+  std::mt19937 rng(42);
+  std::exponential_distribution<double> exponential(1.0);
+
+  for (size_t id = 0; id < 1000; ++id) {
+    queue->push(simcpp::QueuedEvent(exponential(rng), id, nullptr));
+  }
+  queue->remove_if(
+      [](const simcpp::QueuedEvent &entry) { return entry.id % 3 == 0; });
+  ASSERT_EQ(queue->size(), 666);
+
+  auto previous = queue->pop();
+  while (!queue->empty()) {
+    auto entry = queue->pop();
+    ASSERT_NE(entry.id % 3, 0);
+    ASSERT_TRUE(simcpp::before(previous, entry));
+    previous = entry;
+  }
+}
+
+TEST_P(QueueTest, SimulationOrder) {
+  simcpp::SimulationOptions options;
+  options.queue_type = GetParam();
+  auto sim = simcpp::Simulation::create(options);
+  std::vector<int> order;
+
+  for (int i = 0; i < 100; ++i) {
+    auto event = sim->timeout((i * 7) % 10 + 1);
+    event->add_handler([&order, i](simcpp::EventPtr) { order.push_back(i); });
+  }
+  sim->run();
+
+  std::vector<int> expected;
+  for (int delay = 0; delay < 10; ++delay) {
+    for (int i = 0; i < 100; ++i) {
+      if ((i * 7) % 10 == delay) {
+        expected.push_back(i);
+      }
+    }
+  }
+  ASSERT_EQ(order, expected);
+  ASSERT_EQ(sim->get_now(), 10);
+}
+
+INSTANTIATE_TEST_SUITE_P(AllQueues, QueueTest,
+                         ::testing::Values(simcpp::QueueType::BinaryHeap,
+                                           simcpp::QueueType::QuaternaryHeap,
+                                           simcpp::QueueType::Calendar,
+                                           simcpp::QueueType::Ladder,
+                                           simcpp::QueueType::SplitHeap));
+
+TEST(TimingWheelTest, MatchesPriorityQueueOrder) {
+  // Three levels up to 26.2, further entries are left to the heap.
+  simcpp::TimingWheelQueue queue(simcpp::make_queue(simcpp::QueueType::Ladder),
+                                 0.0001, 20.0);
+  check_priority_queue_order(&queue);
+}
+
+TEST(TimingWheelTest, Discard) {
+  simcpp::TimingWheelQueue queue(
+      simcpp::make_queue(simcpp::QueueType::BinaryHeap), 1.0, 64.0,
+      [](const simcpp::QueuedEvent &entry) { return entry.id % 2 == 1; });
+  for (size_t id = 0; id < 100; ++id) {
+    queue.push(simcpp::QueuedEvent(static_cast<double>(id % 50), id, nullptr));
+  }
+  // Beyond the horizon, so never discarded.
+  for (size_t id = 100; id < 110; ++id) {
+    queue.push(simcpp::QueuedEvent(1000.0, id, nullptr));
+  }
+  ASSERT_EQ(queue.size(), 110);
+
+  auto previous = queue.pop();
+  size_t n_popped = 1;
+  while (!queue.empty()) {
+    auto entry = queue.pop();
+    ASSERT_TRUE(entry.id % 2 == 0 || entry.id >= 100);
+    ASSERT_TRUE(simcpp::before(previous, entry));
+    previous = entry;
+    ++n_popped;
+  }
+  ASSERT_EQ(n_popped, 60);
+}
+
+/// Run timeouts, of which some are aborted or cancelled, in a simulation.
+std::vector<int>
+run_aborted_timeouts(const simcpp::SimulationOptions &options) {
+  auto sim = simcpp::Simulation::create(options);
+  std::vector<int> order;
+  std::vector<simcpp::EventPtr> timeouts;
+  for (int i = 0; i < 300; ++i) {
+    auto event = sim->timeout((i * 7) % 50 * 0.25 + (i % 3) * 1000.0);
+    event->add_handler([&order, i](simcpp::EventPtr) { order.push_back(i); });
+    timeouts.push_back(event);
+  }
+  for (int i = 0; i < 300; i += 2) {
+    timeouts[i]->abort();
+  }
+  sim->cancel(timeouts[1]);
+  sim->run_until(5.0);
+  for (int i = 3; i < 300; i += 6) {
+    timeouts[i]->abort();
+    sim->timeout(0.25)->add_handler(
+        [&order, i](simcpp::EventPtr) { order.push_back(-i); });
+  }
+  sim->run();
+  return order;
+}
+
+TEST(TimingWheelTest, SimulationOrder) {
+  simcpp::SimulationOptions options;
+  auto expected = run_aborted_timeouts(options);
+  ASSERT_GT(expected.size(), 150);
+
+  options.timing_wheel_resolution = 0.1;
+  options.timing_wheel_horizon = 100.0;
+  ASSERT_EQ(run_aborted_timeouts(options), expected);
+  options.compaction_ratio = 0.01;
+  ASSERT_EQ(run_aborted_timeouts(options), expected);
+}
+
+TEST(PoolTest, ReusesBlocks) {
+  simcpp::Pool pool;
+
+  void *a = pool.allocate(40);
+  void *b = pool.allocate(48);
+  ASSERT_NE(a, b);
+  ASSERT_EQ(pool.get_n_allocated(), 2);
+
+  pool.deallocate(a, 40);
+  ASSERT_EQ(pool.allocate(33), a);
+  pool.deallocate(a, 33);
+  pool.deallocate(b, 48);
+  ASSERT_EQ(pool.get_n_allocated(), 0);
+
+  void *large = pool.allocate(4096);
+  pool.deallocate(large, 4096);
+}
+
+TEST(PoolTest, OverAlignedType) {
+  struct alignas(64) Line {
+    char bytes[64];
+  };
+  simcpp::Pool pool;
+  simcpp::PoolAllocator<Line> allocator(&pool);
+
+  Line *line = allocator.allocate(3);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(line) % 64, 0);
+  ASSERT_EQ(pool.get_n_allocated(), 0);
+  allocator.deallocate(line, 3);
+}
+
+TEST(PoolTest, PooledSimulation) {
+  simcpp::SimulationOptions options;
+  options.pooled_allocation = true;
+  auto sim = simcpp::Simulation::create(options);
+  auto pool = sim->get_pool();
+  ASSERT_NE(pool, nullptr);
+
+  {
+    auto event1 = sim->timeout(5);
+    auto event2 = sim->timeout(10);
+    auto awaiter1 = sim->start_process<Awaiter>(sim->any_of({event1, event2}));
+    auto awaiter2 = sim->start_process<Awaiter>(sim->all_of({event1, event2}));
+    ASSERT_GT(pool->get_n_allocated(), 0);
+
+    sim->advance_to(awaiter1);
+    ASSERT_EQ(sim->get_now(), 5);
+    sim->advance_to(awaiter2);
+    ASSERT_EQ(sim->get_now(), 10);
+  }
+
+  sim->run();
+  ASSERT_EQ(pool->get_n_allocated(), 0);
+}
+
+TEST(PoolTest, EventOutlivesSimulation) {
+  simcpp::SimulationOptions options;
+  options.pooled_allocation = true;
+  auto sim = simcpp::Simulation::create(options);
+  auto event = sim->event();
+  sim.reset();
+
+  ASSERT_TRUE(event->is_pending());
+  ASSERT_TRUE(event->abort());
+}
+
+simcpp::Task sleeper(simcpp::Simulation &sim, std::vector<double> *times) {
+  for (int i = 1; i <= 3; ++i) {
+    co_await sim.timeout(i);
+    times->push_back(sim.get_now());
+  }
+}
+
+simcpp::Task racer(simcpp::Simulation &sim, simcpp::EventPtr event,
+                   double *any_of_time, double *all_of_time) {
+  auto any_of = sim.any_of({event, sim.timeout(5)});
+  co_await any_of;
+  *any_of_time = sim.get_now();
+  auto all_of = sim.all_of({event, sim.timeout(5)});
+  co_await all_of;
+  *all_of_time = sim.get_now();
+}
+
+simcpp::Task joiner(simcpp::Simulation &sim, double *time) {
+  std::vector<double> times;
+  co_await sleeper(sim, &times);
+  *time = sim.get_now();
+}
+
+simcpp::Task receiver(simcpp::Simulation &sim,
+                     simcpp::ValueEventPtr<std::unique_ptr<int>> event,
+                     simcpp::Store<std::unique_ptr<int>> *store, int *sum) {
+  auto &value = co_await event;
+  *sum += *value;
+  co_await sim.timeout(1.0);
+  auto &item = co_await store->get();
+  *sum += *item;
+}
+
+TEST(TaskTest, Timeouts) {
+  auto sim = simcpp::Simulation::create();
+  std::vector<double> times;
+  auto task = sleeper(*sim, &times);
+
+  sim->run();
+  ASSERT_EQ(times, std::vector<double>({1, 3, 6}));
+  ASSERT_TRUE(task->is_processed());
+}
+
+TEST(TaskTest, AnyOfAllOf) {
+  auto sim = simcpp::Simulation::create();
+  double any_of_time = -1;
+  double all_of_time = -1;
+  racer(*sim, sim->timeout(2), &any_of_time, &all_of_time);
+
+  sim->run();
+  ASSERT_EQ(any_of_time, 2);
+  ASSERT_EQ(all_of_time, 7);
+}
+
+TEST(TaskTest, WaitForTask) {
+  auto sim = simcpp::Simulation::create();
+  double time = -1;
+  auto task = joiner(*sim, &time);
+  auto awaiter = sim->start_process<Awaiter>(task.get_event());
+
+  sim->advance_to(awaiter);
+  ASSERT_EQ(time, 6);
+  ASSERT_EQ(sim->get_now(), 6);
+}
+
+TEST(TaskTest, AwaitValue) {
+  auto sim = simcpp::Simulation::create();
+  auto event = sim->event<simcpp::ValueEvent<std::unique_ptr<int>>>();
+  simcpp::Store<std::unique_ptr<int>> store(sim);
+  int sum = 0;
+  receiver(*sim, event, &store, &sum);
+
+  event->trigger(std::make_unique<int>(1));
+  store.put(std::make_unique<int>(2));
+  sim->run();
+  ASSERT_EQ(sum, 3);
+}
+
+TEST(TaskTest, FramesFromPool) {
+  auto sim = simcpp::Simulation::create();
+  auto pool = sim->get_pool();
+  std::vector<double> times;
+  sleeper(*sim, &times);
+  ASSERT_EQ(pool->get_n_allocated(), 1);
+
+  sim->run();
+  ASSERT_EQ(pool->get_n_allocated(), 0);
+}
+
+TEST(TaskTest, Abort) {
+  auto sim = simcpp::Simulation::create();
+  std::vector<double> times;
+  auto task = sleeper(*sim, &times);
+
+  sim->step();
+  ASSERT_TRUE(task->abort());
+  sim->run();
+  ASSERT_TRUE(times.empty());
+  ASSERT_TRUE(task->is_aborted());
+}
+
+TEST(TaskTest, WaitingDoesNotKeepSimulationAlive) {
+  auto sim = simcpp::Simulation::create();
+  simcpp::SimulationWeakPtr weak = sim;
+  std::vector<double> times;
+  sleeper(*sim, &times);
+
+  sim->step();
+  sim.reset();
+  ASSERT_TRUE(weak.expired());
+}
+
+TEST(StatsTest, Tally) {
+  simcpp::Tally tally;
+  for (double value : {2.0, 4.0, 4.0, 4.0, 5.0, 5.0, 7.0, 9.0}) {
+    tally.add(value);
+  }
+
+  ASSERT_EQ(tally.get_count(), 8);
+  ASSERT_DOUBLE_EQ(tally.get_mean(), 5.0);
+  ASSERT_DOUBLE_EQ(tally.get_variance(), 32.0 / 7.0);
+  ASSERT_EQ(tally.get_min(), 2.0);
+  ASSERT_EQ(tally.get_max(), 9.0);
+}
+
+TEST(StatsTest, Merge) {
+  simcpp::Tally all;
+  simcpp::Tally a;
+  simcpp::Tally b;
+  for (int i = 0; i < 100; ++i) {
+    double value = (i * 37) % 11 + 0.5 * i;
+    all.add(value);
+    (i < 30 ? a : b).add(value);
+  }
+
+  a.merge(b);
+  ASSERT_EQ(a.get_count(), all.get_count());
+  ASSERT_NEAR(a.get_mean(), all.get_mean(), 1e-12);
+  ASSERT_NEAR(a.get_variance(), all.get_variance(), 1e-9);
+  ASSERT_EQ(a.get_min(), all.get_min());
+  ASSERT_EQ(a.get_max(), all.get_max());
+}
+
+TEST(StatsTest, Quantiles) {
+  ASSERT_NEAR(simcpp::normal_quantile(0.975), 1.959964, 1e-6);
+  ASSERT_NEAR(simcpp::normal_quantile(0.001), -3.090232, 1e-6);
+  ASSERT_NEAR(simcpp::student_t_quantile(0.975, 1), 12.7062, 1e-4);
+  ASSERT_NEAR(simcpp::student_t_quantile(0.975, 2), 4.3027, 1e-4);
+  ASSERT_NEAR(simcpp::student_t_quantile(0.975, 9), 2.2622, 1e-3);
+  ASSERT_NEAR(simcpp::student_t_quantile(0.995, 30), 2.7500, 1e-3);
+}
+
+TEST(StatsTest, TimeWeighted) {
+  auto sim = simcpp::Simulation::create();
+  simcpp::TimeWeightedStat length(sim);
+  sim->timeout(1)->add_handler([&](simcpp::EventPtr) { length.add(2); });
+  sim->timeout(3)->add_handler([&](simcpp::EventPtr) { length.add(-1); });
+  sim->timeout(4)->add_handler([&](simcpp::EventPtr) { length.set(0); });
+  sim->timeout(5);
+  sim->run_until(2);
+  ASSERT_DOUBLE_EQ(length.get_mean(), 1.0);
+  sim->run();
+
+  // 0 for 1, 2 for 2, 1 for 1 and 0 for 1 time unit.
+  ASSERT_DOUBLE_EQ(length.get_duration(), 5.0);
+  ASSERT_DOUBLE_EQ(length.get_mean(), 1.0);
+  ASSERT_DOUBLE_EQ(length.get_variance(), 0.8);
+  ASSERT_EQ(length.get_min(), 0.0);
+  ASSERT_EQ(length.get_max(), 2.0);
+
+  auto other = simcpp::Simulation::create();
+  simcpp::TimeWeightedStat busy(other, 4);
+  other->timeout(5);
+  other->run();
+
+  simcpp::TimeWeightedStat all;
+  all.merge(length);
+  all.merge(busy);
+  ASSERT_DOUBLE_EQ(all.get_duration(), 10.0);
+  ASSERT_DOUBLE_EQ(all.get_mean(), 2.5);
+  // 0 for 2, 1 for 1, 2 for 2 and 4 for 5 time units.
+  ASSERT_DOUBLE_EQ(all.get_variance(),
+                   (2 * 6.25 + 2.25 + 2 * 0.25 + 5 * 2.25) / 10);
+  ASSERT_EQ(all.get_max(), 4.0);
+  ASSERT_THROW(all.set(1.0), std::logic_error);
+  ASSERT_THROW(all.add(1.0), std::logic_error);
+}
+
+TEST(StatsTest, QuantileSketch) {
+  simcpp::QuantileSketch a(0.01);
+  simcpp::QuantileSketch b(0.01);
+  for (int i = 0; i <= 10000; ++i) {
+    (i % 3 == 0 ? a : b).add(i * 0.5);
+  }
+  a.merge(b);
+
+  ASSERT_EQ(a.get_count(), 10001);
+  ASSERT_EQ(a.get_quantile(0.0), 0.0);
+  ASSERT_EQ(a.get_quantile(1.0), 5000.0);
+  for (double p : {0.01, 0.25, 0.5, 0.9, 0.999}) {
+    double exact = p * 5000.0;
+    ASSERT_NEAR(a.get_quantile(p), exact, exact * 0.01);
+  }
+}
+
+TEST(StatsTest, QuantileSketchInvalid) {
+  ASSERT_THROW(simcpp::QuantileSketch(0.0), std::invalid_argument);
+  ASSERT_THROW(simcpp::QuantileSketch(1.0), std::invalid_argument);
+
+  simcpp::QuantileSketch a(0.01);
+  ASSERT_THROW(a.add(-1.0), std::invalid_argument);
+  ASSERT_EQ(a.get_count(), 0);
+
+  simcpp::QuantileSketch b(0.02);
+  b.add(1.0);
+  ASSERT_THROW(a.merge(b), std::invalid_argument);
+  ASSERT_EQ(a.get_count(), 0);
+}
+
+TEST(StatsTest, BatchMeans) {
+  simcpp::BatchMeans batches(8);
+  std::mt19937_64 rng(1);
+  std::normal_distribution<double> noise(0.0, 1.0);
+  // An autocorrelated sequence around 10.
+  double value = 10.0;
+  for (int i = 0; i < 100000; ++i) {
+    value = 10.0 + 0.9 * (value - 10.0) + noise(rng);
+    batches.add(value);
+  }
+
+  ASSERT_EQ(batches.get_count(), 100000);
+  ASSERT_GE(batches.get_n_batches(), 4);
+  ASSERT_LT(batches.get_n_batches(), 8);
+  ASSERT_EQ(batches.get_batch_size() * 8, 131072);
+  double half_width = batches.get_confidence_half_width();
+  ASSERT_GT(half_width, 0.0);
+  ASSERT_LT(half_width, 0.5);
+  ASSERT_NEAR(batches.get_mean(), 10.0, half_width);
+}
+
+TEST(StatsTest, BatchMeansInvalid) {
+  ASSERT_THROW(simcpp::BatchMeans(0), std::invalid_argument);
+  ASSERT_THROW(simcpp::BatchMeans(7), std::invalid_argument);
+}
+
+TEST(RandomTest, Philox) {
+  // Known answers of Philox4x32-10 from Random123.
+  uint32_t counter[4] = {0, 0, 0, 0};
+  uint32_t key[2] = {0, 0};
+  uint32_t block[4];
+  simcpp::Random::philox(counter, key, block);
+  ASSERT_EQ(block[0], 0x6627e8d5u);
+  ASSERT_EQ(block[1], 0xe169c58du);
+  ASSERT_EQ(block[2], 0xbc57ac4cu);
+  ASSERT_EQ(block[3], 0x9b00dbd8u);
+
+  uint32_t pi_counter[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+  uint32_t pi_key[2] = {0xa4093822, 0x299f31d0};
+  simcpp::Random::philox(pi_counter, pi_key, block);
+  ASSERT_EQ(block[0], 0xd16cfe09u);
+  ASSERT_EQ(block[1], 0x94fdccebu);
+  ASSERT_EQ(block[2], 0x5001e420u);
+  ASSERT_EQ(block[3], 0x24126ea1u);
+}
+
+TEST(RandomTest, Substreams) {
+  simcpp::Random random(42);
+  auto first = random.substream(1);
+  for (int i = 0; i < 1000; ++i) {
+    random();
+  }
+  auto second = random.substream(1);
+  ASSERT_EQ(first.get_stream(), second.get_stream());
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_EQ(first(), second());
+  }
+
+  auto other = random.substream(2);
+  auto nested = random.substream(1).substream(1);
+  ASSERT_NE(first(), other());
+  ASSERT_NE(first.get_stream(), nested.get_stream());
+  ASSERT_NE(simcpp::Random(1)(), simcpp::Random(2)());
+}
+
+TEST(RandomTest, FillSameAsSingle) {
+  simcpp::Random single(7, 3);
+  simcpp::Random batch(7, 3);
+  // Odd sizes leave values in the buffers between fills.
+  for (size_t n : {1, 37, 1000, 3}) {
+    std::vector<double> values(n);
+    batch.fill_uniform(values.data(), n);
+    for (double value : values) {
+      ASSERT_EQ(value, single.uniform());
+    }
+    batch.fill_exponential(values.data(), n, 2.0);
+    for (double value : values) {
+      ASSERT_EQ(value, single.exponential(2.0));
+    }
+    batch.fill_normal(values.data(), n, 1.0, 2.0);
+    for (double value : values) {
+      ASSERT_EQ(value, single.normal(1.0, 2.0));
+    }
+    batch.fill_lognormal(values.data(), n, 0.0, 0.5);
+    for (double value : values) {
+      ASSERT_EQ(value, single.lognormal(0.0, 0.5));
+    }
+    batch.fill_erlang(values.data(), n, 3, 1.5);
+    for (double value : values) {
+      ASSERT_EQ(value, single.erlang(3, 1.5));
+    }
+  }
+}
+
+TEST(RandomTest, Moments) {
+  simcpp::Random random(1);
+  std::vector<double> values(200000);
+  simcpp::Tally tally;
+
+  random.fill_exponential(values.data(), values.size(), 4.0);
+  for (double value : values) {
+    tally.add(value);
+  }
+  ASSERT_NEAR(tally.get_mean(), 0.25, 0.005);
+  ASSERT_NEAR(tally.get_stddev(), 0.25, 0.005);
+
+  tally = simcpp::Tally();
+  random.fill_normal(values.data(), values.size(), 3.0, 2.0);
+  for (double value : values) {
+    tally.add(value);
+  }
+  ASSERT_NEAR(tally.get_mean(), 3.0, 0.02);
+  ASSERT_NEAR(tally.get_stddev(), 2.0, 0.02);
+
+  tally = simcpp::Tally();
+  random.fill_erlang(values.data(), values.size(), 4, 2.0);
+  for (double value : values) {
+    tally.add(value);
+  }
+  ASSERT_NEAR(tally.get_mean(), 2.0, 0.01);
+  ASSERT_NEAR(tally.get_variance(), 1.0, 0.02);
+
+  std::uniform_int_distribution<int> dice(1, 6);
+  for (int i = 0; i < 1000; ++i) {
+    int value = dice(random);
+    ASSERT_GE(value, 1);
+    ASSERT_LE(value, 6);
+  }
+}
+
+TEST(RandomTest, SimulationSeed) {
+  simcpp::SimulationOptions options;
+  options.seed = 5;
+  auto sim = simcpp::Simulation::create(options);
+  simcpp::Random random(5);
+  ASSERT_EQ(sim->get_random()(), random());
+
+  // Forks continue the stream of the simulation.
+  sim->get_random().normal();
+  simcpp::SnapshotRegistry registry;
+  auto fork = sim->fork(registry);
+  ASSERT_EQ(fork->get_random().normal(), sim->get_random().normal());
+  ASSERT_EQ(fork->get_random().uniform(), sim->get_random().uniform());
+}
+
+double replicated_queue(simcpp::Replication &replication) {
+  std::exponential_distribution<double> delay(1.0);
+  for (int i = 0; i < 100; ++i) {
+    replication.sim->timeout(delay(replication.sim->get_random()));
+  }
+  replication.sim->run();
+  return replication.sim->get_now();
+}
+
+TEST(ReplicationTest, IndependentOfThreads) {
+  auto seeds = simcpp::ReplicationRunner::make_seeds(64, 42);
+  auto one = simcpp::ReplicationRunner(1).run(replicated_queue, seeds);
+  auto four = simcpp::ReplicationRunner(4).run(replicated_queue, seeds);
+
+  ASSERT_EQ(one.values, four.values);
+  ASSERT_EQ(one.summary.get_mean(), four.summary.get_mean());
+  ASSERT_EQ(four.summary.get_count(), 64);
+  ASSERT_NE(four.values[0], four.values[1]);
+
+  simcpp::SimulationOptions options;
+  options.seed = seeds[7];
+  simcpp::Replication replication(7, seeds[7],
+                                  simcpp::Simulation::create(options));
+  ASSERT_EQ(four.values[7], replicated_queue(replication));
+}
+
+TEST(ReplicationTest, Exception) {
+  simcpp::ReplicationRunner runner(4);
+  auto model = [](simcpp::Replication &replication) -> double {
+    if (replication.index == 5) {
+      throw std::runtime_error("failed");
+    }
+    return 0.0;
+  };
+
+  ASSERT_THROW(runner.run(model, 16, 0), std::runtime_error);
+}
+
+TEST(SimulationTest, RunUntil) {
+  auto sim = simcpp::Simulation::create();
+  auto event1 = sim->timeout(5);
+  auto event2 = sim->timeout(10);
+
+  sim->run_until(10);
+  ASSERT_EQ(sim->get_now(), 10);
+  ASSERT_TRUE(event1->is_processed());
+  ASSERT_FALSE(event2->is_processed());
+}
+
+TEST(SimulationTest, CompactAborted) {
+  auto sim = simcpp::Simulation::create();
+  std::vector<simcpp::EventPtr> timeouts;
+  std::vector<std::weak_ptr<simcpp::Event>> aborted;
+  for (int i = 0; i < 200; ++i) {
+    timeouts.push_back(sim->timeout(i + 1));
+  }
+  for (int i = 0; i < 200; i += 2) {
+    timeouts[i]->abort();
+    aborted.push_back(timeouts[i]);
+    timeouts[i] = nullptr;
+  }
+
+  // Half of the queue is aborted, so it was compacted.
+  for (auto &event : aborted) {
+    ASSERT_TRUE(event.expired());
+  }
+
+  std::vector<double> times;
+  while (sim->step()) {
+    times.push_back(sim->get_now());
+  }
+  ASSERT_EQ(times.size(), 100);
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_EQ(times[i], 2 * i + 2);
+  }
+}
+
+TEST(SimulationTest, Cancel) {
+  auto sim = simcpp::Simulation::create();
+  auto timeout = sim->timeout(5);
+  std::weak_ptr<simcpp::Event> weak = timeout;
+
+  ASSERT_TRUE(sim->cancel(timeout));
+  ASSERT_TRUE(timeout->is_aborted());
+  ASSERT_FALSE(sim->cancel(timeout));
+  timeout = nullptr;
+
+  ASSERT_TRUE(weak.expired());
+  ASSERT_FALSE(sim->has_next());
+}
+
+TEST(ResourceTest, Fifo) {
+  simcpp::SimulationOptions options;
+  options.pooled_allocation = true;
+  auto sim = simcpp::Simulation::create(options);
+  simcpp::Resource resource(sim, 1);
+  auto request1 = resource.request();
+  auto request2 = resource.request();
+  auto request3 = resource.request();
+  ASSERT_TRUE(request1->is_granted());
+  ASSERT_EQ(resource.get_n_queued(), 2);
+
+  // A reneging request leaves the queue immediately.
+  request2->abort();
+  ASSERT_EQ(resource.get_n_queued(), 1);
+
+  resource.release(request1);
+  ASSERT_FALSE(request2->is_triggered());
+  ASSERT_TRUE(request3->is_granted());
+  ASSERT_TRUE(request3->is_triggered());
+  ASSERT_EQ(resource.get_n_users(), 1);
+  ASSERT_EQ(resource.get_n_queued(), 0);
+}
+
+TEST(ResourceTest, Priority) {
+  auto sim = simcpp::Simulation::create();
+  simcpp::PriorityResource resource(sim, 1);
+  auto request0 = resource.request(0);
+  auto request1 = resource.request(5);
+  auto request2 = resource.request(1);
+  auto request3 = resource.request(1);
+
+  resource.release(request0);
+  ASSERT_TRUE(request2->is_granted());
+  resource.release(request2);
+  ASSERT_TRUE(request3->is_granted());
+  request1->abort();
+  resource.release(request3);
+  ASSERT_EQ(resource.get_n_users(), 0);
+  ASSERT_EQ(resource.get_n_queued(), 0);
+}
+
+TEST(ResourceTest, Preemption) {
+  auto sim = simcpp::Simulation::create();
+  simcpp::PreemptiveResource resource(sim, 1);
+  auto low = resource.request(5, false);
+  auto preempted = low->preempted();
+  auto equal = resource.request(5, true);
+  ASSERT_TRUE(low->is_granted());
+  ASSERT_FALSE(equal->is_granted());
+
+  auto high = resource.request(1, true);
+  ASSERT_TRUE(high->is_granted());
+  ASSERT_TRUE(low->is_preempted());
+  ASSERT_TRUE(preempted->is_triggered());
+
+  resource.release(low);
+  ASSERT_EQ(resource.get_n_users(), 1);
+  resource.release(high);
+  ASSERT_TRUE(equal->is_granted());
+}
+
+TEST(ContainerTest, Levels) {
+  auto sim = simcpp::Simulation::create();
+  simcpp::Container container(sim, 10.0);
+  auto get = container.get(5.0);
+  container.put(3.0);
+  ASSERT_FALSE(get->is_triggered());
+  container.put(4.0);
+  ASSERT_TRUE(get->is_triggered());
+  ASSERT_EQ(container.get_level(), 2.0);
+
+  auto put = container.put(9.0);
+  auto aborted = container.get(3.0);
+  auto get2 = container.get(1.0);
+  ASSERT_FALSE(put->is_triggered());
+  aborted->abort();
+  ASSERT_EQ(container.get_n_gets(), 1);
+  container.get(1.0);
+  ASSERT_TRUE(get2->is_triggered());
+  ASSERT_TRUE(put->is_triggered());
+  ASSERT_EQ(container.get_level(), 9.0);
+}
+
+TEST(StoreTest, Capacity) {
+  auto sim = simcpp::Simulation::create();
+  simcpp::Store<int> store(sim, 1);
+  store.put(1);
+  auto put = store.put(2);
+  ASSERT_FALSE(put->is_triggered());
+
+  auto get = store.get();
+  ASSERT_EQ(get->get_item(), 1);
+  ASSERT_TRUE(put->is_triggered());
+  ASSERT_EQ(store.get_items(), std::deque<int>({2}));
+}
+
+TEST(StoreTest, Filter) {
+  auto sim = simcpp::Simulation::create();
+  simcpp::FilterStore<int> store(sim);
+  auto even = store.get([](const int &item) { return item % 2 == 0; });
+  auto any = store.get();
+
+  store.put(1);
+  ASSERT_FALSE(even->is_triggered());
+  ASSERT_TRUE(any->is_triggered());
+  ASSERT_EQ(any->get_item(), 1);
+
+  store.put(3);
+  store.put(4);
+  ASSERT_TRUE(even->is_triggered());
+  ASSERT_EQ(even->get_item(), 4);
+  ASSERT_EQ(store.size(), 1);
+}
+
+class ValueReceiver : public simcpp::Process {
+public:
+  ValueReceiver(simcpp::SimulationPtr sim,
+                simcpp::ValueEventPtr<std::unique_ptr<int>> event, int *value)
+      : Process(sim), event(event), value(value) {}
+
+  bool Run() override {
+    PT_BEGIN();
+    PROC_WAIT_FOR(event);
+    *value = *event->get_value();
+    PT_END();
+  }
+
+private:
+  simcpp::ValueEventPtr<std::unique_ptr<int>> event;
+  int *value;
+};
+
+TEST(ValueEventTest, MoveOnly) {
+  auto sim = simcpp::Simulation::create();
+  auto event = sim->event<simcpp::ValueEvent<std::unique_ptr<int>>>();
+  int *received = nullptr;
+  event->add_handler(
+      [&received](std::unique_ptr<int> &value) { received = value.get(); });
+  ASSERT_FALSE(event->has_value());
+  ASSERT_THROW(event->get_value(), std::logic_error);
+
+  auto value = std::make_unique<int>(1);
+  int *sent = value.get();
+  ASSERT_TRUE(event->trigger(std::move(value)));
+  ASSERT_FALSE(event->trigger(std::make_unique<int>(2)));
+  sim->run();
+  ASSERT_EQ(received, sent);
+  ASSERT_EQ(event->get_value().get(), sent);
+}
+
+TEST(ValueEventTest, LoadBeforeTrigger) {
+  auto sim = simcpp::Simulation::create();
+  auto event = sim->event<simcpp::ValueEvent<std::string>>();
+  simcpp::Archive archive;
+  event->save(archive);
+  ASSERT_TRUE(event->trigger(std::string("first"), 1.0));
+
+  event->load(archive);
+  ASSERT_FALSE(event->has_value());
+  ASSERT_TRUE(event->trigger(std::string("second"), 2.0));
+  ASSERT_EQ(event->get_value(), "second");
+}
+
+TEST(ValueEventTest, ProcessWait) {
+  auto sim = simcpp::Simulation::create();
+  auto event = sim->event<simcpp::ValueEvent<std::unique_ptr<int>>>();
+  int value = 0;
+  sim->start_process<ValueReceiver>(event, &value);
+
+  ASSERT_TRUE(event->emplace(2.0, new int(5)));
+  ASSERT_FALSE(event->emplace(1.0, nullptr));
+  sim->run();
+  ASSERT_EQ(value, 5);
+  ASSERT_EQ(sim->get_now(), 2.0);
+}
+
+/// Static process which notifies another one when its signal is notified.
+class StaticPlayer : public simcpp::StaticProcess {
+public:
+  StaticPlayer(simcpp::StaticScheduler &sim, simcpp::StaticSignal *own,
+               simcpp::StaticSignal *other, std::vector<double> *times)
+      : StaticProcess(sim), own(own), other(other), times(times) {}
+
+  bool Run() override {
+    PT_BEGIN();
+    while (true) {
+      STATIC_WAIT_FOR(*own);
+      times->push_back(sim->get_now());
+      if (times->size() < 6) {
+        other->notify(1.0);
+      }
+    }
+    PT_END();
+  }
+
+private:
+  simcpp::StaticSignal *own;
+  simcpp::StaticSignal *other;
+  std::vector<double> *times;
+};
+
+/// Static process which waits for a fixed delay a number of times.
+class StaticSleeper : public simcpp::StaticProcess {
+public:
+  StaticSleeper(simcpp::StaticScheduler &sim, double delay, int id,
+                std::vector<int> *ids)
+      : StaticProcess(sim), delay(delay), id(id), ids(ids) {}
+
+  bool Run() override {
+    PT_BEGIN();
+    for (i = 0; i < 3; ++i) {
+      STATIC_WAIT(delay);
+      ids->push_back(id);
+    }
+    PT_END();
+  }
+
+private:
+  double delay;
+  int id;
+  std::vector<int> *ids;
+  int i = 0;
+};
+
+TEST(StaticSimulationTest, PingPong) {
+  simcpp::StaticSimulation<StaticPlayer, StaticSleeper> sim;
+  simcpp::StaticSignal ping(sim);
+  simcpp::StaticSignal pong(sim);
+  std::vector<double> times;
+  sim.start_process<StaticPlayer>(&ping, &pong, &times);
+  sim.start_process<StaticPlayer>(&pong, &ping, &times);
+  ASSERT_EQ(ping.get_n_waiting(), 1);
+  ASSERT_EQ(pong.get_n_waiting(), 1);
+
+  ASSERT_EQ(ping.notify(), 1);
+  sim.run();
+  ASSERT_EQ(times, std::vector<double>({0, 1, 2, 3, 4, 5}));
+  ASSERT_EQ(sim.get_processes<StaticPlayer>().size(), 2);
+  ASSERT_EQ(ping.get_n_waiting(), 1);
+  ASSERT_EQ(pong.get_n_waiting(), 1);
+}
+
+TEST(StaticSimulationTest, SameTimeInOrder) {
+  simcpp::StaticSimulation<StaticPlayer, StaticSleeper> sim;
+  std::vector<int> ids;
+  sim.start_process<StaticSleeper>(2.0, 1, &ids);
+  sim.start_process<StaticSleeper>(1.0, 2, &ids);
+  sim.start_process<StaticSleeper>(2.0, 3, &ids);
+
+  sim.run_until(2.0);
+  ASSERT_EQ(ids, std::vector<int>({2}));
+  ASSERT_EQ(sim.get_now(), 2.0);
+  sim.run();
+  ASSERT_EQ(ids, std::vector<int>({2, 1, 3, 2, 2, 1, 3, 1, 3}));
+  ASSERT_EQ(sim.get_now(), 6.0);
+}
+
+#ifdef SIMCPP_PROFILE
+TEST(ProfilerTest, Counts) {
+  auto sim = simcpp::Simulation::create();
+  simcpp::ProfilerOptions options;
+  options.trace = true;
+  options.queue_sample_interval = 1;
+  simcpp::Profiler profiler(options);
+  simcpp::Profiler::set_active(&profiler);
+
+  auto event = sim->event();
+  sim->start_process<Awaiter>(event);
+  sim->timeout(1)->add_handler([event](simcpp::EventPtr) { event->trigger(); });
+  sim->timeout(2)->abort();
+  sim->run();
+  simcpp::Profiler::set_active(nullptr);
+
+  // The start event of the process, two timeouts, the event and the process.
+  ASSERT_EQ(profiler.get_n_scheduled(), 5);
+  ASSERT_EQ(profiler.get_n_processed(), 4);
+  ASSERT_EQ(profiler.get_n_aborted(), 1);
+  ASSERT_EQ(profiler.get_max_queue_size(), 3);
+  // The aborted timeout is skipped.
+  ASSERT_EQ(profiler.get_queue_samples().size(), 4);
+  ASSERT_EQ(profiler.get_handler_counts(), (std::vector<uint64_t>{1, 3}));
+
+  auto awaiter = profiler.get_type_stats(typeid(Awaiter));
+  ASSERT_EQ(awaiter.name, "Awaiter");
+  ASSERT_EQ(awaiter.n_allocated, 1);
+  ASSERT_EQ(awaiter.n_resumes, 2);
+  ASSERT_EQ(awaiter.n_processed, 1);
+  ASSERT_EQ(profiler.get_type_stats(typeid(simcpp::Event)).n_allocated, 4);
+
+  std::ostringstream summary;
+  profiler.write_summary(summary);
+  ASSERT_NE(summary.str().find("\"Awaiter\":{\"allocated\":1,"),
+            std::string::npos);
+
+  std::ostringstream trace;
+  profiler.write_trace(trace);
+  ASSERT_NE(trace.str().find("\"name\":\"Awaiter\",\"ph\":\"X\""),
+            std::string::npos);
+}
+#endif
+
+#ifdef SIMCPP_TRACE
+TEST(TraceTest, Records) {
+  auto path = ::testing::TempDir() + "simcpp-test.trace";
+  {
+    auto sim = simcpp::Simulation::create();
+    simcpp::TraceRecorder recorder(path);
+    simcpp::TraceRecorder::set_active(&recorder);
+
+    auto event = sim->event();
+    sim->start_process<Awaiter>(event);
+    sim->timeout(1)->add_handler(
+        [event](simcpp::EventPtr) { event->trigger(); });
+    sim->timeout(2)->abort();
+    sim->run();
+    simcpp::TraceRecorder::set_active(nullptr);
+    ASSERT_EQ(recorder.get_n_records(), 12);
+  }
+
+  using Kind = simcpp::TraceRecord::Kind;
+  std::vector<std::tuple<double, Kind, std::string>> expected = {
+      {0, Kind::Trigger, "simcpp::Event"},
+      {0, Kind::Trigger, "simcpp::Event"},
+      {0, Kind::Trigger, "simcpp::Event"},
+      {0, Kind::Abort, "simcpp::Event"},
+      {0, Kind::Process, "simcpp::Event"},
+      {0, Kind::Resume, "Awaiter"},
+      {1, Kind::Process, "simcpp::Event"},
+      {1, Kind::Trigger, "simcpp::Event"},
+      {1, Kind::Process, "simcpp::Event"},
+      {1, Kind::Resume, "Awaiter"},
+      {1, Kind::Trigger, "Awaiter"},
+      {1, Kind::Process, "Awaiter"}};
+
+  simcpp::TraceReader reader(path);
+  simcpp::TraceRecord record;
+  std::vector<std::tuple<double, Kind, std::string>> records;
+  std::vector<uint64_t> events;
+  while (reader.next(record)) {
+    records.emplace_back(record.time, record.kind,
+                         reader.get_types()[record.type]);
+    events.push_back(record.event);
+  }
+  ASSERT_EQ(records, expected);
+  // The resumed process is the one processed last.
+  ASSERT_EQ(events[5], events[11]);
+  ASSERT_EQ(events[7], events[8]);
+}
+
+TEST(TraceTest, Encodings) {
+  auto run = [](const std::string &path, bool compress) {
+    simcpp::TraceOptions options;
+    options.chunk_size = 64;
+    options.n_chunks = 2;
+    options.compress = compress;
+    simcpp::TraceRecorder recorder(path, options);
+    simcpp::TraceRecorder::set_active(&recorder);
+    auto sim = simcpp::Simulation::create();
+    for (int i = 0; i < 1000; ++i) {
+      sim->timeout(i % 7 * 0.1);
+    }
+    sim->run();
+    simcpp::TraceRecorder::set_active(nullptr);
+  };
+
+  auto plain_path = ::testing::TempDir() + "simcpp-test-plain.trace";
+  auto packed_path = ::testing::TempDir() + "simcpp-test-packed.trace";
+  run(plain_path, false);
+  run(packed_path, true);
+
+  simcpp::TraceReader plain(plain_path);
+  simcpp::TraceReader packed(packed_path);
+  simcpp::TraceRecord a;
+  simcpp::TraceRecord b;
+  size_t n = 0;
+  while (plain.next(a)) {
+    ASSERT_TRUE(packed.next(b));
+    ASSERT_EQ(a.time, b.time);
+    ASSERT_EQ(a.kind, b.kind);
+    ASSERT_EQ(plain.get_types()[a.type], packed.get_types()[b.type]);
+    ++n;
+  }
+  ASSERT_FALSE(packed.next(b));
+  ASSERT_EQ(n, 2000);
+
+  std::ifstream plain_file(plain_path, std::ios::binary | std::ios::ate);
+  std::ifstream packed_file(packed_path, std::ios::binary | std::ios::ate);
+  ASSERT_LT(packed_file.tellg() * 2, plain_file.tellg());
+}
+#endif
+
+/// Burst of events at the same times, some scheduling more at the same time.
+std::vector<std::pair<double, int>> run_burst(bool batched) {
+  auto sim = simcpp::Simulation::create();
+  std::vector<std::pair<double, int>> log;
+
+  for (int i = 0; i < 20; ++i) {
+    sim->timeout(1 + i % 3)->add_handler([sim, &log, i](simcpp::EventPtr) {
+      log.push_back({sim->get_now(), i});
+      if (i % 4 == 0) {
+        auto event = sim->event();
+        event->add_handler([sim, &log, i](simcpp::EventPtr) {
+          log.push_back({sim->get_now(), 100 + i});
+        });
+        event->trigger();
+      }
+      if (i % 5 == 0) {
+        sim->timeout(1)->add_handler([sim, &log, i](simcpp::EventPtr) {
+          log.push_back({sim->get_now(), 200 + i});
+        });
+      }
+    });
+  }
+
+  if (batched) {
+    sim->run();
+  } else {
+    while (sim->step()) {
+    }
+  }
+  return log;
+}
+
+TEST(SimulationTest, BatchSameOrderAsStep) {
+  auto expected = run_burst(false);
+
+  ASSERT_EQ(run_burst(true), expected);
+  ASSERT_EQ(expected.size(), 29);
+}
+
+TEST(SimulationTest, BatchException) {
+  auto sim = simcpp::Simulation::create();
+  std::vector<int> log;
+  for (int i = 0; i < 4; ++i) {
+    sim->timeout(1)->add_handler([&log, i](simcpp::EventPtr) {
+      log.push_back(i);
+      if (i == 1) {
+        throw std::runtime_error("handler failed");
+      }
+    });
+  }
+
+  ASSERT_THROW(sim->run_batch(), std::runtime_error);
+  ASSERT_EQ(log, (std::vector<int>{0, 1}));
+
+  ASSERT_EQ(sim->run_batch(), 2);
+  ASSERT_EQ(log, (std::vector<int>{0, 1, 2, 3}));
+  ASSERT_FALSE(sim->has_next());
+}
+
+TEST(RealtimeTest, FollowsWallClock) {
+  simcpp::RealtimeOptions realtime_options;
+  // One unit of simulation time per millisecond.
+  realtime_options.factor = 0.001;
+  simcpp::RealtimeSimulation rt(realtime_options);
+  auto sim = rt.get_simulation();
+  std::vector<double> wall_times;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 1; i <= 5; ++i) {
+    sim->timeout(4.0 * i)->add_handler([&](simcpp::EventPtr) {
+      std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      wall_times.push_back(elapsed.count());
+    });
+  }
+
+  rt.run();
+  ASSERT_EQ(wall_times.size(), 5);
+  for (int i = 0; i < 5; ++i) {
+    ASSERT_GE(wall_times[i], 4.0 * (i + 1));
+  }
+  ASSERT_EQ(rt.get_lateness().get_count(), 5);
+  ASSERT_EQ(sim->get_now(), 20.0);
+
+  rt.run_until(25.0);
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  ASSERT_GE(elapsed.count(), 25.0);
+  ASSERT_EQ(sim->get_now(), 25.0);
+}
+
+TEST(RealtimeTest, Inject) {
+  simcpp::RealtimeOptions realtime_options;
+  realtime_options.factor = 0.001;
+  simcpp::RealtimeSimulation rt(realtime_options);
+  std::vector<double> times;
+  std::thread producer([&rt, &times]() {
+    for (int i = 0; i < 3; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      rt.inject([&times](simcpp::SimulationPtr sim) {
+        times.push_back(sim->get_now());
+        sim->timeout(1.0);
+      });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    rt.stop();
+  });
+
+  rt.run_until(1000.0);
+  producer.join();
+  ASSERT_EQ(times.size(), 3);
+  ASSERT_GE(times[0], 5.0);
+  ASSERT_GE(times[1], times[0] + 5.0);
+  ASSERT_GE(times[2], times[1] + 5.0);
+  ASSERT_LT(rt.get_simulation()->get_now(), 1000.0);
+  ASSERT_EQ(rt.get_lateness().get_count(), 3);
+}
+
+TEST(RealtimeTest, InjectMoreThanCapacity) {
+  simcpp::RealtimeOptions realtime_options;
+  realtime_options.factor = 0.001;
+  realtime_options.inbox_capacity = 2;
+  simcpp::RealtimeSimulation rt(realtime_options);
+  int n_injected = 0;
+  std::thread producer([&rt, &n_injected]() {
+    for (int i = 0; i < 100; ++i) {
+      rt.inject([&n_injected](simcpp::SimulationPtr) { ++n_injected; });
+    }
+    // Injections are called in order, so all others were called before.
+    rt.inject([&rt](simcpp::SimulationPtr) { rt.stop(); });
+  });
+
+  rt.run_until(1000.0);
+  producer.join();
+  ASSERT_EQ(n_injected, 100);
+}
+
+TEST(RealtimeTest, Strict) {
+  simcpp::RealtimeOptions realtime_options;
+  realtime_options.factor = 0.001;
+  realtime_options.strict = true;
+  simcpp::RealtimeSimulation rt(realtime_options);
+  auto sim = rt.get_simulation();
+  sim->timeout(1.0)->add_handler([](simcpp::EventPtr) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  });
+  sim->timeout(2.0);
+
+  ASSERT_TRUE(rt.step());
+  ASSERT_THROW(rt.step(), std::runtime_error);
+  ASSERT_EQ(rt.get_n_late(), 1);
+}
+
+TEST(InboxTest, Backpressure) {
+  simcpp::SimulationOptions options;
+  options.inbox_capacity = 3;
+  auto sim = simcpp::Simulation::create(options);
+  std::vector<double> times;
+  auto handler = [&times, &sim](simcpp::EventPtr) {
+    times.push_back(sim->get_now());
+  };
+
+  // Rounded up to 4 slots.
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(sim->try_post(4.0 - i, handler));
+  }
+  ASSERT_FALSE(sim->try_post(0.0, handler));
+  sim->run_until(2.5);
+  ASSERT_EQ(times, std::vector<double>({1.0, 2.0}));
+
+  // Posted handlers whose time passed are called at the current time.
+  ASSERT_TRUE(sim->try_post(0.0, handler));
+  sim->run();
+  ASSERT_EQ(times, std::vector<double>({1.0, 2.0, 2.5, 3.0, 4.0}));
+
+  ASSERT_THROW(simcpp::Simulation::create()->try_post(0.0, handler),
+               std::logic_error);
+}
+
+TEST(InboxTest, Producers) {
+  simcpp::SimulationOptions options;
+  options.inbox_capacity = 64;
+  auto sim = simcpp::Simulation::create(options);
+  const int n_producers = 4;
+  const int n_posts = 5000;
+  std::vector<int> next(n_producers, 0);
+  bool in_order = true;
+  int n_received = 0;
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < n_producers; ++p) {
+    producers.emplace_back([&, p]() {
+      for (int i = 0; i < n_posts; ++i) {
+        sim->post(0.0, [&, p, i](simcpp::EventPtr) {
+          in_order = in_order && next[p] == i;
+          next[p] = i + 1;
+          ++n_received;
+        });
+      }
+    });
+  }
+
+  while (n_received < n_producers * n_posts) {
+    if (!sim->step()) {
+      std::this_thread::yield();
+    }
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  ASSERT_TRUE(in_order);
+  ASSERT_FALSE(sim->has_next());
+}
+
+TEST(ParallelTest, PingPong) {
+  simcpp::ParallelSimulation psim(2);
+  psim.connect(0, 1, 1.0);
+  psim.connect(1, 0, 1.0);
+
+  std::vector<std::vector<std::pair<double, int64_t>>> received(2);
+  for (size_t id = 0; id < 2; ++id) {
+    auto &lp = psim.get_process(id);
+    lp.on_message([&lp, &received](const simcpp::Message &message) {
+      received[lp.get_id()].push_back({message.time, message.kind});
+      lp.send(1 - lp.get_id(), 1.0, message.kind + 1);
+    });
+  }
+
+  // A local event at the time of a message is processed after it.
+  auto &lp1 = psim.get_process(1);
+  lp1.get_simulation()->timeout(1)->add_handler(
+      [&received](simcpp::EventPtr) { received[1].push_back({1, -1}); });
+  psim.get_process(0).send(1, 1.0);
+
+  psim.run_until(5);
+  ASSERT_EQ(received[1], (std::vector<std::pair<double, int64_t>>(
+                             {{1, 0}, {1, -1}, {3, 2}})));
+  ASSERT_EQ(received[0],
+            (std::vector<std::pair<double, int64_t>>({{2, 1}, {4, 3}})));
+  ASSERT_EQ(lp1.get_simulation()->get_now(), 5);
+
+  psim.run_until(7);
+  ASSERT_EQ(received[1].back(), (std::pair<double, int64_t>(5, 4)));
+  ASSERT_EQ(received[0].back(), (std::pair<double, int64_t>(6, 5)));
+}
+
+TEST(ParallelTest, MoreMessagesAfterEndThanFit) {
+  simcpp::ParallelSimulation psim(2);
+  psim.connect(0, 1, 1.0);
+
+  // The receiver reaches the end as soon as the first message arrives, while
+  // the sender still has more messages than fit into the channel.
+  auto &sender = psim.get_process(0);
+  sender.get_simulation()->timeout(9.5)->add_handler(
+      [&sender](simcpp::EventPtr) {
+        for (int i = 0; i < 3000; ++i) {
+          sender.send(1, 1.0);
+        }
+      });
+  size_t n_received = 0;
+  psim.get_process(1).on_message(
+      [&n_received](const simcpp::Message &) { ++n_received; });
+
+  psim.run_until(10);
+  ASSERT_EQ(n_received, 0u);
+  psim.run_until(20);
+  ASSERT_EQ(n_received, 3000u);
+}
+
+TEST(ParallelTest, LookaheadViolation) {
+  simcpp::ParallelSimulation psim(2);
+  psim.connect(0, 1, 1.0);
+
+  ASSERT_THROW(psim.get_process(0).send(1, 0.5), std::invalid_argument);
+  ASSERT_THROW(psim.get_process(1).send(0, 1.0), std::invalid_argument);
+}
+
+/// Single server station in a ring of logical processes.
+template <typename LogicalProcess> class Station {
+public:
+  std::vector<std::pair<double, double>> departures = {};
+
+  Station(LogicalProcess &lp, size_t next)
+      : lp(lp), next(next), rng(lp.get_id()) {
+    lp.on_message(
+        [this](const simcpp::Message &message) { arrive(message.value); });
+  }
+
+  void save(simcpp::Archive &archive) const {
+    archive.save(std::vector<double>(queue.begin(), queue.end()));
+    archive.save(busy);
+    archive.save(rng);
+    archive.save(departures.size());
+  }
+
+  void load(simcpp::Archive &archive) {
+    std::vector<double> queue;
+    archive.load(queue);
+    this->queue.assign(queue.begin(), queue.end());
+    archive.load(busy);
+    archive.load(rng);
+    size_t n_departures;
+    archive.load(n_departures);
+    departures.resize(n_departures);
+  }
+
+  void arrive(double customer) {
+    queue.push_back(customer);
+    if (!busy) {
+      serve();
+    }
+  }
+
+private:
+  LogicalProcess &lp;
+  size_t next;
+  std::mt19937_64 rng;
+  std::exponential_distribution<double> service{1.0};
+  std::deque<double> queue = {};
+  bool busy = false;
+
+  void serve() {
+    busy = true;
+    double customer = queue.front();
+    queue.pop_front();
+
+    auto sim = lp.get_simulation();
+    sim->timeout(service(rng))->add_handler([this, customer](simcpp::EventPtr) {
+      departures.push_back({lp.get_simulation()->get_now(), customer});
+      lp.send(next, 1.0 + service(rng), 0, customer);
+      busy = false;
+      if (!queue.empty()) {
+        serve();
+      }
+    });
+  }
+};
+
+std::vector<std::vector<std::pair<double, double>>> run_ring(size_t n) {
+  simcpp::ParallelSimulation psim(n);
+  std::vector<std::unique_ptr<Station<simcpp::LogicalProcess>>> stations;
+  for (size_t id = 0; id < n; ++id) {
+    psim.connect(id, (id + 1) % n, 1.0);
+    stations.emplace_back(new Station<simcpp::LogicalProcess>(psim.get_process(id), (id + 1) % n));
+  }
+  for (size_t id = 0; id < n; ++id) {
+    for (int customer = 0; customer < 10; ++customer) {
+      stations[id]->arrive(id * 100 + customer);
+    }
+  }
+
+  psim.run_until(200);
+
+  std::vector<std::vector<std::pair<double, double>>> departures;
+  for (auto &station : stations) {
+    departures.push_back(station->departures);
+  }
+  return departures;
+}
+
+TEST(ParallelTest, Deterministic) {
+  auto first = run_ring(4);
+  auto second = run_ring(4);
+
+  ASSERT_EQ(first, second);
+  for (auto &departures : first) {
+    ASSERT_GT(departures.size(), 50);
+  }
+}
+
+class Ticker : public simcpp::Process {
+public:
+  int n = 0;
+
+  explicit Ticker(simcpp::SimulationPtr sim) : Process(sim) {}
+
+  bool Run() override {
+    auto sim = this->sim.lock();
+
+    PT_BEGIN();
+    while (true) {
+      PROC_WAIT_FOR(sim->timeout(1));
+      ++n;
+    }
+    PT_END();
+  }
+
+  void save(simcpp::Archive &archive) const override {
+    Process::save(archive);
+    archive.save(n);
+  }
+
+  void load(simcpp::Archive &archive) override {
+    Process::load(archive);
+    archive.load(n);
+  }
+};
+
+TEST(ArchiveTest, Values) {
+  simcpp::Archive archive;
+  archive.save(42);
+  archive.save(std::vector<double>{1.5, 2.5});
+  auto pointer = std::make_shared<int>(7);
+  archive.save(pointer);
+
+  int value;
+  std::vector<double> values;
+  std::shared_ptr<int> loaded;
+  archive.load(value);
+  archive.load(values);
+  archive.load(loaded);
+
+  ASSERT_EQ(value, 42);
+  ASSERT_EQ(values, (std::vector<double>{1.5, 2.5}));
+  ASSERT_EQ(loaded, pointer);
+}
+
+TEST(ArchiveTest, Process) {
+  auto sim = simcpp::Simulation::create();
+  auto ticker = sim->start_process<Ticker>();
+  sim->run_until(2.5);
+  ASSERT_EQ(ticker->n, 2);
+
+  simcpp::Archive archive;
+  ticker->save(archive);
+  sim->run_until(4.5);
+  ASSERT_EQ(ticker->n, 4);
+
+  ticker->load(archive);
+  ASSERT_EQ(ticker->n, 2);
+  ASSERT_TRUE(ticker->is_pending());
+}
+
+using Laps = std::vector<std::pair<double, int>>;
+
+class Lapper : public simcpp::Process {
+public:
+  Lapper(simcpp::SimulationPtr sim, Laps *laps, int id)
+      : Process(sim), laps(laps), id(id) {}
+
+  bool Run() override {
+    auto sim = this->sim.lock();
+
+    PT_BEGIN();
+    while (n < 5) {
+      timeout = sim->timeout(1.0 + id * 0.5);
+      PROC_WAIT_FOR(sim->any_of({timeout, sim->timeout(10.0)}));
+      ++n;
+      laps->emplace_back(sim->get_now(), id);
+    }
+    PT_END();
+  }
+
+  void save(simcpp::Archive &archive) const override {
+    Process::save(archive);
+    archive.save(id);
+    archive.save(n);
+    archive.save(timeout);
+  }
+
+  void load(simcpp::Archive &archive) override {
+    Process::load(archive);
+    archive.load(id);
+    archive.load(n);
+    archive.load(timeout);
+  }
+
+private:
+  Laps *laps;
+  int id;
+  int n = 0;
+  simcpp::EventPtr timeout = nullptr;
+};
+
+TEST(SnapshotTest, RestoreContinues) {
+  Laps laps;
+  auto sim = simcpp::Simulation::create();
+  auto lapper1 = sim->start_process<Lapper>(&laps, 1);
+  auto lapper2 = sim->start_process<Lapper>(&laps, 2);
+  sim->start_process<Lapper>(&laps, 3);
+  sim->start_process<Awaiter>(sim->all_of({lapper1, lapper2}));
+  sim->run_until(3.2);
+
+  Laps restored_laps;
+  simcpp::SnapshotRegistry registry;
+  registry.add<Lapper>("Lapper", [&](simcpp::SimulationPtr sim) {
+    return sim->event<Lapper>(&restored_laps, 0);
+  });
+  registry.add<Awaiter>("Awaiter", [](simcpp::SimulationPtr sim) {
+    return sim->event<Awaiter>(nullptr);
+  });
+  auto path = ::testing::TempDir() + "simcpp-test.snapshot";
+  simcpp::Snapshot::take(sim, registry).write(path);
+
+  size_t n_laps = laps.size();
+  sim->run();
+  Laps expected(laps.begin() + n_laps, laps.end());
+  ASSERT_EQ(expected.size(), 11);
+
+  auto restored = simcpp::Snapshot::read(path).restore(registry);
+  ASSERT_EQ(restored->get_now(), 3.2);
+  restored->run();
+  ASSERT_EQ(restored_laps, expected);
+  ASSERT_EQ(restored->get_now(), sim->get_now());
+}
+
+TEST(SnapshotTest, Unsupported) {
+  simcpp::SnapshotRegistry registry;
+  auto sim = simcpp::Simulation::create();
+  Laps laps;
+  auto lapper = sim->start_process<Lapper>(&laps, 1);
+  ASSERT_THROW(simcpp::Snapshot::take(sim, registry), std::invalid_argument);
+
+  sim = simcpp::Simulation::create();
+  sim->timeout(1.0)->add_handler([](simcpp::EventPtr) {});
+  ASSERT_THROW(simcpp::Snapshot::take(sim, registry), std::invalid_argument);
+}
+
+/// Client of a counter, which leaves if it waits too long.
+class Client : public simcpp::Process {
+public:
+  explicit Client(simcpp::SimulationPtr sim,
+                  simcpp::Resource *counter = nullptr, int *n_served = nullptr)
+      : Process(sim), counter(counter), n_served(n_served) {}
+
+  bool Run() override {
+    auto sim = this->sim.lock();
+
+    PT_BEGIN();
+    request = counter->request();
+    timeout = sim->timeout(3.0);
+    PROC_WAIT_FOR(sim->any_of({request, timeout}));
+    if (!request->is_granted()) {
+      request->abort();
+      PT_EXIT();
+    }
+    timeout->abort();
+    PROC_WAIT_FOR(sim->timeout(2.0));
+    ++*n_served;
+    counter->release(request);
+    PT_END();
+  }
+
+  void save(simcpp::Archive &archive) const override {
+    Process::save(archive);
+    archive.save(request);
+    archive.save(timeout);
+  }
+
+  void load(simcpp::Archive &archive) override {
+    Process::load(archive);
+    archive.load(request);
+    archive.load(timeout);
+  }
+
+private:
+  simcpp::Resource *counter;
+  int *n_served;
+  simcpp::RequestPtr request = nullptr;
+  simcpp::EventPtr timeout = nullptr;
+};
+
+TEST(SnapshotTest, Fork) {
+  Laps laps;
+  auto sim = simcpp::Simulation::create();
+  sim->start_process<Lapper>(&laps, 1);
+  sim->start_process<Lapper>(&laps, 2);
+  sim->run_until(3.2);
+
+  Laps forked_laps;
+  simcpp::SnapshotRegistry registry;
+  registry.add<Lapper>("Lapper", [&](simcpp::SimulationPtr sim) {
+    return sim->event<Lapper>(&forked_laps, 0);
+  });
+  auto fork = sim->fork(registry);
+
+  size_t n_laps = laps.size();
+  sim->run();
+  fork->run();
+  ASSERT_EQ(forked_laps, Laps(laps.begin() + n_laps, laps.end()));
+}
+
+TEST(SnapshotTest, ForkScenarios) {
+  auto sim = simcpp::Simulation::create();
+  simcpp::Resource counter(sim, 1);
+  int n_served = 0;
+  for (int i = 0; i < 40; ++i) {
+    sim->start_process_delayed<Client>(i, &counter, &n_served);
+  }
+  sim->run_until(10.5);
+
+  // One branch continues unchanged, the other adds a counter.
+  class Branch {
+  public:
+    simcpp::SimulationPtr sim = nullptr;
+    std::unique_ptr<simcpp::Resource> counter = nullptr;
+    int n_served = 0;
+  };
+  std::vector<Branch> branches(2);
+  for (auto &branch : branches) {
+    branch.sim = simcpp::Simulation::create();
+    branch.counter.reset(new simcpp::Resource(branch.sim, 1));
+    simcpp::SnapshotRegistry registry;
+    registry.add<Client>("Client", [&branch](simcpp::SimulationPtr sim) {
+      return sim->event<Client>(branch.counter.get(), &branch.n_served);
+    });
+    registry.add<simcpp::Request>("simcpp::Request");
+    sim->fork(
+        branch.sim, registry,
+        [&](simcpp::Archive &archive) {
+          archive.save(n_served);
+          counter.save(archive);
+        },
+        [&](simcpp::Archive &archive) {
+          archive.load(branch.n_served);
+          branch.counter->load(archive);
+        });
+  }
+  branches[1].counter->set_capacity(2);
+
+  std::vector<std::thread> threads;
+  for (auto &branch : branches) {
+    threads.emplace_back([&branch]() { branch.sim->run(); });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  sim->run();
+
+  ASSERT_EQ(branches[0].n_served, n_served);
+  ASSERT_GT(branches[1].n_served, n_served);
+}
+
+std::vector<std::vector<std::pair<double, double>>>
+run_time_warp_ring(size_t n, size_t gvt_interval, simcpp::simtime window) {
+  simcpp::TimeWarpSimulation tsim(n, simcpp::SimulationOptions(), gvt_interval,
+                                  window);
+  std::vector<std::unique_ptr<Station<simcpp::TimeWarpProcess>>> stations;
+  for (size_t id = 0; id < n; ++id) {
+    auto &lp = tsim.get_process(id);
+    stations.emplace_back(
+        new Station<simcpp::TimeWarpProcess>(lp, (id + 1) % n));
+    auto station = stations.back().get();
+    lp.on_checkpoint(
+        [station](simcpp::Archive &archive) { station->save(archive); },
+        [station](simcpp::Archive &archive) { station->load(archive); });
+  }
+  for (size_t id = 0; id < n; ++id) {
+    for (int customer = 0; customer < 10; ++customer) {
+      stations[id]->arrive(id * 100 + customer);
+    }
+  }
+
+  tsim.run_until(200);
+  EXPECT_GE(tsim.get_gvt(), 200);
+
+  std::vector<std::vector<std::pair<double, double>>> departures;
+  for (auto &station : stations) {
+    departures.push_back(station->departures);
+  }
+  return departures;
+}
+
+TEST(TimeWarpTest, SameAsConservative) {
+  auto expected = run_ring(4);
+
+  auto infinity = std::numeric_limits<simcpp::simtime>::infinity();
+  ASSERT_EQ(run_time_warp_ring(4, 1024, infinity), expected);
+  ASSERT_EQ(run_time_warp_ring(4, 16, 5.0), expected);
+}
+
+TEST(TimeWarpTest, ZeroDelay) {
+  simcpp::TimeWarpSimulation tsim(1);
+
+  ASSERT_THROW(tsim.get_process(0).send(0, 0.0), std::invalid_argument);
+}
@@ -0,0 +1,516 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "timewarp.h"
+
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+
+#include "queue.h"
+
+namespace simcpp {
+
+namespace {
+
+const simtime infinity = std::numeric_limits<simtime>::infinity();
+
+/// Idle iterations after which an idle logical process requests the GVT.
+const size_t idle_gvt_interval = 64;
+
+} // namespace
+
+/* TimeWarpStats */
+
+void TimeWarpStats::merge(const TimeWarpStats &other) {
+  n_processed += other.n_processed;
+  n_rolled_back += other.n_rolled_back;
+  n_rollbacks += other.n_rollbacks;
+  n_anti_messages += other.n_anti_messages;
+  n_gvt_rounds = std::max(n_gvt_rounds, other.n_gvt_rounds);
+  max_checkpoints = std::max(max_checkpoints, other.max_checkpoints);
+}
+
+double TimeWarpStats::get_efficiency() const {
+  if (n_processed == 0) {
+    return 1.0;
+  }
+
+  return static_cast<double>(n_processed - n_rolled_back) /
+         static_cast<double>(n_processed);
+}
+
+/* TimeWarpProcess */
+
+TimeWarpProcess::TimeWarpProcess(size_t id, TimeWarpSimulation *owner,
+                                 const SimulationOptions &options)
+    : id(id), owner(owner), sim(Simulation::create(options)) {}
+
+TimeWarpProcess::~TimeWarpProcess() {}
+
+size_t TimeWarpProcess::get_id() const { return id; }
+
+SimulationPtr TimeWarpProcess::get_simulation() const { return sim; }
+
+void TimeWarpProcess::on_message(Receiver receiver) {
+  this->receiver = std::move(receiver);
+}
+
+void TimeWarpProcess::on_checkpoint(StateHandler save, StateHandler load) {
+  save_state = std::move(save);
+  load_state = std::move(load);
+}
+
+void TimeWarpProcess::send(size_t target, simtime delay,
+                           int64_t kind /* = 0 */, double value /* = 0.0 */,
+                           std::shared_ptr<void> data /* = nullptr */) {
+  if (!(delay > 0)) {
+    throw std::invalid_argument("message delay must be positive");
+  }
+
+  Message message;
+  message.time = sim->get_now() + delay;
+  message.source = id;
+  message.sequence = next_sequence++;
+  message.kind = kind;
+  message.value = value;
+  message.data = std::move(data);
+
+  SentMessage entry;
+  entry.target = target;
+  entry.message = message;
+  sent.push_back(std::move(entry));
+
+  owner->processes[target]->post(std::move(message));
+}
+
+const TimeWarpStats &TimeWarpProcess::get_stats() const { return stats; }
+
+bool TimeWarpProcess::Key::operator<(const Key &other) const {
+  if (time != other.time) {
+    return time < other.time;
+  }
+
+  if (kind != other.kind) {
+    return kind < other.kind;
+  }
+
+  if (first != other.first) {
+    return first < other.first;
+  }
+
+  return second < other.second;
+}
+
+bool TimeWarpProcess::Before::operator()(const Message &a,
+                                         const Message &b) const {
+  return key(a) < key(b);
+}
+
+void TimeWarpProcess::record_event(Event &event) {
+  Record record;
+  record.kind = Record::Kind::Event;
+  record.event = event.shared_from_this();
+  event.save(record.archive);
+  records.push_back(std::move(record));
+}
+
+void TimeWarpProcess::record_push(simtime time, size_t id) {
+  Record record;
+  record.kind = Record::Kind::Push;
+  record.time = time;
+  record.id = id;
+  records.push_back(std::move(record));
+}
+
+void TimeWarpProcess::record_pop(simtime time, size_t id, EventPtr event) {
+  Record record;
+  record.kind = Record::Kind::Pop;
+  record.time = time;
+  record.id = id;
+  record.event = std::move(event);
+  records.push_back(std::move(record));
+}
+
+TimeWarpProcess::Key TimeWarpProcess::key(const Message &message) {
+  Key key;
+  key.time = message.time;
+  key.kind = 0;
+  key.first = message.source;
+  key.second = message.sequence;
+  return key;
+}
+
+void TimeWarpProcess::post(Message message) {
+  std::lock_guard<std::mutex> lock(mailbox_mutex);
+  mailbox.push_back(std::move(message));
+}
+
+void TimeWarpProcess::receive() {
+  std::vector<Message> messages;
+  {
+    std::lock_guard<std::mutex> lock(mailbox_mutex);
+    messages.swap(mailbox);
+  }
+
+  for (auto &message : messages) {
+    auto key = this->key(message);
+
+    if (message.anti) {
+      // A message is always received before its anti-message. If it was
+      // already delivered, undo that first.
+      auto it = inbox.find(message);
+      if (it == inbox.end()) {
+        rollback(key);
+        it = inbox.find(message);
+      }
+      if (it != inbox.end()) {
+        inbox.erase(it);
+      }
+      continue;
+    }
+
+    // A straggler from the past of this logical process.
+    if (!checkpoints.empty() && key < checkpoints.back().key) {
+      rollback(key);
+    }
+    inbox.insert(std::move(message));
+  }
+}
+
+bool TimeWarpProcess::next_key(Key &key) {
+  bool found = false;
+
+  if (!inbox.empty()) {
+    key = this->key(*inbox.begin());
+    found = true;
+  }
+
+  if (!sim->queued_events->empty()) {
+    auto &top = sim->queued_events->top();
+    Key event_key;
+    event_key.time = top.time;
+    event_key.kind = 1;
+    event_key.first = top.id;
+    event_key.second = 0;
+    if (!found || event_key < key) {
+      key = event_key;
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+void TimeWarpProcess::process(const Key &key) {
+  Checkpoint checkpoint;
+  checkpoint.key = key;
+  checkpoint.now = sim->now;
+  checkpoint.next_id = sim->next_id;
+  checkpoint.next_sequence = next_sequence;
+  checkpoint.n_records = records.size();
+  checkpoint.n_sent = sent.size();
+  checkpoint.n_delivered = delivered.size();
+  if (save_state) {
+    save_state(checkpoint.state);
+  }
+  checkpoints.push_back(std::move(checkpoint));
+  stats.max_checkpoints =
+      std::max<uint64_t>(stats.max_checkpoints, checkpoints.size());
+  ++stats.n_processed;
+
+  if (key.kind == 0) {
+    Message message = *inbox.begin();
+    inbox.erase(inbox.begin());
+    sim->now = message.time;
+    delivered.push_back(message);
+    if (receiver) {
+      receiver(message);
+    }
+  } else {
+    sim->step();
+  }
+}
+
+void TimeWarpProcess::rollback(const Key &key) {
+  size_t first = checkpoints.size();
+  while (first > 0 && !(checkpoints[first - 1].key < key)) {
+    --first;
+  }
+  if (first == checkpoints.size()) {
+    return;
+  }
+
+  // Restoring must not be journaled itself.
+  Journal::set_active(nullptr);
+
+  auto &checkpoint = checkpoints[first];
+
+  std::unordered_set<size_t> pushed;
+  for (size_t i = records.size(); i > checkpoint.n_records; --i) {
+    auto &record = records[i - 1];
+    switch (record.kind) {
+    case Record::Kind::Event:
+      record.archive.rewind();
+      record.event->load(record.archive);
+      break;
+    case Record::Kind::Push:
+      pushed.insert(record.id);
+      break;
+    case Record::Kind::Pop:
+      record.event->queued = true;
+      sim->queued_events->push(
+          QueuedEvent(record.time, record.id, record.event));
+      break;
+    }
+  }
+  if (!pushed.empty()) {
+    sim->queued_events->remove_if([&pushed](const QueuedEvent &entry) {
+      if (pushed.count(entry.id) == 0) {
+        return false;
+      }
+      entry.event->queued = false;
+      return true;
+    });
+  }
+  records.resize(checkpoint.n_records);
+
+  for (size_t i = checkpoint.n_delivered; i < delivered.size(); ++i) {
+    inbox.insert(std::move(delivered[i]));
+  }
+  delivered.resize(checkpoint.n_delivered);
+
+  for (size_t i = checkpoint.n_sent; i < sent.size(); ++i) {
+    Message anti = sent[i].message;
+    anti.anti = true;
+    anti.data = nullptr;
+    owner->processes[sent[i].target]->post(std::move(anti));
+    ++stats.n_anti_messages;
+  }
+  sent.resize(checkpoint.n_sent);
+
+  sim->now = checkpoint.now;
+  sim->next_id = checkpoint.next_id;
+  next_sequence = checkpoint.next_sequence;
+  if (load_state) {
+    checkpoint.state.rewind();
+    load_state(checkpoint.state);
+  }
+
+  stats.n_rolled_back += checkpoints.size() - first;
+  ++stats.n_rollbacks;
+  checkpoints.resize(first);
+
+  Journal::set_active(this);
+}
+
+void TimeWarpProcess::fossil_collect(simtime gvt) {
+  size_t n_committed = 0;
+  while (n_committed < checkpoints.size() &&
+         checkpoints[n_committed].key.time < gvt) {
+    ++n_committed;
+  }
+  if (n_committed == 0) {
+    return;
+  }
+
+  size_t n_records = records.size();
+  size_t n_sent = sent.size();
+  size_t n_delivered = delivered.size();
+  if (n_committed < checkpoints.size()) {
+    auto &oldest = checkpoints[n_committed];
+    n_records = oldest.n_records;
+    n_sent = oldest.n_sent;
+    n_delivered = oldest.n_delivered;
+  }
+
+  records.erase(records.begin(), records.begin() + n_records);
+  sent.erase(sent.begin(), sent.begin() + n_sent);
+  delivered.erase(delivered.begin(), delivered.begin() + n_delivered);
+  checkpoints.erase(checkpoints.begin(), checkpoints.begin() + n_committed);
+
+  for (auto &checkpoint : checkpoints) {
+    checkpoint.n_records -= n_records;
+    checkpoint.n_sent -= n_sent;
+    checkpoint.n_delivered -= n_delivered;
+  }
+}
+
+simtime TimeWarpProcess::local_minimum() {
+  Key key;
+  return next_key(key) ? key.time : infinity;
+}
+
+void TimeWarpProcess::run_until(simtime end) {
+  Journal::set_active(this);
+  size_t n_since_gvt = 0;
+  size_t n_idle = 0;
+
+  while (true) {
+    receive();
+
+    if (owner->gvt_requested.load(std::memory_order_acquire)) {
+      if (!owner->synchronize(*this)) {
+        break;
+      }
+      n_since_gvt = 0;
+      n_idle = 0;
+      if (owner->gvt >= end) {
+        break;
+      }
+      continue;
+    }
+
+    Key key;
+    if (next_key(key) && key.time < end &&
+        key.time < owner->gvt + owner->window) {
+      process(key);
+      ++n_since_gvt;
+      if (n_since_gvt >= owner->gvt_interval) {
+        owner->gvt_requested.store(true, std::memory_order_release);
+      }
+    } else {
+      // Wait for messages or for the GVT to move the optimism window.
+      ++n_idle;
+      if (n_idle >= idle_gvt_interval) {
+        owner->gvt_requested.store(true, std::memory_order_release);
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  Journal::set_active(nullptr);
+  sim->run_until(end);
+}
+
+/* TimeWarpSimulation */
+
+TimeWarpSimulation::Barrier::Barrier(size_t n) : n(n) {}
+
+bool TimeWarpSimulation::Barrier::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (failed) {
+    return false;
+  }
+
+  uint64_t generation = this->generation;
+  ++n_waiting;
+  if (n_waiting == n) {
+    n_waiting = 0;
+    ++this->generation;
+    condition.notify_all();
+    return true;
+  }
+
+  condition.wait(lock, [this, generation]() {
+    return failed || this->generation != generation;
+  });
+  return !failed;
+}
+
+void TimeWarpSimulation::Barrier::reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  n_waiting = 0;
+  failed = false;
+}
+
+void TimeWarpSimulation::Barrier::fail() {
+  std::lock_guard<std::mutex> lock(mutex);
+  failed = true;
+  condition.notify_all();
+}
+
+TimeWarpSimulation::TimeWarpSimulation(
+    size_t n_processes,
+    const SimulationOptions &options /* = SimulationOptions() */,
+    size_t gvt_interval /* = 1024 */,
+    simtime window /* = std::numeric_limits<simtime>::infinity() */)
+    : gvt_interval(gvt_interval), window(window), gvt_requested(false),
+      barrier(n_processes), local_minimums(n_processes, 0.0) {
+  for (size_t id = 0; id < n_processes; ++id) {
+    processes.emplace_back(new TimeWarpProcess(id, this, options));
+  }
+}
+
+TimeWarpProcess &TimeWarpSimulation::get_process(size_t index) {
+  return *processes[index];
+}
+
+size_t TimeWarpSimulation::get_n_processes() const { return processes.size(); }
+
+void TimeWarpSimulation::run_until(simtime end) {
+  std::exception_ptr error = nullptr;
+  std::mutex error_mutex;
+  barrier.reset();
+  gvt_requested = false;
+
+  auto work = [&](size_t index) {
+    try {
+      processes[index]->run_until(end);
+    } catch (...) {
+      Journal::set_active(nullptr);
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+      barrier.fail();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t index = 1; index < processes.size(); ++index) {
+    threads.emplace_back(work, index);
+  }
+  if (!processes.empty()) {
+    work(0);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+simtime TimeWarpSimulation::get_gvt() const { return gvt; }
+
+TimeWarpStats TimeWarpSimulation::get_stats() const {
+  TimeWarpStats stats;
+  for (auto &process : processes) {
+    stats.merge(process->stats);
+  }
+  return stats;
+}
+
+bool TimeWarpSimulation::synchronize(TimeWarpProcess &process) {
+  // After the first barrier, no logical process sends messages anymore except
+  // anti-messages caused by the messages it receives now. Those are never
+  // earlier than the local minimum of the sender.
+  if (!barrier.wait()) {
+    return false;
+  }
+  process.receive();
+  local_minimums[process.id] = process.local_minimum();
+
+  if (!barrier.wait()) {
+    return false;
+  }
+  simtime gvt = *std::min_element(local_minimums.begin(), local_minimums.end());
+  if (process.id == 0) {
+    this->gvt = gvt;
+    gvt_requested = false;
+  }
+
+  if (!barrier.wait()) {
+    return false;
+  }
+  process.fossil_collect(gvt);
+  ++process.stats.n_gvt_rounds;
+  return true;
+}
+
+} // namespace simcpp
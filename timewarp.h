@@ -0,0 +1,315 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_TIMEWARP_H_
+#define SIMCPP_TIMEWARP_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "archive.h"
+#include "pdes.h"
+#include "simcpp.h"
+
+namespace simcpp {
+
+class TimeWarpSimulation;
+
+/// Statistics of optimistic logical processes.
+class TimeWarpStats {
+public:
+  /// Number of processed events and delivered messages, including those which
+  /// were rolled back.
+  uint64_t n_processed = 0;
+
+  /// Number of processed events and delivered messages which were rolled back.
+  uint64_t n_rolled_back = 0;
+
+  /// Number of rollbacks.
+  uint64_t n_rollbacks = 0;
+
+  /// Number of anti-messages sent.
+  uint64_t n_anti_messages = 0;
+
+  /// Number of computations of the global virtual time.
+  uint64_t n_gvt_rounds = 0;
+
+  /// Largest number of checkpoints held at once.
+  uint64_t max_checkpoints = 0;
+
+  /**
+   * Add the statistics of another logical process.
+   *
+   * @param other Other statistics.
+   */
+  void merge(const TimeWarpStats &other);
+
+  /// @return Fraction of processed events and messages which were not rolled
+  /// back.
+  double get_efficiency() const;
+};
+
+/**
+ * Optimistic logical process of a Time Warp simulation.
+ *
+ * Owns a simulation which runs speculatively on its own thread. Before each
+ * event or message, a checkpoint is taken: The current time and counters of
+ * the simulation and the state of the model outside of events are saved by
+ * copy. Changes of the event queue, events and processes are journaled
+ * incrementally (see Journal). When a message from the past arrives, the
+ * logical process rolls back to the checkpoint before it and cancels the
+ * messages it sent since with anti-messages.
+ *
+ * Processes and custom events must save and load all state which changes
+ * while they are pending, see Event::save. Coroutine tasks cannot be rolled
+ * back. Side effects outside of the simulation, such as output, may happen
+ * more than once.
+ */
+class TimeWarpProcess : private Journal {
+public:
+  using Receiver = std::function<void(const Message &)>;
+  using StateHandler = std::function<void(Archive &)>;
+
+  /**
+   * Construct a logical process. Use TimeWarpSimulation instead.
+   *
+   * @param id Index of the logical process.
+   * @param owner Simulation the logical process belongs to.
+   * @param options Options of the simulation.
+   */
+  TimeWarpProcess(size_t id, TimeWarpSimulation *owner,
+                  const SimulationOptions &options);
+
+  ~TimeWarpProcess();
+
+  /// @return Index of the logical process.
+  size_t get_id() const;
+
+  /// @return Simulation instance of the logical process.
+  SimulationPtr get_simulation() const;
+
+  /**
+   * Set the function which is called when a message is delivered.
+   *
+   * It is called at the time of the message, before any local event scheduled
+   * at the same time.
+   *
+   * @param receiver Function called with each delivered message.
+   */
+  void on_message(Receiver receiver);
+
+  /**
+   * Set the functions which save and restore the state of the model outside
+   * of events and processes, for example counters, queues and random number
+   * generators. The state is saved at every checkpoint.
+   *
+   * @param save Function which saves the state.
+   * @param load Function which restores the state in the same order.
+   */
+  void on_checkpoint(StateHandler save, StateHandler load);
+
+  /**
+   * Send a message to another logical process.
+   *
+   * @param target Index of the receiving logical process.
+   * @param delay Delay after which the message is delivered. Must be positive.
+   * @param kind Kind of the message.
+   * @param value Value carried by the message.
+   * @param data Data carried by the message.
+   */
+  void send(size_t target, simtime delay, int64_t kind = 0, double value = 0.0,
+            std::shared_ptr<void> data = nullptr);
+
+  /// @return Statistics of the logical process.
+  const TimeWarpStats &get_stats() const;
+
+private:
+  friend class TimeWarpSimulation;
+
+  /// Position of an event or message in the order of processing.
+  class Key {
+  public:
+    simtime time;
+    /// 0 for messages, 1 for events, so messages come first.
+    int kind;
+    size_t first;
+    uint64_t second;
+
+    bool operator<(const Key &other) const;
+  };
+
+  class Before {
+  public:
+    bool operator()(const Message &a, const Message &b) const;
+  };
+
+  class Record {
+  public:
+    enum class Kind { Event, Push, Pop };
+
+    Kind kind;
+    simtime time = 0.0;
+    size_t id = 0;
+    EventPtr event = nullptr;
+    Archive archive = {};
+  };
+
+  class Checkpoint {
+  public:
+    Key key;
+    simtime now;
+    size_t next_id;
+    uint64_t next_sequence;
+    size_t n_records;
+    size_t n_sent;
+    size_t n_delivered;
+    Archive state = {};
+  };
+
+  class SentMessage {
+  public:
+    size_t target;
+    Message message;
+  };
+
+  size_t id;
+  TimeWarpSimulation *owner;
+  SimulationPtr sim;
+  Receiver receiver = nullptr;
+  StateHandler save_state = nullptr;
+  StateHandler load_state = nullptr;
+  uint64_t next_sequence = 0;
+  TimeWarpStats stats = {};
+
+  std::mutex mailbox_mutex = {};
+  std::vector<Message> mailbox = {};
+
+  /// Received messages which are not delivered yet.
+  std::set<Message, Before> inbox = {};
+  std::vector<Checkpoint> checkpoints = {};
+  std::vector<Record> records = {};
+  std::vector<SentMessage> sent = {};
+  std::vector<Message> delivered = {};
+
+  void record_event(Event &event) override;
+  void record_push(simtime time, size_t id) override;
+  void record_pop(simtime time, size_t id, EventPtr event) override;
+
+  static Key key(const Message &message);
+  void post(Message message);
+  void receive();
+  bool next_key(Key &key);
+  void process(const Key &key);
+  void rollback(const Key &key);
+  void fossil_collect(simtime gvt);
+  simtime local_minimum();
+  void run_until(simtime end);
+};
+
+/**
+ * Optimistic parallel discrete-event simulation (Time Warp, D. Jefferson).
+ *
+ * The model is partitioned into logical processes, each with its own
+ * simulation running speculatively on its own thread. Unlike the
+ * conservative ParallelSimulation, no lookahead is needed, so models with
+ * small message delays can still run in parallel.
+ *
+ * The global virtual time (GVT), the smallest time to which any logical
+ * process can still roll back, is computed periodically while all logical
+ * processes wait at a barrier. Checkpoints, journal entries and messages
+ * older than the GVT are discarded (fossil collection), which bounds memory.
+ *
+ * Messages are delivered before local events at the same time, in the order of
+ * the sending logical process and then the order of sending. Therefore, the
+ * committed results are the same as those of a ParallelSimulation of the same
+ * model and do not depend on the scheduling of threads.
+ */
+class TimeWarpSimulation {
+public:
+  /**
+   * Construct an optimistic parallel simulation.
+   *
+   * @param n_processes Number of logical processes.
+   * @param options Options of the simulation of each logical process.
+   * @param gvt_interval Number of events and messages a logical process
+   * processes before it requests a computation of the GVT.
+   * @param window Optimism window. Logical processes do not process events
+   * and messages later than the GVT plus the window, which limits rollbacks
+   * when logical processes progress at different speeds.
+   */
+  explicit TimeWarpSimulation(
+      size_t n_processes,
+      const SimulationOptions &options = SimulationOptions(),
+      size_t gvt_interval = 1024,
+      simtime window = std::numeric_limits<simtime>::infinity());
+
+  /**
+   * @param index Index of the logical process.
+   * @return Logical process.
+   */
+  TimeWarpProcess &get_process(size_t index);
+
+  /// @return Number of logical processes.
+  size_t get_n_processes() const;
+
+  /**
+   * Run all logical processes until a time, each on its own thread. Blocks
+   * until the GVT reaches the time.
+   *
+   * Events and messages at exactly the time are not processed yet.
+   *
+   * @param end Time to run until.
+   */
+  void run_until(simtime end);
+
+  /// @return Last computed global virtual time.
+  simtime get_gvt() const;
+
+  /// @return Statistics of all logical processes.
+  TimeWarpStats get_stats() const;
+
+private:
+  friend class TimeWarpProcess;
+
+  /// Reusable barrier, which is broken if a logical process fails.
+  class Barrier {
+  public:
+    explicit Barrier(size_t n);
+
+    /// @return Whether the barrier was passed and not broken.
+    bool wait();
+
+    void reset();
+    void fail();
+
+  private:
+    std::mutex mutex = {};
+    std::condition_variable condition = {};
+    size_t n;
+    size_t n_waiting = 0;
+    uint64_t generation = 0;
+    bool failed = false;
+  };
+
+  std::vector<std::unique_ptr<TimeWarpProcess>> processes = {};
+  size_t gvt_interval;
+  simtime window;
+  simtime gvt = 0.0;
+  std::atomic<bool> gvt_requested;
+  Barrier barrier;
+  std::vector<simtime> local_minimums = {};
+
+  bool synchronize(TimeWarpProcess &process);
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_TIMEWARP_H_
@@ -0,0 +1,471 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#include "trace.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+namespace simcpp {
+
+namespace {
+
+thread_local TraceRecorder *active_recorder = nullptr;
+
+const char magic[8] = {'S', 'I', 'M', 'C', 'P', 'P', 'T', 'R'};
+const uint32_t version = 1;
+
+enum class BlockType : uint32_t { Types, Records };
+enum class Encoding : uint32_t { Plain, Packed };
+
+class Header {
+public:
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+class BlockHeader {
+public:
+  BlockType type;
+  Encoding encoding;
+  /// Number of types or records.
+  uint64_t n;
+  /// Size of the block after the header in bytes.
+  uint64_t size;
+};
+
+/**
+ * @param type Type.
+ * @return Readable name of the type.
+ */
+std::string type_name(const std::type_info &type) {
+#if defined(__GNUG__)
+  int status = 0;
+  char *name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+  if (status == 0 && name != nullptr) {
+    std::string result(name);
+    std::free(name);
+    return result;
+  }
+#endif
+  return type.name();
+}
+
+template <typename T>
+void append(std::vector<unsigned char> &buffer, const T &value) {
+  auto bytes = reinterpret_cast<const unsigned char *>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T> unsigned char *put(unsigned char *out, const T &value) {
+  std::memcpy(out, &value, sizeof(T));
+  return out + sizeof(T);
+}
+
+/// Maximum size of a varint in bytes.
+const size_t max_varint_size = 10;
+
+unsigned char *put_varint(unsigned char *out, uint64_t value) {
+  while (value >= 0x80) {
+    *out++ = static_cast<unsigned char>(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = static_cast<unsigned char>(value);
+  return out;
+}
+
+uint64_t time_bits(double time) {
+  uint64_t bits;
+  std::memcpy(&bits, &time, sizeof(bits));
+  return bits;
+}
+
+/// Reverse the bytes, so the low mantissa bits, which are mostly zero in the
+/// XOR of close times, become the high bits, which varints omit.
+uint64_t reverse_bytes(uint64_t value) {
+  uint64_t result = 0;
+  for (int i = 0; i < 8; ++i) {
+    result = (result << 8) | (value & 0xff);
+    value >>= 8;
+  }
+  return result;
+}
+
+uint64_t zigzag(uint64_t delta) {
+  return (delta << 1) ^ (0 - (delta >> 63));
+}
+
+uint64_t unzigzag(uint64_t value) { return (value >> 1) ^ (0 - (value & 1)); }
+
+/// Bounds-checked reader of the bytes of a block.
+class Cursor {
+public:
+  Cursor(const unsigned char *data, size_t size)
+      : data(data), end(data + size) {}
+
+  template <typename T> T read() {
+    T value;
+    require(sizeof(T));
+    std::memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return value;
+  }
+
+  uint64_t read_varint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      require(1);
+      unsigned char byte = *data++;
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (byte < 0x80) {
+        return value;
+      }
+    }
+    throw std::runtime_error("invalid varint in trace");
+  }
+
+  Cursor sub(size_t size) {
+    require(size);
+    Cursor cursor(data, size);
+    data += size;
+    return cursor;
+  }
+
+  const unsigned char *take(size_t size) {
+    require(size);
+    auto result = data;
+    data += size;
+    return result;
+  }
+
+private:
+  const unsigned char *data;
+  const unsigned char *end;
+
+  void require(size_t size) const {
+    if (static_cast<size_t>(end - data) < size) {
+      throw std::runtime_error("truncated trace block");
+    }
+  }
+};
+
+} // namespace
+
+/* TraceRecorder */
+
+TraceRecorder::TraceRecorder(
+    const std::string &path,
+    const TraceOptions &options /* = TraceOptions() */)
+    : options(options), stream(path, std::ios::binary),
+      chunks(options.n_chunks), head(0), tail(0), stopping(false) {
+  if (!stream) {
+    throw std::runtime_error("cannot open trace file " + path);
+  }
+
+  Header header;
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.reserved = 0;
+  stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  for (auto &chunk : chunks) {
+    chunk.records.resize(options.chunk_size);
+  }
+  position = chunks[0].records.data();
+  end = position + options.chunk_size;
+
+  writer = std::thread([this] { write(); });
+}
+
+TraceRecorder::~TraceRecorder() {
+  flush();
+  stopping.store(true, std::memory_order_release);
+  writer.join();
+}
+
+TraceRecorder *TraceRecorder::get_active() { return active_recorder; }
+
+void TraceRecorder::set_active(TraceRecorder *recorder) {
+  active_recorder = recorder;
+}
+
+void TraceRecorder::flush() {
+  auto &chunk = chunks[tail.load(std::memory_order_relaxed) % chunks.size()];
+  if (position != chunk.records.data() || !chunk.types.empty()) {
+    next_chunk();
+  }
+
+  auto published = tail.load(std::memory_order_relaxed);
+  while (head.load(std::memory_order_acquire) != published) {
+    std::this_thread::yield();
+  }
+}
+
+uint64_t TraceRecorder::get_n_records() const {
+  auto &chunk = chunks[tail.load(std::memory_order_relaxed) % chunks.size()];
+  return n_published + (position - chunk.records.data());
+}
+
+void TraceRecorder::next_chunk() {
+  publish();
+
+  auto next = tail.load(std::memory_order_relaxed);
+  while (next - head.load(std::memory_order_acquire) >= chunks.size()) {
+    std::this_thread::yield();
+  }
+
+  auto &chunk = chunks[next % chunks.size()];
+  chunk.types.clear();
+  position = chunk.records.data();
+  end = position + options.chunk_size;
+}
+
+void TraceRecorder::publish() {
+  auto current = tail.load(std::memory_order_relaxed);
+  auto &chunk = chunks[current % chunks.size()];
+  chunk.size = position - chunk.records.data();
+  n_published += chunk.size;
+  tail.store(current + 1, std::memory_order_release);
+}
+
+uint32_t TraceRecorder::add_type(const std::type_info &type) {
+  auto it = types.find(&type);
+  if (it == types.end()) {
+    // Equal types may have distinct type_info objects across shared
+    // libraries, which then get distinct indices but equal names.
+    auto index = static_cast<uint32_t>(types.size());
+    it = types.emplace(&type, index).first;
+    chunks[tail.load(std::memory_order_relaxed) % chunks.size()]
+        .types.push_back(type_name(type));
+  }
+
+  auto &slot = type_cache[(reinterpret_cast<uintptr_t>(&type) >> 4) %
+                          type_cache_size];
+  slot.type = &type;
+  slot.index = it->second;
+  return slot.index;
+}
+
+void TraceRecorder::write() {
+  while (true) {
+    auto current = head.load(std::memory_order_relaxed);
+    if (current == tail.load(std::memory_order_acquire)) {
+      if (stopping.load(std::memory_order_acquire)) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      continue;
+    }
+
+    write_chunk(chunks[current % chunks.size()]);
+    if (current + 1 == tail.load(std::memory_order_acquire)) {
+      stream.flush();
+    }
+    head.store(current + 1, std::memory_order_release);
+  }
+}
+
+void TraceRecorder::write_chunk(const Chunk &chunk) {
+  if (!chunk.types.empty()) {
+    std::vector<unsigned char> names;
+    for (auto &name : chunk.types) {
+      append(names, static_cast<uint32_t>(name.size()));
+      names.insert(names.end(), name.begin(), name.end());
+    }
+
+    BlockHeader header;
+    header.type = BlockType::Types;
+    header.encoding = Encoding::Plain;
+    header.n = chunk.types.size();
+    header.size = names.size();
+    stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char *>(names.data()), names.size());
+  }
+
+  if (chunk.size == 0) {
+    return;
+  }
+
+  auto records = chunk.records.data();
+  size_t n = chunk.size;
+  // Encoded into buffers of the largest possible size, which are reused.
+  for (auto &column : columns) {
+    column.resize(n * max_varint_size);
+  }
+  unsigned char *ends[4];
+  for (int i = 0; i < 4; ++i) {
+    ends[i] = columns[i].data();
+  }
+
+  if (options.compress) {
+    uint64_t time = 0;
+    uint64_t event = 0;
+    for (size_t i = 0; i < n; ++i) {
+      auto bits = time_bits(records[i].time);
+      ends[0] = put_varint(ends[0], reverse_bytes(bits ^ time));
+      time = bits;
+      ends[1] = put_varint(ends[1], zigzag(records[i].event - event));
+      event = records[i].event;
+      ends[2] = put_varint(ends[2], records[i].type);
+    }
+    // Four kinds per byte.
+    for (size_t i = 0; i < n; i += 4) {
+      unsigned kinds = 0;
+      for (size_t j = i; j < n && j < i + 4; ++j) {
+        kinds |= static_cast<unsigned>(records[j].kind) << (2 * (j - i));
+      }
+      *ends[3]++ = static_cast<unsigned char>(kinds);
+    }
+  } else {
+    for (size_t i = 0; i < n; ++i) {
+      ends[0] = put(ends[0], records[i].time);
+      ends[1] = put(ends[1], records[i].event);
+      ends[2] = put(ends[2], records[i].type);
+      ends[3] = put(ends[3], records[i].kind);
+    }
+  }
+
+  uint64_t sizes[4];
+  for (int i = 0; i < 4; ++i) {
+    sizes[i] = ends[i] - columns[i].data();
+  }
+
+  BlockHeader header;
+  header.type = BlockType::Records;
+  header.encoding = options.compress ? Encoding::Packed : Encoding::Plain;
+  header.n = n;
+  header.size =
+      3 * sizeof(uint64_t) + sizes[0] + sizes[1] + sizes[2] + sizes[3];
+  stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  // The sizes of the first three columns, so readers can skip columns.
+  stream.write(reinterpret_cast<const char *>(sizes), 3 * sizeof(uint64_t));
+  for (int i = 0; i < 4; ++i) {
+    stream.write(reinterpret_cast<const char *>(columns[i].data()), sizes[i]);
+  }
+}
+
+/* TraceReader */
+
+TraceReader::TraceReader(const std::string &path)
+    : stream(path, std::ios::binary) {
+  Header header;
+  if (!stream.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, magic, sizeof(magic)) != 0) {
+    throw std::runtime_error("not a trace file: " + path);
+  }
+  if (header.version != version) {
+    throw std::runtime_error("unsupported trace version");
+  }
+}
+
+bool TraceReader::next(TraceRecord &record) {
+  while (position == records.size()) {
+    if (!read_block()) {
+      return false;
+    }
+  }
+
+  record = records[position];
+  ++position;
+  return true;
+}
+
+const std::vector<std::string> &TraceReader::get_types() const {
+  return types;
+}
+
+const char *TraceReader::get_kind_name(TraceRecord::Kind kind) {
+  switch (kind) {
+  case TraceRecord::Kind::Trigger:
+    return "trigger";
+  case TraceRecord::Kind::Process:
+    return "process";
+  case TraceRecord::Kind::Abort:
+    return "abort";
+  case TraceRecord::Kind::Resume:
+    return "resume";
+  }
+  return "unknown";
+}
+
+bool TraceReader::read_block() {
+  BlockHeader header;
+  if (!stream.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+    if (stream.gcount() == 0) {
+      return false;
+    }
+    throw std::runtime_error("truncated trace block");
+  }
+
+  std::vector<unsigned char> data(header.size);
+  if (!stream.read(reinterpret_cast<char *>(data.data()), data.size())) {
+    throw std::runtime_error("truncated trace block");
+  }
+  Cursor cursor(data.data(), data.size());
+
+  if (header.type == BlockType::Types) {
+    for (uint64_t i = 0; i < header.n; ++i) {
+      auto size = cursor.read<uint32_t>();
+      auto name = reinterpret_cast<const char *>(cursor.take(size));
+      types.emplace_back(name, size);
+    }
+    return true;
+  }
+  if (header.type != BlockType::Records) {
+    throw std::runtime_error("unknown trace block");
+  }
+
+  // Every record takes at least one byte in each column.
+  size_t n = header.n;
+  if (n > header.size) {
+    throw std::runtime_error("invalid trace block");
+  }
+  records.resize(n);
+  position = 0;
+
+  uint64_t sizes[3];
+  for (auto &size : sizes) {
+    size = cursor.read<uint64_t>();
+  }
+  Cursor times = cursor.sub(sizes[0]);
+  Cursor events = cursor.sub(sizes[1]);
+  Cursor indices = cursor.sub(sizes[2]);
+
+  if (header.encoding == Encoding::Packed) {
+    uint64_t time = 0;
+    uint64_t event = 0;
+    auto kinds = cursor.take((n + 3) / 4);
+    for (size_t i = 0; i < n; ++i) {
+      time ^= reverse_bytes(times.read_varint());
+      std::memcpy(&records[i].time, &time, sizeof(time));
+      event += unzigzag(events.read_varint());
+      records[i].event = event;
+      records[i].type = static_cast<uint32_t>(indices.read_varint());
+      records[i].kind = static_cast<TraceRecord::Kind>(
+          (kinds[i / 4] >> (2 * (i % 4))) & 3);
+    }
+  } else {
+    for (size_t i = 0; i < n; ++i) {
+      records[i].time = times.read<double>();
+      records[i].event = events.read<uint64_t>();
+      records[i].type = indices.read<uint32_t>();
+      records[i].kind = cursor.read<TraceRecord::Kind>();
+    }
+  }
+
+  for (auto &record : records) {
+    if (record.type >= types.size()) {
+      throw std::runtime_error("unknown type in trace");
+    }
+  }
+  return true;
+}
+
+} // namespace simcpp
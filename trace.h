@@ -0,0 +1,262 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+#ifndef SIMCPP_TRACE_H_
+#define SIMCPP_TRACE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Call a method of the active trace recorder, if any.
+ *
+ * Expands to nothing unless SIMCPP_TRACE is defined. SIMCPP_TRACE must be
+ * defined for the whole program, as it changes inline code in the headers.
+ *
+ * @param hook Call of a method of TraceRecorder.
+ */
+#ifdef SIMCPP_TRACE
+#define SIMCPP_TRACE_HOOK(hook)                                                \
+  do {                                                                         \
+    if (::simcpp::TraceRecorder *active_recorder =                             \
+            ::simcpp::TraceRecorder::get_active()) {                           \
+      active_recorder->hook;                                                   \
+    }                                                                          \
+  } while (0)
+#else
+#define SIMCPP_TRACE_HOOK(hook)                                                \
+  do {                                                                         \
+  } while (0)
+#endif
+
+namespace simcpp {
+
+/// Options of a trace recorder.
+struct TraceOptions {
+  /// Number of records per chunk of the file.
+  size_t chunk_size = 16384;
+
+  /// Number of chunks buffered between the simulation and the writer thread.
+  size_t n_chunks = 16;
+
+  /// Whether to delta and varint encode the columns of a chunk.
+  bool compress = true;
+};
+
+/// Record of a trace.
+class TraceRecord {
+public:
+  enum class Kind : uint8_t { Trigger, Process, Abort, Resume };
+
+  /// Simulation time.
+  double time;
+
+  /// Address of the event, which identifies it as long as it exists.
+  uint64_t event;
+
+  /// Index of the dynamic type of the event in the types of the trace.
+  uint32_t type;
+
+  Kind kind;
+};
+
+/**
+ * Streaming recorder of triggered, processed and aborted events and resumed
+ * processes.
+ *
+ * Records are appended to chunks in the simulation thread, which a background
+ * thread encodes and writes to a file, so recording costs a few stores per
+ * record. Chunks are handed over through a lock-free ring; when the writer
+ * falls behind, the simulation waits for a free chunk, so no record is lost.
+ *
+ * A trace file starts with the magic "SIMCPPTR" and a version, followed by
+ * blocks. A block of type names assigns indices to the types seen since the
+ * previous block; a block of records stores the time, event, type and kind
+ * columns of one chunk after each other, either as plain arrays or, with
+ * TraceOptions::compress, with the time XOR-ed and the event delta-encoded
+ * against the previous record, and varint-encoded. Use TraceReader or the
+ * trace2csv tool to read a trace.
+ *
+ * The hooks are only compiled in if SIMCPP_TRACE is defined. Then, the
+ * simulations used on a thread report to the recorder active on that thread:
+ *
+ * ```
+ * simcpp::TraceRecorder recorder("run.trace");
+ * simcpp::TraceRecorder::set_active(&recorder);
+ * sim->run();
+ * simcpp::TraceRecorder::set_active(nullptr);
+ * ```
+ */
+class TraceRecorder {
+public:
+  using Kind = TraceRecord::Kind;
+
+  /**
+   * Construct a recorder and start its writer thread.
+   *
+   * @param path Path of the trace file.
+   * @param options Options of the recorder.
+   */
+  explicit TraceRecorder(const std::string &path,
+                         const TraceOptions &options = TraceOptions());
+
+  TraceRecorder(const TraceRecorder &) = delete;
+  TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+  /// Write the remaining records and stop the writer thread.
+  ~TraceRecorder();
+
+  /// @return Recorder which is active on this thread, or nullptr.
+  static TraceRecorder *get_active();
+
+  /**
+   * Make a recorder active on this thread.
+   *
+   * @param recorder Recorder to activate, or nullptr to deactivate.
+   */
+  static void set_active(TraceRecorder *recorder);
+
+  /**
+   * Set the simulation time of the following records.
+   *
+   * @param time Simulation time.
+   */
+  void set_time(double time) { now = time; }
+
+  /**
+   * Append a record.
+   *
+   * @param kind Kind of the record.
+   * @param type Dynamic type of the event.
+   * @param event Address of the event.
+   */
+  void record(Kind kind, const std::type_info &type, const void *event) {
+    if (position == end) {
+      next_chunk();
+    }
+
+    position->time = now;
+    position->event = reinterpret_cast<uintptr_t>(event);
+    position->type = type_index(type);
+    position->kind = kind;
+    ++position;
+  }
+
+  /// Write all records appended so far to the file.
+  void flush();
+
+  /// @return Number of records appended so far.
+  uint64_t get_n_records() const;
+
+private:
+  class Chunk {
+  public:
+    std::vector<TraceRecord> records = {};
+    size_t size = 0;
+    /// Names of the types which first appear in this chunk.
+    std::vector<std::string> types = {};
+  };
+
+  /// Size of a cache line. The indices are padded to separate cache lines,
+  /// so the simulation and the writer do not invalidate each other's cache.
+  static const size_t cache_line_size = 64;
+  static const size_t type_cache_size = 64;
+
+  class TypeSlot {
+  public:
+    const std::type_info *type;
+    uint32_t index;
+  };
+
+  TraceOptions options;
+  std::ofstream stream;
+  std::vector<Chunk> chunks;
+  TraceRecord *position = nullptr;
+  TraceRecord *end = nullptr;
+  double now = 0.0;
+  uint64_t n_published = 0;
+  /// Indices of recently recorded types, by the address of their type_info,
+  /// in front of the map of all types.
+  TypeSlot type_cache[type_cache_size] = {};
+  std::unordered_map<const std::type_info *, uint32_t> types = {};
+  /// Encoded columns of a chunk. Used by the writer thread.
+  std::vector<unsigned char> columns[4] = {};
+  std::thread writer;
+  char padding1[cache_line_size];
+  /// Number of chunks written. Written by the writer thread.
+  std::atomic<size_t> head;
+  char padding2[cache_line_size - sizeof(std::atomic<size_t>)];
+  /// Number of chunks published. Written by the simulation thread.
+  std::atomic<size_t> tail;
+  std::atomic<bool> stopping;
+
+  /// Publish the current chunk and wait for a free one.
+  void next_chunk();
+  void publish();
+  uint32_t type_index(const std::type_info &type) {
+    auto &slot = type_cache[(reinterpret_cast<uintptr_t>(&type) >> 4) %
+                            type_cache_size];
+    return slot.type == &type ? slot.index : add_type(type);
+  }
+
+  uint32_t add_type(const std::type_info &type);
+  void write();
+  void write_chunk(const Chunk &chunk);
+};
+
+/**
+ * Sequential reader of a trace file written by TraceRecorder.
+ *
+ * ```
+ * simcpp::TraceReader reader("run.trace");
+ * simcpp::TraceRecord record;
+ * while (reader.next(record)) {
+ *   std::cout << record.time << " " << reader.get_types()[record.type] << "\n";
+ * }
+ * ```
+ */
+class TraceReader {
+public:
+  /**
+   * Open a trace file. Throws std::runtime_error if it is not a trace.
+   *
+   * @param path Path of the trace file.
+   */
+  explicit TraceReader(const std::string &path);
+
+  /**
+   * Read the next record. Throws std::runtime_error if the file is corrupt.
+   *
+   * @param record Set to the next record.
+   * @return Whether there was a record.
+   */
+  bool next(TraceRecord &record);
+
+  /// @return Names of the types of the records read so far, by index.
+  const std::vector<std::string> &get_types() const;
+
+  /**
+   * @param kind Kind of a record.
+   * @return Name of the kind.
+   */
+  static const char *get_kind_name(TraceRecord::Kind kind);
+
+private:
+  std::ifstream stream;
+  std::vector<TraceRecord> records = {};
+  size_t position = 0;
+  std::vector<std::string> types = {};
+
+  bool read_block();
+};
+
+} // namespace simcpp
+
+#endif // SIMCPP_TRACE_H_
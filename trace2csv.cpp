@@ -0,0 +1,45 @@
+// Copyright © 2021 Bjørnar Steinnes Luteberget, Felix Schütz.
+// Licensed under the MIT license. See the LICENSE file for details.
+
+// Convert a trace written by simcpp::TraceRecorder to CSV on stdout.
+//
+// Usage: trace2csv run.trace > run.csv
+
+#include <cstdio>
+#include <exception>
+#include <string>
+
+#include "trace.h"
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s TRACE\n", argv[0]);
+    return 2;
+  }
+
+  try {
+    simcpp::TraceReader reader(argv[1]);
+    simcpp::TraceRecord record;
+
+    printf("time,event,kind,type\n");
+    while (reader.next(record)) {
+      std::string type = reader.get_types()[record.type];
+      // Quote the type, as template arguments contain commas.
+      std::string quoted;
+      for (char c : type) {
+        if (c == '"') {
+          quoted += '"';
+        }
+        quoted += c;
+      }
+      printf("%.17g,%llu,%s,\"%s\"\n", record.time,
+             static_cast<unsigned long long>(record.event),
+             simcpp::TraceReader::get_kind_name(record.kind), quoted.c_str());
+    }
+  } catch (const std::exception &e) {
+    fprintf(stderr, "%s: %s\n", argv[0], e.what());
+    return 1;
+  }
+
+  return 0;
+}